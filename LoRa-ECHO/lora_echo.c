@@ -0,0 +1,270 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "lora_echo.h"
+
+#define __DRIVER_NAME		"lora-echo"
+
+/*
+ * A sample in-kernel client of the LoRa framework.  It sends each received
+ * packet back right in the RX completion path, without any user / kernel
+ * crossing, and it measures the turnaround from the packet received by the
+ * radio to the echo handed to the device.  Two echoes on the same channel
+ * would echo each other forever.
+ */
+
+static char *device = "/dev/loraVIRT1";
+module_param(device, charp, 0444);
+MODULE_PARM_DESC(device, "The LoRa device to echo on");
+
+static unsigned int freq;
+module_param(freq, uint, 0444);
+MODULE_PARM_DESC(freq, "Set the carrier frequency in Hz, 0 for unchanged");
+
+static unsigned int sprf;
+module_param(sprf, uint, 0444);
+MODULE_PARM_DESC(sprf, "Set the spreading factor in chips / symbol, 0 for "
+		 "unchanged");
+
+static struct lora_client *client;
+static struct dentry *debugfs;
+static DEFINE_SPINLOCK(stat_lock);
+static struct loraecho_stat stat;
+
+/* Count a latency into its accounting, with stat_lock held. */
+static void
+loraecho_lat_add(struct loraecho_lat *lat, u64 from, u64 to)
+{
+	u64 ns;
+
+	ns = (to > from) ? to - from : 0;
+	lat->n++;
+	lat->sum_ns += ns;
+	if (ns > lat->max_ns)
+		lat->max_ns = ns;
+}
+
+/**
+ * loraecho_done - Account a packet which has been sent back
+ * @cl:		the client
+ * @tx:		the packet sent back
+ */
+static void
+loraecho_done(struct lora_client *cl, struct lora_client_tx *tx)
+{
+	struct loraecho_ctx *ctx;
+
+	ctx = tx->ctx;
+
+	spin_lock(&stat_lock);
+	if (tx->status == (ssize_t)tx->len) {
+		stat.echoed++;
+		loraecho_lat_add(&(stat.queue), ctx->cb_ns, tx->start_ns);
+		loraecho_lat_add(&(stat.turnaround), ctx->rx_ns, tx->start_ns);
+		if (tx->aired_ns > 0)
+			loraecho_lat_add(&(stat.air), tx->start_ns,
+					 tx->aired_ns);
+	}
+	else
+		stat.tx_errors++;
+	spin_unlock(&stat_lock);
+
+	kfree(ctx);
+}
+
+/**
+ * loraecho_rx - Send a received packet back
+ * @cl:		the client
+ * @buf:	the received packet
+ * @len:	the length of the packet
+ * @meta:	the metadata of the packet
+ */
+static void
+loraecho_rx(struct lora_client *cl, const uint8_t *buf, size_t len,
+	    const struct lora_pkt_meta *meta)
+{
+	struct loraecho_ctx *ctx;
+	u64 now;
+
+	now = ktime_get_ns();
+	ctx = kmalloc(sizeof(struct loraecho_ctx), GFP_KERNEL);
+	if (ctx != NULL) {
+		ctx->rx_ns = (meta->rx_ns > 0) ? meta->rx_ns : now;
+		ctx->cb_ns = now;
+		if (lora_client_xmit(cl, buf, len, loraecho_done, ctx)) {
+			kfree(ctx);
+			ctx = NULL;
+		}
+	}
+
+	spin_lock(&stat_lock);
+	stat.rx++;
+	if (meta->rx_ns > 0)
+		loraecho_lat_add(&(stat.deliver), meta->rx_ns, now);
+	if (ctx == NULL)
+		stat.dropped++;
+	spin_unlock(&stat_lock);
+}
+
+/* Show a latency in us. */
+static void
+loraecho_lat_show(struct seq_file *s, const char *name,
+		  const struct loraecho_lat *lat)
+{
+	seq_printf(s, "%-11s %8llu %12llu %12llu\n", name,
+		   (unsigned long long)lat->n,
+		   (unsigned long long)(lat->n ?
+			div64_u64(lat->sum_ns, lat->n * 1000) : 0),
+		   (unsigned long long)div64_u64(lat->max_ns, 1000));
+}
+
+static int
+loraecho_stats_show(struct seq_file *s, void *v)
+{
+	struct loraecho_stat st;
+
+	spin_lock(&stat_lock);
+	st = stat;
+	spin_unlock(&stat_lock);
+
+	seq_printf(s, "rx:        %llu\n", (unsigned long long)st.rx);
+	seq_printf(s, "echoed:    %llu\n", (unsigned long long)st.echoed);
+	seq_printf(s, "dropped:   %llu\n", (unsigned long long)st.dropped);
+	seq_printf(s, "tx errors: %llu\n", (unsigned long long)st.tx_errors);
+	seq_printf(s, "%-11s %8s %12s %12s\n", "latency", "count", "mean_us",
+		   "max_us");
+	loraecho_lat_show(s, "deliver", &(st.deliver));
+	loraecho_lat_show(s, "queue", &(st.queue));
+	loraecho_lat_show(s, "turnaround", &(st.turnaround));
+	loraecho_lat_show(s, "air", &(st.air));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(loraecho_stats);
+
+/**
+ * loraecho_devt - Get the device number of a character device by its path
+ * @name:	the path of the character device
+ * @devt:	the buffer going to hold the device number
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+loraecho_devt(const char *name, dev_t *devt)
+{
+	struct path path;
+	struct inode *inode;
+	int status;
+
+	status = kern_path(name, LOOKUP_FOLLOW, &path);
+	if (status)
+		return status;
+
+	inode = d_inode(path.dentry);
+	if (S_ISCHR(inode->i_mode))
+		*devt = inode->i_rdev;
+	else
+		status = -ENODEV;
+	path_put(&path);
+
+	return status;
+}
+
+/* LoRa-ECHO kernel module's initial function. */
+static int loraecho_init(void)
+{
+	uint32_t v;
+	dev_t devt;
+	int status;
+
+	pr_debug("lora-echo: init on %s\n", device);
+
+	status = loraecho_devt(device, &devt);
+	if (status) {
+		pr_err("lora-echo: no character device %s\n", device);
+		return status;
+	}
+
+	client = lora_client_register(devt, loraecho_rx, NULL);
+	if (IS_ERR(client)) {
+		pr_err("lora-echo: %s is not a LoRa device\n", device);
+		return PTR_ERR(client);
+	}
+
+	/* The settings are accessed without the character device too. */
+	if ((freq > 0) && lora_client_set(client, LORA_SET_FREQUENCY, freq))
+		pr_warn("lora-echo: failed to set the frequency\n");
+	if ((sprf > 0) && lora_client_set(client, LORA_SET_SPRFACTOR, sprf))
+		pr_warn("lora-echo: failed to set the spreading factor\n");
+	if (!lora_client_get(client, LORA_GET_FREQUENCY, &v))
+		pr_info("lora-echo: echo on %s at %u Hz\n", device, v);
+
+	debugfs = debugfs_create_dir(__DRIVER_NAME, NULL);
+	debugfs_create_file("stats", S_IRUSR, debugfs, NULL,
+			    &loraecho_stats_fops);
+
+	return 0;
+}
+
+/* LoRa-ECHO kernel module's exit function. */
+static void loraecho_exit(void)
+{
+	pr_debug("lora-echo: exit\n");
+
+	debugfs_remove_recursive(debugfs);
+	lora_client_unregister(client);
+}
+
+module_init(loraecho_init);
+module_exit(loraecho_exit);
+
+MODULE_AUTHOR("Jian-Hong Pan, <starnight@g.ncu.edu.tw>");
+MODULE_DESCRIPTION("A sample in-kernel LoRa client echoing the packets");
+MODULE_LICENSE("Dual BSD/GPL");
@@ -0,0 +1,100 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_ECHO_H__
+#define __LORA_ECHO_H__
+
+#include <linux/spinlock.h>
+
+#include "lora.h"
+
+/**
+ * struct loraecho_lat: A latency of the echoed packets
+ * @n:			How many latencies have been counted
+ * @sum_ns:		The sum of the latencies in ns
+ * @max_ns:		The max latency in ns
+ */
+struct loraecho_lat {
+	u64 n;
+	u64 sum_ns;
+	u64 max_ns;
+};
+
+/**
+ * struct loraecho_stat: The counters and the turnaround of the echo
+ * @rx:			How many packets have been received
+ * @echoed:		How many packets have been sent back
+ * @dropped:		How many packets have not been queued to be sent back
+ * @tx_errors:		How many packets have failed to be sent back
+ * @deliver:		From received by the radio to the rx callback
+ * @queue:		From the rx callback to handed to the device
+ * @turnaround:		From received by the radio to handed to the device
+ * @air:		From handed to the device to left the air
+ */
+struct loraecho_stat {
+	u64 rx;
+	u64 echoed;
+	u64 dropped;
+	u64 tx_errors;
+	struct loraecho_lat deliver;
+	struct loraecho_lat queue;
+	struct loraecho_lat turnaround;
+	struct loraecho_lat air;
+};
+
+/**
+ * struct loraecho_ctx: The times of a packet being sent back
+ * @rx_ns:		The CLOCK_MONOTONIC time it was received by the radio
+ * @cb_ns:		The CLOCK_MONOTONIC time it reached the rx callback
+ */
+struct loraecho_ctx {
+	u64 rx_ns;
+	u64 cb_ns;
+};
+
+extern struct lora_client *lora_client_register(dev_t,
+	void (*)(struct lora_client *, const uint8_t *, size_t,
+		 const struct lora_pkt_meta *),
+	void *);
+extern void lora_client_unregister(struct lora_client *);
+extern int lora_client_xmit(struct lora_client *, const uint8_t *, size_t,
+	void (*)(struct lora_client *, struct lora_client_tx *), void *);
+extern long lora_client_set(struct lora_client *, unsigned int, uint32_t);
+extern long lora_client_get(struct lora_client *, unsigned int, uint32_t *);
+
+#endif
@@ -0,0 +1,477 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/version.h>
+#include <crypto/hash.h>
+#include <crypto/skcipher.h>
+#include <crypto/algapi.h>
+#include <crypto/aes.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+
+#include "lora_crypto.h"
+
+/**
+ * lora_crypto_done - The completion callback of an AES-CTR request
+ * @data:	the slot of the request
+ * @err:	the result of the request
+ *
+ * The last finished request of the batch wakes up the waiting reader.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+static void
+lora_crypto_done(void *data, int err)
+{
+	struct lora_crypto_slot *s = data;
+#else
+static void
+lora_crypto_done(struct crypto_async_request *areq, int err)
+{
+	struct lora_crypto_slot *s = areq->data;
+#endif
+
+	/* A backlogged request has just been started. */
+	if (err == -EINPROGRESS)
+		return;
+
+	s->err = err;
+	if (atomic_dec_and_test(&(s->cr->pending)))
+		complete(&(s->cr->done));
+}
+
+/**
+ * lora_crypto_ctr - Run the AES-CTR requests of a batch
+ * @cr:		the crypto context
+ * @s:		the slots whose requests have been set
+ * @n:		how many slots
+ *
+ * All the requests are submitted before waiting, so an asynchronous
+ * implementation processes the whole batch at the same time.  The result of
+ * each request is left in its slot.
+ */
+static void
+lora_crypto_ctr(struct lora_crypto *cr, struct lora_crypto_slot **s, int n)
+{
+	int i;
+	int ret;
+
+	/* Hold a reference, so the batch does not complete while submitting. */
+	atomic_set(&(cr->pending), 1);
+	reinit_completion(&(cr->done));
+
+	for (i = 0; i < n; i++) {
+		atomic_inc(&(cr->pending));
+		s[i]->err = 0;
+		ret = crypto_skcipher_encrypt(s[i]->req);
+		if ((ret == -EINPROGRESS) || (ret == -EBUSY))
+			continue;
+		/* It has been processed synchronously. */
+		s[i]->err = ret;
+		atomic_dec(&(cr->pending));
+	}
+
+	if (!atomic_dec_and_test(&(cr->pending)))
+		wait_for_completion(&(cr->done));
+}
+
+/**
+ * lora_crypto_setctr - Set the AES-CTR request of a frame
+ * @s:		the slot holding the request
+ * @addr:	the address of the frame
+ * @fcnt:	the frame counter of the frame
+ * @payload:	the payload going to be encrypted or decrypted in place
+ * @len:	the length of the payload
+ *
+ * The counter block is unique for each address and frame counter, the
+ * block index in the last byte starts from 1.
+ */
+static void
+lora_crypto_setctr(struct lora_crypto_slot *s, uint32_t addr, uint32_t fcnt,
+		   uint8_t *payload, size_t len)
+{
+	memset(s->iv, 0, sizeof(s->iv));
+	s->iv[0] = 0x01;
+	put_unaligned_le32(addr, &(s->iv[6]));
+	put_unaligned_le32(fcnt, &(s->iv[10]));
+	s->iv[15] = 0x01;
+
+	sg_init_one(&(s->sg), payload, len);
+	skcipher_request_set_crypt(s->req, &(s->sg), &(s->sg), len, s->iv);
+}
+
+/**
+ * lora_crypto_mic - Calculate the truncated AES-CMAC of a frame
+ * @cr:		the crypto context
+ * @frame:	the frame without the MIC
+ * @len:	the length of the frame without the MIC
+ * @mic:	the buffer going to hold the LORA_CRYPTO_MICLEN bytes MIC
+ *
+ * Return:	0 / negative number for OK / error
+ */
+static int
+lora_crypto_mic(struct lora_crypto *cr, const uint8_t *frame, size_t len,
+		uint8_t *mic)
+{
+	SHASH_DESC_ON_STACK(desc, cr->cmac);
+	uint8_t d[AES_BLOCK_SIZE];
+	int ret;
+
+	desc->tfm = cr->cmac;
+	ret = crypto_shash_digest(desc, frame, len, d);
+	shash_desc_zero(desc);
+	memcpy(mic, d, LORA_CRYPTO_MICLEN);
+
+	return ret;
+}
+
+/**
+ * lora_crypto_replayed - Check a frame counter against the replay window
+ * @cr:		the crypto context
+ * @fcnt:	the frame counter of the received frame
+ *
+ * Return:	1 / 0 for replayed or too old / acceptable
+ */
+static int
+lora_crypto_replayed(struct lora_crypto *cr, uint32_t fcnt)
+{
+	uint32_t d;
+
+	if (!cr->rx_valid || (fcnt > cr->rx_top))
+		return 0;
+
+	d = cr->rx_top - fcnt;
+	if (d >= LORA_CRYPTO_REPLAYWIN)
+		return 1;
+
+	return (cr->rx_mask >> d) & 1;
+}
+
+/**
+ * lora_crypto_accept - Mark a frame counter as seen in the replay window
+ * @cr:		the crypto context
+ * @fcnt:	the frame counter of the authenticated frame
+ */
+static void
+lora_crypto_accept(struct lora_crypto *cr, uint32_t fcnt)
+{
+	uint32_t d;
+
+	if (!cr->rx_valid) {
+		cr->rx_valid = 1;
+		cr->rx_top = fcnt;
+		cr->rx_mask = 1;
+	}
+	else if (fcnt > cr->rx_top) {
+		d = fcnt - cr->rx_top;
+		cr->rx_mask = (d < LORA_CRYPTO_REPLAYWIN) ?
+			      (cr->rx_mask << d) | 1 : 1;
+		cr->rx_top = fcnt;
+	}
+	else {
+		cr->rx_mask |= 1ULL << (cr->rx_top - fcnt);
+	}
+
+	cr->stat.rx_fcnt = cr->rx_top;
+}
+
+/**
+ * lora_crypto_alloc - Allocate the crypto context with the keys
+ * @key:	the keys and the addresses
+ *
+ * Return:	the crypto context, ERR_PTR() for error
+ */
+struct lora_crypto *
+lora_crypto_alloc(const struct lora_key *key)
+{
+	struct lora_crypto *cr;
+	struct lora_crypto_slot *s;
+	int ret;
+	int i;
+
+	cr = kzalloc(sizeof(struct lora_crypto), GFP_KERNEL);
+	if (cr == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	memcpy(&(cr->key), key, sizeof(struct lora_key));
+	cr->stat.tx_fcnt = key->fcnt;
+	init_completion(&(cr->done));
+
+	cr->cmac = crypto_alloc_shash("cmac(aes)", 0, 0);
+	if (IS_ERR(cr->cmac)) {
+		ret = PTR_ERR(cr->cmac);
+		cr->cmac = NULL;
+		goto err;
+	}
+	ret = crypto_shash_setkey(cr->cmac, key->mic_key, LORA_KEYLEN);
+	if (ret < 0)
+		goto err;
+
+	cr->ctr = crypto_alloc_skcipher("ctr(aes)", 0, 0);
+	if (IS_ERR(cr->ctr)) {
+		ret = PTR_ERR(cr->ctr);
+		cr->ctr = NULL;
+		goto err;
+	}
+	ret = crypto_skcipher_setkey(cr->ctr, key->enc_key, LORA_KEYLEN);
+	if (ret < 0)
+		goto err;
+
+	for (i = 0; i <= LORA_CRYPTO_BATCH; i++) {
+		s = (i < LORA_CRYPTO_BATCH) ? &(cr->slot[i]) : &(cr->tx);
+		s->cr = cr;
+		s->req = skcipher_request_alloc(cr->ctr, GFP_KERNEL);
+		if (s->req == NULL) {
+			ret = -ENOMEM;
+			goto err;
+		}
+		skcipher_request_set_callback(s->req,
+					      CRYPTO_TFM_REQ_MAY_BACKLOG,
+					      lora_crypto_done, s);
+	}
+
+	return cr;
+
+err:
+	lora_crypto_free(cr);
+
+	return ERR_PTR(ret);
+}
+
+/**
+ * lora_crypto_free - Free the crypto context and wipe the keys
+ * @cr:		the crypto context, NULL for nothing
+ */
+void
+lora_crypto_free(struct lora_crypto *cr)
+{
+	int i;
+
+	if (cr == NULL)
+		return;
+
+	for (i = 0; i < LORA_CRYPTO_BATCH; i++)
+		skcipher_request_free(cr->slot[i].req);
+	skcipher_request_free(cr->tx.req);
+	if (cr->ctr != NULL)
+		crypto_free_skcipher(cr->ctr);
+	if (cr->cmac != NULL)
+		crypto_free_shash(cr->cmac);
+
+	/* The keys and the decrypted frames must not be left in memory. */
+	memzero_explicit(cr, sizeof(struct lora_crypto));
+	kfree(cr);
+}
+
+/**
+ * lora_crypto_seal - Secure a frame in place
+ * @cr:		the crypto context
+ * @buf:	the buffer holding the payload at the start
+ * @len:	the length of the payload in bytes
+ * @max:	the length of the buffer in bytes
+ *
+ * The payload is moved behind the header, encrypted if required, and
+ * followed by the MIC.
+ *
+ * Return:	the length of the secured frame, negative number for error
+ */
+ssize_t
+lora_crypto_seal(struct lora_crypto *cr, uint8_t *buf, size_t len,
+		 size_t max)
+{
+	struct lora_crypto_slot *s;
+	uint32_t fcnt;
+	int ret;
+
+	if (len + LORA_CRYPTO_OVERHEAD > max)
+		return -EMSGSIZE;
+	/* A wrapped frame counter would be refused by the replay window. */
+	fcnt = cr->stat.tx_fcnt;
+	if (fcnt == U32_MAX)
+		return -EOVERFLOW;
+
+	memmove(buf + LORA_CRYPTO_HDRLEN, buf, len);
+	put_unaligned_le32(cr->key.addr, buf);
+	put_unaligned_le32(fcnt, buf + 4);
+
+	if ((cr->key.flags & LORA_KEY_ENCRYPT) && (len > 0)) {
+		s = &(cr->tx);
+		lora_crypto_setctr(s, cr->key.addr, fcnt,
+				   buf + LORA_CRYPTO_HDRLEN, len);
+		lora_crypto_ctr(cr, &s, 1);
+		if (s->err < 0)
+			return s->err;
+	}
+
+	len += LORA_CRYPTO_HDRLEN;
+	ret = lora_crypto_mic(cr, buf, len, buf + len);
+	if (ret < 0)
+		return ret;
+
+	cr->stat.tx_fcnt++;
+	cr->stat.tx_sealed++;
+
+	return len + LORA_CRYPTO_MICLEN;
+}
+
+/**
+ * lora_crypto_open - Verify and decrypt the frames of the batch in place
+ * @cr:		the crypto context whose slots hold cr->qn received frames
+ *
+ * The cheap checks go first, so a foreign or replayed frame costs no
+ * crypto at all.  The frames passing the AES-CMAC are decrypted together.
+ * The dropped frames get length 0 and are never read.
+ *
+ * Return:	how many frames are left to be read
+ */
+int
+lora_crypto_open(struct lora_crypto *cr)
+{
+	struct lora_crypto_slot *dec[LORA_CRYPTO_BATCH];
+	struct lora_crypto_slot *s;
+	uint8_t mic[LORA_CRYPTO_MICLEN];
+	uint32_t addr, fcnt;
+	size_t plen;
+	int ndec = 0;
+	int nok = 0;
+	int i;
+
+	for (i = 0; i < cr->qn; i++) {
+		s = &(cr->slot[i]);
+		if (s->len < LORA_CRYPTO_OVERHEAD) {
+			cr->stat.rx_short++;
+			s->len = 0;
+			continue;
+		}
+
+		addr = get_unaligned_le32(s->frame);
+		fcnt = get_unaligned_le32(s->frame + 4);
+		if (addr != cr->key.peer) {
+			cr->stat.rx_foreign++;
+			s->len = 0;
+			continue;
+		}
+		if (lora_crypto_replayed(cr, fcnt)) {
+			cr->stat.rx_replayed++;
+			s->len = 0;
+			continue;
+		}
+
+		plen = s->len - LORA_CRYPTO_MICLEN;
+		if ((lora_crypto_mic(cr, s->frame, plen, mic) < 0)
+			|| crypto_memneq(mic, s->frame + plen,
+					 LORA_CRYPTO_MICLEN)) {
+			cr->stat.rx_badmic++;
+			s->len = 0;
+			continue;
+		}
+		/* Only the authenticated frames move the replay window. */
+		lora_crypto_accept(cr, fcnt);
+
+		plen -= LORA_CRYPTO_HDRLEN;
+		if ((cr->key.flags & LORA_KEY_ENCRYPT) && (plen > 0)) {
+			lora_crypto_setctr(s, addr, fcnt,
+					   s->frame + LORA_CRYPTO_HDRLEN, plen);
+			dec[ndec++] = s;
+		}
+	}
+
+	if (ndec > 0)
+		lora_crypto_ctr(cr, dec, ndec);
+
+	for (i = 0; i < cr->qn; i++) {
+		s = &(cr->slot[i]);
+		if (s->len == 0)
+			continue;
+		if (s->err < 0) {
+			cr->stat.rx_errors++;
+			s->len = 0;
+			continue;
+		}
+		nok++;
+	}
+
+	cr->qhead = 0;
+	cr->stat.rx_batches++;
+	if (cr->qn > cr->stat.rx_maxbatch)
+		cr->stat.rx_maxbatch = cr->qn;
+
+	return nok;
+}
+
+/**
+ * lora_crypto_pop - Read the payload of the next verified frame
+ * @cr:		the crypto context
+ * @buf:	buffer going to be read the payload into
+ * @len:	the length of the buffer in bytes
+ *
+ * Return:	the length of the payload read in bytes, 0 for nothing left
+ */
+ssize_t
+lora_crypto_pop(struct lora_crypto *cr, uint8_t *buf, size_t len)
+{
+	struct lora_crypto_slot *s;
+	size_t plen;
+
+	while (cr->qhead < cr->qn) {
+		s = &(cr->slot[cr->qhead]);
+		cr->qhead++;
+		if (s->len == 0)
+			continue;
+
+		plen = s->len - LORA_CRYPTO_OVERHEAD;
+		len = (plen < len) ? plen : len;
+		memcpy(buf, s->frame + LORA_CRYPTO_HDRLEN, len);
+		/* Wipe the read plaintext. */
+		memzero_explicit(s->frame, sizeof(s->frame));
+		s->len = 0;
+		cr->last = s->pkt;
+		cr->last_ts = s->ts;
+		cr->stat.rx_opened++;
+
+		return len;
+	}
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+#ifndef __LORA_CRYPTO_H__
+#define __LORA_CRYPTO_H__
+
+#include <linux/completion.h>
+#include <linux/scatterlist.h>
+#include <linux/atomic.h>
+#include <linux/spi/spi.h>
+
+#include "lora.h"
+#include "sx1278_fifo.h"
+
+/* A batch holds all the RX packets which can be queued in the chip. */
+#define LORA_CRYPTO_BATCH		SX127X_FIFO_MAX_RXPKT
+
+struct lora_crypto;
+
+/**
+ * struct lora_crypto_slot: A frame in the crypto batch
+ * @cr:			The crypto context owning the slot
+ * @req:		The AES-CTR request of the frame
+ * @sg:			The payload of the frame
+ * @iv:			The counter block of the frame
+ * @err:		The result of the AES-CTR request
+ * @pkt:		The FIFO record of the frame
+ * @ts:			The time the frame was read from the FIFO in ns
+ * @len:		The length of the frame, 0 for dropped
+ * @frame:		The frame
+ */
+struct lora_crypto_slot {
+	struct lora_crypto *cr;
+	struct skcipher_request *req;
+	struct scatterlist sg;
+	uint8_t iv[16];
+	int err;
+	struct sx127X_fifo_pkt pkt;
+	u64 ts;
+	uint8_t len;
+	uint8_t frame[256];
+};
+
+/**
+ * struct lora_crypto: The secured frames of a LoRa SPI device
+ * @key:		The keys and the addresses
+ * @stat:		The counters of the secured frames
+ * @cmac:		The AES-CMAC transformation keyed by the MIC key
+ * @ctr:		The AES-CTR transformation keyed by the encryption key
+ * @pending:		How many AES-CTR requests of the batch are in flight
+ * @done:		Completed after the whole batch is processed
+ * @rx_top:		The newest accepted frame counter
+ * @rx_mask:		The accepted frame counters behind rx_top
+ * @rx_valid:		A frame has been accepted since the keys were set
+ * @qn:			How many frames are in the batch
+ * @qhead:		The next frame of the batch going to be read
+ * @last:		The FIFO record of the frame last read
+ * @last_ts:		The time the frame last read was read from the FIFO
+ * @slot:		The frames of the batch
+ * @tx:			The AES-CTR request of the written frame
+ *
+ * All the fields but the ones of the AES-CTR completion are protected by
+ * the buffer lock of the LoRa device.
+ */
+struct lora_crypto {
+	struct lora_key key;
+	struct lora_crypto_stat stat;
+	struct crypto_shash *cmac;
+	struct crypto_skcipher *ctr;
+	atomic_t pending;
+	struct completion done;
+	uint32_t rx_top;
+	uint64_t rx_mask;
+	uint8_t rx_valid;
+	uint8_t qn;
+	uint8_t qhead;
+	struct sx127X_fifo_pkt last;
+	u64 last_ts;
+	struct lora_crypto_slot slot[LORA_CRYPTO_BATCH];
+	struct lora_crypto_slot tx;
+};
+
+struct lora_crypto *
+lora_crypto_alloc(const struct lora_key *key);
+
+void
+lora_crypto_free(struct lora_crypto *cr);
+
+ssize_t
+lora_crypto_seal(struct lora_crypto *cr, uint8_t *buf, size_t len,
+		 size_t max);
+
+int
+lora_crypto_open(struct lora_crypto *cr);
+
+ssize_t
+lora_crypto_pop(struct lora_crypto *cr, uint8_t *buf, size_t len);
+
+static inline int
+lora_crypto_pending(struct lora_crypto *cr)
+{
+	return cr->qhead < cr->qn;
+}
+
+#endif
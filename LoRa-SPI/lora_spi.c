@@ -49,520 +49,1999 @@
 #include <linux/of_device.h>
 #include <linux/errno.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/version.h>
+#include <linux/ktime.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 
 #include "lora_spi.h"
 #include "sx1278.h"
+#include "sx1278_fifo.h"
+#include "lora_crypto.h"
+#include "sx1278_trace.h"
+
+/* The user space build of the emulator has -Wall, while the kernel only
+ * warns of the ignored results of copy_{to,from}_user() with W=1. */
+#ifndef __KERNEL__
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
 
 #define __DRIVER_NAME		"lora-spi"
 #ifndef N_LORASPI_MINORS
 #define N_LORASPI_MINORS	8
 #endif
 
+/* Wake up before each periodic resident frame to prepare the FIFO. */
+#define LORASPI_BEACON_LEAD_MS	20
+
 static DECLARE_BITMAP(minors, N_LORASPI_MINORS);
 
 static DEFINE_MUTEX(minors_lock);
 
 /**
- * loraspi_read - Read from the LoRa device's communication
- * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the read data in user space
- * @size:	the length of the buffer in bytes
+ * loraspi_crypto_pull - Verify all the RX packets queued in the chip's FIFO
+ * @ldata:	LoRa SPI device whose buffer lock has been held
  *
- * Return:	Read how many bytes actually, negative number for error
+ * The queued packets are read out together, so they are verified and
+ * decrypted as one batch.  The packets failing the checks are dropped here
+ * and never reach user space.
+ *
+ * Return:	How many verified packets are ready to be read
  */
-static ssize_t
-loraspi_read(struct lora_struct *lrdata, const char __user *buf, size_t size)
+static int
+loraspi_crypto_pull(struct loraspi_data *ldata)
 {
 	struct spi_device *spi;
-	ssize_t status;
-	int c = 0;
-	uint8_t adr;
-	uint8_t flag;
+	struct sx127X_fifo *fifo;
+	struct lora_crypto *cr;
+	ssize_t c;
+	int n;
+
+	spi = ldata->lrdata.lora_device;
+	fifo = &(ldata->fifo);
+	cr = ldata->crypto;
+
+	for (n = 0; (fifo->nrx > 0) && (n < LORA_CRYPTO_BATCH); n++) {
+		c = sx127X_fifo_pop(spi, fifo, cr->slot[n].frame,
+				    sizeof(cr->slot[n].frame));
+		cr->slot[n].pkt = fifo->last;
+		cr->slot[n].len = (c > 0) ? c : 0;
+		cr->slot[n].ts = ktime_get_ns();
+	}
+	cr->qn = n;
+
+	return lora_crypto_open(cr);
+}
+
+/**
+ * loraspi_rx_ready - Account the packet handed to the reader
+ * @ldata:	LoRa SPI device
+ * @popped:	the time the packet was read from the FIFO in ns
+ */
+static void
+loraspi_rx_ready(struct loraspi_data *ldata, u64 popped)
+{
+	ldata->rx_ns = ktime_get_ns();
+	lora_hist_add(&(ldata->lrdata), LORA_HIST_RX_READY,
+		      ldata->rx_ns - popped);
+}
+
+/**
+ * loraspi_rx_start - Set the chip to RX continuous state, if it is not
+ * @ldata:	LoRa SPI device whose buffer lock has been held
+ */
+static void
+loraspi_rx_start(struct loraspi_data *ldata)
+{
+	struct spi_device *spi;
+	struct sx127X_fifo *fifo;
 	uint8_t st;
-	uint32_t timeout;
 
-	spi = lrdata->lora_device;
-	dev_dbg(&(spi->dev), "Read %zu bytes into user space\n", size);
+	spi = ldata->lrdata.lora_device;
+	fifo = &(ldata->fifo);
 
-	mutex_lock(&(lrdata->buf_lock));
 	/* Get chip's current state. */
 	st = sx127X_getState(spi);
 
-	/*  Prepare and set the chip to RX continuous mode, if it is not. */
 	if (st != SX127X_RXCONTINUOUS_MODE) {
+		/* The chip clears the FIFO in sleep state. */
+		if (st == SX127X_SLEEP_MODE)
+			sx127X_fifo_reset(fifo);
+		else
+			sx127X_fifo_harvest(spi, fifo);
+
 		/* Set chip to standby state. */
 		dev_dbg(&(spi->dev), "Going to set standby state\n");
 		sx127X_setState(spi, SX127X_STANDBY_MODE);
 
-		/* Set chip FIFO RX base. */
-		adr = 0x00;
+		/* Set chip FIFO RX base right after the queued packets. */
 		dev_dbg(&(spi->dev), "Going to set RX base address\n");
-		sx127X_write_reg(spi, SX127X_REG_FIFO_RX_BASE_ADDR, &adr, 1);
+		sx127X_write_reg(spi, SX127X_REG_FIFO_RX_BASE_ADDR,
+				 &(fifo->rx_adr), 1);
 
-		/* Clear all of the IRQ flags. */
-		sx127X_clearLoRaAllFlag(spi);
 		/* Set chip to RX continuous state waiting for receiving. */
 		sx127X_setState(spi, SX127X_RXCONTINUOUS_MODE);
 	}
+}
+
+/**
+ * loraspi_recv_locked - Receive a packet from the LoRa device
+ * @lrdata:	LoRa device whose buffer lock has been held
+ * @buf:	the buffer going to hold the packet
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, -1 / -2 for time out / CRC error
+ */
+static ssize_t
+loraspi_recv_locked(struct lora_struct *lrdata, uint8_t *buf, size_t size)
+{
+	struct spi_device *spi;
+	struct loraspi_data *ldata;
+	struct sx127X_fifo *fifo;
+	int c = 0;
+	int flag;
+	uint32_t timeout;
+
+	spi = lrdata->lora_device;
+	ldata = to_loraspi(lrdata);
+	fifo = &(ldata->fifo);
+
+	/* The verified packets of the last batch are read first. */
+	if ((ldata->crypto != NULL) && lora_crypto_pending(ldata->crypto)) {
+		c = lora_crypto_pop(ldata->crypto, buf, size);
+		ldata->rx_pkt = ldata->crypto->last;
+		loraspi_rx_ready(ldata, ldata->crypto->last_ts);
+		return c;
+	}
+
+	/* Prepare and set the chip to RX continuous mode, if it is not. */
+	loraspi_rx_start(ldata);
 
 	/* Wait and check there is any packet received ready. */
 	for (timeout = 0; timeout < 250; timeout++) {
-		flag = sx127X_getLoRaFlag(spi,
-					SX127X_FLAG_RXTIMEOUT |
-					SX127X_FLAG_RXDONE |
-					SX127X_FLAG_PAYLOADCRCERROR);
-		if (flag == 0)
-			msleep(20);
-		else
+		flag = sx127X_fifo_harvest(spi, fifo);
+		/* Keep waiting, if all the secured packets are dropped. */
+		if ((ldata->crypto != NULL) && (fifo->nrx > 0)
+			&& (loraspi_crypto_pull(ldata) > 0))
+			break;
+		if ((fifo->nrx > 0) || (flag < 0))
 			break;
+		if (flag & (SX127X_FLAG_RXTIMEOUT |
+			    SX127X_FLAG_PAYLOADCRCERROR))
+			break;
+		msleep(20);
 	}
 
-	/* If there is nothing or received timeout. */
-	if ((flag == 0) || (flag & SX127X_FLAG_RXTIMEOUT)) {
-		c = -1;
+	if ((ldata->crypto != NULL) && lora_crypto_pending(ldata->crypto)) {
+		/* There is a verified packet of the batch. */
+		c = lora_crypto_pop(ldata->crypto, buf, size);
+		ldata->rx_pkt = ldata->crypto->last;
+		loraspi_rx_ready(ldata, ldata->crypto->last_ts);
 	}
-	/* If there is a packet, but the payload is CRC error. */
-	if (sx127X_getLoRaFlag(spi, SX127X_FLAG_PAYLOADCRCERROR)) {
+	else if (fifo->nrx > 0) {
+		/* There is a ready packet in the chip's FIFO. */
+		c = sx127X_fifo_pop(spi, fifo, buf, size);
+		ldata->rx_pkt = fifo->last;
+		loraspi_rx_ready(ldata, ktime_get_ns());
+	}
+	else if ((flag > 0) && (flag & SX127X_FLAG_PAYLOADCRCERROR)) {
+		/* There is a packet, but the payload is CRC error. */
 		c = -2;
 	}
+	else {
+		/* There is nothing or received timeout. */
+		c = -1;
+	}
+
+	return c;
+}
+
+/**
+ * loraspi_read - Read from the LoRa device's communication
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the read data in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+loraspi_read(struct lora_struct *lrdata, const char __user *buf, size_t size)
+{
+	struct spi_device *spi;
+	ssize_t status;
+	int c;
+
+	spi = lrdata->lora_device;
+	dev_dbg(&(spi->dev), "Read %zu bytes into user space\n", size);
+
+	lora_lock(lrdata);
+	memset(lrdata->rx_buf, 0, lrdata->bufmaxlen);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	/* Read from chip to LoRa data RX buffer. */
+	c = loraspi_recv_locked(lrdata, lrdata->rx_buf, size);
+	/* Copy from LoRa data RX buffer to user space. */
+	if (c > 0) {
+		status = copy_to_user((void *)buf, lrdata->rx_buf, c);
+		trace_lora_rx_read(spi, to_loraspi(lrdata)->rx_pkt.id, c);
+		lora_hist_add(lrdata, LORA_HIST_RX_COPY,
+			      ktime_get_ns() - to_loraspi(lrdata)->rx_ns);
+	}
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loraspi_recv - Receive a packet into a kernel buffer
+ * @lrdata:	LoRa device
+ * @buf:	the buffer going to hold the packet in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+loraspi_recv(struct lora_struct *lrdata, uint8_t *buf, size_t size)
+{
+	int c;
+
+	lora_lock(lrdata);
+	c = loraspi_recv_locked(lrdata, buf, size);
+	if (c > 0)
+		trace_lora_rx_read(lrdata->lora_device,
+				   to_loraspi(lrdata)->rx_pkt.id, c);
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loraspi_startrx - Set the chip to RX without waiting for a packet
+ * @lrdata:	LoRa device
+ *
+ * Return:	0 for success
+ */
+static long
+loraspi_startrx(struct lora_struct *lrdata)
+{
+	lora_lock(lrdata);
+	loraspi_rx_start(to_loraspi(lrdata));
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getmaxtx - Get the most bytes a packet carries
+ * @lrdata:	LoRa device
+ *
+ * A packet is the fixed length of Implicit Header Mode, or the buffer, less
+ * the overhead of the secured frames if there are keys.
+ *
+ * Return:	the most bytes of a packet with the current settings
+ */
+static long
+loraspi_getmaxtx(struct lora_struct *lrdata)
+{
+	struct loraspi_data *ldata;
+	long max;
+
+	ldata = to_loraspi(lrdata);
+	max = ldata->implicit ? ldata->implicit : lrdata->bufmaxlen;
+	if (ldata->crypto != NULL)
+		max -= LORA_CRYPTO_OVERHEAD;
+
+	return (max > 0) ? max : 0;
+}
+
+/**
+ * loraspi_clock_now - Get current time of the designated clock
+ * @clockid:	CLOCK_MONOTONIC or CLOCK_BOOTTIME
+ *
+ * Return:	Current time of the clock
+ */
+static ktime_t
+loraspi_clock_now(clockid_t clockid)
+{
+	return (clockid == CLOCK_BOOTTIME) ? ktime_get_boottime() : ktime_get();
+}
+
+/* The completion callback of the SPI message setting the chip's state. */
+static void
+loraspi_timed_complete(void *context)
+{
+	struct loraspi_timed *tmd = context;
+	struct loraspi_data *ldata;
+
+	tmd->mono = ktime_get();
+	tmd->achieved = (tmd->clockid == CLOCK_MONOTONIC) ?
+			tmd->mono : loraspi_clock_now(tmd->clockid);
+	if ((tmd->cmd[1] & 0x07) == SX127X_TX_MODE) {
+		ldata = container_of(tmd, struct loraspi_data, timed);
+		trace_lora_tx_start(ldata->lrdata.lora_device, ldata->tx_id, 1);
+	}
+	complete(&(tmd->done));
+}
+
+/* The timer callback sets the chip's state at the designated time. */
+static enum hrtimer_restart
+loraspi_timed_fire(struct hrtimer *timer)
+{
+	struct loraspi_timed *tmd;
+	struct loraspi_data *ldata;
+	int status;
+
+	tmd = container_of(timer, struct loraspi_timed, timer);
+	ldata = container_of(tmd, struct loraspi_data, timed);
+
+	/* This is atomic context, so the SPI message must be asynchronous. */
+	status = spi_async(ldata->lrdata.lora_device, &(tmd->m));
+	if (status) {
+		tmd->m.status = status;
+		complete(&(tmd->done));
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * loraspi_timed_state - Set the chip's state at the designated time
+ * @ldata:	LoRa SPI device which has been prepared for the state
+ * @st:		the state going to be set
+ * @clockid:	the clock of the designated time
+ * @at:		the designated time
+ *
+ * Return:	0 / -ETIME / other negative number for set / late / error
+ */
+static int
+loraspi_timed_state(struct loraspi_data *ldata, uint8_t st,
+		    clockid_t clockid, ktime_t at)
+{
+	struct spi_device *spi;
+	struct loraspi_timed *tmd;
+
+	spi = ldata->lrdata.lora_device;
+	tmd = &(ldata->timed);
+
+	/* Prepare the only SPI message left to be sent at the time. */
+	tmd->clockid = clockid;
+	tmd->cmd[0] = SX127X_REG_OP_MODE | 0x80;
+	tmd->cmd[1] = (sx127X_getMode(spi) & 0xF8) | (st & 0x07);
+	memset(&(tmd->t), 0, sizeof(tmd->t));
+	tmd->t.tx_buf = tmd->cmd;
+	tmd->t.len = 2;
+	spi_message_init(&(tmd->m));
+	spi_message_add_tail(&(tmd->t), &(tmd->m));
+	tmd->m.complete = loraspi_timed_complete;
+	tmd->m.context = tmd;
+	reinit_completion(&(tmd->done));
+
+	/* It is too late to be set at the time. */
+	if (ktime_compare(loraspi_clock_now(clockid), at) >= 0)
+		return -ETIME;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&(tmd->timer), loraspi_timed_fire, clockid,
+		      HRTIMER_MODE_ABS);
+#else
+	hrtimer_init(&(tmd->timer), clockid, HRTIMER_MODE_ABS);
+	tmd->timer.function = loraspi_timed_fire;
+#endif
+	hrtimer_start(&(tmd->timer), at, HRTIMER_MODE_ABS);
+
+	/* Wait until the timer has set the chip's state. */
+	if (wait_for_completion_interruptible(&(tmd->done))) {
+		/* Cancel the state, if the timer has not fired yet. */
+		if (hrtimer_cancel(&(tmd->timer)))
+			return -EINTR;
+		wait_for_completion(&(tmd->done));
+	}
+
+	return tmd->m.status;
+}
+
+/**
+ * loraspi_txtime_start - Set the chip to TX state at the scheduled time
+ * @ldata:	LoRa SPI device whose FIFO has been loaded already
+ *
+ * Return:	0 / negative number for sent / dropped
+ */
+static int
+loraspi_txtime_start(struct loraspi_data *ldata)
+{
+	struct spi_device *spi;
+	struct loraspi_txtime *txt;
+	ktime_t start;
+	int64_t lateness;
+	int status;
+
+	spi = ldata->lrdata.lora_device;
+	txt = &(ldata->txtime);
+	start = ns_to_ktime(txt->req.time_ns);
+	txt->status.requested_ns = txt->req.time_ns;
+	txt->status.achieved_ns = 0;
+
+	status = loraspi_timed_state(ldata, SX127X_TX_MODE,
+				     txt->req.clockid, start);
+	txt->status.status = status;
+	if (status == -ETIME) {
+		/* Drop the packet, if it is too late to be sent. */
+		dev_dbg(&(spi->dev), "Scheduled TX is late, drop it\n");
+		txt->status.late++;
+	}
+	if (status)
+		return status;
+
+	/* Account the achieved start time against the requested one. */
+	lateness = ktime_to_ns(ktime_sub(ldata->timed.achieved, start));
+	txt->status.achieved_ns = ktime_to_ns(ldata->timed.achieved);
+	txt->status.sent++;
+	txt->status.sum_lateness_ns += lateness;
+	if (lateness > txt->status.max_lateness_ns)
+		txt->status.max_lateness_ns = lateness;
+	dev_dbg(&(spi->dev), "Scheduled TX starts %lld ns late\n", lateness);
+
+	return 0;
+}
+
+/**
+ * loraspi_rxwin_open - Open the RX windows after the TX
+ * @ldata:	LoRa SPI device which has just finished the TX
+ * @txend:	the end time of the TX in CLOCK_MONOTONIC
+ */
+static void
+loraspi_rxwin_open(struct loraspi_data *ldata, ktime_t txend)
+{
+	struct spi_device *spi;
+	struct loraspi_rxwin *rxw;
+	struct lora_rxwin_param *p;
+	uint32_t freq, sprf, bw, symb, prelen;
+	uint32_t maxpkt;
+	unsigned long expire;
+	uint64_t n;
+	uint8_t cr;
+	uint8_t flag;
+	uint8_t len;
+	int status;
+	int i;
+
+	spi = ldata->lrdata.lora_device;
+	rxw = &(ldata->rxwin);
+	memset(rxw->status.result, 0, sizeof(rxw->status.result));
+	memset(rxw->status.len, 0, sizeof(rxw->status.len));
+	memset(rxw->status.opened_ns, 0, sizeof(rxw->status.opened_ns));
+
+	/* Keep the default RF settings going to be restored. */
+	freq = sx127X_getLoRaFreq(spi);
+	sprf = sx127X_getLoRaSPRFactor(spi);
+	bw = sx127X_getLoRaBW(spi);
+	symb = sx127X_getLoRaRXByteTimeout(spi);
+	cr = sx127X_getLoRaCR(spi);
+	prelen = sx127X_getLoRaPreambleLen(spi);
+
+	for (i = 0; i < rxw->req.nwin; i++) {
+		p = &(rxw->req.win[i]);
+
+		/* Prepare the window's RF settings in standby state. */
+		sx127X_setState(spi, SX127X_STANDBY_MODE);
+		sx127X_setLoRaFreq(spi, p->freq);
+		sx127X_setLoRaSPRFactor(spi, p->sprf);
+		sx127X_setLoRaBW(spi, p->bw);
+		/* The window lasts for the time-out in terms of symbols. */
+		n = (uint64_t)p->timeout_ms * p->bw;
+		do_div(n, p->sprf * 1000);
+		sx127X_setLoRaRXByteTimeout(spi, n + 1);
+		sx127X_clearLoRaAllFlag(spi);
+
+		status = loraspi_timed_state(ldata, SX127X_RXSINGLE_MODE,
+					     CLOCK_MONOTONIC,
+					     ktime_add_ms(txend, p->delay_ms));
+		if (status == -ETIME) {
+			/* Open the window right now, if it is late. */
+			dev_dbg(&(spi->dev), "RX%d window is late\n", i + 1);
+			sx127X_setState(spi, SX127X_RXSINGLE_MODE);
+			ldata->timed.mono = ktime_get();
+		}
+		else if (status) {
+			rxw->status.result[i] = status;
+			break;
+		}
+		rxw->status.opened_ns[i] = ktime_to_ns(ldata->timed.mono);
+
+		/* Wait until RX done or time out, includes a whole packet. */
+		maxpkt = sx127X_calcLoRaAirTime(p->sprf, p->bw, cr, prelen,
+					0, 1, (p->sprf * 1000 / p->bw) > 16,
+					SX127X_MAX_FIFO_LENGTH);
+		expire = jiffies + msecs_to_jiffies(p->timeout_ms +
+						    maxpkt / 1000 + 20);
+		do {
+			usleep_range(1000, 2000);
+			flag = sx127X_getLoRaFlag(spi,
+						SX127X_FLAG_RXTIMEOUT |
+						SX127X_FLAG_RXDONE |
+						SX127X_FLAG_PAYLOADCRCERROR);
+		} while ((flag == 0) && time_before(jiffies, expire));
+
+		if (flag & SX127X_FLAG_PAYLOADCRCERROR) {
+			rxw->status.result[i] = LORA_RXWIN_CRCERROR;
+		}
+		else if (flag & SX127X_FLAG_RXDONE) {
+			rxw->status.result[i] = LORA_RXWIN_CAUGHT;
+			sx127X_read_reg(spi, SX127X_REG_RX_NB_BYTES, &len, 1);
+			rxw->status.len[i] = len;
+			rxw->status.caught++;
+			dev_dbg(&(spi->dev), "RX%d window caught\n", i + 1);
+			/* Keep the packet in FIFO for the next read. */
+			break;
+		}
+		else {
+			rxw->status.result[i] = LORA_RXWIN_TIMEOUT;
+		}
+	}
+
+	if ((i == rxw->req.nwin) || (rxw->status.result[i] < 0)) {
+		/* Nothing caught, so nothing should be read. */
+		rxw->status.missed++;
+		sx127X_setState(spi, SX127X_STANDBY_MODE);
+		sx127X_clearLoRaAllFlag(spi);
+	}
+
+	/* Restore the default RF settings. */
+	sx127X_setState(spi, SX127X_STANDBY_MODE);
+	sx127X_setLoRaFreq(spi, freq);
+	sx127X_setLoRaSPRFactor(spi, sprf);
+	sx127X_setLoRaBW(spi, bw);
+	sx127X_setLoRaRXByteTimeout(spi, symb);
+}
+
+/**
+ * loraspi_txdone_wait - Wait until the TX is finished
+ * @spi:	spi device to communicate with
+ * @len:	the length of the packet being sent in bytes
+ *
+ * Return:	1 / 0 for finished / time out
+ */
+static int
+loraspi_txdone_wait(struct spi_device *spi, size_t len)
+{
+	uint32_t timeout;
+	uint8_t flag;
+
+	/* Long payloads at high spreading factors last for seconds. */
+	timeout = sx127X_getLoRaAirTime(spi, len) / 20000 + 3;
+	dev_dbg(&(spi->dev), "The time out is %u ms", timeout * 20);
+
+	/* Wait until TX is finished by checking the TX flag. */
+	for (; timeout > 0; timeout--) {
+		flag = sx127X_getLoRaFlag(spi, SX127X_FLAG_TXDONE);
+		if (flag != 0) {
+			dev_dbg(&(spi->dev), "Wait TX is finished\n");
+			return 1;
+		}
+
+		if (timeout > 1)
+			msleep(20);
+	}
+	dev_dbg(&(spi->dev), "Wait TX is time out\n");
+
+	return 0;
+}
+
+/**
+ * loraspi_rx_resume - Set the chip back to RX continuous state
+ * @ldata:	LoRa SPI device which has just finished the TX
+ *
+ * The RX slot gets the space freed by the TX back.
+ */
+static void
+loraspi_rx_resume(struct loraspi_data *ldata)
+{
+	struct spi_device *spi;
+
+	spi = ldata->lrdata.lora_device;
+
+	dev_dbg(&(spi->dev), "Set back to RX continuous state\n");
+	sx127X_setState(spi, SX127X_STANDBY_MODE);
+	sx127X_fifo_setslot(&(ldata->fifo), ldata->fifo.slot);
+	sx127X_write_reg(spi, SX127X_REG_FIFO_RX_BASE_ADDR,
+			 &(ldata->fifo.rx_adr), 1);
+	sx127X_setState(spi, SX127X_RXCONTINUOUS_MODE);
+}
+
+/**
+ * loraspi_xmit_locked - Send the data in the TX buffer
+ * @lrdata:	LoRa device whose buffer lock has been held
+ * @len:	the length of the data in the TX buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loraspi_xmit_locked(struct lora_struct *lrdata, size_t len)
+{
+	struct spi_device *spi;
+	struct loraspi_data *ldata;
+	ssize_t status;
+	size_t ulen;
+	int c;
+	ktime_t txend;
+	u64 loaded = 0;
+	u64 started = 0;
+
+	spi = lrdata->lora_device;
+	ldata = to_loraspi(lrdata);
+	ulen = len;
+
+	/* Secure the packet in place.  The padding of Implicit Header Mode
+	 * goes inside the secured payload, so the receiver can verify it. */
+	if (ldata->crypto != NULL) {
+		if (ldata->implicit)
+			len = (ldata->implicit > LORA_CRYPTO_OVERHEAD) ?
+			      ldata->implicit - LORA_CRYPTO_OVERHEAD : 0;
+		else
+			len = min_t(size_t, len,
+				    lrdata->bufmaxlen - LORA_CRYPTO_OVERHEAD);
+		status = lora_crypto_seal(ldata->crypto, lrdata->tx_buf, len,
+					  lrdata->bufmaxlen);
+		if (status < 0)
+			return status;
+		ulen = min_t(size_t, ulen, len);
+		len = status;
+	}
+
+	lrdata->tx_buflen = len;
+	/* Implicit Header Mode always sends the fixed length payload. */
+	if (ldata->implicit)
+		lrdata->tx_buflen = ldata->implicit;
+
+	/* Queue the received packets, they stay in FIFO during the TX. */
+	sx127X_fifo_harvest(spi, &(ldata->fifo));
+
+	/* Stage the TX packet in the FIFO while the chip keeps receiving. */
+	dev_dbg(&(spi->dev), "Going to stage the TX packet\n");
+	ldata->tx_id++;
+	c = sx127X_fifo_stage(spi, &(ldata->fifo), lrdata->tx_buf,
+			      lrdata->tx_buflen);
+	if (c > 0) {
+		trace_lora_tx_enqueue(spi, ldata->tx_id, c);
+		loaded = ktime_get_ns();
+		lora_hist_add(lrdata, LORA_HIST_TX_LOAD, loaded - ldata->tx_ns);
+	}
+
+	/* Clear LoRa IRQ TX flag. */
+	sx127X_clearLoRaFlag(spi, SX127X_FLAG_TXDONE);
+
+	/* Set chip to TX state at the scheduled time, if there is. */
+	if ((c > 0) && (ldata->txtime.req.time_ns != 0)) {
+		dev_dbg(&(spi->dev), "Set TX state at the scheduled time\n");
+		status = loraspi_txtime_start(ldata);
+		/* The scheduled time is only for this packet. */
+		ldata->txtime.req.time_ns = 0;
+		if (status < 0)
+			c = status;
+		txend = ldata->timed.mono;
+	}
+	else if (c > 0) {
+		/* Set chip to TX state to send the data in FIFO to RF. */
+		dev_dbg(&(spi->dev), "Set TX state\n");
+		sx127X_fifo_starttx(spi, &(ldata->fifo));
+		trace_lora_tx_start(spi, ldata->tx_id, 0);
+		txend = ktime_get();
+	}
+
+	if (c > 0) {
+		started = ktime_to_ns(txend);
+		lora_hist_add(lrdata, LORA_HIST_TX_START, started - loaded);
+	}
 
-	/* There is a ready packet in the chip's FIFO. */
-	if (c == 0) {
-		memset(lrdata->rx_buf, 0, lrdata->bufmaxlen);
-		size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
-		/* Read from chip to LoRa data RX buffer. */
-		c = sx127X_readLoRaData(spi, lrdata->rx_buf, size);
-		/* Copy from LoRa data RX buffer to user space. */
-		if (c > 0)
-			status = copy_to_user((void *)buf, lrdata->rx_buf, c);
+	/* The RX windows are timed from the end of the TX. */
+	if ((c > 0) && (ldata->rxwin.req.nwin > 0))
+		txend = ktime_add_us(txend, sx127X_getLoRaAirTime(spi, c));
+
+	/* Wait until TX is finished. */
+	if ((c > 0) && !loraspi_txdone_wait(spi, c)) {
+		trace_lora_tx_done(spi, ldata->tx_id, c, -ETIME);
+		lora_stats_inc(lrdata, tx_timeouts);
+		c = 0;
+	}
+	else {
+		trace_lora_tx_done(spi, ldata->tx_id, max(c, 0), min(c, 0));
+		if (c > 0) {
+			ldata->txdone_ns = ktime_get_ns();
+			lora_hist_add(lrdata, LORA_HIST_TX_AIR,
+				      ldata->txdone_ns - started);
+			lora_stats_inc(lrdata, tx_packets);
+			lora_stats_add(lrdata, tx_bytes, c);
+		}
 	}
 
-	/* Clear all of the IRQ flags. */
-	sx127X_clearLoRaAllFlag(spi);
+	/* The TX packet has left the FIFO or it is given up. */
+	sx127X_fifo_txdone(&(ldata->fifo));
+
+	/* Report the written bytes of user space, not the padded or the
+	 * secured ones. */
+	if ((c > 0) && ((ldata->crypto != NULL) || ldata->implicit))
+		c = min_t(int, c, ulen);
+
+	/* Open the RX windows after TX is finished, if there are. */
+	if ((c > 0) && (ldata->rxwin.req.nwin > 0)) {
+		loraspi_rxwin_open(ldata, txend);
+		/* Queue the packet caught in the RX windows. */
+		sx127X_fifo_harvest(spi, &(ldata->fifo));
+	}
+
+	/* Set chip to RX continuous state with the freed TX space. */
+	loraspi_rx_resume(ldata);
+
+	lrdata->tx_buflen = 0;
+
+	return c;
+}
+
+/**
+ * loraspi_write - Write to the LoRa device's communication
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the data going to be written in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loraspi_write(struct lora_struct *lrdata, const char __user *buf, size_t size)
+{
+	struct spi_device *spi;
+	ssize_t status;
+	int c;
+	u64 t;
+
+	spi = lrdata->lora_device;
+	dev_dbg(&(spi->dev), "Write %zu bytes from user space\n", size);
+
+	t = ktime_get_ns();
+	lora_lock(lrdata);
+	to_loraspi(lrdata)->tx_ns = t;
+	memset(lrdata->tx_buf, 0, lrdata->bufmaxlen);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	status = copy_from_user(lrdata->tx_buf, buf, size);
+
+	if (status >= size) {
+		lora_unlock(lrdata);
+		return 0;
+	}
+
+	c = loraspi_xmit_locked(lrdata, size - status);
+
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loraspi_xmit - Send a packet from a kernel buffer
+ * @lrdata:	LoRa device
+ * @buf:	the buffer holding the packet in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loraspi_xmit(struct lora_struct *lrdata, const uint8_t *buf, size_t size)
+{
+	int c;
+	u64 t;
+
+	if (size == 0)
+		return 0;
+
+	t = ktime_get_ns();
+	lora_lock(lrdata);
+	to_loraspi(lrdata)->tx_ns = t;
+	memset(lrdata->tx_buf, 0, lrdata->bufmaxlen);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	memcpy(lrdata->tx_buf, buf, size);
+	c = loraspi_xmit_locked(lrdata, size);
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loraspi_beacon_send - Send the resident frame
+ * @ldata:	LoRa SPI device whose resident frame has been pinned
+ * @at:		the CLOCK_MONOTONIC time to send, 0 for right now
+ *
+ * Only the counter and the FIFO pointers are written before the TX, the
+ * frame itself stays in the FIFO.
+ *
+ * Return:	0 / negative number for sent / error
+ */
+static int
+loraspi_beacon_send(struct loraspi_data *ldata, ktime_t at)
+{
+	struct spi_device *spi;
+	struct loraspi_beacon *bcn;
+	uint8_t *patch;
+	uint32_t cnt;
+	uint32_t v;
+	int status;
+	int i;
+
+	spi = ldata->lrdata.lora_device;
+	bcn = &(ldata->beacon);
+	if (bcn->req.len == 0)
+		return -ENODATA;
+
+	sx127X_fifo_harvest(spi, &(ldata->fifo));
+
+	/* Patch the increased counter, unless it has not been sent yet. */
+	cnt = bcn->status.counter;
+	patch = NULL;
+	if (!bcn->fresh && (bcn->req.patch_len > 0)) {
+		cnt++;
+		patch = bcn->req.payload + bcn->req.patch_off;
+		for (i = bcn->req.patch_len - 1, v = cnt; i >= 0; i--, v >>= 8)
+			patch[i] = v & 0xFF;
+	}
+
+	status = sx127X_fifo_rearm(spi, &(ldata->fifo), bcn->req.patch_off,
+				   patch, bcn->req.patch_len);
+	if (status == -ENODATA) {
+		/* The chip has lost the FIFO in sleep state, so pin it again. */
+		dev_dbg(&(spi->dev), "Pin the resident frame again\n");
+		sx127X_fifo_pin(spi, &(ldata->fifo), bcn->req.payload,
+				bcn->req.len);
+		status = sx127X_fifo_rearm(spi, &(ldata->fifo), 0, NULL, 0);
+	}
+
+	/* Clear LoRa IRQ TX flag. */
+	sx127X_clearLoRaFlag(spi, SX127X_FLAG_TXDONE);
+
+	/* The resident frame is traced as packet 0. */
+	ldata->tx_id = 0;
+	if ((status == 0) && (ktime_to_ns(at) != 0)) {
+		status = loraspi_timed_state(ldata, SX127X_TX_MODE,
+					     CLOCK_MONOTONIC, at);
+		if (status == -ETIME) {
+			/* Send it right now, if it is late. */
+			bcn->status.late++;
+			status = 0;
+			sx127X_fifo_starttx(spi, &(ldata->fifo));
+			trace_lora_tx_start(spi, 0, 0);
+			ldata->timed.mono = ktime_get();
+		}
+	}
+	else if (status == 0) {
+		sx127X_fifo_starttx(spi, &(ldata->fifo));
+		trace_lora_tx_start(spi, 0, 0);
+		ldata->timed.mono = ktime_get();
+	}
+
+	if ((status == 0) && !loraspi_txdone_wait(spi, bcn->req.len))
+		status = -ETIME;
+	trace_lora_tx_done(spi, 0, bcn->req.len, status);
+	if (status == 0) {
+		lora_hist_add(&(ldata->lrdata), LORA_HIST_TX_AIR,
+			      ktime_get_ns() - ktime_to_ns(ldata->timed.mono));
+		lora_stats_inc(&(ldata->lrdata), tx_packets);
+		lora_stats_add(&(ldata->lrdata), tx_bytes, bcn->req.len);
+	}
+	else if (status == -ETIME) {
+		lora_stats_inc(&(ldata->lrdata), tx_timeouts);
+	}
+
+	if (status == 0) {
+		bcn->status.sent++;
+		bcn->status.counter = cnt;
+		bcn->status.last_ns = ktime_to_ns(ldata->timed.mono);
+		bcn->fresh = 0;
+	}
+	else {
+		bcn->status.failed++;
+	}
+
+	loraspi_rx_resume(ldata);
+
+	return status;
+}
+
+/* The work sends the resident frame periodically. */
+static void
+loraspi_beacon_work(struct work_struct *work)
+{
+	struct loraspi_beacon *bcn;
+	struct loraspi_data *ldata;
+	ktime_t now;
+	int64_t ahead;
+
+	bcn = container_of(to_delayed_work(work), struct loraspi_beacon, work);
+	ldata = container_of(bcn, struct loraspi_data, beacon);
+
+	lora_lock(&(ldata->lrdata));
+	if ((bcn->req.len > 0) && (bcn->req.period_ms > 0)) {
+		loraspi_beacon_send(ldata, bcn->next);
+
+		/* Keep the period from drifting with the TX and the work. */
+		now = ktime_get();
+		do {
+			bcn->next = ktime_add_ms(bcn->next, bcn->req.period_ms);
+		} while (ktime_compare(bcn->next, now) <= 0);
+
+		/* Wake up early enough to prepare the FIFO before the time. */
+		ahead = ktime_ms_delta(bcn->next, now) - LORASPI_BEACON_LEAD_MS;
+		schedule_delayed_work(&(bcn->work),
+				      msecs_to_jiffies((ahead > 0) ? ahead : 0));
+	}
+	lora_unlock(&(ldata->lrdata));
+}
+
+/**
+ * loraspi_setstate - Set the state of the LoRa device
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the state value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setstate(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t st32;
+	uint8_t st;
+
+	spi = lrdata->lora_device;
+	status = copy_from_user(&st32, arg, sizeof(uint32_t));
+	switch (st32) {
+	case LORA_STATE_SLEEP:
+		st = SX127X_SLEEP_MODE;		break;
+	case LORA_STATE_STANDBY:
+		st = SX127X_STANDBY_MODE;	break;
+	case LORA_STATE_TX:
+		st = SX127X_TX_MODE;		break;
+	case LORA_STATE_RX:
+		st = SX127X_RXCONTINUOUS_MODE;	break;
+	case LORA_STATE_CAD:
+		st = SX127X_CAD_MODE;		break;
+	default:
+		st = SX127X_STANDBY_MODE;
+	}
+
+	lora_lock(lrdata);
+	sx127X_setState(spi, st);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getstate - Get the state of the LoRa device
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the state value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getstate(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t st32;
+	uint8_t st;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	st = sx127X_getState(spi);
+	lora_unlock(lrdata);
+
+	st32 = st;
+	switch (st) {
+	case SX127X_SLEEP_MODE:
+		st32 = LORA_STATE_SLEEP;	break;
+	case SX127X_STANDBY_MODE:
+		st32 = LORA_STATE_STANDBY;	break;
+	case SX127X_FSTX_MODE:
+	case SX127X_TX_MODE:
+		st32 = LORA_STATE_TX;		break;
+	case SX127X_FSRX_MODE:
+	case SX127X_RXSINGLE_MODE:
+	case SX127X_RXCONTINUOUS_MODE:
+		st32 = LORA_STATE_RX;		break;
+	case SX127X_CAD_MODE:
+		st32 = LORA_STATE_CAD;		break;
+	default:
+		st32 = LORA_STATE_SLEEP;
+	}
+	status = copy_to_user(arg, &st32, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_setfreq - Set the carrier frequency
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the carrier frequency in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setfreq(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t freq;
+
+	spi = lrdata->lora_device;
+	status = copy_from_user(&freq, arg, sizeof(uint32_t));
+	dev_dbg(&(spi->dev), "Set frequency %u Hz from user space\n", freq);
+
+	lora_lock(lrdata);
+	sx127X_setLoRaFreq(spi, freq);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getfreq - Get the carrier frequency
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the carrier frequency in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getfreq(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t freq;
+
+	spi = lrdata->lora_device;
+	dev_dbg(&(spi->dev), "Get frequency to user space\n");
+
+	lora_lock(lrdata);
+	freq = sx127X_getLoRaFreq(spi);
+	lora_unlock(lrdata);
+	dev_dbg(&(spi->dev), "The carrier freq is %u Hz\n", freq);
+
+	status = copy_to_user(arg, &freq, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_setpower - Set the PA power
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the PA output value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setpower(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	int32_t dbm;
+
+	spi = lrdata->lora_device;
+	status = copy_from_user(&dbm, arg, sizeof(uint32_t));
+
+#define LORA_MAX_POWER	(17)
+#define LORA_MIN_POWER	(-2)
+	if (dbm > LORA_MAX_POWER)
+		dbm = LORA_MAX_POWER;
+	else if (dbm < LORA_MIN_POWER)
+		dbm = LORA_MIN_POWER;
+
+	lora_lock(lrdata);
+	sx127X_setLoRaPower(spi, dbm);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getpower -  Get the PA power
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the PA output value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getpower(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	int32_t dbm;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	dbm = sx127X_getLoRaPower(spi);
+	lora_unlock(lrdata);
+
+	status = copy_to_user(arg, &dbm, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_setsprfactor - Set the RF spreading factor
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the spreading factor in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setsprfactor(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t sprf;
+
+	spi = lrdata->lora_device;
+	status = copy_from_user(&sprf, arg, sizeof(uint32_t));
+
+	lora_lock(lrdata);
+	sx127X_setLoRaSPRFactor(spi, sprf);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getsprfactor - Get the RF spreading factor
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the spreading factor in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getsprfactor(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t sprf;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	sprf = sx127X_getLoRaSPRFactor(spi);
+	lora_unlock(lrdata);
+
+	status = copy_to_user(arg, &sprf, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_setbandwidth - Set the RF bandwith
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the RF bandwith value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setbandwidth(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t bw;
+
+	spi = lrdata->lora_device;
+	status = copy_from_user(&bw, arg, sizeof(uint32_t));
+
+	lora_lock(lrdata);
+	sx127X_setLoRaBW(spi, bw);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getbandwidth - Get the RF bandwith
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the RF bandwith value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getbandwidth(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t bw;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	bw = sx127X_getLoRaBW(spi);
+	lora_unlock(lrdata);
+
+	status = copy_to_user(arg, &bw, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_getrssi - Get current RSSI
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the RSSI value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getrssi(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	int32_t rssi;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	rssi = sx127X_getLoRaRSSI(spi);
+	lora_unlock(lrdata);
+
+	status = copy_to_user(arg, &rssi, sizeof(int32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_getsnr - Get last packet's SNR
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the SNR value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getsnr(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	int status;
+	uint32_t snr;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	snr = sx127X_getLoRaLastPacketSNR(spi);
+	lora_unlock(lrdata);
+
+	status = copy_to_user(arg, &snr, sizeof(uint32_t));
+
+	return 0;
+}
+
+/**
+ * loraspi_settxtime - Set the start time of the next TX
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the lora_txtime structure in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_settxtime(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loraspi_data *ldata;
+	struct lora_txtime req;
+
+	ldata = to_loraspi(lrdata);
+	if (copy_from_user(&req, arg, sizeof(struct lora_txtime)))
+		return -EFAULT;
+
+	if ((req.clockid != CLOCK_MONOTONIC) && (req.clockid != CLOCK_BOOTTIME))
+		return -EINVAL;
+	if ((req.flags != 0) || (req.time_ns < 0))
+		return -EINVAL;
+
+	lora_lock(lrdata);
+	ldata->txtime.req = req;
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_gettxtime - Get the status of the scheduled TX
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the lora_txtime_status in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_gettxtime(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loraspi_data *ldata;
+	struct lora_txtime_status st;
+
+	ldata = to_loraspi(lrdata);
+
+	lora_lock(lrdata);
+	st = ldata->txtime.status;
+	lora_unlock(lrdata);
+
+	if (copy_to_user(arg, &st, sizeof(struct lora_txtime_status)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loraspi_setrxwin - Set the RX windows opened after each TX
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the lora_rxwin structure in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setrxwin(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loraspi_data *ldata;
+	struct lora_rxwin req;
+	struct lora_rxwin_param *p;
+	int i;
+
+	ldata = to_loraspi(lrdata);
+	if (copy_from_user(&req, arg, sizeof(struct lora_rxwin)))
+		return -EFAULT;
+
+	if ((req.nwin > LORA_RXWIN_MAX) || (req.flags != 0))
+		return -EINVAL;
+	for (i = 0; i < req.nwin; i++) {
+		p = &(req.win[i]);
+		/* Spreading factor must be 64 ~ 4096 chips / symbol. */
+		if ((p->sprf < 64) || (p->sprf > 4096)
+			|| (p->sprf & (p->sprf - 1)))
+			return -EINVAL;
+		if ((p->bw == 0) || (p->timeout_ms == 0))
+			return -EINVAL;
+		/* The windows must be opened in order. */
+		if ((i > 0) && (p->delay_ms <= req.win[i - 1].delay_ms))
+			return -EINVAL;
+	}
+
+	lora_lock(lrdata);
+	ldata->rxwin.req = req;
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getrxwin - Get the status of the last RX windows
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the lora_rxwin_status in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getrxwin(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loraspi_data *ldata;
+	struct lora_rxwin_status st;
+
+	ldata = to_loraspi(lrdata);
+
+	lora_lock(lrdata);
+	st = ldata->rxwin.status;
+	lora_unlock(lrdata);
+
+	if (copy_to_user(arg, &st, sizeof(struct lora_rxwin_status)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loraspi_setcr - Set the coding rate
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the coding rate denominator in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setcr(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	uint32_t cr;
+
+	spi = lrdata->lora_device;
+	if (copy_from_user(&cr, arg, sizeof(uint32_t)))
+		return -EFAULT;
+	/* Coding rate is 4/5 ~ 4/8. */
+	if ((cr < 5) || (cr > 8))
+		return -EINVAL;
+
+	lora_lock(lrdata);
+	sx127X_setLoRaCR(spi, 0x40 | cr);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loraspi_getcr - Get the coding rate
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the coding rate denominator in user
+ *		space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getcr(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	uint32_t cr;
+
+	spi = lrdata->lora_device;
+
+	lora_lock(lrdata);
+	cr = sx127X_getLoRaCR(spi) & 0x0F;
+	lora_unlock(lrdata);
+
+	if (copy_to_user(arg, &cr, sizeof(uint32_t)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loraspi_setcrc - Enable or disable the payload CRC
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding 1 / 0 for enabled / disabled in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_setcrc(struct lora_struct *lrdata, void __user *arg)
+{
+	struct spi_device *spi;
+	uint32_t yesno;
+
+	spi = lrdata->lora_device;
+	if (copy_from_user(&yesno, arg, sizeof(uint32_t)))
+		return -EFAULT;
 
-	mutex_unlock(&(lrdata->buf_lock));
+	lora_lock(lrdata);
+	sx127X_setLoRaCRC(spi, yesno ? 1 : 0);
+	lora_unlock(lrdata);
 
-	return c;
+	return 0;
 }
 
 /**
- * loraspi_write - Write to the LoRa device's communication
+ * loraspi_getcrc - Get the payload CRC is enabled or not
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the data going to be written in user space
- * @size:	the length of the buffer in bytes
+ * @arg:	the buffer going to hold 1 / 0 for enabled / disabled in user
+ *		space
  *
- * Return:	Write how many bytes actually, negative number for error
+ * Return:	0 / other values for success / error
  */
-static ssize_t
-loraspi_write(struct lora_struct *lrdata, const char __user *buf, size_t size)
+static long
+loraspi_getcrc(struct lora_struct *lrdata, void __user *arg)
 {
 	struct spi_device *spi;
-	ssize_t status;
-	int c;
-	uint8_t adr;
-	uint8_t flag;
-	uint32_t timeout;
+	uint32_t yesno;
 
 	spi = lrdata->lora_device;
-	dev_dbg(&(spi->dev), "Write %zu bytes from user space\n", size);
-
-	mutex_lock(&(lrdata->buf_lock));
-	memset(lrdata->tx_buf, 0, lrdata->bufmaxlen);
-	status = copy_from_user(lrdata->tx_buf, buf, size);
-
-	if (status >= size)
-		return 0;
-
-	lrdata->tx_buflen = size - status;
-
-	/* Set chip to standby state. */
-	dev_dbg(&(spi->dev), "Going to set standby state\n");
-	sx127X_setState(spi, SX127X_STANDBY_MODE);
-
-	/* Set chip FIFO TX base. */
-	adr = 0x80;
-	dev_dbg(&(spi->dev), "Going to set TX base address\n");
-	sx127X_write_reg(spi, SX127X_REG_FIFO_TX_BASE_ADDR, &adr, 1);
-
-	/* Write to SPI chip synchronously to fill the FIFO of the chip. */
-	c = sx127X_sendLoRaData(spi, lrdata->tx_buf, lrdata->tx_buflen);
-
-	/* Clear LoRa IRQ TX flag. */
-	sx127X_clearLoRaFlag(spi, SX127X_FLAG_TXDONE);
-
-	if (c > 0) {
-		/* Set chip to TX state to send the data in FIFO to RF. */
-		dev_dbg(&(spi->dev), "Set TX state\n");
-		sx127X_setState(spi, SX127X_TX_MODE);
-
-		timeout = (c + sx127X_getLoRaPreambleLen(spi) + 1) + 2;
-		dev_dbg(&(spi->dev), "The time out is %u ms", timeout * 20);
-
-		/* Wait until TX is finished by checking the TX flag. */
-		for (flag = 0; timeout > 0; timeout--) {
-			flag = sx127X_getLoRaFlag(spi, SX127X_FLAG_TXDONE);
-			if (flag != 0) {
-				dev_dbg(&(spi->dev), "Wait TX is finished\n");
-				break;
-			}
-
-			if (timeout == 1) {
-				c = 0;
-				dev_dbg(&(spi->dev), "Wait TX is time out\n");
-			}
-			else {
-				msleep(20);
-			}
-		}
-	}
-
-	/* Set chip to RX continuous state. */
-	dev_dbg(&(spi->dev), "Set back to RX continuous state\n");
-	sx127X_setState(spi, SX127X_STANDBY_MODE);
-	sx127X_setState(spi, SX127X_RXCONTINUOUS_MODE);
 
-	lrdata->tx_buflen = 0;
+	lora_lock(lrdata);
+	yesno = sx127X_getLoRaCRC(spi);
+	lora_unlock(lrdata);
 
-	mutex_unlock(&(lrdata->buf_lock));
+	if (copy_to_user(arg, &yesno, sizeof(uint32_t)))
+		return -EFAULT;
 
-	return c;
+	return 0;
 }
 
 /**
- * loraspi_setstate - Set the state of the LoRa device
+ * loraspi_setparam - Set a 32 bits setting with a kernel value
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the state value in user space
+ * @cmd:	LORA_SET_* of the setting
+ * @val:	the value of the setting
+ *
+ * The values are checked as the ioctl commands do.
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_setstate(struct lora_struct *lrdata, void __user *arg)
+loraspi_setparam(struct lora_struct *lrdata, unsigned int cmd, uint32_t val)
 {
 	struct spi_device *spi;
-	int status;
-	uint32_t st32;
-	uint8_t st;
+	int32_t dbm;
 
 	spi = lrdata->lora_device;
-	status = copy_from_user(&st32, arg, sizeof(uint32_t));
-	switch (st32) {
-	case LORA_STATE_SLEEP:
-		st = SX127X_SLEEP_MODE;		break;
-	case LORA_STATE_STANDBY:
-		st = SX127X_STANDBY_MODE;	break;
-	case LORA_STATE_TX:
-		st = SX127X_TX_MODE;		break;
-	case LORA_STATE_RX:
-		st = SX127X_RXCONTINUOUS_MODE;	break;
-	case LORA_STATE_CAD:
-		st = SX127X_CAD_MODE;		break;
+	dbm = (int32_t)val;
+
+	switch (cmd) {
+	case LORA_SET_POWER:
+		if (dbm > LORA_MAX_POWER)
+			dbm = LORA_MAX_POWER;
+		else if (dbm < LORA_MIN_POWER)
+			dbm = LORA_MIN_POWER;
+		break;
+	case LORA_SET_CODINGRATE:
+		/* Coding rate is 4/5 ~ 4/8. */
+		if ((val < 5) || (val > 8))
+			return -EINVAL;
+		break;
+	case LORA_SET_FREQUENCY:
+	case LORA_SET_SPRFACTOR:
+	case LORA_SET_BANDWIDTH:
+	case LORA_SET_CRC:
+		break;
 	default:
-		st = SX127X_STANDBY_MODE;
+		return -ENOTTY;
 	}
 
-	mutex_lock(&(lrdata->buf_lock));
-	sx127X_setState(spi, st);
-	mutex_unlock(&(lrdata->buf_lock));
+	lora_lock(lrdata);
+	switch (cmd) {
+	case LORA_SET_FREQUENCY:
+		sx127X_setLoRaFreq(spi, val);		break;
+	case LORA_SET_POWER:
+		sx127X_setLoRaPower(spi, dbm);		break;
+	case LORA_SET_SPRFACTOR:
+		sx127X_setLoRaSPRFactor(spi, val);	break;
+	case LORA_SET_BANDWIDTH:
+		sx127X_setLoRaBW(spi, val);		break;
+	case LORA_SET_CODINGRATE:
+		sx127X_setLoRaCR(spi, 0x40 | val);	break;
+	case LORA_SET_CRC:
+		sx127X_setLoRaCRC(spi, val ? 1 : 0);	break;
+	}
+	lora_unlock(lrdata);
 
 	return 0;
 }
 
 /**
- * loraspi_getstate - Get the state of the LoRa device
+ * loraspi_getparam - Get a 32 bits setting into a kernel buffer
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the state value in user space
+ * @cmd:	LORA_GET_* of the setting
+ * @val:	the buffer going to hold the value of the setting
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getstate(struct lora_struct *lrdata, void __user *arg)
+loraspi_getparam(struct lora_struct *lrdata, unsigned int cmd, uint32_t *val)
 {
 	struct spi_device *spi;
-	int status;
-	uint32_t st32;
-	uint8_t st;
+	long ret;
 
 	spi = lrdata->lora_device;
+	ret = 0;
 
-	mutex_lock(&(lrdata->buf_lock));
-	st = sx127X_getState(spi);
-	mutex_unlock(&(lrdata->buf_lock));
-
-	st32 = st;
-	switch (st) {
-	case SX127X_SLEEP_MODE:
-		st32 = LORA_STATE_SLEEP;	break;
-	case SX127X_STANDBY_MODE:
-		st32 = LORA_STATE_STANDBY;	break;
-	case SX127X_FSTX_MODE:
-	case SX127X_TX_MODE:
-		st32 = LORA_STATE_TX;		break;
-	case SX127X_FSRX_MODE:
-	case SX127X_RXSINGLE_MODE:
-	case SX127X_RXCONTINUOUS_MODE:
-		st32 = LORA_STATE_RX;		break;
-	case SX127X_CAD_MODE:
-		st32 = LORA_STATE_CAD;		break;
+	lora_lock(lrdata);
+	switch (cmd) {
+	case LORA_GET_FREQUENCY:
+		*val = sx127X_getLoRaFreq(spi);			break;
+	case LORA_GET_POWER:
+		*val = (int32_t)sx127X_getLoRaPower(spi);	break;
+	case LORA_GET_SPRFACTOR:
+		*val = sx127X_getLoRaSPRFactor(spi);		break;
+	case LORA_GET_BANDWIDTH:
+		*val = sx127X_getLoRaBW(spi);			break;
+	case LORA_GET_CODINGRATE:
+		*val = sx127X_getLoRaCR(spi) & 0x0F;		break;
+	case LORA_GET_CRC:
+		*val = sx127X_getLoRaCRC(spi);			break;
 	default:
-		st32 = LORA_STATE_SLEEP;
+		ret = -ENOTTY;
 	}
-	status = copy_to_user(arg, &st32, sizeof(uint32_t));
+	lora_unlock(lrdata);
 
-	return 0;
+	return ret;
 }
 
 /**
- * loraspi_setfreq - Set the carrier frequency
+ * loraspi_setimplicit - Set the header mode and the fixed payload length
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the carrier frequency in user space
+ * @arg:	the buffer holding the fixed payload length in user space,
+ *		0 for Explicit Header Mode
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_setfreq(struct lora_struct *lrdata, void __user *arg)
+loraspi_setimplicit(struct lora_struct *lrdata, void __user *arg)
 {
 	struct spi_device *spi;
-	int status;
-	uint32_t freq;
+	struct loraspi_data *ldata;
+	uint32_t len;
 
 	spi = lrdata->lora_device;
-	status = copy_from_user(&freq, arg, sizeof(uint32_t));
-	dev_dbg(&(spi->dev), "Set frequency %u Hz from user space\n", freq);
-
-	mutex_lock(&(lrdata->buf_lock));
-	sx127X_setLoRaFreq(spi, freq);
-	mutex_unlock(&(lrdata->buf_lock));
+	ldata = to_loraspi(lrdata);
+	if (copy_from_user(&len, arg, sizeof(uint32_t)))
+		return -EFAULT;
+	if (len > lrdata->bufmaxlen)
+		return -EINVAL;
+
+	lora_lock(lrdata);
+	ldata->implicit = len;
+	sx127X_setState(spi, SX127X_STANDBY_MODE);
+	sx127X_setLoRaImplicit(spi, (len > 0) ? 1 : 0);
+	/* RX in Implicit Header Mode knows the payload length by itself. */
+	if (len > 0)
+		sx127X_setLoRaPayloadLen(spi, len);
+	/* Every RX packet has the fixed length in Implicit Header Mode. */
+	sx127X_fifo_setslot(&(ldata->fifo), (len > 0) ? len : ldata->maxpayload);
+	sx127X_write_reg(spi, SX127X_REG_FIFO_RX_BASE_ADDR,
+			 &(ldata->fifo.rx_adr), 1);
+	sx127X_setState(spi, SX127X_RXCONTINUOUS_MODE);
+	lora_unlock(lrdata);
 
 	return 0;
 }
 
 /**
- * loraspi_getfreq - Get the carrier frequency
+ * loraspi_getimplicit - Get the fixed payload length of the header mode
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the carrier frequency in user space
+ * @arg:	the buffer going to hold the fixed payload length in user
+ *		space, 0 for Explicit Header Mode
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getfreq(struct lora_struct *lrdata, void __user *arg)
+loraspi_getimplicit(struct lora_struct *lrdata, void __user *arg)
 {
-	struct spi_device *spi;
-	int status;
-	uint32_t freq;
+	struct loraspi_data *ldata;
+	uint32_t len;
 
-	spi = lrdata->lora_device;
-	dev_dbg(&(spi->dev), "Get frequency to user space\n");
+	ldata = to_loraspi(lrdata);
 
-	mutex_lock(&(lrdata->buf_lock));
-	freq = sx127X_getLoRaFreq(spi);
-	mutex_unlock(&(lrdata->buf_lock));
-	dev_dbg(&(spi->dev), "The carrier freq is %u Hz\n", freq);
+	lora_lock(lrdata);
+	len = ldata->implicit;
+	lora_unlock(lrdata);
 
-	status = copy_to_user(arg, &freq, sizeof(uint32_t));
+	if (copy_to_user(arg, &len, sizeof(uint32_t)))
+		return -EFAULT;
 
 	return 0;
 }
 
 /**
- * loraspi_setpower - Set the PA power
+ * loraspi_setmaxpayload - Set the max payload length of the RX packets
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the PA output value in user space
+ * @arg:	the buffer holding the max payload length in user space
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_setpower(struct lora_struct *lrdata, void __user *arg)
+loraspi_setmaxpayload(struct lora_struct *lrdata, void __user *arg)
 {
 	struct spi_device *spi;
-	int status;
-	int32_t dbm;
+	struct loraspi_data *ldata;
+	uint32_t len;
 
 	spi = lrdata->lora_device;
-	status = copy_from_user(&dbm, arg, sizeof(uint32_t));
-
-#define LORA_MAX_POWER	(17)
-#define LORA_MIN_POWER	(-2)
-	if (dbm > LORA_MAX_POWER)
-		dbm = LORA_MAX_POWER;
-	else if (dbm < LORA_MIN_POWER)
-		dbm = LORA_MIN_POWER;
-
-	mutex_lock(&(lrdata->buf_lock));
-	sx127X_setLoRaPower(spi, dbm);
-	mutex_unlock(&(lrdata->buf_lock));
+	ldata = to_loraspi(lrdata);
+	if (copy_from_user(&len, arg, sizeof(uint32_t)))
+		return -EFAULT;
+	if ((len == 0) || (len > SX127X_MAX_FIFO_LENGTH))
+		return -EINVAL;
+
+	lora_lock(lrdata);
+	ldata->maxpayload = len;
+	/* The chip drops the longer packets, so less FIFO is reserved. */
+	sx127X_setLoRaMaxRXBuff(spi, len);
+	if (ldata->implicit == 0)
+		sx127X_fifo_setslot(&(ldata->fifo), len);
+	lora_unlock(lrdata);
 
 	return 0;
 }
 
 /**
- * loraspi_getpower -  Get the PA power
+ * loraspi_getfifostat - Get the occupancy and the counters of the FIFO
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the PA output value in user space
+ * @arg:	the buffer going to hold the FIFO status in user space
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getpower(struct lora_struct *lrdata, void __user *arg)
+loraspi_getfifostat(struct lora_struct *lrdata, void __user *arg)
 {
 	struct spi_device *spi;
-	int status;
-	int32_t dbm;
+	struct sx127X_fifo *fifo;
+	struct lora_fifo_stat st;
 
 	spi = lrdata->lora_device;
-
-	mutex_lock(&(lrdata->buf_lock));
-	dbm = sx127X_getLoRaPower(spi);
-	mutex_unlock(&(lrdata->buf_lock));
-
-	status = copy_to_user(arg, &dbm, sizeof(uint32_t));
+	fifo = &(to_loraspi(lrdata)->fifo);
+	memset(&st, 0, sizeof(st));
+
+	lora_lock(lrdata);
+	sx127X_fifo_harvest(spi, fifo);
+	st.rx_pending = fifo->nrx;
+	st.used = sx127X_fifo_used(fifo);
+	st.rx_slot = fifo->slot;
+	st.rx_queued = fifo->stat.rx_queued;
+	st.rx_overwrites = fifo->stat.rx_overwrites;
+	st.rx_crcerrors = fifo->stat.rx_crcerrors;
+	st.tx_staged = fifo->stat.tx_staged;
+	st.tx_paused_rx = fifo->stat.tx_paused_rx;
+	lora_unlock(lrdata);
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
 
 	return 0;
 }
 
 /**
- * loraspi_setsprfactor - Set the RF spreading factor
+ * loraspi_setbeacon - Pin the resident frame in the chip's FIFO
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the spreading factor in user space
+ * @arg:	the buffer holding the resident frame in user space
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_setsprfactor(struct lora_struct *lrdata, void __user *arg)
+loraspi_setbeacon(struct lora_struct *lrdata, void __user *arg)
 {
 	struct spi_device *spi;
-	int status;
-	uint32_t sprf;
+	struct loraspi_data *ldata;
+	struct loraspi_beacon *bcn;
+	struct lora_beacon req;
+	uint32_t cnt;
+	uint32_t i;
+	uint8_t st;
+	long status;
 
 	spi = lrdata->lora_device;
-	status = copy_from_user(&sprf, arg, sizeof(uint32_t));
+	ldata = to_loraspi(lrdata);
+	bcn = &(ldata->beacon);
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+	if ((req.len > LORA_BEACON_MAXLEN)
+		|| (req.patch_len > LORA_BEACON_MAXPATCH)
+		|| (req.patch_off > req.len)
+		|| ((req.patch_off + req.patch_len) > req.len))
+		return -EINVAL;
+
+	/* Stop sending periodically before the frame is changed. */
+	cancel_delayed_work_sync(&(bcn->work));
+
+	lora_lock(lrdata);
+	status = 0;
+	/* Implicit Header Mode always sends the fixed length payload. */
+	if ((req.len > 0) && ldata->implicit && (req.len != ldata->implicit))
+		status = -EINVAL;
+	/* The period must be longer than the frame on air. */
+	if ((req.len > 0) && (req.period_ms > 0)
+		&& ((uint64_t)req.period_ms * 1000 <=
+		    sx127X_getLoRaAirTime(spi, req.len)))
+		status = -EINVAL;
+	if (status) {
+		lora_unlock(lrdata);
+		return status;
+	}
 
-	mutex_lock(&(lrdata->buf_lock));
-	sx127X_setLoRaSPRFactor(spi, sprf);
-	mutex_unlock(&(lrdata->buf_lock));
+	bcn->req = req;
+	memset(&(bcn->status), 0, sizeof(bcn->status));
+	/* The counter starts from the value in the frame. */
+	for (cnt = 0, i = 0; i < req.patch_len; i++)
+		cnt = (cnt << 8) | req.payload[req.patch_off + i];
+	bcn->status.counter = cnt;
+	bcn->fresh = 1;
+
+	st = sx127X_getState(spi);
+	sx127X_fifo_pin(spi, &(ldata->fifo), bcn->req.payload, req.len);
+	/* Pinning may pause RX, and the RX slot goes below the frame. */
+	if (st == SX127X_RXCONTINUOUS_MODE)
+		loraspi_rx_resume(ldata);
+
+	if ((req.len > 0) && (req.period_ms > 0)) {
+		bcn->next = ktime_add_ms(ktime_get(), LORASPI_BEACON_LEAD_MS);
+		schedule_delayed_work(&(bcn->work), 0);
+	}
+	lora_unlock(lrdata);
 
 	return 0;
 }
 
 /**
- * loraspi_getsprfactor - Get the RF spreading factor
+ * loraspi_sendbeacon - Send the resident frame right now
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the spreading factor in user space
+ * @arg:	not used
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getsprfactor(struct lora_struct *lrdata, void __user *arg)
+loraspi_sendbeacon(struct lora_struct *lrdata, void __user *arg)
 {
-	struct spi_device *spi;
-	int status;
-	uint32_t sprf;
+	long status;
 
-	spi = lrdata->lora_device;
+	lora_lock(lrdata);
+	status = loraspi_beacon_send(to_loraspi(lrdata), 0);
+	lora_unlock(lrdata);
 
-	mutex_lock(&(lrdata->buf_lock));
-	sprf = sx127X_getLoRaSPRFactor(spi);
-	mutex_unlock(&(lrdata->buf_lock));
+	return status;
+}
 
-	status = copy_to_user(arg, &sprf, sizeof(uint32_t));
+/**
+ * loraspi_getbeacon - Get the accounting of the resident frame
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the status in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loraspi_getbeacon(struct lora_struct *lrdata, void __user *arg)
+{
+	struct lora_beacon_status st;
+
+	lora_lock(lrdata);
+	st = to_loraspi(lrdata)->beacon.status;
+	lora_unlock(lrdata);
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
 
 	return 0;
 }
 
 /**
- * loraspi_setbandwidth - Set the RF bandwith
+ * loraspi_setkey - Set the keys of the secured frames
  * @lrdata:	LoRa device
- * @arg:	the buffer holding the RF bandwith value in user space
+ * @arg:	the buffer holding the keys in user space
+ *
+ * The counters of the dropped frames carry over the new keys.
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_setbandwidth(struct lora_struct *lrdata, void __user *arg)
+loraspi_setkey(struct lora_struct *lrdata, void __user *arg)
 {
-	struct spi_device *spi;
-	int status;
-	uint32_t bw;
+	struct loraspi_data *ldata;
+	struct lora_crypto *cr = NULL;
+	struct lora_crypto *old;
+	struct lora_key key;
+	uint32_t fcnt;
+	long ret = 0;
+
+	ldata = to_loraspi(lrdata);
+	if (copy_from_user(&key, arg, sizeof(struct lora_key)))
+		return -EFAULT;
+	if (key.flags & ~(LORA_KEY_ENABLE | LORA_KEY_ENCRYPT)) {
+		ret = -EINVAL;
+		goto out;
+	}
 
-	spi = lrdata->lora_device;
-	status = copy_from_user(&bw, arg, sizeof(uint32_t));
+	if (key.flags & LORA_KEY_ENABLE) {
+		/* The crypto transformations are allocated without the lock. */
+		cr = lora_crypto_alloc(&key);
+		if (IS_ERR(cr)) {
+			ret = PTR_ERR(cr);
+			goto out;
+		}
+	}
 
-	mutex_lock(&(lrdata->buf_lock));
-	sx127X_setLoRaBW(spi, bw);
-	mutex_unlock(&(lrdata->buf_lock));
+	lora_lock(lrdata);
+	old = ldata->crypto;
+	if ((cr != NULL) && (old != NULL)) {
+		fcnt = cr->stat.tx_fcnt;
+		cr->stat = old->stat;
+		cr->stat.tx_fcnt = fcnt;
+		cr->stat.rx_fcnt = 0;
+	}
+	ldata->crypto = cr;
+	lora_unlock(lrdata);
 
-	return 0;
+	lora_crypto_free(old);
+
+out:
+	memzero_explicit(&key, sizeof(struct lora_key));
+
+	return ret;
 }
 
 /**
- * loraspi_getbandwidth - Get the RF bandwith
+ * loraspi_getcryptostat - Get the counters of the secured frames
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the RF bandwith value in user space
+ * @arg:	the buffer going to hold the counters in user space
  *
- * Return:	0 / other values for success / error
+ * Return:	0 / other values for success / error, all zero for plain
+ *		frames
  */
 static long
-loraspi_getbandwidth(struct lora_struct *lrdata, void __user *arg)
+loraspi_getcryptostat(struct lora_struct *lrdata, void __user *arg)
 {
-	struct spi_device *spi;
-	int status;
-	uint32_t bw;
+	struct loraspi_data *ldata;
+	struct lora_crypto_stat st;
 
-	spi = lrdata->lora_device;
+	ldata = to_loraspi(lrdata);
+	memset(&st, 0, sizeof(struct lora_crypto_stat));
 
-	mutex_lock(&(lrdata->buf_lock));
-	bw = sx127X_getLoRaBW(spi);
-	mutex_unlock(&(lrdata->buf_lock));
+	lora_lock(lrdata);
+	if (ldata->crypto != NULL)
+		st = ldata->crypto->stat;
+	lora_unlock(lrdata);
 
-	status = copy_to_user(arg, &bw, sizeof(uint32_t));
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
 
 	return 0;
 }
 
 /**
- * loraspi_getrssi - Get current RSSI
+ * loraspi_getpktmeta - Get the signal and the time of the packet last read
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the RSSI value in user space
+ * @meta:	the buffer going to hold the metadata in kernel space
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getrssi(struct lora_struct *lrdata, void __user *arg)
+loraspi_getpktmeta(struct lora_struct *lrdata, struct lora_pkt_meta *meta)
 {
 	struct spi_device *spi;
-	int status;
-	int32_t rssi;
+	struct sx127X_fifo_pkt pkt;
+	uint8_t lf;
 
 	spi = lrdata->lora_device;
 
-	mutex_lock(&(lrdata->buf_lock));
-	rssi = sx127X_getLoRaRSSI(spi);
-	mutex_unlock(&(lrdata->buf_lock));
-
-	status = copy_to_user(arg, &rssi, sizeof(int32_t));
+	lora_lock(lrdata);
+	pkt = to_loraspi(lrdata)->rx_pkt;
+	meta->rx_ns = to_loraspi(lrdata)->rx_ns;
+	meta->tx_ns = to_loraspi(lrdata)->txdone_ns;
+	lf = sx127X_getMode(spi) & 0x08;
+	lora_unlock(lrdata);
+
+	/* The RSSI offset depends on the low or high frequency band, and
+	 * the packet under the noise floor has the negative SNR added. */
+	meta->rssi = (lf ? -164 : -157) + pkt.rssi;
+	if (pkt.snr < 0)
+		meta->rssi += pkt.snr / 4;
+	meta->snr = pkt.snr;
+	meta->len = pkt.len;
+	meta->reserved = 0;
 
 	return 0;
 }
 
 /**
- * loraspi_getsnr - Get last packet's SNR
+ * loraspi_getpktstat - Get the signal of the packet last read
  * @lrdata:	LoRa device
- * @arg:	the buffer going to hold the SNR value in user space
+ * @arg:	the buffer going to hold the struct lora_pkt_stat in user space
  *
  * Return:	0 / other values for success / error
  */
 static long
-loraspi_getsnr(struct lora_struct *lrdata, void __user *arg)
+loraspi_getpktstat(struct lora_struct *lrdata, void __user *arg)
 {
-	struct spi_device *spi;
-	int status;
-	uint32_t snr;
+	struct lora_pkt_meta meta;
+	struct lora_pkt_stat st;
 
-	spi = lrdata->lora_device;
+	loraspi_getpktmeta(lrdata, &meta);
+	st.rssi = meta.rssi;
+	st.snr = meta.snr;
+	st.len = meta.len;
 
-	mutex_lock(&(lrdata->buf_lock));
-	snr = sx127X_getLoRaLastPacketSNR(spi);
-	mutex_unlock(&(lrdata->buf_lock));
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
 
-	status = copy_to_user(arg, &snr, sizeof(uint32_t));
+	return 0;
+}
+
+/**
+ * loraspi_getchipstat - Read the chip's valid header and packet counters
+ * @lrdata:	LoRa device
+ * @st:		the statistics going to hold the chip's counters
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static long
+loraspi_getchipstat(struct lora_struct *lrdata, struct lora_stats *st)
+{
+	uint8_t r[4];
+	int status;
+
+	/* The header and the packet counters are contiguous registers. */
+	status = sx127X_read_reg(lrdata->lora_device,
+				 SX127X_REG_RX_HEADER_CNT_VALUE_MSB, r, 4);
+	if (status != 4)
+		return (status < 0) ? status : -EIO;
+
+	st->chip_rx_headers = r[0] * 256 + r[1];
+	st->chip_rx_packets = r[2] * 256 + r[3];
 
 	return 0;
 }
@@ -594,6 +2073,7 @@ static long
 loraspi_ready2read(struct lora_struct *lrdata)
 {
 	struct spi_device *spi;
+	struct loraspi_data *ldata;
 	long ret;
 
 	spi = lrdata->lora_device;
@@ -601,10 +2081,21 @@ loraspi_ready2read(struct lora_struct *lrdata)
 	ret = 0;
 	/* Mutex is not lock, than it is not in reading file operation. */
 	if (!mutex_is_locked(&(lrdata->buf_lock))) {
-		/* Check the chip have recieved full data. */
-		mutex_lock(&(lrdata->buf_lock));
-		ret = sx127X_getLoRaFlag(spi, SX127X_FLAG_RXDONE) != 0;
-		mutex_unlock(&(lrdata->buf_lock));
+		/* Check there are packets queued in the chip's FIFO. */
+		lora_lock(lrdata);
+		ldata = to_loraspi(lrdata);
+		sx127X_fifo_harvest(spi, &(ldata->fifo));
+		if (ldata->crypto != NULL) {
+			/* Only the verified packets wake up the readers. */
+			if (!lora_crypto_pending(ldata->crypto)
+				&& (ldata->fifo.nrx > 0))
+				loraspi_crypto_pull(ldata);
+			ret = lora_crypto_pending(ldata->crypto);
+		}
+		else {
+			ret = ldata->fifo.nrx > 0;
+		}
+		lora_unlock(lrdata);
 	}
 
 	return ret;
@@ -619,6 +2110,8 @@ struct lora_driver lr_driver = {
 struct lora_operations lrops = {
 	.read = loraspi_read,
 	.write = loraspi_write,
+	.xmit = loraspi_xmit,
+	.recv = loraspi_recv,
 	.setState = loraspi_setstate,
 	.getState = loraspi_getstate,
 	.setFreq = loraspi_setfreq,
@@ -631,8 +2124,32 @@ struct lora_operations lrops = {
 	.getBW = loraspi_getbandwidth,
 	.getRSSI = loraspi_getrssi,
 	.getSNR = loraspi_getsnr,
+	.setTxTime = loraspi_settxtime,
+	.getTxTime = loraspi_gettxtime,
+	.setRxWin = loraspi_setrxwin,
+	.getRxWin = loraspi_getrxwin,
+	.setCR = loraspi_setcr,
+	.getCR = loraspi_getcr,
+	.setCRC = loraspi_setcrc,
+	.getCRC = loraspi_getcrc,
+	.setImplicit = loraspi_setimplicit,
+	.getImplicit = loraspi_getimplicit,
+	.setMaxPayload = loraspi_setmaxpayload,
+	.getFIFOStat = loraspi_getfifostat,
+	.setBeacon = loraspi_setbeacon,
+	.sendBeacon = loraspi_sendbeacon,
+	.getBeacon = loraspi_getbeacon,
+	.setKey = loraspi_setkey,
+	.getCryptoStat = loraspi_getcryptostat,
+	.getPktStat = loraspi_getpktstat,
+	.getPktMeta = loraspi_getpktmeta,
+	.setParam = loraspi_setparam,
+	.getParam = loraspi_getparam,
+	.getChipStat = loraspi_getchipstat,
 	.ready2write = loraspi_ready2write,
 	.ready2read = loraspi_ready2read,
+	.startRX = loraspi_startrx,
+	.getMaxTx = loraspi_getmaxtx,
 };
 
 /* The compatible SoC array. */
@@ -687,6 +2204,7 @@ MODULE_DEVICE_TABLE(spi, spi_ids);
 /* The SPI probe callback function. */
 static int loraspi_probe(struct spi_device *spi)
 {
+	struct loraspi_data *ldata;
 	struct lora_struct *lrdata;
 	struct device *dev;
 	unsigned long minor;
@@ -705,34 +2223,61 @@ static int loraspi_probe(struct spi_device *spi)
 	loraspi_probe_acpi(spi);
 
 	/* Allocate lora device's data. */
-	lrdata = kzalloc(sizeof(struct lora_struct), GFP_KERNEL);
-	if (!lrdata)
+	ldata = kzalloc(sizeof(struct loraspi_data), GFP_KERNEL);
+	if (!ldata)
 		return -ENOMEM;
+	lrdata = &(ldata->lrdata);
 
 	/* Initial the lora device's data. */
 	lrdata->lora_device = spi;
 	lrdata->ops = &lrops;
 	mutex_init(&(lrdata->buf_lock));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&(ldata->timed.timer), loraspi_timed_fire,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+	hrtimer_init(&(ldata->timed.timer), CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#endif
+	init_completion(&(ldata->timed.done));
+	INIT_DELAYED_WORK(&(ldata->beacon.work), loraspi_beacon_work);
+	ldata->maxpayload = SX127X_MAX_FIFO_LENGTH;
+	sx127X_fifo_init(&(ldata->fifo), ldata->maxpayload);
 	mutex_lock(&minors_lock);
 	minor = find_first_zero_bit(minors, N_LORASPI_MINORS);
 	if (minor < N_LORASPI_MINORS) {
-		set_bit(minor, minors);
 		lrdata->devt = MKDEV(lr_driver.major, minor);
+		/* The counters are ready before the statistics are shown. */
+		status = lora_device_add(lrdata);
+	}
+	else {
+		/* No more lora device available. */
+		status = -ENODEV;
+	}
+
+	if (status == 0) {
+		set_bit(minor, minors);
 		dev = device_create(lr_driver.lora_class,
 				&(spi->dev),
 				lrdata->devt,
 				lrdata,
 				"loraSPI%d.%d",
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+				spi->controller->bus_num,
+				spi_get_chipselect(spi, 0));
+#else
 				spi->master->bus_num, spi->chip_select);
+#endif
 		/* Set the SPI device's driver data for later use.  */
 		spi_set_drvdata(spi, lrdata);
-		lora_device_add(lrdata);
 		status = PTR_ERR_OR_ZERO(dev);
+		if (status == 0) {
+			lora_device_debugfs(&lr_driver, lrdata, dev_name(dev));
+			if (lora_device_netdev(&lr_driver, lrdata, dev))
+				dev_warn(&(spi->dev), "no network interface\n");
+		}
 	}
 	else {
-		/* No more lora device available. */
-		kfree(lrdata);
-		status = -ENODEV;
+		kfree(ldata);
 	}
 	
 	/* Initial the SX127X chip. */
@@ -744,29 +2289,40 @@ static int loraspi_probe(struct spi_device *spi)
 }
 
 /* The SPI remove callback function. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+static void loraspi_remove(struct spi_device *spi)
+#else
 static int loraspi_remove(struct spi_device *spi)
+#endif
 {
 	struct lora_struct *lrdata;
 	
 	dev_info(&(spi->dev), "remove a LoRa SPI device");
 
 	lrdata = spi_get_drvdata(spi);
+	/* Stop the periodic and the timed state setting, if there are. */
+	cancel_delayed_work_sync(&(to_loraspi(lrdata)->beacon.work));
+	hrtimer_cancel(&(to_loraspi(lrdata)->timed.timer));
 
-	/* Clear the lora device's data. */
-	lrdata->lora_device = NULL;
-	/* No more operations to the lora device from user space. */
-	lora_device_remove(lrdata);
 	mutex_lock(&minors_lock);
+	/* The statistics go away before their counters. */
 	device_destroy(lr_driver.lora_class, lrdata->devt);
 	clear_bit(MINOR(lrdata->devt), minors);
+	/* No more operations to the lora device from user space. */
+	lora_device_remove(lrdata);
+	/* Clear the lora device's data, the network interface is gone. */
+	lrdata->lora_device = NULL;
 	/* Set the SX127X chip to sleep. */
 	sx127X_setState(spi, SX127X_SLEEP_MODE);
 	mutex_unlock(&minors_lock);
 
-	/* Free the memory of the lora device.  */
-	kfree(lrdata);
-	
+	/* Wipe the keys and free the memory of the lora device.  */
+	lora_crypto_free(to_loraspi(lrdata)->crypto);
+	kfree(to_loraspi(lrdata));
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 18, 0)
+
 	return 0;
+#endif
 }
 
 /* The SPI driver which acts as a protocol driver in this kernel module. */
@@ -39,10 +39,118 @@
 #ifndef __LORA_SPI_H__
 #define __LORA_SPI_H__
 
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/spi/spi.h>
+
 #include "lora.h"
+#include "sx1278_fifo.h"
+
+struct lora_crypto;
+
+/**
+ * struct loraspi_timed: Set the chip's state by a timer at a designated time
+ * @timer:		The timer fires at the designated time
+ * @m:			The prepared SPI message going to set the chip's state
+ * @t:			The SPI transfer of the prepared SPI message
+ * @cmd:		The OP mode register address and the value of the state
+ * @done:		Completed after the chip's state has been set
+ * @clockid:		The clock of the designated time
+ * @achieved:		The time of the state has been set in the clock
+ * @mono:		The time of the state has been set in CLOCK_MONOTONIC
+ */
+struct loraspi_timed {
+	struct hrtimer timer;
+	struct spi_message m;
+	struct spi_transfer t;
+	uint8_t cmd[2];
+	struct completion done;
+	clockid_t clockid;
+	ktime_t achieved;
+	ktime_t mono;
+};
+
+/**
+ * struct loraspi_txtime: The scheduled TX of a LoRa SPI device
+ * @req:		The requested start time of the next TX
+ * @status:		The accounting of the scheduled TX
+ */
+struct loraspi_txtime {
+	struct lora_txtime req;
+	struct lora_txtime_status status;
+};
+
+/**
+ * struct loraspi_rxwin: The RX windows opened after each TX
+ * @req:		The parameters of the RX windows
+ * @status:		The result of the last RX windows
+ */
+struct loraspi_rxwin {
+	struct lora_rxwin req;
+	struct lora_rxwin_status status;
+};
+
+/**
+ * struct loraspi_beacon: The resident frame sent again and again
+ * @req:		The resident frame and how it is sent
+ * @status:		The accounting of the resident frame
+ * @work:		Send the resident frame periodically
+ * @next:		The CLOCK_MONOTONIC time of the next periodic send
+ * @fresh:		The counter in the FIFO has not been sent yet
+ */
+struct loraspi_beacon {
+	struct lora_beacon req;
+	struct lora_beacon_status status;
+	struct delayed_work work;
+	ktime_t next;
+	uint8_t fresh;
+};
+
+/**
+ * struct loraspi_data: LoRa SPI device
+ * @lrdata:		The LoRa device registered into the LoRa framework
+ * @timed:		Set the chip's state at a designated time
+ * @txtime:		The scheduled TX
+ * @rxwin:		The RX windows after TX
+ * @implicit:		The fixed payload length in Implicit Header Mode,
+ *			0 for Explicit Header Mode
+ * @maxpayload:		The max payload length of the RX packets
+ * @fifo:		The allocator of the chip's FIFO
+ * @beacon:		The resident frame pinned in the chip's FIFO
+ * @crypto:		The keys of the secured frames, NULL for plain frames
+ * @tx_id:		The trace id of the packet being sent
+ * @rx_pkt:		The FIFO record of the packet last received
+ * @tx_ns:		The time the packet being sent was written in ns
+ * @rx_ns:		The time the packet last received was available to
+ *			the reader in ns
+ * @txdone_ns:		The time the packet last sent left the air in ns
+ */
+struct loraspi_data {
+	struct lora_struct lrdata;
+	struct loraspi_timed timed;
+	struct loraspi_txtime txtime;
+	struct loraspi_rxwin rxwin;
+	uint8_t implicit;
+	uint8_t maxpayload;
+	struct sx127X_fifo fifo;
+	struct loraspi_beacon beacon;
+	struct lora_crypto *crypto;
+	uint32_t tx_id;
+	struct sx127X_fifo_pkt rx_pkt;
+	u64 tx_ns;
+	u64 rx_ns;
+	u64 txdone_ns;
+};
+
+#define to_loraspi(lr)	container_of(lr, struct loraspi_data, lrdata)
 
 extern int lora_device_add(struct lora_struct *);
 extern int lora_device_remove(struct lora_struct *);
+extern void lora_device_debugfs(struct lora_driver *, struct lora_struct *,
+				const char *);
+extern int lora_device_netdev(struct lora_driver *, struct lora_struct *,
+			      struct device *);
 extern int lora_register_driver(struct lora_driver *);
 extern int lora_unregister_driver(struct lora_driver *);
 
@@ -0,0 +1,318 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_SPI_BUDGET_H__
+#define __LORA_SPI_BUDGET_H__
+
+#include "lora.h"
+#include "sx1278.h"
+
+/*
+ * The SPI bus budget of each public operation of the LoRa SPI driver.  The
+ * table and the runner are shared by the KUnit suite in lora_spi_kunit.c
+ * and the user space build in emulator/spi-budget.c, both count the
+ * transactions and the bytes on a fake SPI controller.  A budget is the cost
+ * measured when it was set, so a change making an operation cost more SPI
+ * transactions or bytes fails the suite until the budget is raised on
+ * purpose.
+ */
+
+/* The kinds of the operations. */
+enum lora_spi_budget_kind {
+	LORA_SPI_BUDGET_SETSTATE,	/* sx127X_setState() */
+	LORA_SPI_BUDGET_READ,		/* sx127X_readLoRaData() */
+	LORA_SPI_BUDGET_SEND,		/* sx127X_sendLoRaData() */
+	LORA_SPI_BUDGET_IOCTL,		/* An ioctl handler of lora_operations */
+	LORA_SPI_BUDGET_CHIPSTAT,	/* lora_operations' getChipStat */
+	LORA_SPI_BUDGET_TX,		/* A full TX cycle, lora_operations' xmit */
+	LORA_SPI_BUDGET_RX,		/* A full RX cycle, lora_operations' recv */
+};
+
+/* The setup of an operation, which is not counted. */
+#define LORA_SPI_BUDGET_RXPKT		0x01	/* A packet waits in RX state */
+#define LORA_SPI_BUDGET_BEACON		0x02	/* The resident frame is set */
+
+/* The payload length of the sent & received packets. */
+#define LORA_SPI_BUDGET_PKTLEN		32
+/* The length of the kernel buffer of the operations. */
+#define LORA_SPI_BUDGET_BUFLEN		256
+
+/**
+ * struct lora_spi_budget: An operation with its budget
+ * @name:		The name of the operation
+ * @kind:		The kind of the operation
+ * @op:			The offset of the ioctl handler in lora_operations
+ * @arg:		The argument copied into the user buffer, or NULL
+ * @len:		The length of the argument in bytes
+ * @setup:		LORA_SPI_BUDGET_RXPKT | LORA_SPI_BUDGET_BEACON
+ * @xfers:		The max SPI transactions of a call
+ * @bytes:		The max SPI bytes of a call, with the addresses
+ */
+struct lora_spi_budget {
+	const char *name;
+	enum lora_spi_budget_kind kind;
+	size_t op;
+	const void *arg;
+	size_t len;
+	unsigned int setup;
+	unsigned long xfers;
+	unsigned long bytes;
+};
+
+/**
+ * struct lora_spi_budget_env: Where the operations run
+ * @spi:		The SPI device on the counting controller
+ * @lrdata:		The LoRa device probed on the SPI device
+ * @arg:		The user buffer passed to the ioctl handlers
+ * @buf:		The kernel buffer of LORA_SPI_BUDGET_BUFLEN bytes
+ * @put:		Copy the argument into the user buffer
+ * @receive:		Let the chip receive a packet from the air
+ * @reset:		Reset the counters of the controller
+ * @count:		Read the counters of the controller
+ */
+struct lora_spi_budget_env {
+	struct spi_device *spi;
+	struct lora_struct *lrdata;
+	void __user *arg;
+	uint8_t *buf;
+	int (*put)(struct lora_spi_budget_env *, const void *, size_t);
+	void (*receive)(struct lora_spi_budget_env *, const uint8_t *, size_t);
+	void (*reset)(struct lora_spi_budget_env *);
+	void (*count)(struct lora_spi_budget_env *,
+		      unsigned long *, unsigned long *);
+};
+
+/* The arguments of the ioctl handlers, all of them valid. */
+static const uint32_t lora_spi_budget_state = LORA_STATE_STANDBY;
+static const uint32_t lora_spi_budget_rx = LORA_STATE_RX;
+static const uint32_t lora_spi_budget_freq = 434000000;
+static const int32_t lora_spi_budget_power = 14;
+static const uint32_t lora_spi_budget_sprf = 128;
+static const uint32_t lora_spi_budget_bw = 125000;
+static const uint32_t lora_spi_budget_cr = 5;
+static const uint32_t lora_spi_budget_crc = 1;
+static const uint32_t lora_spi_budget_implicit;
+static const uint32_t lora_spi_budget_maxpayload = 255;
+static const struct lora_txtime lora_spi_budget_txtime = {
+	.clockid = CLOCK_MONOTONIC,
+};
+static const struct lora_rxwin lora_spi_budget_rxwin;
+static const struct lora_beacon lora_spi_budget_beacon = {
+	.len = LORA_SPI_BUDGET_PKTLEN,
+	.patch_len = 2,
+};
+static const struct lora_key lora_spi_budget_key;
+
+#define LORA_SPI_BUDGET_CHIP(_name, _kind, _setup, _xfers, _bytes)	\
+	{ .name = _name, .kind = _kind, .setup = _setup,		\
+	  .xfers = _xfers, .bytes = _bytes }
+
+#define LORA_SPI_BUDGET_IOC(_op, _arg, _setup, _xfers, _bytes)	\
+	{ .name = #_op, .kind = LORA_SPI_BUDGET_IOCTL,			\
+	  .op = offsetof(struct lora_operations, _op),			\
+	  .arg = _arg, .len = sizeof(*(_arg)), .setup = _setup,		\
+	  .xfers = _xfers, .bytes = _bytes }
+
+#define LORA_SPI_BUDGET_GET(_op, _setup, _xfers, _bytes)		\
+	{ .name = #_op, .kind = LORA_SPI_BUDGET_IOCTL,			\
+	  .op = offsetof(struct lora_operations, _op),			\
+	  .setup = _setup, .xfers = _xfers, .bytes = _bytes }
+
+/* The operations and their budgets. */
+static const struct lora_spi_budget lora_spi_budgets[] = {
+	LORA_SPI_BUDGET_CHIP("sx127X_setState", LORA_SPI_BUDGET_SETSTATE,
+			     0, 2, 4),
+	LORA_SPI_BUDGET_CHIP("sx127X_readLoRaData", LORA_SPI_BUDGET_READ,
+			     LORA_SPI_BUDGET_RXPKT, 4, 39),
+	LORA_SPI_BUDGET_CHIP("sx127X_sendLoRaData", LORA_SPI_BUDGET_SEND,
+			     0, 4, 39),
+	LORA_SPI_BUDGET_IOC(setState, &lora_spi_budget_state, 0, 2, 4),
+	LORA_SPI_BUDGET_GET(getState, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setFreq, &lora_spi_budget_freq, 0, 1, 4),
+	LORA_SPI_BUDGET_GET(getFreq, 0, 1, 4),
+	LORA_SPI_BUDGET_IOC(setPower, &lora_spi_budget_power, 0, 1, 2),
+	LORA_SPI_BUDGET_GET(getPower, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setSPRFactor, &lora_spi_budget_sprf, 0,
+			    2, 4),
+	LORA_SPI_BUDGET_GET(getSPRFactor, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setBW, &lora_spi_budget_bw, 0, 2, 4),
+	LORA_SPI_BUDGET_GET(getBW, 0, 1, 2),
+	LORA_SPI_BUDGET_GET(getRSSI, 0, 2, 4),
+	LORA_SPI_BUDGET_GET(getSNR, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setTxTime, &lora_spi_budget_txtime, 0,
+			    0, 0),
+	LORA_SPI_BUDGET_GET(getTxTime, 0, 0, 0),
+	LORA_SPI_BUDGET_IOC(setRxWin, &lora_spi_budget_rxwin, 0, 0, 0),
+	LORA_SPI_BUDGET_GET(getRxWin, 0, 0, 0),
+	LORA_SPI_BUDGET_IOC(setCR, &lora_spi_budget_cr, 0, 2, 4),
+	LORA_SPI_BUDGET_GET(getCR, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setCRC, &lora_spi_budget_crc, 0, 2, 4),
+	LORA_SPI_BUDGET_GET(getCRC, 0, 1, 2),
+	LORA_SPI_BUDGET_IOC(setImplicit, &lora_spi_budget_implicit, 0,
+			    7, 14),
+	LORA_SPI_BUDGET_GET(getImplicit, 0, 0, 0),
+	LORA_SPI_BUDGET_IOC(setMaxPayload, &lora_spi_budget_maxpayload, 0,
+			    1, 2),
+	LORA_SPI_BUDGET_GET(getFIFOStat, 0, 3, 16),
+	LORA_SPI_BUDGET_IOC(setBeacon, &lora_spi_budget_beacon, 0,
+			    11, 55),
+	LORA_SPI_BUDGET_GET(sendBeacon, LORA_SPI_BUDGET_BEACON, 18, 49),
+	LORA_SPI_BUDGET_GET(getBeacon, 0, 0, 0),
+	LORA_SPI_BUDGET_IOC(setKey, &lora_spi_budget_key, 0, 0, 0),
+	LORA_SPI_BUDGET_GET(getCryptoStat, 0, 0, 0),
+	LORA_SPI_BUDGET_GET(getPktStat, LORA_SPI_BUDGET_RXPKT, 1, 2),
+	LORA_SPI_BUDGET_CHIP("getChipStat", LORA_SPI_BUDGET_CHIPSTAT,
+			     0, 1, 5),
+	LORA_SPI_BUDGET_CHIP("tx_cycle", LORA_SPI_BUDGET_TX, 0, 23, 91),
+	LORA_SPI_BUDGET_CHIP("rx_cycle", LORA_SPI_BUDGET_RX,
+			     LORA_SPI_BUDGET_RXPKT, 6, 53),
+};
+
+/**
+ * lora_spi_budget_open - Get the buffers of the LoRa device as opening it
+ * @lrdata:	LoRa device
+ *
+ * Return:	0 / -ENOMEM for success / failed
+ */
+static inline int
+lora_spi_budget_open(struct lora_struct *lrdata)
+{
+	lrdata->rx_buf = kzalloc(LORA_SPI_BUDGET_BUFLEN, GFP_KERNEL);
+	lrdata->tx_buf = kzalloc(LORA_SPI_BUDGET_BUFLEN, GFP_KERNEL);
+	if ((lrdata->rx_buf == NULL) || (lrdata->tx_buf == NULL))
+		return -ENOMEM;
+	/* The same as lora.c opening the device. */
+	lrdata->bufmaxlen = LORA_SPI_BUDGET_BUFLEN - 1;
+
+	return 0;
+}
+
+/* Put back the buffers of the LoRa device as releasing it. */
+static inline void
+lora_spi_budget_release(struct lora_struct *lrdata)
+{
+	kfree(lrdata->rx_buf);
+	kfree(lrdata->tx_buf);
+	lrdata->rx_buf = NULL;
+	lrdata->tx_buf = NULL;
+}
+
+/**
+ * lora_spi_budget_run - Run an operation and check its budget
+ * @env:	where the operation runs
+ * @b:		the operation with its budget
+ * @xfers:	the buffer going to hold the counted transactions
+ * @bytes:	the buffer going to hold the counted bytes
+ *
+ * Return:	0 / -E2BIG / other negative number for within / over the
+ *		budget / the operation failed
+ */
+static inline long
+lora_spi_budget_run(struct lora_spi_budget_env *env,
+		    const struct lora_spi_budget *b,
+		    unsigned long *xfers, unsigned long *bytes)
+{
+	struct lora_struct *lrdata = env->lrdata;
+	struct lora_operations *ops = lrdata->ops;
+	long (*ioc)(struct lora_struct *, void __user *);
+	struct lora_stats st;
+	long ret;
+	int i;
+
+	/* Bring the device to where the operation starts, not counted. */
+	if (b->setup & LORA_SPI_BUDGET_BEACON) {
+		env->put(env, &lora_spi_budget_beacon,
+			 sizeof(lora_spi_budget_beacon));
+		ret = ops->setBeacon(lrdata, env->arg);
+		if (ret < 0)
+			return ret;
+	}
+	if (b->setup & LORA_SPI_BUDGET_RXPKT) {
+		env->put(env, &lora_spi_budget_rx, sizeof(lora_spi_budget_rx));
+		ops->setState(lrdata, env->arg);
+		for (i = 0; i < LORA_SPI_BUDGET_PKTLEN; i++)
+			env->buf[i] = i;
+		env->receive(env, env->buf, LORA_SPI_BUDGET_PKTLEN);
+	}
+	if (b->arg != NULL)
+		env->put(env, b->arg, b->len);
+	for (i = 0; i < LORA_SPI_BUDGET_PKTLEN; i++)
+		env->buf[i] = 0xA5 ^ i;
+
+	env->reset(env);
+	switch (b->kind) {
+	case LORA_SPI_BUDGET_SETSTATE:
+		sx127X_setState(env->spi, SX127X_STANDBY_MODE);
+		ret = 0;
+		break;
+	case LORA_SPI_BUDGET_READ:
+		ret = sx127X_readLoRaData(env->spi, env->buf,
+					  LORA_SPI_BUDGET_BUFLEN);
+		break;
+	case LORA_SPI_BUDGET_SEND:
+		ret = sx127X_sendLoRaData(env->spi, env->buf,
+					  LORA_SPI_BUDGET_PKTLEN);
+		break;
+	case LORA_SPI_BUDGET_IOCTL:
+		memcpy(&ioc, (uint8_t *)ops + b->op, sizeof(ioc));
+		ret = ioc(lrdata, env->arg);
+		break;
+	case LORA_SPI_BUDGET_CHIPSTAT:
+		memset(&st, 0, sizeof(st));
+		ret = ops->getChipStat(lrdata, &st);
+		break;
+	case LORA_SPI_BUDGET_TX:
+		ret = ops->xmit(lrdata, env->buf, LORA_SPI_BUDGET_PKTLEN);
+		break;
+	case LORA_SPI_BUDGET_RX:
+		ret = ops->recv(lrdata, env->buf, LORA_SPI_BUDGET_BUFLEN);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+	env->count(env, xfers, bytes);
+
+	if (ret < 0)
+		return ret;
+	if ((*xfers > b->xfers) || (*bytes > b->bytes))
+		return -E2BIG;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <kunit/test.h>
+#include <kunit/device.h>
+#include <linux/spi/spi.h>
+#include <linux/mman.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <asm/uaccess.h>
+
+#include "lora_spi_budget.h"
+/* The register model of the user space emulator serves the fake bus. */
+#include "../emulator/sx127x-model.c"
+
+/*
+ * The SPI bus budget suite of the LoRa SPI driver as KUnit.  It is linked
+ * into the module only with "make KUNIT=1".  A fake SPI controller counts
+ * the messages and the bytes going through it, and shifts them through the
+ * SX127x register model, whose time follows the real time.
+ */
+
+/* The signal of the received packets. */
+#define LORASPI_KUNIT_RSSI	-80	/* dBm */
+#define LORASPI_KUNIT_SNR	28	/* 0.25 dB */
+
+/**
+ * struct loraspi_kunit_bus: The fake SPI controller with an SX127x
+ * @env:		The environment of the budget runner
+ * @lock:		Serializes the model between the bus & the test
+ * @chip:		The register model of the chip
+ * @last:		The time the model has been advanced to
+ * @xfers:		The counted SPI messages
+ * @bytes:		The counted SPI bytes
+ */
+struct loraspi_kunit_bus {
+	struct lora_spi_budget_env env;
+	struct mutex lock;
+	struct sx127x_model chip;
+	ktime_t last;
+	unsigned long xfers;
+	unsigned long bytes;
+};
+
+/* Advance the model to now, the caller holds the lock. */
+static void
+loraspi_kunit_advance(struct loraspi_kunit_bus *bus)
+{
+	ktime_t now;
+
+	now = ktime_get();
+	sx127x_model_advance(&(bus->chip),
+			     ktime_to_us(ktime_sub(now, bus->last)));
+	bus->last = now;
+}
+
+/* Shift an SPI message through the model as one chip select. */
+static int
+loraspi_kunit_transfer(struct spi_controller *ctlr, struct spi_message *m)
+{
+	struct loraspi_kunit_bus *bus = spi_controller_get_devdata(ctlr);
+	struct spi_transfer *t;
+	const uint8_t *tx;
+	uint8_t *rx;
+	uint8_t b;
+	unsigned int i;
+
+	mutex_lock(&(bus->lock));
+	loraspi_kunit_advance(bus);
+	sx127x_model_select(&(bus->chip));
+	list_for_each_entry(t, &(m->transfers), transfer_list) {
+		tx = t->tx_buf;
+		rx = t->rx_buf;
+		for (i = 0; i < t->len; i++) {
+			b = sx127x_model_shift(&(bus->chip),
+					       (tx != NULL) ? tx[i] : 0);
+			if (rx != NULL)
+				rx[i] = b;
+		}
+		m->actual_length += t->len;
+		bus->bytes += t->len;
+	}
+	bus->xfers++;
+	mutex_unlock(&(bus->lock));
+
+	m->status = 0;
+	spi_finalize_current_message(ctlr);
+
+	return 0;
+}
+
+static int
+loraspi_kunit_put(struct lora_spi_budget_env *env, const void *arg, size_t len)
+{
+	if (clear_user(env->arg, PAGE_SIZE))
+		return -EFAULT;
+
+	return copy_to_user(env->arg, arg, len) ? -EFAULT : 0;
+}
+
+static void
+loraspi_kunit_receive(struct lora_spi_budget_env *env, const uint8_t *buf,
+		      size_t len)
+{
+	struct loraspi_kunit_bus *bus;
+
+	bus = container_of(env, struct loraspi_kunit_bus, env);
+	mutex_lock(&(bus->lock));
+	loraspi_kunit_advance(bus);
+	sx127x_model_receive(&(bus->chip), buf, len,
+			     LORASPI_KUNIT_RSSI, LORASPI_KUNIT_SNR, 0);
+	mutex_unlock(&(bus->lock));
+}
+
+static void
+loraspi_kunit_reset(struct lora_spi_budget_env *env)
+{
+	struct loraspi_kunit_bus *bus;
+
+	bus = container_of(env, struct loraspi_kunit_bus, env);
+	mutex_lock(&(bus->lock));
+	bus->xfers = 0;
+	bus->bytes = 0;
+	mutex_unlock(&(bus->lock));
+}
+
+static void
+loraspi_kunit_count(struct lora_spi_budget_env *env, unsigned long *xfers,
+		    unsigned long *bytes)
+{
+	struct loraspi_kunit_bus *bus;
+
+	bus = container_of(env, struct loraspi_kunit_bus, env);
+	mutex_lock(&(bus->lock));
+	*xfers = bus->xfers;
+	*bytes = bus->bytes;
+	mutex_unlock(&(bus->lock));
+}
+
+/* Run each operation of the table against its budget. */
+static void
+loraspi_kunit_budget(struct kunit *test)
+{
+	struct spi_board_info info = {
+		.modalias = "lora-spi",
+		.max_speed_hz = 10000000,
+	};
+	struct spi_controller *ctlr;
+	struct loraspi_kunit_bus *bus;
+	struct spi_device *spi;
+	struct device *dev;
+	const struct lora_spi_budget *b;
+	unsigned long xfers, bytes;
+	unsigned long uaddr;
+	size_t i;
+	long ret;
+
+	dev = kunit_device_register(test, "lora-spi-kunit");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+	ctlr = spi_alloc_master(dev, sizeof(struct loraspi_kunit_bus));
+	KUNIT_ASSERT_NOT_NULL(test, ctlr);
+	bus = spi_controller_get_devdata(ctlr);
+	mutex_init(&(bus->lock));
+	sx127x_model_init(&(bus->chip));
+	bus->last = ktime_get();
+	ctlr->bus_num = -1;
+	ctlr->num_chipselect = 1;
+	ctlr->transfer_one_message = loraspi_kunit_transfer;
+	ret = spi_register_controller(ctlr);
+	if (ret)
+		spi_controller_put(ctlr);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	/* The driver of this module binds the device as it is added. */
+	spi = spi_new_device(ctlr, &info);
+	KUNIT_ASSERT_NOT_NULL(test, spi);
+	KUNIT_ASSERT_NOT_NULL(test, spi_get_drvdata(spi));
+
+	uaddr = kunit_vm_mmap(test, NULL, 0, PAGE_SIZE,
+			      PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+			      0);
+	KUNIT_ASSERT_NE_MSG(test, uaddr, 0, "No user memory");
+
+	bus->env.spi = spi;
+	bus->env.lrdata = spi_get_drvdata(spi);
+	bus->env.arg = (void __user *)uaddr;
+	bus->env.buf = kunit_kzalloc(test, LORA_SPI_BUDGET_BUFLEN, GFP_KERNEL);
+	bus->env.put = loraspi_kunit_put;
+	bus->env.receive = loraspi_kunit_receive;
+	bus->env.reset = loraspi_kunit_reset;
+	bus->env.count = loraspi_kunit_count;
+	KUNIT_ASSERT_NOT_NULL(test, bus->env.buf);
+	KUNIT_ASSERT_EQ(test, lora_spi_budget_open(bus->env.lrdata), 0);
+
+	for (i = 0; i < ARRAY_SIZE(lora_spi_budgets); i++) {
+		b = &(lora_spi_budgets[i]);
+		ret = lora_spi_budget_run(&(bus->env), b, &xfers, &bytes);
+		KUNIT_EXPECT_TRUE_MSG(test, (ret == 0) || (ret == -E2BIG),
+				      "%s failed with %ld", b->name, ret);
+		KUNIT_EXPECT_LE_MSG(test, xfers, b->xfers,
+				    "%s is over the budget of SPI transactions",
+				    b->name);
+		KUNIT_EXPECT_LE_MSG(test, bytes, b->bytes,
+				    "%s is over the budget of SPI bytes",
+				    b->name);
+	}
+
+	lora_spi_budget_release(bus->env.lrdata);
+	spi_unregister_device(spi);
+	spi_unregister_controller(ctlr);
+}
+
+static struct kunit_case loraspi_kunit_cases[] = {
+	KUNIT_CASE(loraspi_kunit_budget),
+	{}
+};
+
+static struct kunit_suite loraspi_kunit_suite = {
+	.name = "lora-spi-budget",
+	.test_cases = loraspi_kunit_cases,
+};
+
+kunit_test_suite(loraspi_kunit_suite);
@@ -40,9 +40,14 @@
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/spi/spi.h>
+#include <linux/ktime.h>
 #include <asm/div64.h>
 
 #include "sx1278.h"
+#include "lora.h"
+
+#define CREATE_TRACE_POINTS
+#include "sx1278_trace.h"
 
 #ifndef F_XOSC
 #define F_XOSC		32000000
@@ -62,12 +67,25 @@ ssize_t
 sx127X_sync(struct spi_device *spi, struct spi_message *m)
 {
 	DECLARE_COMPLETION_ONSTACK(done);
+	struct lora_struct *lrdata;
 	int status;
+	u64 t;
 
 	if (spi == NULL)
-		status = -ESHUTDOWN;
-	else
-		status = spi_sync(spi, m);
+		return -ESHUTDOWN;
+
+	t = ktime_get_ns();
+	status = spi_sync(spi, m);
+	t = ktime_get_ns() - t;
+
+	trace_sx127x_sync(spi, m, status, t);
+
+	/* The LoRa SPI device is the SPI device's driver data. */
+	lrdata = spi_get_drvdata(spi);
+	lora_hist_add(lrdata, LORA_HIST_SPI, t);
+	lora_stats_inc(lrdata, spi_transactions);
+	if (status != 0)
+		lora_stats_inc(lrdata, spi_errors);
 
 	if (status == 0)
 		status = m->actual_length;
@@ -209,6 +227,7 @@ sx127X_setState(struct spi_device *spi, uint8_t st)
 
 	/* Get original OP Mode register. */
 	op_mode = sx127X_getMode(spi);
+	trace_sx127x_state(spi, op_mode, st);
 	/* Set device to designated state. */
 	op_mode = (op_mode & 0xF8) | (st & 0x07);
 	sx127X_write_reg(spi, SX127X_REG_OP_MODE, &op_mode, 1);
@@ -382,6 +401,7 @@ sx127X_getLoRaAllFlag(struct spi_device *spi)
 	uint8_t flags;
 
 	sx127X_read_reg(spi, SX127X_REG_IRQ_FLAGS, &flags, 1);
+	trace_sx127x_flags(spi, flags, 0);
 
 	return flags;
 }
@@ -394,13 +414,9 @@ sx127X_getLoRaAllFlag(struct spi_device *spi)
 void
 sx127X_clearLoRaFlag(struct spi_device *spi, uint8_t f)
 {
-	uint8_t flag;
-
-	/* Get oiginal flag. */
-	flag = sx127X_getLoRaAllFlag(spi);
-	/* Set the designated bits of the flag. */
-	flag |= f;
-	sx127X_write_reg(spi, SX127X_REG_IRQ_FLAGS, &flag, 1);
+	/* Writing 1 clears the flag, so the other flags are left as 0. */
+	sx127X_write_reg(spi, SX127X_REG_IRQ_FLAGS, &f, 1);
+	trace_sx127x_flags(spi, 0, f);
 }
 
 /**
@@ -507,7 +523,7 @@ sx127X_setLoRaCR(struct spi_device *spi, uint8_t cr)
 	uint8_t mcf1;
 
 	sx127X_read_reg(spi, SX127X_REG_MODEM_CONFIG1, &mcf1, 1);
-	mcf1 = (mcf1 & 0x0E) | (((cr & 0xF) - 4) << 1);
+	mcf1 = (mcf1 & 0xF1) | (((cr & 0xF) - 4) << 1);
 	sx127X_write_reg(spi, SX127X_REG_MODEM_CONFIG1, &mcf1, 1);
 }
 
@@ -545,6 +561,35 @@ sx127X_setLoRaImplicit(struct spi_device *spi, uint8_t yesno)
 	sx127X_write_reg(spi, SX127X_REG_MODEM_CONFIG1, &mcf1, 1);
 }
 
+/**
+ * sx127X_getLoRaImplicit - Get LoRa packages in Explicit / Implicit Header Mode
+ * @spi:	spi device to communicate with
+ *
+ * Return:	1 / 0 for Implicit Header Mode / Explicit Header Mode
+ */
+uint8_t
+sx127X_getLoRaImplicit(struct spi_device *spi)
+{
+	uint8_t mcf1;
+
+	sx127X_read_reg(spi, SX127X_REG_MODEM_CONFIG1, &mcf1, 1);
+
+	return mcf1 & 0x01;
+}
+
+/**
+ * sx127X_setLoRaPayloadLen - Set the payload length in LoRa packet
+ * @spi:	spi device to communicate with
+ * @len:	the payload length going to be assigned in bytes
+ *
+ * The payload length must be set before RX in Implicit Header Mode.
+ */
+void
+sx127X_setLoRaPayloadLen(struct spi_device *spi, uint8_t len)
+{
+	sx127X_write_reg(spi, SX127X_REG_PAYLOAD_LENGTH, &len, 1);
+}
+
 /**
  * sx127X_setLoRaRXByteTimeout - Get RX operation time-out in terms of symbols
  * @spi:	spi device to communicate with
@@ -683,7 +728,6 @@ sx127X_sendLoRaData(struct spi_device *spi, uint8_t *buf, size_t len)
 	sx127X_read_reg(spi, SX127X_REG_FIFO_TX_BASE_ADDR, &base_adr, 1);
 	sx127X_write_reg(spi, SX127X_REG_FIFO_ADDR_PTR, &base_adr, 1);
 
-#define SX127X_MAX_FIFO_LENGTH	0xFF
 	blen = (len < SX127X_MAX_FIFO_LENGTH) ? len : SX127X_MAX_FIFO_LENGTH;
 
 	/* Write to SPI chip synchronously to fill the FIFO of the chip. */
@@ -807,6 +851,91 @@ sx127X_setLoRaCRC(struct spi_device *spi, uint8_t yesno)
 	sx127X_write_reg(spi, SX127X_REG_MODEM_CONFIG2, &mcf2, 1);
 }
 
+/**
+ * sx127X_getLoRaCRC - Get CRC generation and check on received payload
+ * @spi:	spi device to communicate with
+ *
+ * Return:	1 / 0 for check / not check
+ */
+uint8_t
+sx127X_getLoRaCRC(struct spi_device *spi)
+{
+	uint8_t mcf2;
+
+	sx127X_read_reg(spi, SX127X_REG_MODEM_CONFIG2, &mcf2, 1);
+
+	return (mcf2 >> 2) & 0x01;
+}
+
+/**
+ * sx127X_calcLoRaAirTime - Calculate the time on air of a LoRa packet
+ * @sprf:	spreading factor in chips / symbol
+ * @bw:		RF bandwidth in Hz
+ * @cr:		coding rate in a byte, high 4 bits / low 4 bits: numerator /
+ * 		denominator
+ * @prelen:	the preamble length in symbols
+ * @implicit:	1 / 0 for Implicit Header Mode / Explicit Header Mode
+ * @crc:	1 / 0 for with / without payload CRC
+ * @ldro:	1 / 0 for low data rate optimization enabled / disabled
+ * @len:	the payload length in bytes
+ *
+ * Return:	the time on air in us
+ */
+uint32_t
+sx127X_calcLoRaAirTime(uint32_t sprf, uint32_t bw, uint8_t cr, uint32_t prelen,
+		       uint8_t implicit, uint8_t crc, uint8_t ldro, size_t len)
+{
+	int32_t sf;
+	int32_t num, den;
+	uint32_t nsym;
+	uint64_t t;
+
+	sf = 6;
+	while ((sf < 12) && (((uint32_t)1 << sf) < sprf))
+		sf++;
+	if (bw == 0)
+		return 0;
+
+	/* The payload symbols from the Semtech's time on air formula. */
+	num = 8 * (int32_t)len - 4 * sf + 28 + 16 * (crc ? 1 : 0)
+		- 20 * (implicit ? 1 : 0);
+	den = 4 * (sf - 2 * (ldro ? 1 : 0));
+	nsym = 8;
+	if (num > 0)
+		nsym += ((num + den - 1) / den) * (cr & 0x0F);
+
+	/* The preamble lasts for (prelen + 4.25) symbols. */
+	t = ((uint64_t)(4 * prelen + 17) + 4 * (uint64_t)nsym)
+		* ((uint64_t)1 << sf) * 1000000;
+	do_div(t, 4 * bw);
+
+	return t;
+}
+
+/**
+ * sx127X_getLoRaAirTime - Get the time on air of a LoRa packet
+ * @spi:	spi device to communicate with
+ * @len:	the payload length in bytes
+ *
+ * Return:	the time on air in us with current modem settings
+ */
+uint32_t
+sx127X_getLoRaAirTime(struct spi_device *spi, size_t len)
+{
+	uint8_t mcf[3];
+	uint32_t bw;
+
+	sx127X_read_reg(spi, SX127X_REG_MODEM_CONFIG1, mcf, 2);
+	sx127X_read_reg(spi, SX127X_REG_MODEM_CONFIG3, &(mcf[2]), 1);
+	bw = ((mcf[0] >> 4) < ARRAY_SIZE(hz)) ? hz[mcf[0] >> 4] : 0;
+
+	return sx127X_calcLoRaAirTime((uint32_t)1 << (mcf[1] >> 4), bw,
+				      0x40 + ((mcf[0] & 0x0E) >> 1) + 4,
+				      sx127X_getLoRaPreambleLen(spi),
+				      mcf[0] & 0x01, (mcf[1] >> 2) & 0x01,
+				      (mcf[2] >> 3) & 0x01, len);
+}
+
 /**
  * sx127X_setBoost - Set RF power amplifier boost in normal output range
  * @spi:	spi device to communicate with
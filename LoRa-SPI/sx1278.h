@@ -93,6 +93,9 @@
 #define SX127X_REG_AGC_THRESH3			0x64
 #define SX127X_REG_PLL				0x70
 
+/* SX127X's FIFO data buffer */
+#define SX127X_MAX_FIFO_LENGTH			0xFF
+
 /* SX127X's operating states in LoRa mode */
 #define SX127X_SLEEP_MODE			0x00
 #define SX127X_STANDBY_MODE			0x01
@@ -193,6 +196,18 @@ sx127X_getLoRaCR(struct spi_device *spi);
 void
 sx127X_setLoRaImplicit(struct spi_device *spi, uint8_t yesno);
 
+uint8_t
+sx127X_getLoRaImplicit(struct spi_device *spi);
+
+void
+sx127X_setLoRaPayloadLen(struct spi_device *spi, uint8_t len);
+
+void
+sx127X_setLoRaRXByteTimeout(struct spi_device *spi, uint32_t n);
+
+uint32_t
+sx127X_getLoRaRXByteTimeout(struct spi_device *spi);
+
 void
 sx127X_setLoRaRXTimeout(struct spi_device *spi, uint32_t ms);
 
@@ -226,6 +241,16 @@ sx127X_getLoRaPreambleLen(struct spi_device *spi);
 void
 sx127X_setLoRaCRC(struct spi_device *spi, uint8_t yesno);
 
+uint8_t
+sx127X_getLoRaCRC(struct spi_device *spi);
+
+uint32_t
+sx127X_calcLoRaAirTime(uint32_t sprf, uint32_t bw, uint8_t cr, uint32_t prelen,
+		       uint8_t implicit, uint8_t crc, uint8_t ldro, size_t len);
+
+uint32_t
+sx127X_getLoRaAirTime(struct spi_device *spi, size_t len);
+
 void
 sx127X_setBoost(struct spi_device *spi, uint8_t yesno);
 
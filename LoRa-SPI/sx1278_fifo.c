@@ -0,0 +1,530 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/spi/spi.h>
+#include <linux/errno.h>
+#include <linux/ktime.h>
+
+#include "sx1278.h"
+#include "sx1278_fifo.h"
+#include "lora.h"
+#include "sx1278_trace.h"
+
+/**
+ * sx127X_fifo_overlap - Check two areas are overlapped in the FIFO
+ * @a:		the start address of the first area
+ * @alen:	the length of the first area
+ * @b:		the start address of the second area
+ * @blen:	the length of the second area
+ *
+ * The FIFO address wraps around, so does an area across the top.
+ *
+ * Return:	1 / 0 for overlapped / not overlapped
+ */
+static int
+sx127X_fifo_overlap(uint16_t a, uint16_t alen, uint16_t b, uint16_t blen)
+{
+	uint16_t d;
+
+	if ((alen == 0) || (blen == 0))
+		return 0;
+
+	/* Distance from a to b and from b to a along the ring. */
+	d = (b + SX127X_FIFO_SIZE - a) % SX127X_FIFO_SIZE;
+	if (d < alen)
+		return 1;
+	d = (a + SX127X_FIFO_SIZE - b) % SX127X_FIFO_SIZE;
+
+	return d < blen;
+}
+
+/**
+ * sx127X_fifo_remove - Remove an RX packet from the queue
+ * @fifo:	the FIFO allocator
+ * @i:		the index of the RX packet in the queue
+ */
+static void
+sx127X_fifo_remove(struct sx127X_fifo *fifo, uint8_t i)
+{
+	fifo->nrx--;
+	memmove(&(fifo->rx[i]), &(fifo->rx[i + 1]),
+		(fifo->nrx - i) * sizeof(struct sx127X_fifo_pkt));
+}
+
+/**
+ * sx127X_fifo_drop - Drop the RX packets overwritten by an area
+ * @fifo:	the FIFO allocator
+ * @adr:	the start address of the area
+ * @len:	the length of the area
+ */
+static void
+sx127X_fifo_drop(struct sx127X_fifo *fifo, uint16_t adr, uint16_t len)
+{
+	uint8_t i;
+
+	for (i = 0; i < fifo->nrx;) {
+		if (sx127X_fifo_overlap(fifo->rx[i].adr, fifo->rx[i].len,
+					adr, len)) {
+			sx127X_fifo_remove(fifo, i);
+			fifo->stat.rx_overwrites++;
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+/**
+ * sx127X_fifo_place - Place the RX slot for the next packet
+ * @fifo:	the FIFO allocator
+ * @adr:	the address right after the last RX packet
+ *
+ * The RX slot is never across the TX packets or the top of the FIFO.
+ */
+static void
+sx127X_fifo_place(struct sx127X_fifo *fifo, uint16_t adr)
+{
+	uint16_t end;
+
+	end = SX127X_FIFO_SIZE - fifo->res_len - fifo->tx_len;
+	if ((adr + fifo->slot) > end)
+		adr = 0;
+	fifo->rx_adr = adr;
+}
+
+/**
+ * sx127X_fifo_init - Initial the FIFO allocator
+ * @fifo:	the FIFO allocator
+ * @slot:	the max RX packet length in bytes
+ */
+void
+sx127X_fifo_init(struct sx127X_fifo *fifo, uint8_t slot)
+{
+	memset(fifo, 0, sizeof(struct sx127X_fifo));
+	fifo->slot = slot;
+}
+
+/**
+ * sx127X_fifo_reset - Forget all of the packets in the FIFO
+ * @fifo:	the FIFO allocator
+ *
+ * The chip clears the FIFO in sleep state, so are the packets.
+ */
+void
+sx127X_fifo_reset(struct sx127X_fifo *fifo)
+{
+	fifo->nrx = 0;
+	fifo->rx_adr = 0;
+	fifo->tx_len = 0;
+	fifo->res_len = 0;
+	fifo->res_ready = 0;
+	fifo->pkt_cnt = 0;
+}
+
+/**
+ * sx127X_fifo_setslot - Set the bytes reserved for the packet being received
+ * @fifo:	the FIFO allocator
+ * @slot:	the max RX packet length in bytes
+ */
+void
+sx127X_fifo_setslot(struct sx127X_fifo *fifo, uint8_t slot)
+{
+	fifo->slot = slot;
+	sx127X_fifo_place(fifo, fifo->rx_adr);
+}
+
+/**
+ * sx127X_fifo_used - Get the occupancy of the FIFO
+ * @fifo:	the FIFO allocator
+ *
+ * Return:	the bytes used by the queued RX packets and the TX packets
+ */
+size_t
+sx127X_fifo_used(struct sx127X_fifo *fifo)
+{
+	size_t used;
+	uint8_t i;
+
+	used = fifo->res_len + fifo->tx_len;
+	for (i = 0; i < fifo->nrx; i++)
+		used += fifo->rx[i].len;
+
+	return used;
+}
+
+/**
+ * sx127X_fifo_harvest - Queue the received packet and move the RX base
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ *
+ * The RX current address, IRQ flags, RX bytes, the packet counters and the
+ * packet's SNR & RSSI are contiguous registers, so they are polled in one
+ * SPI transaction.
+ *
+ * Return:	the IRQ flags before harvested, negative number for error
+ */
+int
+sx127X_fifo_harvest(struct spi_device *spi, struct sx127X_fifo *fifo)
+{
+	/* From FIFO_RX_CURRENT_ADDR to PKT_RSSI_VALUE. */
+	uint8_t r[11];
+	uint8_t flags;
+	uint8_t clr;
+	uint16_t cnt;
+	uint16_t lost;
+	uint32_t overwrites;
+	int status;
+
+	status = sx127X_read_reg(spi, SX127X_REG_FIFO_RX_CURRENT_ADDR, r, 11);
+	if (status != 11)
+		return (status < 0) ? status : -EIO;
+
+	flags = r[2];
+	clr = flags & (SX127X_FLAG_RXTIMEOUT | SX127X_FLAG_RXDONE |
+		       SX127X_FLAG_PAYLOADCRCERROR | SX127X_FLAG_VALIDHEADER);
+	if (!(flags & SX127X_FLAG_RXDONE)) {
+		if (flags & SX127X_FLAG_RXTIMEOUT) {
+			sx127X_write_reg(spi, SX127X_REG_IRQ_FLAGS, &clr, 1);
+			lora_stats_inc(spi_get_drvdata(spi), rx_timeouts);
+		}
+		trace_sx127x_flags(spi, flags,
+				   (clr & SX127X_FLAG_RXTIMEOUT) ? clr : 0);
+		return flags;
+	}
+
+	/* The counter restarts from 0 whenever the chip enters RX state.
+	 * Packets counted but not harvested have been overwritten. */
+	overwrites = fifo->stat.rx_overwrites;
+	cnt = r[6] * 256 + r[7];
+	lost = (cnt > fifo->pkt_cnt) ? (cnt - fifo->pkt_cnt) : cnt;
+	if (lost > 1)
+		fifo->stat.rx_overwrites += lost - 1;
+	fifo->pkt_cnt = cnt;
+
+	if (flags & SX127X_FLAG_PAYLOADCRCERROR) {
+		fifo->stat.rx_crcerrors++;
+		lora_stats_inc(spi_get_drvdata(spi), rx_crcerrors);
+		trace_lora_rx_done(spi, 0, r[3], r[0], 1);
+	}
+	else {
+		/* The new packet has overwritten the older ones it covers. */
+		sx127X_fifo_drop(fifo, r[0], r[3]);
+		if (fifo->nrx == SX127X_FIFO_MAX_RXPKT) {
+			sx127X_fifo_remove(fifo, 0);
+			fifo->stat.rx_overwrites++;
+		}
+		fifo->stat.rx_queued++;
+		fifo->rx[fifo->nrx].adr = r[0];
+		fifo->rx[fifo->nrx].len = r[3];
+		fifo->rx[fifo->nrx].id = fifo->stat.rx_queued;
+		fifo->rx[fifo->nrx].ts = ktime_get_ns();
+		fifo->rx[fifo->nrx].snr = (int8_t)r[9];
+		fifo->rx[fifo->nrx].rssi = r[10];
+		fifo->nrx++;
+		trace_lora_rx_done(spi, fifo->stat.rx_queued, r[3], r[0], 0);
+		lora_stats_inc(spi_get_drvdata(spi), rx_packets);
+		lora_stats_add(spi_get_drvdata(spi), rx_bytes, r[3]);
+
+		/* Next packet goes right after this one. */
+		sx127X_fifo_place(fifo, r[0] + r[3]);
+		sx127X_write_reg(spi, SX127X_REG_FIFO_RX_BASE_ADDR,
+				 &(fifo->rx_adr), 1);
+	}
+
+	sx127X_write_reg(spi, SX127X_REG_IRQ_FLAGS, &clr, 1);
+	trace_sx127x_flags(spi, flags, clr);
+	lora_stats_add(spi_get_drvdata(spi), rx_dropped,
+		       fifo->stat.rx_overwrites - overwrites);
+
+	return flags;
+}
+
+/**
+ * sx127X_fifo_pop - Read the oldest queued RX packet
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ * @buf:	buffer going to be read data into
+ * @len:	the length of the buffer in bytes
+ *
+ * Return:	the actual data length read in bytes, 0 for nothing queued
+ */
+ssize_t
+sx127X_fifo_pop(struct spi_device *spi, struct sx127X_fifo *fifo,
+		uint8_t *buf, size_t len)
+{
+	struct sx127X_fifo_pkt pkt;
+	ssize_t c;
+
+	if (fifo->nrx == 0)
+		return 0;
+
+	pkt = fifo->rx[0];
+	sx127X_fifo_remove(fifo, 0);
+	fifo->last = pkt;
+
+	len = (pkt.len < len) ? pkt.len : len;
+	sx127X_write_reg(spi, SX127X_REG_FIFO_ADDR_PTR, &(pkt.adr), 1);
+	c = sx127X_read_reg(spi, SX127X_REG_FIFO, buf, len);
+	trace_lora_rx_pop(spi, pkt.id, (c > 0) ? c : 0);
+	lora_hist_add(spi_get_drvdata(spi), LORA_HIST_RX_FIFO,
+		      ktime_get_ns() - pkt.ts);
+
+	return c;
+}
+
+/**
+ * sx127X_fifo_wake - Make the FIFO accessible and cache the OP mode
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ *
+ * Return:	the chip's state before woken up
+ */
+static uint8_t
+sx127X_fifo_wake(struct spi_device *spi, struct sx127X_fifo *fifo)
+{
+	uint8_t st;
+
+	/* Keep the OP mode for starting TX by a single register write. */
+	fifo->op_mode = sx127X_getMode(spi);
+	st = fifo->op_mode & 0x07;
+	if (st == SX127X_SLEEP_MODE) {
+		/* The FIFO can not be accessed in sleep state. */
+		fifo->op_mode = (fifo->op_mode & 0xF8) | SX127X_STANDBY_MODE;
+		sx127X_write_reg(spi, SX127X_REG_OP_MODE, &(fifo->op_mode), 1);
+		sx127X_fifo_reset(fifo);
+	}
+
+	return st;
+}
+
+/**
+ * sx127X_fifo_upload - Upload a TX packet into the FIFO
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ * @st:		the chip's state before woken up
+ * @adr:	the start address of the TX packet
+ * @buf:	buffer going to be send
+ * @len:	the length of the buffer in bytes
+ *
+ * The RX slot is moved below the TX packets, or RX is paused if there is no
+ * more room for the RX slot.
+ *
+ * Return:	the actual length written into the FIFO in bytes
+ */
+static ssize_t
+sx127X_fifo_upload(struct spi_device *spi, struct sx127X_fifo *fifo,
+		   uint8_t st, uint8_t adr, uint8_t *buf, size_t len)
+{
+	/* FIFO_ADDR_PTR, FIFO_TX_BASE_ADDR and FIFO_RX_BASE_ADDR */
+	uint8_t r[3];
+	uint8_t blen;
+	ssize_t c;
+
+	/* The RX packets covered by the TX packet are overwritten. */
+	sx127X_fifo_drop(fifo, adr, len);
+	sx127X_fifo_place(fifo, fifo->rx_adr);
+	if ((fifo->rx_adr + fifo->slot) >
+	    (SX127X_FIFO_SIZE - fifo->res_len - fifo->tx_len)) {
+		if ((st == SX127X_RXCONTINUOUS_MODE)
+			|| (st == SX127X_RXSINGLE_MODE)) {
+			fifo->op_mode = (fifo->op_mode & 0xF8) |
+					SX127X_STANDBY_MODE;
+			sx127X_write_reg(spi, SX127X_REG_OP_MODE,
+					 &(fifo->op_mode), 1);
+		}
+		fifo->stat.tx_paused_rx++;
+	}
+
+	r[0] = adr;
+	r[1] = adr;
+	r[2] = fifo->rx_adr;
+	sx127X_write_reg(spi, SX127X_REG_FIFO_ADDR_PTR, r, 3);
+
+	/* Write to SPI chip synchronously to fill the FIFO of the chip. */
+	c = sx127X_write_reg(spi, SX127X_REG_FIFO, buf, len);
+
+	/* Set the FIFO payload length. */
+	blen = (c > 0) ? c : 0;
+	sx127X_write_reg(spi, SX127X_REG_PAYLOAD_LENGTH, &blen, 1);
+
+	return c;
+}
+
+/**
+ * sx127X_fifo_stage - Stage a TX packet in the FIFO without stopping RX
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ * @buf:	buffer going to be send
+ * @len:	the length of the buffer in bytes
+ *
+ * The TX packet is put right below the resident frame, or at the top of
+ * the FIFO if there is no resident frame.
+ *
+ * Return:	the actual length written into the FIFO in bytes, -ENOSPC for
+ *		no room beside the resident frame
+ */
+ssize_t
+sx127X_fifo_stage(struct spi_device *spi, struct sx127X_fifo *fifo,
+		  uint8_t *buf, size_t len)
+{
+	uint8_t st;
+	ssize_t c;
+
+	len = (len < SX127X_MAX_FIFO_LENGTH) ? len : SX127X_MAX_FIFO_LENGTH;
+	if (len == 0)
+		return 0;
+
+	st = sx127X_fifo_wake(spi, fifo);
+	if (len > (SX127X_FIFO_SIZE - fifo->res_len))
+		return -ENOSPC;
+
+	fifo->tx_len = len;
+	fifo->tx_adr = SX127X_FIFO_SIZE - fifo->res_len - len;
+	c = sx127X_fifo_upload(spi, fifo, st, fifo->tx_adr, buf, len);
+	/* TX base and payload length do not point to resident frame now. */
+	fifo->res_ready = 0;
+	fifo->stat.tx_staged++;
+
+	return c;
+}
+
+/**
+ * sx127X_fifo_pin - Pin a resident frame at the top of the FIFO
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ * @buf:	the resident frame
+ * @len:	the length of the resident frame in bytes, 0 for unpinning
+ *
+ * The resident frame stays in the FIFO, so it can be sent again and again
+ * without being uploaded.
+ *
+ * Return:	the actual length written into the FIFO in bytes
+ */
+ssize_t
+sx127X_fifo_pin(struct spi_device *spi, struct sx127X_fifo *fifo,
+		uint8_t *buf, size_t len)
+{
+	uint8_t st;
+	ssize_t c;
+
+	fifo->res_len = 0;
+	fifo->res_ready = 0;
+	len = (len < SX127X_MAX_FIFO_LENGTH) ? len : SX127X_MAX_FIFO_LENGTH;
+	if (len == 0) {
+		sx127X_fifo_place(fifo, fifo->rx_adr);
+		return 0;
+	}
+
+	st = sx127X_fifo_wake(spi, fifo);
+	fifo->res_len = len;
+	fifo->res_adr = SX127X_FIFO_SIZE - len;
+	c = sx127X_fifo_upload(spi, fifo, st, fifo->res_adr, buf, len);
+	fifo->res_ready = 1;
+
+	return c;
+}
+
+/**
+ * sx127X_fifo_rearm - Prepare the resident frame for sending again
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ * @off:	the offset of the patch in the resident frame
+ * @patch:	the bytes going to be patched, NULL for nothing
+ * @plen:	the length of the patch in bytes
+ *
+ * Only the patch, the FIFO pointers and the payload length if they have
+ * been changed are written.  Then sx127X_fifo_starttx() starts the TX.
+ *
+ * Return:	0 / -ENODATA for prepared / no resident frame in the FIFO
+ */
+int
+sx127X_fifo_rearm(struct spi_device *spi, struct sx127X_fifo *fifo,
+		  uint8_t off, uint8_t *patch, size_t plen)
+{
+	/* FIFO_ADDR_PTR and FIFO_TX_BASE_ADDR */
+	uint8_t r[2];
+	uint8_t blen;
+
+	/* The resident frame is lost, if the chip has been in sleep state. */
+	sx127X_fifo_wake(spi, fifo);
+	if (fifo->res_len == 0)
+		return -ENODATA;
+
+	if ((patch != NULL) && (plen > 0)) {
+		r[0] = fifo->res_adr + off;
+		sx127X_write_reg(spi, SX127X_REG_FIFO_ADDR_PTR, r, 1);
+		sx127X_write_reg(spi, SX127X_REG_FIFO, patch, plen);
+	}
+
+	r[0] = fifo->res_adr;
+	r[1] = fifo->res_adr;
+	sx127X_write_reg(spi, SX127X_REG_FIFO_ADDR_PTR, r, 2);
+	if (!fifo->res_ready) {
+		blen = fifo->res_len;
+		sx127X_write_reg(spi, SX127X_REG_PAYLOAD_LENGTH, &blen, 1);
+		fifo->res_ready = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * sx127X_fifo_starttx - Start sending the staged TX packet
+ * @spi:	spi device to communicate with
+ * @fifo:	the FIFO allocator
+ */
+void
+sx127X_fifo_starttx(struct spi_device *spi, struct sx127X_fifo *fifo)
+{
+	uint8_t op_mode;
+
+	op_mode = (fifo->op_mode & 0xF8) | SX127X_TX_MODE;
+	trace_sx127x_state(spi, fifo->op_mode, SX127X_TX_MODE);
+	sx127X_write_reg(spi, SX127X_REG_OP_MODE, &op_mode, 1);
+}
+
+/**
+ * sx127X_fifo_txdone - Release the staged TX packet
+ * @fifo:	the FIFO allocator
+ */
+void
+sx127X_fifo_txdone(struct sx127X_fifo *fifo)
+{
+	fifo->tx_len = 0;
+}
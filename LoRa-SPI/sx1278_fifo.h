@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __SX1278_FIFO_H__
+#define __SX1278_FIFO_H__
+
+/* SX127X's FIFO data buffer is shared by RX and TX. */
+#define SX127X_FIFO_SIZE			256
+/* The max number of the RX packets queued in the FIFO. */
+#define SX127X_FIFO_MAX_RXPKT			16
+
+/**
+ * struct sx127X_fifo_pkt: A packet located in the FIFO
+ * @adr:		The start address of the packet in the FIFO
+ * @len:		The length of the packet in bytes
+ * @id:			The trace id of the packet
+ * @ts:			The time the packet was harvested in ns
+ * @rssi:		The packet RSSI register of the packet
+ * @snr:		The SNR of the packet in 0.25 dB
+ */
+struct sx127X_fifo_pkt {
+	uint8_t adr;
+	uint8_t len;
+	uint32_t id;
+	u64 ts;
+	uint8_t rssi;
+	int8_t snr;
+};
+
+/**
+ * struct sx127X_fifo_stat: The counters of the FIFO
+ * @rx_queued:		How many RX packets have been queued in the FIFO
+ * @rx_overwrites:	How many RX packets have been overwritten before read
+ * @rx_crcerrors:	How many RX packets have been dropped for CRC error
+ * @tx_staged:		How many TX packets have been staged in the FIFO
+ * @tx_paused_rx:	How many TX packets paused RX for no free space
+ */
+struct sx127X_fifo_stat {
+	uint32_t rx_queued;
+	uint32_t rx_overwrites;
+	uint32_t rx_crcerrors;
+	uint32_t tx_staged;
+	uint32_t tx_paused_rx;
+};
+
+/**
+ * struct sx127X_fifo: The allocator of the chip's FIFO data buffer
+ * @rx:			The RX packets queued in the FIFO from old to new
+ * @nrx:		How many RX packets are queued
+ * @rx_adr:		The RX base address where the next packet goes
+ * @slot:		The bytes reserved for the packet being received
+ * @tx_adr:		The start address of the staged TX packet
+ * @tx_len:		The length of the staged TX packet, 0 for nothing
+ * @res_adr:		The start address of the resident frame
+ * @res_len:		The length of the resident frame, 0 for nothing
+ * @res_ready:		The TX base and payload length point to the resident
+ *			frame
+ * @op_mode:		The cached OP mode register while TX is staged
+ * @pkt_cnt:		The chip's valid RX packets counter at last harvest
+ * @stat:		The counters of the FIFO
+ * @last:		The RX packet last popped
+ *
+ * The FIFO is split into an RX ring at the bottom, the staged TX packet
+ * above it and the resident frame at the top.  RX packets are queued one
+ * after another by moving the RX base address, so several short packets
+ * can wait inside the chip.  The TX packet is staged while the chip keeps
+ * receiving, so the TX starts by a single OP mode register write.
+ */
+struct sx127X_fifo {
+	struct sx127X_fifo_pkt rx[SX127X_FIFO_MAX_RXPKT];
+	uint8_t nrx;
+	uint8_t rx_adr;
+	uint8_t slot;
+	uint8_t tx_adr;
+	uint16_t tx_len;
+	uint8_t res_adr;
+	uint16_t res_len;
+	uint8_t res_ready;
+	uint8_t op_mode;
+	uint16_t pkt_cnt;
+	struct sx127X_fifo_stat stat;
+	struct sx127X_fifo_pkt last;
+};
+
+void
+sx127X_fifo_init(struct sx127X_fifo *fifo, uint8_t slot);
+
+void
+sx127X_fifo_reset(struct sx127X_fifo *fifo);
+
+void
+sx127X_fifo_setslot(struct sx127X_fifo *fifo, uint8_t slot);
+
+size_t
+sx127X_fifo_used(struct sx127X_fifo *fifo);
+
+int
+sx127X_fifo_harvest(struct spi_device *spi, struct sx127X_fifo *fifo);
+
+ssize_t
+sx127X_fifo_pop(struct spi_device *spi, struct sx127X_fifo *fifo,
+		uint8_t *buf, size_t len);
+
+ssize_t
+sx127X_fifo_stage(struct spi_device *spi, struct sx127X_fifo *fifo,
+		  uint8_t *buf, size_t len);
+
+ssize_t
+sx127X_fifo_pin(struct spi_device *spi, struct sx127X_fifo *fifo,
+		uint8_t *buf, size_t len);
+
+int
+sx127X_fifo_rearm(struct spi_device *spi, struct sx127X_fifo *fifo,
+		  uint8_t off, uint8_t *patch, size_t plen);
+
+void
+sx127X_fifo_starttx(struct spi_device *spi, struct sx127X_fifo *fifo);
+
+void
+sx127X_fifo_txdone(struct sx127X_fifo *fifo);
+
+#endif
@@ -0,0 +1,249 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lora_spi
+
+#if !defined(__SX1278_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __SX1278_TRACE_H__
+
+#include <linux/tracepoint.h>
+#include <linux/spi/spi.h>
+#include <linux/version.h>
+
+/* The device of each event is printed as spi<bus>.<chip select>. */
+#define SX127X_TRACE_DEV_ENTRY			\
+	__field(u16, bus)			\
+	__field(u16, cs)
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+#define SX127X_TRACE_DEV_ASSIGN(spi)			\
+	__entry->bus = (spi)->controller->bus_num;	\
+	__entry->cs = spi_get_chipselect(spi, 0)
+#else
+#define SX127X_TRACE_DEV_ASSIGN(spi)		\
+	__entry->bus = (spi)->master->bus_num;	\
+	__entry->cs = (spi)->chip_select
+#endif
+
+#define SX127X_TRACE_MODES			\
+	{ 0, "sleep" },				\
+	{ 1, "standby" },			\
+	{ 2, "fstx" },				\
+	{ 3, "tx" },				\
+	{ 4, "fsrx" },				\
+	{ 5, "rxcontinuous" },			\
+	{ 6, "rxsingle" },			\
+	{ 7, "cad" }
+
+/* A whole SPI message: the register, the direction and the duration. */
+TRACE_EVENT(sx127x_sync,
+	TP_PROTO(struct spi_device *spi, struct spi_message *m, int status,
+		 u64 duration_ns),
+	TP_ARGS(spi, m, status, duration_ns),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u8, reg)
+		__field(u8, write)
+		__field(u32, len)
+		__field(int, status)
+		__field(u64, duration_ns)
+	),
+	TP_fast_assign(
+		struct spi_transfer *t;
+		u8 adr = 0;
+
+		t = list_first_entry_or_null(&(m->transfers),
+					     struct spi_transfer,
+					     transfer_list);
+		if ((t != NULL) && (t->tx_buf != NULL))
+			adr = ((const u8 *)t->tx_buf)[0];
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->reg = adr & 0x7F;
+		__entry->write = adr >> 7;
+		__entry->len = m->actual_length;
+		__entry->status = status;
+		__entry->duration_ns = duration_ns;
+	),
+	TP_printk("spi%u.%u %s reg=0x%02x len=%u status=%d duration_ns=%llu",
+		  __entry->bus, __entry->cs, __entry->write ? "write" : "read",
+		  __entry->reg, __entry->len, __entry->status,
+		  __entry->duration_ns)
+);
+
+/* The chip's operating state is changed. */
+TRACE_EVENT(sx127x_state,
+	TP_PROTO(struct spi_device *spi, u8 from, u8 to),
+	TP_ARGS(spi, from, to),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u8, from)
+		__field(u8, to)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->from = from & 0x07;
+		__entry->to = to & 0x07;
+	),
+	TP_printk("spi%u.%u from=%s to=%s", __entry->bus, __entry->cs,
+		  __print_symbolic(__entry->from, SX127X_TRACE_MODES),
+		  __print_symbolic(__entry->to, SX127X_TRACE_MODES))
+);
+
+/* The IRQ flags are read, cleared or both. */
+TRACE_EVENT(sx127x_flags,
+	TP_PROTO(struct spi_device *spi, u8 flags, u8 cleared),
+	TP_ARGS(spi, flags, cleared),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u8, flags)
+		__field(u8, cleared)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->flags = flags;
+		__entry->cleared = cleared;
+	),
+	TP_printk("spi%u.%u flags=0x%02x cleared=0x%02x", __entry->bus,
+		  __entry->cs, __entry->flags, __entry->cleared)
+);
+
+/* A packet moves on.  The id is unique for each direction of a device. */
+DECLARE_EVENT_CLASS(lora_packet,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len),
+	TP_ARGS(spi, id, len),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u32, id)
+		__field(u32, len)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->id = id;
+		__entry->len = len;
+	),
+	TP_printk("spi%u.%u id=%u len=%u", __entry->bus, __entry->cs,
+		  __entry->id, __entry->len)
+);
+
+/* The TX packet has been staged in the chip's FIFO. */
+DEFINE_EVENT(lora_packet, lora_tx_enqueue,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len),
+	TP_ARGS(spi, id, len)
+);
+
+/* The RX packet has been read out of the chip's FIFO. */
+DEFINE_EVENT(lora_packet, lora_rx_pop,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len),
+	TP_ARGS(spi, id, len)
+);
+
+/* The RX packet has been handed to the reader. */
+DEFINE_EVENT(lora_packet, lora_rx_read,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len),
+	TP_ARGS(spi, id, len)
+);
+
+/* The chip has been set to TX state, id 0 for the resident frame. */
+TRACE_EVENT(lora_tx_start,
+	TP_PROTO(struct spi_device *spi, u32 id, u8 scheduled),
+	TP_ARGS(spi, id, scheduled),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u32, id)
+		__field(u8, scheduled)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->id = id;
+		__entry->scheduled = scheduled;
+	),
+	TP_printk("spi%u.%u id=%u scheduled=%u", __entry->bus, __entry->cs,
+		  __entry->id, __entry->scheduled)
+);
+
+/* The TX is finished or given up. */
+TRACE_EVENT(lora_tx_done,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len, int status),
+	TP_ARGS(spi, id, len, status),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u32, id)
+		__field(u32, len)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->id = id;
+		__entry->len = len;
+		__entry->status = status;
+	),
+	TP_printk("spi%u.%u id=%u len=%u status=%d", __entry->bus,
+		  __entry->cs, __entry->id, __entry->len, __entry->status)
+);
+
+/* An RX packet has been found in the chip's FIFO, id 0 for CRC error. */
+TRACE_EVENT(lora_rx_done,
+	TP_PROTO(struct spi_device *spi, u32 id, u32 len, u8 adr, u8 crcerr),
+	TP_ARGS(spi, id, len, adr, crcerr),
+	TP_STRUCT__entry(
+		SX127X_TRACE_DEV_ENTRY
+		__field(u32, id)
+		__field(u32, len)
+		__field(u8, adr)
+		__field(u8, crcerr)
+	),
+	TP_fast_assign(
+		SX127X_TRACE_DEV_ASSIGN(spi);
+		__entry->id = id;
+		__entry->len = len;
+		__entry->adr = adr;
+		__entry->crcerr = crcerr;
+	),
+	TP_printk("spi%u.%u id=%u len=%u adr=0x%02x crc_error=%u",
+		  __entry->bus, __entry->cs, __entry->id, __entry->len,
+		  __entry->adr, __entry->crcerr)
+);
+
+#endif
+
+/* The trace header is out of the kernel's include/trace/events. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sx1278_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,1656 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/errno.h>
+#include <linux/hrtimer.h>
+#include <linux/version.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "lora_virt.h"
+
+#define __DRIVER_NAME		"lora-virt"
+
+/*
+ * The virtual radios share one simulated air.  A packet is on the air for
+ * its time on air from SF, BW, CR and its length.  It reaches the radios
+ * listening on the same SF and BW within a quarter of the BW from its
+ * carrier.  The different SFs are orthogonal, so only the packets of the
+ * same SF collide, and the stronger one survives if it is at least
+ * LORAVIRT_CAPTURE_DB stronger.  The path loss between the radios gives
+ * the RSSI, and the RSSI over the noise floor of the BW gives the SNR,
+ * which must be over the demodulation floor of the SF.
+ */
+
+static unsigned int radios = 2;
+module_param(radios, uint, 0444);
+MODULE_PARM_DESC(radios, "How many virtual radios to create, 1 ~ 32");
+
+static int pathloss = 100;
+module_param(pathloss, int, 0444);
+MODULE_PARM_DESC(pathloss, "The initial path loss between the radios in dB");
+
+static unsigned int loss;
+module_param(loss, uint, 0644);
+MODULE_PARM_DESC(loss, "Drop the delivered packets randomly, in per mille");
+
+static unsigned int delay_us;
+module_param(delay_us, uint, 0644);
+MODULE_PARM_DESC(delay_us, "Delay the packets after they leave the air, in us");
+
+static const uint32_t loravirt_bw[] = {
+	7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+/* The noise floor of each BW: -174 dBm/Hz + 10log(BW) + 6 dB noise
+ * figure, in 0.25 dB. */
+static const int16_t loravirt_noise[] = {
+	-516, -511, -504, -499, -492, -487, -480, -468, -456, -444
+};
+
+/* The SNR demodulation floor of SF 6 ~ 12 in 0.25 dB. */
+static const int16_t loravirt_floor[] = {
+	-20, -30, -40, -50, -60, -70, -80
+};
+
+static struct loravirt_medium medium;
+
+/**
+ * loravirt_sf - Get the spreading factor of the chips / symbol
+ * @sprf:	the spreading factor in chips / symbol
+ *
+ * Return:	the spreading factor 6 ~ 12
+ */
+static uint32_t
+loravirt_sf(uint32_t sprf)
+{
+	uint32_t sf;
+
+	for (sf = 6; (sf < 12) && ((1U << sf) < sprf); sf++);
+
+	return sf;
+}
+
+/**
+ * loravirt_bwidx - Get the index of the RF bandwidth in the tables
+ * @bw:		the RF bandwidth in Hz
+ *
+ * Return:	the index of the RF bandwidth
+ */
+static unsigned int
+loravirt_bwidx(uint32_t bw)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(loravirt_bw) - 1; i++) {
+		if (loravirt_bw[i] >= bw)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * loravirt_airtime - Get the time on air of a packet
+ * @ldata:	the virtual radio sending the packet
+ * @len:	the payload length in bytes
+ *
+ * It is the formula of Semtech's SX1276/77/78/79 datasheet, 4.1.1.7, with
+ * the low data rate optimization enabled over 16 ms symbols.
+ *
+ * Return:	the time on air in us
+ */
+static uint32_t
+loravirt_airtime(struct loravirt_data *ldata, size_t len)
+{
+	int32_t sf, de, num, den;
+	uint32_t nsym;
+	uint64_t t;
+
+	sf = loravirt_sf(ldata->sprf);
+	de = (((uint64_t)1000 << sf) >= 16 * (uint64_t)ldata->bw) ? 1 : 0;
+	num = 8 * (int32_t)len - 4 * sf + 28 + 16 * (ldata->crc ? 1 : 0)
+		- 20 * (ldata->implicit ? 1 : 0);
+	den = 4 * (sf - 2 * de);
+	nsym = 8;
+	if (num > 0)
+		nsym += ((num + den - 1) / den) * ldata->cr;
+
+	/* The preamble lasts for (prelen + 4.25) symbols. */
+	t = ((uint64_t)(4 * ldata->prelen + 17) + 4 * (uint64_t)nsym)
+		* ((uint64_t)1000000 << sf);
+	do_div(t, 4 * ldata->bw);
+
+	return t;
+}
+
+/**
+ * loravirt_hears - Can the radio demodulate the packet on the air
+ * @r:		the virtual radio
+ * @air:	the packet on the air
+ *
+ * Return:	1 / 0 for yes / no
+ */
+static int
+loravirt_hears(struct loravirt_data *r, struct loravirt_air *air)
+{
+	uint32_t df;
+
+	df = (r->freq > air->freq) ? r->freq - air->freq : air->freq - r->freq;
+
+	return (r != air->tx) && (r->state == LORA_STATE_RX)
+		&& (r->sprf == air->sprf) && (r->bw == air->bw)
+		&& (!r->implicit == !air->implicit) && (df <= air->bw / 4);
+}
+
+/**
+ * loravirt_rssi - Get the RSSI of the packet at the radio
+ * @air:	the packet on the air
+ * @r:		the virtual radio
+ *
+ * Return:	the RSSI in dBm
+ */
+static int32_t
+loravirt_rssi(struct loravirt_air *air, struct loravirt_data *r)
+{
+	return air->power - medium.pathloss[air->tx->id][r->id];
+}
+
+/**
+ * loravirt_snr - Get the SNR of the packet at the radio
+ * @air:	the packet on the air
+ * @rssi:	the RSSI of the packet at the radio in dBm
+ *
+ * Return:	the SNR in 0.25 dB
+ */
+static int32_t
+loravirt_snr(struct loravirt_air *air, int32_t rssi)
+{
+	return 4 * rssi - loravirt_noise[loravirt_bwidx(air->bw)];
+}
+
+/**
+ * loravirt_state - Set the state of the virtual radio
+ * @ldata:	the virtual radio, the medium's lock has been held
+ * @st:		the state, LORA_STATE_*
+ */
+static void
+loravirt_state(struct loravirt_data *ldata, uint32_t st)
+{
+	/* The counters count from the transition into RX, and the queued
+	 * packets are lost in sleep state, as the chip. */
+	if ((st == LORA_STATE_RX) && (ldata->state != LORA_STATE_RX)) {
+		ldata->rx_headers = 0;
+		ldata->rx_packets = 0;
+	}
+	else if (st == LORA_STATE_SLEEP) {
+		ldata->head = 0;
+		ldata->tail = 0;
+		ldata->npkt = 0;
+	}
+	ldata->state = st;
+}
+
+/**
+ * loravirt_enqueue - Queue a delivered packet for the radio's readers
+ * @r:		the virtual radio, the medium's lock has been held
+ * @air:	the delivered packet
+ */
+static void
+loravirt_enqueue(struct loravirt_data *r, struct loravirt_air *air)
+{
+	struct loravirt_pkt *p;
+	int32_t rssi, snr;
+	size_t len;
+
+	/* The header's length must not exceed the max payload length. */
+	len = r->implicit ? r->implicit : air->len;
+	if (!r->implicit && (len > r->maxpayload))
+		return;
+
+	rssi = loravirt_rssi(air, r);
+	snr = clamp_t(int32_t, loravirt_snr(air, rssi), -128, 127);
+
+	/* The oldest packet is overwritten if the queue is full. */
+	if (r->npkt == LORAVIRT_RXQ) {
+		r->tail = (r->tail + 1) % LORAVIRT_RXQ;
+		r->npkt--;
+		r->overwrites++;
+	}
+	p = &(r->pkt[r->head]);
+	memset(p->buf, 0, sizeof(p->buf));
+	memcpy(p->buf, air->buf, min_t(size_t, len, air->len));
+	p->len = len;
+	p->rssi = rssi;
+	p->snr = snr;
+	p->ts = ktime_get_ns();
+	r->head = (r->head + 1) % LORAVIRT_RXQ;
+	r->npkt++;
+	r->queued++;
+	r->rx_headers++;
+	r->rx_packets++;
+	medium.stat.delivered++;
+
+	wake_up_interruptible(&(r->rxq));
+	wake_up_interruptible(&(r->lrdata.waitqueue));
+}
+
+/**
+ * loravirt_air_fire - A packet leaves the air, or its delay is over
+ * @timer:	the timer of the packet
+ *
+ * Return:	HRTIMER_RESTART to deliver the packet after the delay
+ */
+static enum hrtimer_restart
+loravirt_air_fire(struct hrtimer *timer)
+{
+	struct loravirt_air *air;
+	struct loravirt_data *r;
+	unsigned long flags;
+	unsigned int i;
+	int32_t rssi;
+	uint32_t delay;
+
+	air = container_of(timer, struct loravirt_air, timer);
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	if (!air->aired) {
+		/* The packet has left the air, decide who has got it. */
+		air->aired = 1;
+		medium.stat.sent++;
+		air->tx->txdone_ns = ktime_get_ns();
+		complete(&(air->tx->txdone));
+
+		for (i = 0; i < medium.nradio; i++) {
+			if (!(air->listeners & BIT(i)))
+				continue;
+			r = medium.radio[i];
+			if (air->collided & BIT(i)) {
+				medium.stat.collided++;
+				continue;
+			}
+			/* The radio has left RX or retuned in the middle. */
+			if (!loravirt_hears(r, air))
+				continue;
+			rssi = loravirt_rssi(air, r);
+			if (loravirt_snr(air, rssi)
+				< loravirt_floor[loravirt_sf(air->sprf) - 6]) {
+				medium.stat.weak++;
+				continue;
+			}
+			if ((loss > 0) && ((get_random_u32() % 1000) < loss)) {
+				medium.stat.injected++;
+				continue;
+			}
+			air->deliver |= BIT(i);
+		}
+
+		delay = READ_ONCE(delay_us);
+		if ((delay > 0) && (air->deliver != 0)) {
+			spin_unlock_irqrestore(&(medium.lock), flags);
+			hrtimer_forward_now(timer, us_to_ktime(delay));
+			return HRTIMER_RESTART;
+		}
+	}
+
+	for (i = 0; i < medium.nradio; i++) {
+		if (air->deliver & BIT(i))
+			loravirt_enqueue(medium.radio[i], air);
+	}
+	air->done = 1;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * loravirt_air_gc - Free the packets which have been delivered
+ */
+static void
+loravirt_air_gc(void)
+{
+	struct loravirt_air *air, *n;
+	unsigned long flags;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	list_for_each_entry_safe(air, n, &(medium.air), entry) {
+		if (air->done)
+			list_move(&(air->entry), &done);
+	}
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	/* The timer callback may be still returning. */
+	list_for_each_entry_safe(air, n, &done, entry) {
+		hrtimer_cancel(&(air->timer));
+		kfree(air);
+	}
+}
+
+/**
+ * loravirt_air_send - Put a packet on the air
+ * @ldata:	the sending virtual radio
+ * @buf:	the payload
+ * @len:	the length of the payload
+ *
+ * Return:	the time on air in us, negative number for error
+ */
+static long
+loravirt_air_send(struct loravirt_data *ldata, const uint8_t *buf, size_t len)
+{
+	struct loravirt_air *air, *o;
+	struct loravirt_data *r;
+	unsigned long flags;
+	unsigned int i;
+	int32_t pn, po;
+	uint32_t common;
+	uint32_t t;
+
+	air = kzalloc(sizeof(struct loravirt_air), GFP_KERNEL);
+	if (air == NULL)
+		return -ENOMEM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&(air->timer), loravirt_air_fire, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_ABS);
+#else
+	hrtimer_init(&(air->timer), CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	air->timer.function = loravirt_air_fire;
+#endif
+	air->tx = ldata;
+	memcpy(air->buf, buf, len);
+	air->len = len;
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	if (medium.closing) {
+		spin_unlock_irqrestore(&(medium.lock), flags);
+		kfree(air);
+		return -ESHUTDOWN;
+	}
+
+	air->freq = ldata->freq;
+	air->power = ldata->power;
+	air->sprf = ldata->sprf;
+	air->bw = ldata->bw;
+	air->implicit = ldata->implicit;
+	t = loravirt_airtime(ldata, len);
+	loravirt_state(ldata, LORA_STATE_TX);
+
+	for (i = 0; i < medium.nradio; i++) {
+		if (loravirt_hears(medium.radio[i], air))
+			air->listeners |= BIT(i);
+	}
+
+	/* The packets still on the air collide with the new one. */
+	list_for_each_entry(o, &(medium.air), entry) {
+		if (o->aired)
+			continue;
+		/* The half-duplex sender can not hear them any more. */
+		o->collided |= BIT(ldata->id);
+		common = o->listeners & air->listeners;
+		for (i = 0; i < medium.nradio; i++) {
+			if (!(common & BIT(i)))
+				continue;
+			r = medium.radio[i];
+			pn = loravirt_rssi(air, r);
+			po = loravirt_rssi(o, r);
+			if (pn - po < LORAVIRT_CAPTURE_DB)
+				o->collided |= BIT(i);
+			if (po - pn < LORAVIRT_CAPTURE_DB)
+				air->collided |= BIT(i);
+		}
+	}
+
+	list_add_tail(&(air->entry), &(medium.air));
+	hrtimer_start(&(air->timer), ktime_add_us(ktime_get(), t),
+		      HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	return t;
+}
+
+/**
+ * loravirt_pop - Take a queued packet
+ * @ldata:	the virtual radio
+ * @buf:	the buffer going to hold the packet
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	the length of the packet, -1 for nothing queued
+ */
+static ssize_t
+loravirt_pop(struct loravirt_data *ldata, uint8_t *buf, size_t size)
+{
+	struct lora_struct *lrdata = &(ldata->lrdata);
+	struct loravirt_pkt *p;
+	unsigned long flags;
+	uint32_t over;
+	ssize_t c = -1;
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	if (ldata->npkt > 0) {
+		p = &(ldata->pkt[ldata->tail]);
+		c = min_t(size_t, size, p->len);
+		memcpy(buf, p->buf, c);
+		ldata->last.len = p->len;
+		ldata->last.rssi = p->rssi;
+		ldata->last.snr = p->snr;
+		ldata->last.ts = p->ts;
+		ldata->tail = (ldata->tail + 1) % LORAVIRT_RXQ;
+		ldata->npkt--;
+	}
+	over = ldata->overwrites - ldata->counted;
+	ldata->counted = ldata->overwrites;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	/* The counters are updated in process context only. */
+	if (over > 0)
+		lora_stats_add(lrdata, rx_dropped, over);
+	if (c >= 0) {
+		lora_stats_inc(lrdata, rx_packets);
+		lora_stats_add(lrdata, rx_bytes, c);
+		lora_hist_add(lrdata, LORA_HIST_RX_FIFO,
+			      ktime_get_ns() - ldata->last.ts);
+	}
+
+	return c;
+}
+
+/**
+ * loravirt_startrx - Set the radio to RX without waiting for a packet
+ * @lrdata:	LoRa device
+ *
+ * Return:	0 for success
+ */
+static long
+loravirt_startrx(struct lora_struct *lrdata)
+{
+	struct loravirt_data *ldata;
+	unsigned long flags;
+
+	ldata = to_loravirt(lrdata);
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	if (ldata->state != LORA_STATE_RX)
+		loravirt_state(ldata, LORA_STATE_RX);
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	return 0;
+}
+
+/**
+ * loravirt_getmaxtx - Get the most bytes a packet carries
+ * @lrdata:	LoRa device
+ *
+ * Return:	the fixed length of Implicit Header Mode, or the buffer's
+ */
+static long
+loravirt_getmaxtx(struct lora_struct *lrdata)
+{
+	struct loravirt_data *ldata;
+
+	ldata = to_loravirt(lrdata);
+
+	return ldata->implicit ? ldata->implicit : lrdata->bufmaxlen;
+}
+
+/**
+ * loravirt_recv_locked - Receive a packet, the buffer lock has been held
+ * @lrdata:	LoRa device whose buffer lock has been held
+ * @buf:	the buffer going to hold the packet
+ * @size:	the length of the buffer in bytes
+ *
+ * It waits for 5 seconds at most, as the LoRa SPI devices.
+ *
+ * Return:	Read how many bytes actually, -1 for time out
+ */
+static ssize_t
+loravirt_recv_locked(struct lora_struct *lrdata, uint8_t *buf, size_t size)
+{
+	struct loravirt_data *ldata;
+	ssize_t c;
+	long ret;
+
+	ldata = to_loravirt(lrdata);
+
+	/* Set the radio to RX, if it is not. */
+	loravirt_startrx(lrdata);
+
+	c = loravirt_pop(ldata, buf, size);
+	if (c >= 0)
+		return c;
+
+	ret = wait_event_interruptible_timeout(ldata->rxq,
+					       READ_ONCE(ldata->npkt) > 0,
+					       5 * HZ);
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		lora_stats_inc(lrdata, rx_timeouts);
+
+	return loravirt_pop(ldata, buf, size);
+}
+
+/**
+ * loravirt_read - Read from the LoRa device's communication
+ * @lrdata:	LoRa device
+ * @buf:	the buffer going to hold the read data in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+loravirt_read(struct lora_struct *lrdata, const char __user *buf, size_t size)
+{
+	struct loravirt_data *ldata;
+	ssize_t c;
+
+	ldata = to_loravirt(lrdata);
+
+	lora_lock(lrdata);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	c = loravirt_recv_locked(lrdata, lrdata->rx_buf, size);
+	if ((c > 0) && copy_to_user((void __user *)buf, lrdata->rx_buf, c))
+		c = -EFAULT;
+	if (c > 0)
+		lora_hist_add(lrdata, LORA_HIST_RX_COPY,
+			      ktime_get_ns() - ldata->last.ts);
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loravirt_recv - Receive a packet into a kernel buffer
+ * @lrdata:	LoRa device
+ * @buf:	the buffer going to hold the packet in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+loravirt_recv(struct lora_struct *lrdata, uint8_t *buf, size_t size)
+{
+	ssize_t c;
+
+	lora_lock(lrdata);
+	c = loravirt_recv_locked(lrdata, buf, size);
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loravirt_xmit_locked - Send the packet in the TX buffer
+ * @lrdata:	LoRa device whose buffer lock has been held
+ * @len:	the length of the packet in the TX buffer
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loravirt_xmit_locked(struct lora_struct *lrdata, size_t len)
+{
+	struct loravirt_data *ldata;
+	unsigned long flags;
+	u64 started;
+	long t;
+	ssize_t c;
+
+	ldata = to_loravirt(lrdata);
+	/* Implicit Header Mode always sends the fixed length payload. */
+	lrdata->tx_buflen = ldata->implicit ? ldata->implicit : len;
+
+	loravirt_air_gc();
+	reinit_completion(&(ldata->txdone));
+	started = ktime_get_ns();
+	lora_hist_add(lrdata, LORA_HIST_TX_LOAD, started - ldata->tx_ns);
+	t = loravirt_air_send(ldata, lrdata->tx_buf, lrdata->tx_buflen);
+	if (t < 0) {
+		lrdata->tx_buflen = 0;
+		return t;
+	}
+
+	/* Wait until the packet has left the air. */
+	if (!wait_for_completion_timeout(&(ldata->txdone),
+					 usecs_to_jiffies(t) + HZ)) {
+		lora_stats_inc(lrdata, tx_timeouts);
+		c = 0;
+	}
+	else {
+		lora_hist_add(lrdata, LORA_HIST_TX_AIR,
+			      ktime_get_ns() - started);
+		lora_stats_inc(lrdata, tx_packets);
+		lora_stats_add(lrdata, tx_bytes, lrdata->tx_buflen);
+		/* Report the written bytes, not the padded ones. */
+		c = min_t(size_t, len, lrdata->tx_buflen);
+	}
+
+	/* Set the radio back to RX, as the LoRa SPI devices. */
+	spin_lock_irqsave(&(medium.lock), flags);
+	loravirt_state(ldata, LORA_STATE_RX);
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	lrdata->tx_buflen = 0;
+
+	return c;
+}
+
+/**
+ * loravirt_write - Write to the LoRa device's communication
+ * @lrdata:	LoRa device
+ * @buf:	the buffer holding the data going to be written in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loravirt_write(struct lora_struct *lrdata, const char __user *buf,
+	       size_t size)
+{
+	ssize_t c;
+	u64 t;
+
+	t = ktime_get_ns();
+	lora_lock(lrdata);
+	to_loravirt(lrdata)->tx_ns = t;
+	memset(lrdata->tx_buf, 0, lrdata->bufmaxlen);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	if (copy_from_user(lrdata->tx_buf, buf, size))
+		c = -EFAULT;
+	else
+		c = (size > 0) ? loravirt_xmit_locked(lrdata, size) : 0;
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loravirt_xmit - Send a packet from a kernel buffer
+ * @lrdata:	LoRa device
+ * @buf:	the buffer holding the packet in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+loravirt_xmit(struct lora_struct *lrdata, const uint8_t *buf, size_t size)
+{
+	ssize_t c;
+	u64 t;
+
+	if (size == 0)
+		return 0;
+
+	t = ktime_get_ns();
+	lora_lock(lrdata);
+	to_loravirt(lrdata)->tx_ns = t;
+	memset(lrdata->tx_buf, 0, lrdata->bufmaxlen);
+	size = (lrdata->bufmaxlen < size) ? lrdata->bufmaxlen : size;
+	memcpy(lrdata->tx_buf, buf, size);
+	c = loravirt_xmit_locked(lrdata, size);
+	lora_unlock(lrdata);
+
+	return c;
+}
+
+/**
+ * loravirt_setval - Set a setting of the virtual radio
+ * @lrdata:	LoRa device
+ * @field:	the setting of the virtual radio
+ * @v:		the value of the setting
+ * @min:	the min value of the setting
+ * @max:	the max value of the setting
+ *
+ * The settings are used by the medium, so they are set under its lock.
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setval(struct lora_struct *lrdata, uint32_t *field, uint32_t v,
+		uint32_t min, uint32_t max)
+{
+	unsigned long flags;
+
+	if ((v < min) || (v > max))
+		return -EINVAL;
+
+	lora_lock(lrdata);
+	spin_lock_irqsave(&(medium.lock), flags);
+	*field = v;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_setu32 - Set a setting of the virtual radio from user space
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the value in user space
+ * @field:	the setting of the virtual radio
+ * @min:	the min value of the setting
+ * @max:	the max value of the setting
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setu32(struct lora_struct *lrdata, void __user *arg,
+		uint32_t *field, uint32_t min, uint32_t max)
+{
+	uint32_t v;
+
+	if (copy_from_user(&v, arg, sizeof(uint32_t)))
+		return -EFAULT;
+
+	return loravirt_setval(lrdata, field, v, min, max);
+}
+
+/**
+ * loravirt_getu32 - Get a setting of the virtual radio to user space
+ * @arg:	the buffer going to hold the value in user space
+ * @v:		the value of the setting
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getu32(void __user *arg, uint32_t v)
+{
+	if (copy_to_user(arg, &v, sizeof(uint32_t)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loravirt_setstate - Set the state of the LoRa device
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the state value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setstate(struct lora_struct *lrdata, void __user *arg)
+{
+	unsigned long flags;
+	uint32_t st;
+
+	if (copy_from_user(&st, arg, sizeof(uint32_t)))
+		return -EFAULT;
+	/* Only the sending puts the radio in TX state. */
+	if ((st != LORA_STATE_SLEEP) && (st != LORA_STATE_RX))
+		st = LORA_STATE_STANDBY;
+
+	lora_lock(lrdata);
+	spin_lock_irqsave(&(medium.lock), flags);
+	loravirt_state(to_loravirt(lrdata), st);
+	spin_unlock_irqrestore(&(medium.lock), flags);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_getstate - Get the state of the LoRa device
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the state value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getstate(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, READ_ONCE(to_loravirt(lrdata)->state));
+}
+
+/**
+ * loravirt_setfreq - Set the carrier frequency
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the carrier frequency in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setfreq(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_setu32(lrdata, arg, &(to_loravirt(lrdata)->freq),
+			       0, U32_MAX);
+}
+
+/**
+ * loravirt_getfreq - Get the carrier frequency
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the carrier frequency in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getfreq(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->freq);
+}
+
+/**
+ * loravirt_setpower - Set the PA power
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the PA output value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setpower(struct lora_struct *lrdata, void __user *arg)
+{
+	unsigned long flags;
+	int32_t dbm;
+
+	if (copy_from_user(&dbm, arg, sizeof(int32_t)))
+		return -EFAULT;
+	/* The same range as the SX127x. */
+	dbm = clamp_t(int32_t, dbm, -2, 17);
+
+	lora_lock(lrdata);
+	spin_lock_irqsave(&(medium.lock), flags);
+	to_loravirt(lrdata)->power = dbm;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_getpower - Get the PA power
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the PA output value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getpower(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->power);
+}
+
+/**
+ * loravirt_setsprfactor - Set the RF spreading factor
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the spreading factor in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setsprfactor(struct lora_struct *lrdata, void __user *arg)
+{
+	unsigned long flags;
+	uint32_t sprf;
+
+	if (copy_from_user(&sprf, arg, sizeof(uint32_t)))
+		return -EFAULT;
+
+	lora_lock(lrdata);
+	spin_lock_irqsave(&(medium.lock), flags);
+	to_loravirt(lrdata)->sprf = 1U << loravirt_sf(sprf);
+	spin_unlock_irqrestore(&(medium.lock), flags);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_getsprfactor - Get the RF spreading factor
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the spreading factor in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getsprfactor(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->sprf);
+}
+
+/**
+ * loravirt_setbandwidth - Set the RF bandwidth
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the RF bandwidth in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setbandwidth(struct lora_struct *lrdata, void __user *arg)
+{
+	unsigned long flags;
+	uint32_t bw;
+
+	if (copy_from_user(&bw, arg, sizeof(uint32_t)))
+		return -EFAULT;
+
+	lora_lock(lrdata);
+	spin_lock_irqsave(&(medium.lock), flags);
+	to_loravirt(lrdata)->bw = loravirt_bw[loravirt_bwidx(bw)];
+	spin_unlock_irqrestore(&(medium.lock), flags);
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_getbandwidth - Get the RF bandwidth
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the RF bandwidth in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getbandwidth(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->bw);
+}
+
+/**
+ * loravirt_getrssi - Get current RSSI of the channel
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the RSSI value in user space
+ *
+ * It is the strongest packet on the air around the carrier, or the noise
+ * floor if the channel is clear.
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getrssi(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loravirt_data *ldata;
+	struct loravirt_air *air;
+	unsigned long flags;
+	int32_t rssi, r;
+	uint32_t df;
+
+	ldata = to_loravirt(lrdata);
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	rssi = loravirt_noise[loravirt_bwidx(ldata->bw)] / 4;
+	list_for_each_entry(air, &(medium.air), entry) {
+		df = (ldata->freq > air->freq) ? ldata->freq - air->freq
+					       : air->freq - ldata->freq;
+		if (air->aired || (air->tx == ldata) || (df > ldata->bw / 2))
+			continue;
+		r = loravirt_rssi(air, ldata);
+		rssi = max(rssi, r);
+	}
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	if (copy_to_user(arg, &rssi, sizeof(int32_t)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loravirt_getsnr - Get last packet's SNR
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the SNR value in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getsnr(struct lora_struct *lrdata, void __user *arg)
+{
+	/* In dB, as the SX127x chip layer. */
+	return loravirt_getu32(arg, to_loravirt(lrdata)->last.snr / 4);
+}
+
+/**
+ * loravirt_setcr - Set the coding rate
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the coding rate denominator in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setcr(struct lora_struct *lrdata, void __user *arg)
+{
+	/* Coding rate is 4/5 ~ 4/8. */
+	return loravirt_setu32(lrdata, arg, &(to_loravirt(lrdata)->cr), 5, 8);
+}
+
+/**
+ * loravirt_getcr - Get the coding rate
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the coding rate denominator in user
+ *		space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getcr(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->cr);
+}
+
+/**
+ * loravirt_setcrc - Enable or disable the payload CRC
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding 1 / 0 for enabled / disabled in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setcrc(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_setu32(lrdata, arg, &(to_loravirt(lrdata)->crc), 0, 1);
+}
+
+/**
+ * loravirt_getcrc - Get the payload CRC is enabled or not
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold 1 / 0 for enabled / disabled in user
+ *		space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getcrc(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->crc);
+}
+
+/**
+ * loravirt_setparam - Set a 32 bits setting with a kernel value
+ * @lrdata:	LoRa device
+ * @cmd:	LORA_SET_* of the setting
+ * @val:	the value of the setting
+ *
+ * The values are checked and rounded as the ioctl commands do.
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setparam(struct lora_struct *lrdata, unsigned int cmd, uint32_t val)
+{
+	struct loravirt_data *ldata;
+	unsigned long flags;
+
+	ldata = to_loravirt(lrdata);
+
+	switch (cmd) {
+	case LORA_SET_FREQUENCY:
+		return loravirt_setval(lrdata, &(ldata->freq), val, 0, U32_MAX);
+	case LORA_SET_SPRFACTOR:
+		return loravirt_setval(lrdata, &(ldata->sprf),
+				       1U << loravirt_sf(val), 0, U32_MAX);
+	case LORA_SET_BANDWIDTH:
+		return loravirt_setval(lrdata, &(ldata->bw),
+				       loravirt_bw[loravirt_bwidx(val)],
+				       0, U32_MAX);
+	case LORA_SET_CODINGRATE:
+		return loravirt_setval(lrdata, &(ldata->cr), val, 5, 8);
+	case LORA_SET_CRC:
+		return loravirt_setval(lrdata, &(ldata->crc), val, 0, 1);
+	case LORA_SET_POWER:
+		lora_lock(lrdata);
+		spin_lock_irqsave(&(medium.lock), flags);
+		ldata->power = clamp_t(int32_t, (int32_t)val, -2, 17);
+		spin_unlock_irqrestore(&(medium.lock), flags);
+		lora_unlock(lrdata);
+		return 0;
+	}
+
+	return -ENOTTY;
+}
+
+/**
+ * loravirt_getparam - Get a 32 bits setting into a kernel buffer
+ * @lrdata:	LoRa device
+ * @cmd:	LORA_GET_* of the setting
+ * @val:	the buffer going to hold the value of the setting
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getparam(struct lora_struct *lrdata, unsigned int cmd, uint32_t *val)
+{
+	struct loravirt_data *ldata;
+
+	ldata = to_loravirt(lrdata);
+
+	switch (cmd) {
+	case LORA_GET_FREQUENCY:
+		*val = ldata->freq;	break;
+	case LORA_GET_POWER:
+		*val = ldata->power;	break;
+	case LORA_GET_SPRFACTOR:
+		*val = ldata->sprf;	break;
+	case LORA_GET_BANDWIDTH:
+		*val = ldata->bw;	break;
+	case LORA_GET_CODINGRATE:
+		*val = ldata->cr;	break;
+	case LORA_GET_CRC:
+		*val = ldata->crc;	break;
+	default:
+		return -ENOTTY;
+	}
+
+	return 0;
+}
+
+/**
+ * loravirt_setimplicit - Set the header mode and the fixed payload length
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the fixed payload length in user space,
+ *		0 for Explicit Header Mode
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setimplicit(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_setu32(lrdata, arg, &(to_loravirt(lrdata)->implicit),
+			       0, LORAVIRT_MAXLEN);
+}
+
+/**
+ * loravirt_getimplicit - Get the fixed payload length of the header mode
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the fixed payload length in user
+ *		space, 0 for Explicit Header Mode
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getimplicit(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_getu32(arg, to_loravirt(lrdata)->implicit);
+}
+
+/**
+ * loravirt_setmaxpayload - Set the max payload length of the RX packets
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the max payload length in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_setmaxpayload(struct lora_struct *lrdata, void __user *arg)
+{
+	return loravirt_setu32(lrdata, arg,
+			       &(to_loravirt(lrdata)->maxpayload),
+			       1, LORAVIRT_MAXLEN);
+}
+
+/**
+ * loravirt_getfifostat - Get the occupancy and the counters of the queue
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the FIFO status in user space
+ *
+ * The queue of the received packets stands for the chip's FIFO.
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getfifostat(struct lora_struct *lrdata, void __user *arg)
+{
+	struct loravirt_data *ldata;
+	struct lora_fifo_stat st;
+	unsigned long flags;
+	unsigned int i;
+
+	ldata = to_loravirt(lrdata);
+	memset(&st, 0, sizeof(st));
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	st.rx_pending = ldata->npkt;
+	for (i = 0; i < ldata->npkt; i++)
+		st.used += ldata->pkt[(ldata->tail + i) % LORAVIRT_RXQ].len;
+	st.rx_slot = ldata->implicit ? ldata->implicit : ldata->maxpayload;
+	st.rx_queued = ldata->queued;
+	st.rx_overwrites = ldata->overwrites;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loravirt_getpktmeta - Get the signal and the time of the packet last read
+ * @lrdata:	LoRa device
+ * @meta:	the buffer going to hold the metadata in kernel space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getpktmeta(struct lora_struct *lrdata, struct lora_pkt_meta *meta)
+{
+	struct loravirt_data *ldata;
+
+	ldata = to_loravirt(lrdata);
+
+	lora_lock(lrdata);
+	meta->rx_ns = ldata->last.ts;
+	meta->tx_ns = ldata->txdone_ns;
+	meta->rssi = ldata->last.rssi;
+	meta->snr = ldata->last.snr;
+	meta->len = ldata->last.len;
+	meta->reserved = 0;
+	lora_unlock(lrdata);
+
+	return 0;
+}
+
+/**
+ * loravirt_getpktstat - Get the signal of the packet last read
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the struct lora_pkt_stat in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+loravirt_getpktstat(struct lora_struct *lrdata, void __user *arg)
+{
+	struct lora_pkt_meta meta;
+	struct lora_pkt_stat st;
+
+	loravirt_getpktmeta(lrdata, &meta);
+	st.rssi = meta.rssi;
+	st.snr = meta.snr;
+	st.len = meta.len;
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * loravirt_getchipstat - Get the valid header and packet counters
+ * @lrdata:	LoRa device
+ * @st:		the statistics going to hold the counters
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static long
+loravirt_getchipstat(struct lora_struct *lrdata, struct lora_stats *st)
+{
+	struct loravirt_data *ldata;
+	unsigned long flags;
+
+	ldata = to_loravirt(lrdata);
+
+	/* The chip's counters are 16 bits. */
+	spin_lock_irqsave(&(medium.lock), flags);
+	st->chip_rx_headers = ldata->rx_headers & 0xFFFF;
+	st->chip_rx_packets = ldata->rx_packets & 0xFFFF;
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	return 0;
+}
+
+/**
+ * loravirt_ready2write - Is ready to be written
+ * @lrdata:	LoRa device
+ *
+ * Return:	1 / 0 for ready / not ready
+ */
+static long
+loravirt_ready2write(struct lora_struct *lrdata)
+{
+	/* Mutex is not lock, than it is not writing. */
+	return mutex_is_locked(&(lrdata->buf_lock)) ? 0 : 1;
+}
+
+/**
+ * loravirt_ready2read - Is ready to be read
+ * @lrdata:	LoRa device
+ *
+ * Return:	1 / 0 for ready / not ready
+ */
+static long
+loravirt_ready2read(struct lora_struct *lrdata)
+{
+	return READ_ONCE(to_loravirt(lrdata)->npkt) > 0;
+}
+
+struct lora_driver lr_driver = {
+	.name = __DRIVER_NAME,
+	.num = N_LORAVIRT_MINORS,
+	.owner = THIS_MODULE,
+};
+
+struct lora_operations lrops = {
+	.read = loravirt_read,
+	.write = loravirt_write,
+	.xmit = loravirt_xmit,
+	.recv = loravirt_recv,
+	.setState = loravirt_setstate,
+	.getState = loravirt_getstate,
+	.setFreq = loravirt_setfreq,
+	.getFreq = loravirt_getfreq,
+	.setPower = loravirt_setpower,
+	.getPower = loravirt_getpower,
+	.setSPRFactor = loravirt_setsprfactor,
+	.getSPRFactor = loravirt_getsprfactor,
+	.setBW = loravirt_setbandwidth,
+	.getBW = loravirt_getbandwidth,
+	.getRSSI = loravirt_getrssi,
+	.getSNR = loravirt_getsnr,
+	.setCR = loravirt_setcr,
+	.getCR = loravirt_getcr,
+	.setCRC = loravirt_setcrc,
+	.getCRC = loravirt_getcrc,
+	.setImplicit = loravirt_setimplicit,
+	.getImplicit = loravirt_getimplicit,
+	.setMaxPayload = loravirt_setmaxpayload,
+	.getFIFOStat = loravirt_getfifostat,
+	.getPktStat = loravirt_getpktstat,
+	.getPktMeta = loravirt_getpktmeta,
+	.setParam = loravirt_setparam,
+	.getParam = loravirt_getparam,
+	.getChipStat = loravirt_getchipstat,
+	.ready2write = loravirt_ready2write,
+	.ready2read = loravirt_ready2read,
+	.startRX = loravirt_startrx,
+	.getMaxTx = loravirt_getmaxtx,
+};
+
+/*------------------------------ Medium Controls -----------------------------*/
+
+static int
+loravirt_pathloss_show(struct seq_file *s, void *v)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < medium.nradio; i++) {
+		for (j = 0; j < medium.nradio; j++)
+			seq_printf(s, "%5d", medium.pathloss[i][j]);
+		seq_puts(s, "\n");
+	}
+
+	return 0;
+}
+
+static int
+loravirt_pathloss_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, loravirt_pathloss_show, NULL);
+}
+
+/**
+ * loravirt_pathloss_write - Set the path loss between the radios
+ * @filp:	the pathloss file
+ * @buf:	"<a> <b> <dB>" for the radios a and b, or "<dB>" for all
+ * @size:	the length of the buffer in bytes
+ * @pos:	the position of the file
+ *
+ * Return:	the written bytes, negative number for error
+ */
+static ssize_t
+loravirt_pathloss_write(struct file *filp, const char __user *buf,
+			size_t size, loff_t *pos)
+{
+	char str[32];
+	unsigned long flags;
+	unsigned int a, b, i, j;
+	int db;
+
+	if (size >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buf, size))
+		return -EFAULT;
+	str[size] = '\0';
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	if (sscanf(str, "%u %u %d", &a, &b, &db) == 3) {
+		if ((a >= medium.nradio) || (b >= medium.nradio)) {
+			spin_unlock_irqrestore(&(medium.lock), flags);
+			return -EINVAL;
+		}
+		medium.pathloss[a][b] = db;
+		medium.pathloss[b][a] = db;
+	}
+	else if (sscanf(str, "%d", &db) == 1) {
+		for (i = 0; i < medium.nradio; i++)
+			for (j = 0; j < medium.nradio; j++)
+				medium.pathloss[i][j] = db;
+	}
+	else {
+		spin_unlock_irqrestore(&(medium.lock), flags);
+		return -EINVAL;
+	}
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	return size;
+}
+
+static const struct file_operations loravirt_pathloss_fops = {
+	.owner		= THIS_MODULE,
+	.open		= loravirt_pathloss_open,
+	.read		= seq_read,
+	.write		= loravirt_pathloss_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+loravirt_medium_show(struct seq_file *s, void *v)
+{
+	struct loravirt_medium_stat st;
+	struct loravirt_air *air;
+	unsigned long flags;
+	unsigned int onair = 0;
+
+	spin_lock_irqsave(&(medium.lock), flags);
+	st = medium.stat;
+	list_for_each_entry(air, &(medium.air), entry) {
+		if (!air->aired)
+			onair++;
+	}
+	spin_unlock_irqrestore(&(medium.lock), flags);
+
+	seq_printf(s, "sent:      %llu\n",
+		   (unsigned long long)st.sent);
+	seq_printf(s, "delivered: %llu\n",
+		   (unsigned long long)st.delivered);
+	seq_printf(s, "collided:  %llu\n",
+		   (unsigned long long)st.collided);
+	seq_printf(s, "weak:      %llu\n",
+		   (unsigned long long)st.weak);
+	seq_printf(s, "injected:  %llu\n",
+		   (unsigned long long)st.injected);
+	seq_printf(s, "on air:    %u\n", onair);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(loravirt_medium);
+
+/*------------------------------- Virtual Radios -----------------------------*/
+
+/**
+ * loravirt_radio_add - Create a virtual radio
+ * @id:		the index of the radio on the medium, and its minor number
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+loravirt_radio_add(unsigned int id)
+{
+	struct loravirt_data *ldata;
+	struct lora_struct *lrdata;
+	int status;
+
+	ldata = kzalloc(sizeof(struct loravirt_data), GFP_KERNEL);
+	if (ldata == NULL)
+		return -ENOMEM;
+	lrdata = &(ldata->lrdata);
+
+	/* The reset settings of the SX127x. */
+	ldata->id = id;
+	ldata->state = LORA_STATE_RX;
+	ldata->freq = 434000000;
+	ldata->power = 17;
+	ldata->sprf = 128;
+	ldata->bw = 125000;
+	ldata->cr = 5;
+	ldata->maxpayload = LORAVIRT_MAXLEN;
+	ldata->prelen = 8;
+	init_completion(&(ldata->txdone));
+	init_waitqueue_head(&(ldata->rxq));
+
+	lrdata->ops = &lrops;
+	lrdata->devt = MKDEV(lr_driver.major, id);
+	mutex_init(&(lrdata->buf_lock));
+	init_waitqueue_head(&(lrdata->waitqueue));
+	status = lora_device_add(lrdata);
+	if (status) {
+		kfree(ldata);
+		return status;
+	}
+
+	ldata->dev = device_create(lr_driver.lora_class, NULL, lrdata->devt,
+				   lrdata, "loraVIRT%u", id);
+	status = PTR_ERR_OR_ZERO(ldata->dev);
+	if (status) {
+		lora_device_remove(lrdata);
+		kfree(ldata);
+		return status;
+	}
+	lrdata->lora_device = ldata->dev;
+	lora_device_debugfs(&lr_driver, lrdata, dev_name(ldata->dev));
+
+	spin_lock_irq(&(medium.lock));
+	medium.radio[id] = ldata;
+	medium.nradio = id + 1;
+	spin_unlock_irq(&(medium.lock));
+
+	/* The interface is up only after the radio is on the air. */
+	if (lora_device_netdev(&lr_driver, lrdata, ldata->dev))
+		dev_warn(ldata->dev, "no network interface\n");
+
+	return 0;
+}
+
+/**
+ * loravirt_radio_remove - Remove a virtual radio
+ * @ldata:	the virtual radio, nothing is on the air any more
+ */
+static void
+loravirt_radio_remove(struct loravirt_data *ldata)
+{
+	/* The statistics go away before their counters. */
+	device_destroy(lr_driver.lora_class, ldata->lrdata.devt);
+	lora_device_remove(&(ldata->lrdata));
+	kfree(ldata);
+}
+
+/* LoRa-VIRT kernel module's initial function. */
+static int loravirt_init(void)
+{
+	unsigned int i, j;
+	int status;
+
+	pr_debug("lora-virt: init virtual LoRa radios\n");
+
+	if ((radios == 0) || (radios > N_LORAVIRT_MINORS))
+		return -EINVAL;
+
+	spin_lock_init(&(medium.lock));
+	INIT_LIST_HEAD(&(medium.air));
+	for (i = 0; i < N_LORAVIRT_MINORS; i++)
+		for (j = 0; j < N_LORAVIRT_MINORS; j++)
+			medium.pathloss[i][j] = pathloss;
+
+	/* Register a kind of LoRa driver. */
+	status = lora_register_driver(&lr_driver);
+	if (status)
+		return status;
+	debugfs_create_file("pathloss", S_IRUSR | S_IWUSR, lr_driver.debugfs,
+			    NULL, &loravirt_pathloss_fops);
+	debugfs_create_file("medium", S_IRUSR, lr_driver.debugfs, NULL,
+			    &loravirt_medium_fops);
+
+	for (i = 0; i < radios; i++) {
+		status = loravirt_radio_add(i);
+		if (status)
+			break;
+	}
+	if (status) {
+		while (i-- > 0)
+			loravirt_radio_remove(medium.radio[i]);
+		lora_unregister_driver(&lr_driver);
+	}
+
+	return status;
+}
+
+/* LoRa-VIRT kernel module's exit function. */
+static void loravirt_exit(void)
+{
+	struct loravirt_air *air, *n;
+	unsigned int i;
+	LIST_HEAD(all);
+
+	pr_debug("lora-virt: exit\n");
+
+	/* Take all the packets off the air before the radios go away. */
+	spin_lock_irq(&(medium.lock));
+	medium.closing = 1;
+	list_splice_init(&(medium.air), &all);
+	spin_unlock_irq(&(medium.lock));
+	list_for_each_entry_safe(air, n, &all, entry) {
+		hrtimer_cancel(&(air->timer));
+		kfree(air);
+	}
+
+	for (i = 0; i < medium.nradio; i++)
+		loravirt_radio_remove(medium.radio[i]);
+	/* Unregister the lora driver. */
+	lora_unregister_driver(&lr_driver);
+}
+
+module_init(loravirt_init);
+module_exit(loravirt_exit);
+
+MODULE_AUTHOR("Jian-Hong Pan, <starnight@g.ncu.edu.tw>");
+MODULE_DESCRIPTION("Virtual LoRa radios sharing a simulated air");
+MODULE_LICENSE("Dual BSD/GPL");
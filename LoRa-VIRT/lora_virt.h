@@ -0,0 +1,220 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_VIRT_H__
+#define __LORA_VIRT_H__
+
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "lora.h"
+
+/* The max number of the virtual radios, each is a bit of the masks. */
+#define N_LORAVIRT_MINORS	32
+/* The max payload length of a LoRa packet. */
+#define LORAVIRT_MAXLEN		255
+/* How many received packets a virtual radio queues for its readers. */
+#define LORAVIRT_RXQ		16
+/* A packet survives a collision if it is this much stronger, in dB. */
+#define LORAVIRT_CAPTURE_DB	6
+
+/**
+ * struct loravirt_pkt: A packet received by a virtual radio
+ * @buf:		The payload
+ * @len:		The length of the payload
+ * @rssi:		The RSSI of the packet in dBm
+ * @snr:		The SNR of the packet in 0.25 dB
+ * @ts:			The time the packet was received in ns
+ */
+struct loravirt_pkt {
+	uint8_t buf[LORAVIRT_MAXLEN];
+	uint8_t len;
+	int16_t rssi;
+	int8_t snr;
+	u64 ts;
+};
+
+/**
+ * struct loravirt_data: A virtual LoRa radio
+ * @lrdata:		The LoRa device registered into the LoRa framework
+ * @id:			The index of the radio on the medium
+ * @dev:		The device of the radio's character device
+ * @txdone:		Completed when the packet being sent has left the air
+ * @rxq:		The readers wait on it for the received packets
+ * @state:		The state, LORA_STATE_*
+ * @freq:		The carrier frequency in Hz
+ * @power:		The PA output power in dBm
+ * @sprf:		The spreading factor in chips / symbol
+ * @bw:			The RF bandwidth in Hz
+ * @cr:			The coding rate denominator, 5 ~ 8
+ * @crc:		1 / 0 for the payload CRC enabled / disabled
+ * @implicit:		The fixed payload length in Implicit Header Mode,
+ *			0 for Explicit Header Mode
+ * @maxpayload:		The max payload length of the RX packets
+ * @prelen:		The preamble length in symbols
+ * @pkt:		The queue of the received packets
+ * @head:		Where the next received packet is queued
+ * @tail:		Where the next packet is read from
+ * @npkt:		How many packets are queued
+ * @overwrites:		How many packets have been overwritten before read
+ * @counted:		The overwrites which have been counted as dropped
+ * @rx_headers:		The valid headers received since RX, as the chip
+ * @rx_packets:		The valid packets received since RX, as the chip
+ * @queued:		How many packets have been queued
+ * @last:		The packet last read
+ * @tx_ns:		The time the packet being sent was written in ns
+ * @txdone_ns:		The time the packet last sent left the air in ns
+ */
+struct loravirt_data {
+	struct lora_struct lrdata;
+	unsigned int id;
+	struct device *dev;
+	struct completion txdone;
+	wait_queue_head_t rxq;
+	uint32_t state;
+	uint32_t freq;
+	int32_t power;
+	uint32_t sprf;
+	uint32_t bw;
+	uint32_t cr;
+	uint32_t crc;
+	uint32_t implicit;
+	uint32_t maxpayload;
+	uint32_t prelen;
+	struct loravirt_pkt pkt[LORAVIRT_RXQ];
+	unsigned int head;
+	unsigned int tail;
+	unsigned int npkt;
+	uint32_t overwrites;
+	uint32_t counted;
+	uint32_t rx_headers;
+	uint32_t rx_packets;
+	uint32_t queued;
+	struct loravirt_pkt last;
+	u64 tx_ns;
+	u64 txdone_ns;
+};
+
+#define to_loravirt(lr)	container_of(lr, struct loravirt_data, lrdata)
+
+/**
+ * struct loravirt_air: A packet on the air of the medium
+ * @entry:		The entry in the medium's packet list
+ * @timer:		Fires when the packet leaves the air, then when it is
+ *			delivered after the injected delay
+ * @tx:			The sending radio
+ * @freq:		The carrier frequency in Hz
+ * @power:		The PA output power in dBm
+ * @sprf:		The spreading factor in chips / symbol
+ * @bw:			The RF bandwidth in Hz
+ * @implicit:		The fixed payload length in Implicit Header Mode
+ * @buf:		The payload
+ * @len:		The length of the payload
+ * @listeners:		The radios which could demodulate it when it started
+ * @collided:		The radios where it is lost in a collision
+ * @deliver:		The radios it is delivered to after the delay
+ * @aired:		It has left the air
+ * @done:		It has been delivered, and it can be freed
+ */
+struct loravirt_air {
+	struct list_head entry;
+	struct hrtimer timer;
+	struct loravirt_data *tx;
+	uint32_t freq;
+	int32_t power;
+	uint32_t sprf;
+	uint32_t bw;
+	uint32_t implicit;
+	uint8_t buf[LORAVIRT_MAXLEN];
+	uint8_t len;
+	uint32_t listeners;
+	uint32_t collided;
+	uint32_t deliver;
+	uint8_t aired;
+	uint8_t done;
+};
+
+/**
+ * struct loravirt_medium_stat: The counters of the medium
+ * @sent:		The packets sent on the air
+ * @delivered:		The packets delivered to a radio
+ * @collided:		The packets lost at a radio in a collision
+ * @weak:		The packets under the demodulation floor at a radio
+ * @injected:		The packets dropped at a radio by the loss injection
+ */
+struct loravirt_medium_stat {
+	uint64_t sent;
+	uint64_t delivered;
+	uint64_t collided;
+	uint64_t weak;
+	uint64_t injected;
+};
+
+/**
+ * struct loravirt_medium: The air shared by the virtual radios
+ * @lock:		Protect the medium, the radios' queues and the radios'
+ *			settings used by the medium
+ * @air:		The packets on the air or waiting to be freed
+ * @radio:		The virtual radios
+ * @nradio:		How many virtual radios there are
+ * @pathloss:		The path loss between each two radios in dB
+ * @stat:		The counters of the medium
+ * @closing:		No more packets are sent, the module is exiting
+ */
+struct loravirt_medium {
+	spinlock_t lock;
+	struct list_head air;
+	struct loravirt_data *radio[N_LORAVIRT_MINORS];
+	unsigned int nradio;
+	int16_t pathloss[N_LORAVIRT_MINORS][N_LORAVIRT_MINORS];
+	struct loravirt_medium_stat stat;
+	uint8_t closing;
+};
+
+extern int lora_device_add(struct lora_struct *);
+extern int lora_device_remove(struct lora_struct *);
+extern void lora_device_debugfs(struct lora_driver *, struct lora_struct *,
+				const char *);
+extern int lora_device_netdev(struct lora_driver *, struct lora_struct *,
+			      struct device *);
+extern int lora_register_driver(struct lora_driver *);
+extern int lora_unregister_driver(struct lora_driver *);
+
+#endif
@@ -47,239 +47,2560 @@
 #include <linux/errno.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/bitmap.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/version.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_arp.h>
+#include <linux/skbuff.h>
+#include <linux/ethtool.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/capability.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/signal.h>
+#else
+#include <linux/sched.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+#include <linux/io_uring/cmd.h>
+#define LORA_URING
+/* The multishot command gets the provided buffers since 6.18. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 18, 0)
+#define LORA_URING_MSHOT
+#endif
+#endif
+
+#include "lora.h"
+
+static LIST_HEAD(device_list);
+static DEFINE_MUTEX(device_list_lock);
+
+#ifndef LORA_BUFLEN
+#define LORA_BUFLEN	255
+#endif
+
+/* The qdisc holds the backlog, so the interface's own queue is short. */
+#define LORA_NET_TXQLEN	16
+
+static bool lora_netdev;
+module_param_named(netdev, lora_netdev, bool, 0444);
+MODULE_PARM_DESC(netdev, "Create a network interface for each LoRa device");
+
+/**
+ * lora_device_get - Have the RX/TX buffers of a LoRa device for a new user
+ * @lrdata:	the LoRa device
+ *
+ * The files and the network interface are the users.  It is called with
+ * device_list_lock held.
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+lora_device_get(struct lora_struct *lrdata)
+{
+	/* Have the RX/TX memory buffer. */
+	if (!(lrdata->rx_buf)) {
+		lrdata->rx_buf = kzalloc(LORA_BUFLEN, GFP_KERNEL);
+		if (!(lrdata->rx_buf)) {
+			pr_err("lora: no more memory\n");
+			return -ENOMEM;
+		}
+	}
+	if (!(lrdata->tx_buf)) {
+		lrdata->tx_buf = kzalloc(LORA_BUFLEN, GFP_KERNEL);
+		if (!(lrdata->tx_buf)) {
+			pr_err("lora: no more memory\n");
+			kfree(lrdata->rx_buf);
+			lrdata->rx_buf = NULL;
+			return -ENOMEM;
+		}
+	}
+	lrdata->rx_buflen = 0;
+	lrdata->tx_buflen = 0;
+	lrdata->bufmaxlen = LORA_BUFLEN;
+	lrdata->users++;
+
+	return 0;
+}
+
+/**
+ * lora_device_put - Release the RX/TX buffers of a LoRa device after the
+ *		     last user
+ * @lrdata:	the LoRa device
+ *
+ * It is called with device_list_lock held.
+ */
+static void
+lora_device_put(struct lora_struct *lrdata)
+{
+	if (lrdata->users > 0)
+		lrdata->users--;
+	
+	/* Last close */
+	if (lrdata->users == 0) {
+		kfree(lrdata->rx_buf);
+		kfree(lrdata->tx_buf);
+		lrdata->rx_buf = NULL;
+		lrdata->tx_buf = NULL;
+	}
+}
+
+/**
+ * lora_max_payload - Get the most bytes a packet of a LoRa device carries
+ * @lrdata:	the LoRa device
+ *
+ * It is the driver's effective payload with the current settings, as the
+ * fixed length of implicit header mode or the buffer less the overhead of
+ * the secured frames, and the buffer's length without the driver's own.
+ *
+ * Return:	the most bytes of a packet
+ */
+static size_t
+lora_max_payload(struct lora_struct *lrdata)
+{
+	long max;
+
+	max = lrdata->bufmaxlen;
+	if (lrdata->ops->getMaxTx != NULL)
+		max = min_t(long, max, lrdata->ops->getMaxTx(lrdata));
+
+	return (max > 0) ? max : 0;
+}
+
+/**
+ * lora_net_fit_mtu - Fit the MTU of the network interface to the payload
+ * @lrdata:	the LoRa device whose settings have been changed
+ *
+ * It takes RTNL, so it is not called under RTNL.  The interface is cleared
+ * under RTNL before it is freed.
+ */
+static void
+lora_net_fit_mtu(struct lora_struct *lrdata)
+{
+	struct net_device *ndev;
+	unsigned int max;
+
+	rtnl_lock();
+	ndev = lrdata->netdev;
+	if ((ndev != NULL) && (ndev->reg_state == NETREG_REGISTERED)) {
+		max = max_t(unsigned int, lora_max_payload(lrdata),
+			    ndev->min_mtu);
+		ndev->max_mtu = max;
+		if (ndev->mtu > max)
+			dev_set_mtu(ndev, max);
+	}
+	rtnl_unlock();
+}
+
+static int
+file_open(struct inode *inode, struct file *filp)
+{
+	struct lora_struct *lrdata;
+	int status = -ENXIO;
+
+	pr_debug("lora: open file\n");
+	
+	mutex_lock(&device_list_lock);
+	/* Find the lora data in device_entry with matched dev_t in inode. */
+	list_for_each_entry(lrdata, &device_list, device_entry) {
+		if (lrdata->devt == inode->i_rdev) {
+			status = 0;
+			break;
+		}
+	}
+
+	if (status) {
+		pr_debug("lora: nothing for minor %d\n", iminor(inode));
+		goto err_find_dev;
+	}
+
+	status = lora_device_get(lrdata);
+	if (status)
+		goto err_find_dev;
+	mutex_unlock(&device_list_lock);
+
+	/* Map the data location to the file data pointer. */
+	filp->private_data = lrdata;
+	/* This a character device, so it is not seekable. */
+	nonseekable_open(inode, filp);
+
+	return 0;
+
+err_find_dev:
+	mutex_unlock(&device_list_lock);
+
+	return status;
+}
+
+static int
+file_close(struct inode *inode, struct file *filp)
+{
+	struct lora_struct *lrdata;
+	
+	pr_debug("lora: close file\n");
+	
+	lrdata = filp->private_data;
+
+	mutex_lock(&device_list_lock);
+	filp->private_data = NULL;
+	lora_device_put(lrdata);
+	mutex_unlock(&device_list_lock);
+
+	return 0;
+}
+
+/**
+ * lora_frag_maxsize - Get the most payload bytes of a fragment
+ * @lrdata:	LoRa device
+ *
+ * Return:	the most bytes of a packet without the fragment's header
+ */
+static size_t
+lora_frag_maxsize(struct lora_struct *lrdata)
+{
+	size_t max;
+
+	max = lora_max_payload(lrdata);
+
+	return (max > LORA_FRAG_HDRLEN) ? max - LORA_FRAG_HDRLEN : 0;
+}
+
+/**
+ * lora_frag_expire - Drop the messages which are not reassembled in time
+ * @fr:		the fragmentation layer
+ */
+static void
+lora_frag_expire(struct lora_frag *fr)
+{
+	struct lora_frag_slot *s;
+	int i;
+
+	for (i = 0; i < LORA_FRAG_SLOTS; i++) {
+		s = &(fr->slot[i]);
+		if (s->used && time_after(jiffies, s->deadline)) {
+			s->used = 0;
+			fr->stat.rx_timeouts++;
+			fr->stat.rx_lost += s->cnt - s->nrcv;
+		}
+	}
+}
+
+/**
+ * lora_frag_pending - Is there any message being reassembled
+ * @fr:		the fragmentation layer
+ *
+ * Return:	1 / 0 for pending / nothing
+ */
+static int
+lora_frag_pending(struct lora_frag *fr)
+{
+	int i;
+
+	for (i = 0; i < LORA_FRAG_SLOTS; i++)
+		if (fr->slot[i].used)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * lora_frag_slot - Find or allocate the slot of the fragment's message
+ * @fr:		the fragmentation layer
+ * @id:		the id of the message
+ * @cnt:	how many fragments the message has
+ * @fsz:	the payload length of each fragment but the last one
+ *
+ * The oldest message is dropped, if the reassembly table is full.
+ *
+ * Return:	the slot of the message
+ */
+static struct lora_frag_slot *
+lora_frag_slot(struct lora_frag *fr, uint8_t id, uint8_t cnt, uint8_t fsz)
+{
+	struct lora_frag_slot *s;
+	struct lora_frag_slot *old;
+	int i;
+
+	old = NULL;
+	for (i = 0; i < LORA_FRAG_SLOTS; i++) {
+		s = &(fr->slot[i]);
+		if (s->used && (s->id == id) && (s->cnt == cnt)
+			&& (s->fsz == fsz))
+			return s;
+	}
+
+	for (i = 0; i < LORA_FRAG_SLOTS; i++) {
+		s = &(fr->slot[i]);
+		if (!s->used)
+			break;
+		if ((old == NULL) || time_before(s->deadline, old->deadline))
+			old = s;
+	}
+	if (i == LORA_FRAG_SLOTS) {
+		s = old;
+		fr->stat.rx_evicted++;
+		fr->stat.rx_lost += s->cnt - s->nrcv;
+	}
+
+	s->used = 1;
+	s->id = id;
+	s->cnt = cnt;
+	s->fsz = fsz;
+	s->nrcv = 0;
+	s->len = 0;
+	s->deadline = jiffies + msecs_to_jiffies(fr->param.timeout_ms);
+	bitmap_zero(s->got, LORA_FRAG_MAXCNT);
+
+	return s;
+}
+
+/**
+ * lora_frag_input - Put a received fragment into the reassembly table
+ * @fr:		the fragmentation layer
+ * @frame:	the received frame
+ * @len:	the length of the frame in bytes
+ *
+ * Return:	the slot of the reassembled message, NULL for not yet
+ */
+static struct lora_frag_slot *
+lora_frag_input(struct lora_frag *fr, uint8_t *frame, size_t len)
+{
+	struct lora_frag_slot *s;
+	uint8_t id, idx, cnt, fsz;
+	size_t plen;
+
+	if (len <= LORA_FRAG_HDRLEN) {
+		fr->stat.rx_invalid++;
+		return NULL;
+	}
+
+	id = frame[0];
+	idx = frame[1];
+	cnt = frame[2];
+	fsz = frame[3];
+	plen = len - LORA_FRAG_HDRLEN;
+	/* All of the fragments but the last one are full. */
+	if ((cnt == 0) || (idx >= cnt) || (plen > fsz)
+		|| ((idx < cnt - 1) && (plen != fsz))
+		|| ((cnt * fsz) > LORA_FRAG_MAXMSG)) {
+		fr->stat.rx_invalid++;
+		return NULL;
+	}
+	fr->stat.rx_frags++;
+
+	s = lora_frag_slot(fr, id, cnt, fsz);
+	if (test_and_set_bit(idx, s->got)) {
+		fr->stat.rx_dups++;
+		return NULL;
+	}
+	memcpy(s->buf + idx * fsz, frame + LORA_FRAG_HDRLEN, plen);
+	s->nrcv++;
+	if (idx == cnt - 1)
+		s->len = idx * fsz + plen;
+
+	return (s->nrcv == s->cnt) ? s : NULL;
+}
+
+/**
+ * lora_frag_recv - Receive a reassembled message
+ * @lrdata:	LoRa device
+ * @buf:	the buffer going to hold the message in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * The rest of the message is dropped, if the buffer is too short.
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_frag_recv(struct lora_struct *lrdata, uint8_t *buf, size_t size)
+{
+	struct lora_frag *fr;
+	struct lora_frag_slot *s;
+	ssize_t ret;
+	ssize_t c;
+
+	fr = lrdata->frag;
+
+	mutex_lock(&(fr->rx_lock));
+	for (;;) {
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		lora_frag_expire(fr);
+		c = lrdata->ops->recv(lrdata, fr->rxframe, sizeof(fr->rxframe));
+		if (c < 0) {
+			/* Keep waiting while a message is being reassembled. */
+			if (lora_frag_pending(fr))
+				continue;
+			ret = c;
+			break;
+		}
+
+		s = lora_frag_input(fr, fr->rxframe, c);
+		if (s != NULL) {
+			ret = min_t(size_t, size, s->len);
+			memcpy(buf, s->buf, ret);
+			s->used = 0;
+			fr->stat.rx_msgs++;
+			break;
+		}
+	}
+	mutex_unlock(&(fr->rx_lock));
+
+	return ret;
+}
+
+/**
+ * lora_frag_send - Send a message as several fragments
+ * @lrdata:	LoRa device
+ * @msg:	the buffer holding the message in kernel space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_frag_send(struct lora_struct *lrdata, const uint8_t *msg, size_t size)
+{
+	struct lora_frag *fr;
+	size_t fsz, len, cnt, i;
+	ssize_t ret;
+	ssize_t c;
+
+	fr = lrdata->frag;
+	/* The settings may have shrunk the packets after the fragmentation
+	 * was set, and each fragment tells its size. */
+	fsz = min_t(size_t, fr->param.fragsize, lora_frag_maxsize(lrdata));
+	if (size == 0)
+		return 0;
+	if (fsz == 0)
+		return -EMSGSIZE;
+	cnt = DIV_ROUND_UP(size, fsz);
+	if ((size > LORA_FRAG_MAXMSG) || (cnt > LORA_FRAG_MAXCNT))
+		return -EMSGSIZE;
+
+	mutex_lock(&(fr->tx_lock));
+	ret = size;
+	for (i = 0; i < cnt; i++) {
+		len = min_t(size_t, fsz, size - i * fsz);
+		fr->txframe[0] = fr->txid;
+		fr->txframe[1] = i;
+		fr->txframe[2] = cnt;
+		fr->txframe[3] = fsz;
+		memcpy(fr->txframe + LORA_FRAG_HDRLEN, msg + i * fsz, len);
+
+		c = lrdata->ops->xmit(lrdata, fr->txframe,
+				      LORA_FRAG_HDRLEN + len);
+		if (c != (LORA_FRAG_HDRLEN + len)) {
+			ret = (c < 0) ? c : -EIO;
+			fr->stat.tx_errors++;
+			break;
+		}
+		fr->stat.tx_frags++;
+	}
+	if (ret > 0)
+		fr->stat.tx_msgs++;
+	fr->txid++;
+	mutex_unlock(&(fr->tx_lock));
+
+	return ret;
+}
+
+/**
+ * lora_frag_read - Read a reassembled message
+ * @lrdata:	LoRa device
+ * @buf:	the buffer going to hold the message in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_frag_read(struct lora_struct *lrdata, char __user *buf, size_t size)
+{
+	uint8_t *msg;
+	ssize_t ret;
+
+	size = min_t(size_t, size, LORA_FRAG_MAXMSG);
+	msg = kmalloc(size, GFP_KERNEL);
+	if (msg == NULL)
+		return -ENOMEM;
+
+	ret = lora_frag_recv(lrdata, msg, size);
+	if ((ret > 0) && copy_to_user(buf, msg, ret))
+		ret = -EFAULT;
+	kfree(msg);
+
+	return ret;
+}
+
+/**
+ * lora_frag_write - Write a message as several fragments
+ * @lrdata:	LoRa device
+ * @buf:	the buffer holding the message in user space
+ * @size:	the length of the buffer in bytes
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_frag_write(struct lora_struct *lrdata, const char __user *buf,
+		size_t size)
+{
+	uint8_t *msg;
+	ssize_t ret;
+
+	if (size == 0)
+		return 0;
+	if (size > LORA_FRAG_MAXMSG)
+		return -EMSGSIZE;
+
+	msg = kmalloc(size, GFP_KERNEL);
+	if (msg == NULL)
+		return -ENOMEM;
+	if (copy_from_user(msg, buf, size)) {
+		kfree(msg);
+		return -EFAULT;
+	}
+
+	ret = lora_frag_send(lrdata, msg, size);
+	kfree(msg);
+
+	return ret;
+}
+
+/**
+ * lora_frag_alloc - Allocate the fragmentation layer of the LoRa device
+ * @lrdata:	LoRa device
+ *
+ * Return:	the fragmentation layer, NULL for no more memory
+ */
+static struct lora_frag *
+lora_frag_alloc(struct lora_struct *lrdata)
+{
+	struct lora_frag *fr;
+	int i;
+
+	mutex_lock(&device_list_lock);
+	fr = lrdata->frag;
+	if (fr != NULL)
+		goto end_alloc;
+
+	fr = kzalloc(sizeof(struct lora_frag), GFP_KERNEL);
+	if (fr == NULL)
+		goto end_alloc;
+	for (i = 0; i < LORA_FRAG_SLOTS; i++) {
+		fr->slot[i].buf = kmalloc(LORA_FRAG_MAXMSG, GFP_KERNEL);
+		if (fr->slot[i].buf == NULL)
+			break;
+	}
+	if (i < LORA_FRAG_SLOTS) {
+		while (i-- > 0)
+			kfree(fr->slot[i].buf);
+		kfree(fr);
+		fr = NULL;
+		goto end_alloc;
+	}
+	mutex_init(&(fr->tx_lock));
+	mutex_init(&(fr->rx_lock));
+	lrdata->frag = fr;
+
+end_alloc:
+	mutex_unlock(&device_list_lock);
+
+	return fr;
+}
+
+/**
+ * lora_frag_free - Free the fragmentation layer of the LoRa device
+ * @lrdata:	LoRa device
+ */
+static void
+lora_frag_free(struct lora_struct *lrdata)
+{
+	int i;
+
+	if (lrdata->frag == NULL)
+		return;
+
+	for (i = 0; i < LORA_FRAG_SLOTS; i++)
+		kfree(lrdata->frag->slot[i].buf);
+	kfree(lrdata->frag);
+	lrdata->frag = NULL;
+}
+
+/**
+ * lora_frag_set - Set the fragmentation of the LoRa device
+ * @lrdata:	LoRa device
+ * @arg:	the buffer holding the parameters in user space
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+lora_frag_set(struct lora_struct *lrdata, void __user *arg)
+{
+	struct lora_frag_param param;
+	struct lora_frag *fr;
+
+	if (copy_from_user(&param, arg, sizeof(param)))
+		return -EFAULT;
+	if (param.fragsize == 0)
+		param.fragsize = lora_frag_maxsize(lrdata);
+	if (param.timeout_ms == 0)
+		param.timeout_ms = 30000;
+	if ((param.fragsize == 0)
+		|| (param.fragsize > lora_frag_maxsize(lrdata)))
+		return -EINVAL;
+	if (param.enable && ((lrdata->ops->xmit == NULL)
+		|| (lrdata->ops->recv == NULL)))
+		return -EOPNOTSUPP;
+
+	fr = lora_frag_alloc(lrdata);
+	if (fr == NULL)
+		return -ENOMEM;
+
+	/* Wait for the fragmented read & write on going. */
+	mutex_lock(&(fr->tx_lock));
+	mutex_lock(&(fr->rx_lock));
+	fr->param = param;
+	fr->param.enable = (param.enable != 0);
+	mutex_unlock(&(fr->rx_lock));
+	mutex_unlock(&(fr->tx_lock));
+
+	return 0;
+}
+
+/**
+ * lora_frag_get - Get the parameters or the counters of the fragmentation
+ * @lrdata:	LoRa device
+ * @arg:	the buffer going to hold the result in user space
+ * @stat:	1 / 0 for the counters / parameters
+ *
+ * Return:	0 / other values for success / error
+ */
+static long
+lora_frag_get(struct lora_struct *lrdata, void __user *arg, int stat)
+{
+	struct lora_frag_param param;
+	struct lora_frag_stat st;
+	struct lora_frag *fr;
+	long ret;
+
+	memset(&param, 0, sizeof(param));
+	memset(&st, 0, sizeof(st));
+	fr = lrdata->frag;
+	if (fr != NULL) {
+		mutex_lock(&(fr->rx_lock));
+		param = fr->param;
+		st = fr->stat;
+		mutex_unlock(&(fr->rx_lock));
+	}
+
+	if (stat)
+		ret = copy_to_user(arg, &st, sizeof(st));
+	else
+		ret = copy_to_user(arg, &param, sizeof(param));
+
+	return ret ? -EFAULT : 0;
+}
+
+/**
+ * lora_stats_fetch - Take a consistent snapshot of the device's counters
+ * @lrdata:	the LoRa device
+ * @st:		the buffer going to hold the counters
+ * @chip:	also read the chip's own counters or not
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+lora_stats_fetch(struct lora_struct *lrdata, struct lora_stats *st, int chip)
+{
+	struct lora_pcpu_stats *p;
+	struct lora_stats v;
+	unsigned int start;
+	int cpu;
+
+	memset(st, 0, sizeof(*st));
+	if ((lrdata == NULL) || (lrdata->stats == NULL))
+		return -ENODEV;
+
+	for_each_possible_cpu(cpu) {
+		p = per_cpu_ptr(lrdata->stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&(p->syncp));
+			v = p->stats;
+		} while (u64_stats_fetch_retry(&(p->syncp), start));
+
+		st->rx_packets += v.rx_packets;
+		st->rx_bytes += v.rx_bytes;
+		st->rx_crcerrors += v.rx_crcerrors;
+		st->rx_timeouts += v.rx_timeouts;
+		st->rx_dropped += v.rx_dropped;
+		st->tx_packets += v.tx_packets;
+		st->tx_bytes += v.tx_bytes;
+		st->tx_timeouts += v.tx_timeouts;
+		st->spi_transactions += v.spi_transactions;
+		st->spi_errors += v.spi_errors;
+	}
+
+	if (chip && (lrdata->ops->getChipStat != NULL))
+		return lrdata->ops->getChipStat(lrdata, st);
+
+	return 0;
+}
+
+/**
+ * lora_stats_get - Copy a snapshot of the device's counters to user space
+ * @lrdata:	the LoRa device
+ * @arg:	the user space buffer going to hold the struct lora_stats
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static long
+lora_stats_get(struct lora_struct *lrdata, void __user *arg)
+{
+	struct lora_stats st;
+	int status;
+
+	status = lora_stats_fetch(lrdata, &st, 1);
+	if (status < 0)
+		return status;
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/* Each counter is a read-only file in the statistics directory. */
+#define LORA_STATS_ATTR(field, chip)					\
+static ssize_t								\
+field##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{									\
+	struct lora_stats st;						\
+	int status;							\
+									\
+	status = lora_stats_fetch(dev_get_drvdata(dev), &st, chip);	\
+	if (status < 0)							\
+		return status;						\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)st.field);	\
+}									\
+static DEVICE_ATTR_RO(field)
+
+LORA_STATS_ATTR(rx_packets, 0);
+LORA_STATS_ATTR(rx_bytes, 0);
+LORA_STATS_ATTR(rx_crcerrors, 0);
+LORA_STATS_ATTR(rx_timeouts, 0);
+LORA_STATS_ATTR(rx_dropped, 0);
+LORA_STATS_ATTR(tx_packets, 0);
+LORA_STATS_ATTR(tx_bytes, 0);
+LORA_STATS_ATTR(tx_timeouts, 0);
+LORA_STATS_ATTR(spi_transactions, 0);
+LORA_STATS_ATTR(spi_errors, 0);
+LORA_STATS_ATTR(chip_rx_headers, 1);
+LORA_STATS_ATTR(chip_rx_packets, 1);
+
+static struct attribute *lora_stats_attrs[] = {
+	&dev_attr_rx_packets.attr,
+	&dev_attr_rx_bytes.attr,
+	&dev_attr_rx_crcerrors.attr,
+	&dev_attr_rx_timeouts.attr,
+	&dev_attr_rx_dropped.attr,
+	&dev_attr_tx_packets.attr,
+	&dev_attr_tx_bytes.attr,
+	&dev_attr_tx_timeouts.attr,
+	&dev_attr_spi_transactions.attr,
+	&dev_attr_spi_errors.attr,
+	&dev_attr_chip_rx_headers.attr,
+	&dev_attr_chip_rx_packets.attr,
+	NULL,
+};
+
+static const struct attribute_group lora_stats_group = {
+	.name = "statistics",
+	.attrs = lora_stats_attrs,
+};
+
+static const struct attribute_group *lora_dev_groups[] = {
+	&lora_stats_group,
+	NULL,
+};
+
+static const char * const lora_hist_names[LORA_HIST_NUM] = {
+	[LORA_HIST_TX_LOAD] = "tx_load",
+	[LORA_HIST_TX_START] = "tx_start",
+	[LORA_HIST_TX_AIR] = "tx_air",
+	[LORA_HIST_RX_FIFO] = "rx_fifo",
+	[LORA_HIST_RX_READY] = "rx_ready",
+	[LORA_HIST_RX_COPY] = "rx_copy",
+	[LORA_HIST_SPI] = "spi",
+	[LORA_HIST_LOCK_WAIT] = "lock_wait",
+	[LORA_HIST_LOCK_HOLD] = "lock_hold",
+};
+
+/**
+ * lora_hist_pct - Find the bucket holding a percentile of a histogram
+ * @b:		the buckets of the histogram
+ * @total:	how many latencies are counted in the histogram
+ * @permil:	the percentile in per mille
+ *
+ * Return:	The upper bound of the bucket in ns
+ */
+static u64
+lora_hist_pct(const unsigned long *b, unsigned long total, unsigned int permil)
+{
+	unsigned long sum;
+	u64 want;
+	int i;
+
+	want = div_u64((u64)total * permil + 999, 1000);
+	for (sum = 0, i = 0; i < LORA_HIST_BUCKETS - 1; i++) {
+		sum += b[i];
+		if (sum >= want)
+			break;
+	}
+
+	return (2ULL << i) - 1;
+}
+
+/**
+ * lora_hist_show - Show the latency histograms of a LoRa device
+ * @s:		the sequence file of the latency in debugfs
+ * @v:		not used
+ *
+ * Return:	0 for success
+ */
+static int
+lora_hist_show(struct seq_file *s, void *v)
+{
+	struct lora_struct *lrdata = s->private;
+	unsigned long b[LORA_HIST_BUCKETS];
+	unsigned long total;
+	int id, i, cpu;
+
+	for (id = 0; id < LORA_HIST_NUM; id++) {
+		memset(b, 0, sizeof(b));
+		for_each_possible_cpu(cpu)
+			for (i = 0; i < LORA_HIST_BUCKETS; i++)
+				b[i] += per_cpu_ptr(lrdata->hist,
+						    cpu)->bucket[id][i];
+		for (total = 0, i = 0; i < LORA_HIST_BUCKETS; i++)
+			total += b[i];
+
+		seq_printf(s, "%s: %lu samples", lora_hist_names[id], total);
+		if (total > 0)
+			seq_printf(s, ", p50 < %llu p99 < %llu p99.9 < %llu ns",
+				   lora_hist_pct(b, total, 500),
+				   lora_hist_pct(b, total, 990),
+				   lora_hist_pct(b, total, 999));
+		seq_putc(s, '\n');
+		for (i = 0; i < LORA_HIST_BUCKETS; i++)
+			if (b[i] > 0)
+				seq_printf(s, "%14llu - %14llu ns: %lu\n",
+					   (i > 0) ? (1ULL << i) : 0,
+					   (2ULL << i) - 1, b[i]);
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lora_hist);
+
+/**
+ * lora_hist_reset - Clear the latency histograms of a LoRa device
+ * @filp:	the reset file in debugfs
+ * @buf:	anything written, not used
+ * @size:	the length of the buffer in bytes
+ * @pos:	not used
+ *
+ * Return:	The written length
+ */
+static ssize_t
+lora_hist_reset(struct file *filp, const char __user *buf, size_t size,
+		loff_t *pos)
+{
+	struct lora_struct *lrdata = filp->private_data;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(lrdata->hist, cpu), 0,
+		       sizeof(struct lora_pcpu_hist));
+
+	return size;
+}
+
+static const struct file_operations lora_hist_reset_fops = {
+	.owner	= THIS_MODULE,
+	.open	= simple_open,
+	.write	= lora_hist_reset,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 12, 0)
+	.llseek	= no_llseek,
+#endif
+};
+
+static ssize_t
+file_read(struct file *filp, char __user *buf, size_t size, loff_t *pos)
+{
+	struct lora_struct *lrdata;
+	ssize_t c;
+
+	pr_debug("lora: read file (size=%zu)\n", size);
+
+	lrdata = filp->private_data;
+
+	if ((lrdata->frag != NULL) && lrdata->frag->param.enable)
+		c = lora_frag_read(lrdata, buf, size);
+	else if (lrdata->ops->read != NULL)
+		c = lrdata->ops->read(lrdata, buf, size);
+	else
+		c = 0;
+
+	/* The device is free again, wake up the pollers waiting for it. */
+	wake_up_interruptible(&(lrdata->waitqueue));
+
+	return c;
+}
+
+static ssize_t
+file_write(struct file *filp, const char __user *buf, size_t size, loff_t *pos)
+{
+	struct lora_struct *lrdata;
+	ssize_t c;
+
+	pr_debug("lora: write file (size=%zu)\n", size);
+
+	lrdata = filp->private_data;
+
+	if ((lrdata->frag != NULL) && lrdata->frag->param.enable)
+		c = lora_frag_write(lrdata, buf, size);
+	else if (lrdata->ops->write != NULL) {
+		c = lrdata->ops->write(lrdata, buf, size);
+	}
+	else
+		c = 0;
+
+	/* The TX has finished, wake up the pollers waiting to write. */
+	wake_up_interruptible(&(lrdata->waitqueue));
+
+	return c;
+}
+
+/**
+ * lora_read_iter - Read a packet, or a reassembled message, into the iterator
+ * @lrdata:	the LoRa device
+ * @to:		the iterator going to hold the data
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_read_iter(struct lora_struct *lrdata, struct iov_iter *to)
+{
+	uint8_t *buf;
+	size_t size;
+	ssize_t c;
+	int frag;
+
+	frag = (lrdata->frag != NULL) && lrdata->frag->param.enable;
+	if (!frag && (lrdata->ops->recv == NULL))
+		return -EINVAL;
+
+	size = min_t(size_t, iov_iter_count(to),
+		     frag ? LORA_FRAG_MAXMSG : lrdata->bufmaxlen);
+	if (size == 0)
+		return 0;
+
+	buf = kmalloc(size, GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	if (frag)
+		c = lora_frag_recv(lrdata, buf, size);
+	else
+		c = lrdata->ops->recv(lrdata, buf, size);
+	if ((c > 0) && (copy_to_iter(buf, c, to) != c))
+		c = -EFAULT;
+	kfree(buf);
+	wake_up_interruptible(&(lrdata->waitqueue));
+
+	return c;
+}
+
+/**
+ * file_read_iter - Read a packet, or a reassembled message, into the iterator
+ * @iocb:	the I/O control block of the file
+ * @to:		the iterator going to hold the data, pipes for splice() too
+ *
+ * Return:	Read how many bytes actually, negative number for error
+ */
+static ssize_t
+file_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	return lora_read_iter(iocb->ki_filp->private_data, to);
+}
+
+/**
+ * lora_write_iter - Stream the data of the iterator as packets
+ * @lrdata:	the LoRa device
+ * @from:	the iterator holding the data
+ *
+ * The data is cut into packets of the device's effective payload, or
+ * messages if fragmentation is enabled.  Each packet is sent after the
+ * previous one has left the air, so the radio is paced by the time on air.
+ * A packet sent short ends the stream with the bytes sent so far.
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+lora_write_iter(struct lora_struct *lrdata, struct iov_iter *from)
+{
+	uint8_t *buf;
+	size_t max;
+	size_t n;
+	ssize_t total;
+	ssize_t ret;
+	ssize_t c;
+	int frag;
+
+	frag = (lrdata->frag != NULL) && lrdata->frag->param.enable;
+	if (!frag && (lrdata->ops->xmit == NULL))
+		return -EINVAL;
+
+	max = frag ? LORA_FRAG_MAXMSG : lora_max_payload(lrdata);
+	if (max == 0)
+		return -EMSGSIZE;
+	buf = kmalloc(max, GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	total = 0;
+	ret = 0;
+	while (iov_iter_count(from) > 0) {
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		n = copy_from_iter(buf, min_t(size_t, max,
+					      iov_iter_count(from)), from);
+		if (n == 0) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (frag)
+			c = lora_frag_send(lrdata, buf, n);
+		else
+			c = lrdata->ops->xmit(lrdata, buf, n);
+		if (c != n) {
+			if (c > 0)
+				total += c;
+			ret = (c < 0) ? c : -EIO;
+			break;
+		}
+		total += n;
+	}
+	kfree(buf);
+	wake_up_interruptible(&(lrdata->waitqueue));
+
+	return (total > 0) ? total : ret;
+}
+
+/**
+ * file_write_iter - Stream the data of the iterator as packets
+ * @iocb:	the I/O control block of the file
+ * @from:	the iterator holding the data, pipes for splice() too
+ *
+ * Return:	Write how many bytes actually, negative number for error
+ */
+static ssize_t
+file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	return lora_write_iter(iocb->ki_filp->private_data, from);
+}
+
+/**
+ * lora_ioctl - I/O control a LoRa device by the command
+ * @lrdata:	the LoRa device
+ * @cmd:	the command, LORA_SET_* and LORA_GET_*
+ * @arg:	the argument of the command in user space
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static long
+lora_ioctl(struct lora_struct *lrdata, unsigned int cmd, void __user *arg)
+{
+	long ret;
+	int *pval;
+
+	ret = -ENOTTY;
+	pval = arg;
+
+	/* I/O control by each command. */
+	switch (cmd) {
+	/* Set & read the state of the LoRa device. */
+	case LORA_SET_STATE:
+		if (lrdata->ops->setState != NULL)
+			ret = lrdata->ops->setState(lrdata, pval);
+		break;
+	case LORA_GET_STATE:
+		if (lrdata->ops->getState != NULL)
+			ret = lrdata->ops->getState(lrdata, pval);
+		break;
+	/* Set & get the carrier frequency. */
+	case LORA_SET_FREQUENCY:
+		if (lrdata->ops->setFreq != NULL)
+			ret = lrdata->ops->setFreq(lrdata, pval);
+		break;
+	case LORA_GET_FREQUENCY:
+		if (lrdata->ops->getFreq != NULL)
+			ret = lrdata->ops->getFreq(lrdata, pval);
+		break;
+	/* Set & get the PA power. */
+	case LORA_SET_POWER:
+		if (lrdata->ops->setPower != NULL)
+			ret = lrdata->ops->setPower(lrdata, pval);
+		break;
+	case LORA_GET_POWER:
+		if (lrdata->ops->getPower != NULL)
+			ret = lrdata->ops->getPower(lrdata, pval);
+		break;
+	/* Set & get the RF spreading factor. */
+	case LORA_SET_SPRFACTOR:
+		if (lrdata->ops->setSPRFactor != NULL)
+			ret = lrdata->ops->setSPRFactor(lrdata, pval);
+		break;
+	case LORA_GET_SPRFACTOR:
+		if (lrdata->ops->getSPRFactor != NULL)
+			ret = lrdata->ops->getSPRFactor(lrdata, pval);
+		break;
+	/* Set & get the RF bandwith. */
+	case LORA_SET_BANDWIDTH:
+		if (lrdata->ops->setBW != NULL)
+			ret = lrdata->ops->setBW(lrdata, pval);
+		break;
+	case LORA_GET_BANDWIDTH:
+		if (lrdata->ops->getBW != NULL)
+			ret = lrdata->ops->getBW(lrdata, pval);
+		break;
+	/* Get current RSSI. */
+	case LORA_GET_RSSI:
+		if (lrdata->ops->getRSSI != NULL)
+			ret = lrdata->ops->getRSSI(lrdata, pval);
+		break;
+	/* Get last packet's SNR. */
+	case LORA_GET_SNR:
+		if (lrdata->ops->getSNR != NULL)
+			ret = lrdata->ops->getSNR(lrdata, pval);
+		break;
+	/* Set the start time of the next TX & get the scheduled TX status. */
+	case LORA_SET_TXTIME:
+		if (lrdata->ops->setTxTime != NULL)
+			ret = lrdata->ops->setTxTime(lrdata, pval);
+		break;
+	case LORA_GET_TXTIME:
+		if (lrdata->ops->getTxTime != NULL)
+			ret = lrdata->ops->getTxTime(lrdata, pval);
+		break;
+	/* Set the RX windows after each TX & get the last windows' result. */
+	case LORA_SET_RXWIN:
+		if (lrdata->ops->setRxWin != NULL)
+			ret = lrdata->ops->setRxWin(lrdata, pval);
+		break;
+	case LORA_GET_RXWIN:
+		if (lrdata->ops->getRxWin != NULL)
+			ret = lrdata->ops->getRxWin(lrdata, pval);
+		break;
+	/* Set & get the coding rate. */
+	case LORA_SET_CODINGRATE:
+		if (lrdata->ops->setCR != NULL)
+			ret = lrdata->ops->setCR(lrdata, pval);
+		break;
+	case LORA_GET_CODINGRATE:
+		if (lrdata->ops->getCR != NULL)
+			ret = lrdata->ops->getCR(lrdata, pval);
+		break;
+	/* Set & get the payload CRC. */
+	case LORA_SET_CRC:
+		if (lrdata->ops->setCRC != NULL)
+			ret = lrdata->ops->setCRC(lrdata, pval);
+		break;
+	case LORA_GET_CRC:
+		if (lrdata->ops->getCRC != NULL)
+			ret = lrdata->ops->getCRC(lrdata, pval);
+		break;
+	/* Set & get the implicit header mode's fixed payload length. */
+	case LORA_SET_IMPLICIT:
+		if (lrdata->ops->setImplicit != NULL)
+			ret = lrdata->ops->setImplicit(lrdata, pval);
+		if (ret == 0)
+			lora_net_fit_mtu(lrdata);
+		break;
+	case LORA_GET_IMPLICIT:
+		if (lrdata->ops->getImplicit != NULL)
+			ret = lrdata->ops->getImplicit(lrdata, pval);
+		break;
+	/* Set the max RX payload length & get the chip's FIFO status. */
+	case LORA_SET_MAXPAYLOAD:
+		if (lrdata->ops->setMaxPayload != NULL)
+			ret = lrdata->ops->setMaxPayload(lrdata, pval);
+		break;
+	case LORA_GET_FIFOSTAT:
+		if (lrdata->ops->getFIFOStat != NULL)
+			ret = lrdata->ops->getFIFOStat(lrdata, pval);
+		break;
+	/* Pin & send the resident frame & get its status. */
+	case LORA_SET_BEACON:
+		if (lrdata->ops->setBeacon != NULL)
+			ret = lrdata->ops->setBeacon(lrdata, pval);
+		break;
+	case LORA_SEND_BEACON:
+		if (lrdata->ops->sendBeacon != NULL)
+			ret = lrdata->ops->sendBeacon(lrdata, pval);
+		break;
+	case LORA_GET_BEACON:
+		if (lrdata->ops->getBeacon != NULL)
+			ret = lrdata->ops->getBeacon(lrdata, pval);
+		break;
+	/* Set the keys of the secured frames & get their counters. */
+	case LORA_SET_KEY:
+		if (lrdata->ops->setKey != NULL)
+			ret = lrdata->ops->setKey(lrdata, pval);
+		if (ret == 0)
+			lora_net_fit_mtu(lrdata);
+		break;
+	case LORA_GET_CRYPTOSTAT:
+		if (lrdata->ops->getCryptoStat != NULL)
+			ret = lrdata->ops->getCryptoStat(lrdata, pval);
+		break;
+	/* Set & get the fragmentation & get its counters. */
+	case LORA_SET_FRAG:
+		ret = lora_frag_set(lrdata, pval);
+		break;
+	case LORA_GET_FRAG:
+		ret = lora_frag_get(lrdata, pval, 0);
+		break;
+	case LORA_GET_FRAGSTAT:
+		ret = lora_frag_get(lrdata, pval, 1);
+		break;
+	/* Get the signal of the packet last read. */
+	case LORA_GET_PKTSTAT:
+		if (lrdata->ops->getPktStat != NULL)
+			ret = lrdata->ops->getPktStat(lrdata, pval);
+		break;
+	/* Get a snapshot of the device's counters. */
+	case LORA_GET_STATS:
+		ret = lora_stats_get(lrdata, pval);
+		break;
+	default:
+		ret = -ENOTTY;
+	}
+
+	return ret;
+}
+
+static long
+file_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	pr_debug("lora: ioctl file (cmd=0x%X)\n", cmd);
+
+	return lora_ioctl(filp->private_data, cmd, (void __user *)arg);
+}
+
+static unsigned int
+file_poll(struct file *filp, poll_table *wait)
+{
+	struct lora_struct *lrdata;
+	unsigned int mask;
+
+	pr_debug("lora: poll file\n");
+
+	lrdata = filp->private_data;
+	if (lrdata == NULL)
+		return -EBADFD;
+
+	/* Register the file into wait queue for multiplexing. */
+	poll_wait(filp, &lrdata->waitqueue, wait);
+
+	/* Check ready to write / read. */
+	mask = 0;
+	if ((lrdata->ops->ready2write != NULL)
+		&& lrdata->ops->ready2write(lrdata))
+		mask |= POLLOUT | POLLWRNORM;
+	if ((lrdata->ops->ready2read != NULL)
+		&& lrdata->ops->ready2read(lrdata))
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+#ifdef LORA_URING
+#ifdef LORA_URING_MSHOT
+/**
+ * lora_uring_post - Post the received packets to the multishot RX command
+ * @cmd:	the multishot RX command
+ * @tw:	the token of io_uring task work
+ *
+ * It runs in the context of the task which submitted the command.  Each
+ * packet is copied into a provided buffer and posted as a CQE.  The command
+ * ends when it has been cancelled, or there is no buffer or room in the CQ.
+ */
+static void
+lora_uring_post(struct io_uring_cmd *cmd, io_tw_token_t tw)
+{
+	unsigned int issue_flags = IO_URING_CMD_TASK_WORK_ISSUE_FLAGS;
+	struct lora_struct *lrdata;
+	struct lora_uring *u;
+	struct lora_uring_pkt *pkt;
+	struct io_br_sel sel;
+	size_t len;
+	int err;
+
+	lrdata = *io_uring_cmd_to_pdu(cmd, struct lora_struct *);
+	u = &(lrdata->uring);
+
+	spin_lock(&(u->lock));
+	while ((u->err == 0) && (u->n > 0)) {
+		pkt = &(u->q[u->head]);
+		spin_unlock(&(u->lock));
+
+		len = pkt->len;
+		sel = io_uring_cmd_buffer_select(cmd, u->bgid, &len,
+						 issue_flags);
+		if (sel.addr == NULL)
+			err = -ENOBUFS;
+		else if (copy_to_user(sel.addr, pkt->buf,
+				      min(len, pkt->len)) != 0)
+			err = -EFAULT;
+		else
+			err = 0;
+		sel.val = (err == 0) ? min(len, pkt->len) : err;
+
+		spin_lock(&(u->lock));
+		u->head = (u->head + 1) % LORA_URING_RXQ;
+		u->n--;
+		spin_unlock(&(u->lock));
+
+		/* It is true if the command can not go on with more CQEs. */
+		if ((err != 0) || io_uring_mshot_cmd_post_cqe(cmd, &sel,
+							      issue_flags)) {
+			spin_lock(&(u->lock));
+			u->err = (err != 0) ? err : -ENOBUFS;
+			break;
+		}
+
+		spin_lock(&(u->lock));
+	}
+
+	err = u->err;
+	u->tw = 0;
+	if (err != 0) {
+		u->cmd = NULL;
+		u->head = 0;
+		u->n = 0;
+	}
+	spin_unlock(&(u->lock));
+
+	if (err != 0)
+		io_uring_cmd_done(cmd, err, issue_flags);
+}
+
+/**
+ * lora_uring_work - Receive the packets for the multishot RX command
+ * @work:	the work of the multishot RX command
+ *
+ * The radio has no interrupt, so the device is checked periodically while
+ * the command is armed.  A packet is received only when the device is
+ * ready to read and there is room for it.
+ */
+static void
+lora_uring_work(struct work_struct *work)
+{
+	struct lora_uring *u;
+	struct lora_struct *lrdata;
+	struct lora_uring_pkt *pkt;
+	struct io_uring_cmd *cmd;
+	ssize_t c;
+	int room;
+
+	u = container_of(to_delayed_work(work), struct lora_uring, work);
+	lrdata = container_of(u, struct lora_struct, uring);
+
+	spin_lock(&(u->lock));
+	if ((u->cmd == NULL) || (u->err != 0)) {
+		spin_unlock(&(u->lock));
+		return;
+	}
+	room = u->n < LORA_URING_RXQ;
+	pkt = &(u->q[(u->head + u->n) % LORA_URING_RXQ]);
+	spin_unlock(&(u->lock));
+
+	/* Only this work fills the free slots, so no lock for the packet. */
+	c = 0;
+	if (room && ((lrdata->ops->ready2read == NULL)
+		     || lrdata->ops->ready2read(lrdata))) {
+		c = lrdata->ops->recv(lrdata, pkt->buf, lrdata->bufmaxlen);
+		wake_up_interruptible(&(lrdata->waitqueue));
+	}
+
+	cmd = NULL;
+	spin_lock(&(u->lock));
+	if (c > 0) {
+		pkt->len = c;
+		u->n++;
+	}
+	if ((u->cmd != NULL) && (u->n > 0) && !u->tw) {
+		u->tw = 1;
+		cmd = u->cmd;
+	}
+	room = (u->cmd != NULL) && (u->err == 0);
+	spin_unlock(&(u->lock));
+
+	if (cmd != NULL)
+		io_uring_cmd_complete_in_task(cmd, lora_uring_post);
+	if (room)
+		schedule_delayed_work(&(u->work), (c > 0) ? 0 :
+				      msecs_to_jiffies(LORA_URING_POLL_MS));
+}
+
+/**
+ * lora_uring_cancel - End the multishot RX command
+ * @lrdata:	the LoRa device
+ * @cmd:	the command going to be ended, NULL for the armed one
+ * @err:	the result of the command
+ * @issue_flags:	the flags of io_uring, 0 for not in its context
+ *
+ * If the packets are being posted, or it is not in the context of io_uring,
+ * the task work ends the command instead.
+ */
+static void
+lora_uring_cancel(struct lora_struct *lrdata, struct io_uring_cmd *cmd,
+		  int err, unsigned int issue_flags)
+{
+	struct lora_uring *u;
+	int post;
+
+	u = &(lrdata->uring);
+
+	spin_lock(&(u->lock));
+	if ((u->cmd == NULL) || ((cmd != NULL) && (u->cmd != cmd))) {
+		spin_unlock(&(u->lock));
+		return;
+	}
+	cmd = u->cmd;
+	u->err = err;
+	if (u->tw || (issue_flags == 0)) {
+		post = !u->tw;
+		u->tw = 1;
+		spin_unlock(&(u->lock));
+		if (post)
+			io_uring_cmd_complete_in_task(cmd, lora_uring_post);
+		return;
+	}
+	u->cmd = NULL;
+	u->head = 0;
+	u->n = 0;
+	spin_unlock(&(u->lock));
+
+	io_uring_cmd_done(cmd, err, issue_flags);
+}
+
+/**
+ * lora_uring_mshot - Arm the multishot RX command
+ * @lrdata:	the LoRa device
+ * @cmd:	the multishot RX command
+ * @issue_flags:	the flags of io_uring
+ *
+ * Return:	-EIOCBQUEUED for armed, negative number for error
+ */
+static int
+lora_uring_mshot(struct lora_struct *lrdata, struct io_uring_cmd *cmd,
+		 unsigned int issue_flags)
+{
+	struct lora_uring *u;
+
+	if (issue_flags & IO_URING_F_CANCEL) {
+		lora_uring_cancel(lrdata, cmd, -ECANCELED, issue_flags);
+		return 0;
+	}
+
+	/* The reassembled messages do not fit a packet slot. */
+	if (((lrdata->frag != NULL) && lrdata->frag->param.enable)
+		|| (lrdata->ops->recv == NULL))
+		return -EOPNOTSUPP;
+
+	u = &(lrdata->uring);
+	spin_lock(&(u->lock));
+	if (u->cmd != NULL) {
+		spin_unlock(&(u->lock));
+		return -EBUSY;
+	}
+	*io_uring_cmd_to_pdu(cmd, struct lora_struct *) = lrdata;
+	u->cmd = cmd;
+	u->bgid = READ_ONCE(cmd->sqe->buf_group);
+	u->err = 0;
+	u->tw = 0;
+	u->head = 0;
+	u->n = 0;
+	spin_unlock(&(u->lock));
+
+	io_uring_cmd_mark_cancelable(cmd, issue_flags);
+	mod_delayed_work(system_wq, &(u->work), 0);
+
+	return -EIOCBQUEUED;
+}
+#endif
+
+/**
+ * file_uring_cmd - Issue the LoRa command of io_uring passthrough
+ * @cmd:	the command of IORING_OP_URING_CMD, LORA_URING_*
+ * @issue_flags:	the flags of io_uring
+ *
+ * The commands sleep on the radio and buf_lock, so they are punted to the
+ * io-wq workers, where they act as read(), write() and ioctl() without a
+ * syscall each.
+ *
+ * Return:	The result of the CQE, -EIOCBQUEUED for completed later
+ */
+static int
+file_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
+{
+	const struct lora_uring_cmd *uc;
+	struct lora_struct *lrdata;
+	struct iov_iter iter;
+	void __user *ubuf;
+	size_t len;
+	int ret;
+
+	pr_debug("lora: uring cmd (cmd_op=0x%X)\n", cmd->cmd_op);
+
+	lrdata = cmd->file->private_data;
+	if (lrdata == NULL)
+		return -EBADFD;
+
+#ifdef LORA_URING_MSHOT
+	if ((cmd->cmd_op == LORA_URING_RECV)
+		&& (cmd->flags & IORING_URING_CMD_MULTISHOT))
+		return lora_uring_mshot(lrdata, cmd, issue_flags);
+#endif
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		return -EAGAIN;
+
+	uc = io_uring_sqe_cmd(cmd->sqe);
+	ubuf = u64_to_user_ptr(READ_ONCE(uc->addr));
+	len = READ_ONCE(uc->len);
+
+	switch (cmd->cmd_op) {
+	/* Receive & send a packet, or a fragmented message. */
+	case LORA_URING_RECV:
+		ret = import_ubuf(ITER_DEST, ubuf, len, &iter);
+		if (ret == 0)
+			ret = lora_read_iter(lrdata, &iter);
+		break;
+	case LORA_URING_SEND:
+		ret = import_ubuf(ITER_SOURCE, ubuf, len, &iter);
+		if (ret == 0)
+			ret = lora_write_iter(lrdata, &iter);
+		break;
+	/* Set the configuration, or get a snapshot of the status. */
+	case LORA_URING_IOCTL:
+		ret = lora_ioctl(lrdata, READ_ONCE(uc->ioctl), ubuf);
+		break;
+	default:
+		ret = -ENOTTY;
+	}
+
+	return ret;
+}
+#endif
+
+/**
+ * lora_uring_init - Initialize the multishot RX command of a LoRa device
+ * @lrdata:	the LoRa device
+ */
+static void
+lora_uring_init(struct lora_struct *lrdata)
+{
+	spin_lock_init(&(lrdata->uring.lock));
+	lrdata->uring.cmd = NULL;
+#ifdef LORA_URING_MSHOT
+	INIT_DELAYED_WORK(&(lrdata->uring.work), lora_uring_work);
+#endif
+}
+
+/**
+ * lora_uring_stop - End the multishot RX command of a removed LoRa device
+ * @lrdata:	the LoRa device
+ */
+static void
+lora_uring_stop(struct lora_struct *lrdata)
+{
+#ifdef LORA_URING_MSHOT
+	lora_uring_cancel(lrdata, NULL, -ENODEV, 0);
+	cancel_delayed_work_sync(&(lrdata->uring.work));
+#endif
+}
+
+/**
+ * struct lora_net: The network interface of a LoRa device
+ * @lrdata:	the LoRa device
+ * @driver:	the LoRa driver of the device
+ * @napi:	Delivers the received packets to the stack with a budget
+ * @wq:		Runs the RX and the TX, which sleep on the radio in turn
+ * @rx_work:	Receives the packets into rxq
+ * @tx_work:	Sends the packet of tx_skb
+ * @rxq:	The received packets waiting for NAPI
+ * @tx_skb:	The packet being sent, the queue is stopped until it is sent
+ * @primed:	The radio has been set to RX since the interface is up or the
+ *		last TX
+ */
+struct lora_net {
+	struct lora_struct *lrdata;
+	struct lora_driver *driver;
+	struct napi_struct napi;
+	struct workqueue_struct *wq;
+	struct delayed_work rx_work;
+	struct work_struct tx_work;
+	struct sk_buff_head rxq;
+	struct sk_buff *tx_skb;
+	int primed;
+};
+
+/* How many received packets wait for NAPI at most. */
+#define LORA_NET_RXQ		64
+/* How many packets are received in a turn of the RX work. */
+#define LORA_NET_RXBATCH	8
+/* How often the RX work checks the device for packets in ms. */
+#define LORA_NET_POLL_MS	20
+
+/* The link layer header of the frames, the metadata of the packets. */
+#define LORA_NET_HLEN		sizeof(struct lora_pkt_meta)
+
+/**
+ * lora_net_rx_work - Receive the packets of the network interface
+ * @work:	the RX work of the network interface
+ *
+ * The radio has no interrupt, so the device is checked periodically while
+ * the interface is up.  The radio is set back to RX without waiting after
+ * the interface is up or a TX, and a packet is only received when the
+ * device has one ready, so the work never sleeps on the air and holds up
+ * the TX behind it.  The software timestamp is the time the packet is
+ * received from the device, and the hardware one is its time of the metadata
+ * on CLOCK_MONOTONIC.
+ */
+static void
+lora_net_rx_work(struct work_struct *work)
+{
+	struct lora_net *ln;
+	struct lora_struct *lrdata;
+	struct net_device *ndev;
+	struct lora_pkt_meta *meta;
+	struct sk_buff *skb;
+	ssize_t c;
+	int n;
+
+	ln = container_of(to_delayed_work(work), struct lora_net, rx_work);
+	lrdata = ln->lrdata;
+	ndev = lrdata->netdev;
+
+	if (!ln->primed) {
+		if (lrdata->ops->startRX != NULL)
+			lrdata->ops->startRX(lrdata);
+		ln->primed = 1;
+	}
+
+	for (n = 0; n < LORA_NET_RXBATCH; n++) {
+		if (skb_queue_len(&(ln->rxq)) >= LORA_NET_RXQ)
+			break;
+		if ((lrdata->ops->ready2read != NULL)
+			&& !lrdata->ops->ready2read(lrdata))
+			break;
+
+		skb = netdev_alloc_skb(ndev, LORA_NET_HLEN + lrdata->bufmaxlen);
+		if (skb == NULL) {
+			ndev->stats.rx_dropped++;
+			break;
+		}
+		c = lrdata->ops->recv(lrdata, skb->data + LORA_NET_HLEN,
+				      lrdata->bufmaxlen);
+		if (c <= 0) {
+			kfree_skb(skb);
+			break;
+		}
+		__net_timestamp(skb);
+
+		meta = skb_put(skb, LORA_NET_HLEN + c);
+		memset(meta, 0, LORA_NET_HLEN);
+		if (lrdata->ops->getPktMeta != NULL)
+			lrdata->ops->getPktMeta(lrdata, meta);
+		meta->len = c;
+		meta->tx_ns = 0;
+		if (meta->rx_ns > 0)
+			skb_hwtstamps(skb)->hwtstamp = ns_to_ktime(meta->rx_ns);
+
+		skb->protocol = htons(LORA_ETH_P);
+		skb->pkt_type = PACKET_HOST;
+		skb_reset_mac_header(skb);
+		skb_pull(skb, LORA_NET_HLEN);
+		skb_reset_network_header(skb);
+		skb_queue_tail(&(ln->rxq), skb);
+	}
+
+	if (n > 0) {
+		napi_schedule(&(ln->napi));
+		wake_up_interruptible(&(lrdata->waitqueue));
+	}
+	if (netif_running(ndev))
+		queue_delayed_work(ln->wq, &(ln->rx_work), (n > 0) ? 0 :
+				   msecs_to_jiffies(LORA_NET_POLL_MS));
+}
+
+/**
+ * lora_net_poll - Deliver the received packets to the stack
+ * @napi:	the NAPI of the network interface
+ * @budget:	how many packets can be delivered at most
+ *
+ * Return:	How many packets have been delivered
+ */
+static int
+lora_net_poll(struct napi_struct *napi, int budget)
+{
+	struct lora_net *ln;
+	struct net_device *ndev;
+	struct sk_buff *skb;
+	int n;
+
+	ln = container_of(napi, struct lora_net, napi);
+	ndev = ln->lrdata->netdev;
+
+	for (n = 0; n < budget; n++) {
+		skb = skb_dequeue(&(ln->rxq));
+		if (skb == NULL)
+			break;
+		ndev->stats.rx_packets++;
+		ndev->stats.rx_bytes += skb->len;
+		netif_receive_skb(skb);
+	}
+	if (n < budget)
+		napi_complete_done(napi, n);
+
+	return n;
+}
+
+/**
+ * lora_net_tx_work - Send the packet of the network interface
+ * @work:	the TX work of the network interface
+ *
+ * The queue is woken up after the packet has left the air, so the backlog
+ * stays in the qdisc.  The hardware TX timestamp is the time the driver
+ * has seen the packet leave the air on CLOCK_MONOTONIC, before it opens the
+ * RX windows and sets the radio back to RX.
+ */
+static void
+lora_net_tx_work(struct work_struct *work)
+{
+	struct lora_net *ln;
+	struct lora_struct *lrdata;
+	struct net_device *ndev;
+	struct skb_shared_hwtstamps hwts;
+	struct lora_pkt_meta meta;
+	struct sk_buff *skb;
+	size_t len;
+	ssize_t c;
+
+	ln = container_of(work, struct lora_net, tx_work);
+	lrdata = ln->lrdata;
+	ndev = lrdata->netdev;
+
+	skb = ln->tx_skb;
+	ln->tx_skb = NULL;
+	if (skb == NULL)
+		return;
+
+	/* The payload follows the link layer header. */
+	len = skb->len - LORA_NET_HLEN;
+	skb_tx_timestamp(skb);
+	c = skb_linearize(skb) ? -ENOMEM :
+		lrdata->ops->xmit(lrdata, skb->data + LORA_NET_HLEN, len);
+	if (c == len) {
+		ndev->stats.tx_packets++;
+		ndev->stats.tx_bytes += len;
+		memset(&meta, 0, sizeof(meta));
+		if ((skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP)
+			&& (lrdata->ops->getPktMeta != NULL))
+			lrdata->ops->getPktMeta(lrdata, &meta);
+		if (meta.tx_ns > 0) {
+			memset(&hwts, 0, sizeof(hwts));
+			hwts.hwtstamp = ns_to_ktime(meta.tx_ns);
+			skb_tstamp_tx(skb, &hwts);
+		}
+		consume_skb(skb);
+	}
+	else {
+		ndev->stats.tx_errors++;
+		kfree_skb(skb);
+	}
+	ln->primed = 0;
+
+	netif_wake_queue(ndev);
+	wake_up_interruptible(&(lrdata->waitqueue));
+}
+
+static netdev_tx_t
+lora_net_start_xmit(struct sk_buff *skb, struct net_device *ndev)
+{
+	struct lora_net *ln;
+
+	ln = netdev_priv(ndev);
+	if ((skb->len <= LORA_NET_HLEN)
+		|| (skb->len - LORA_NET_HLEN > lora_max_payload(ln->lrdata))) {
+		ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	/* A packet on the air at a time, the others wait in the qdisc. */
+	netif_stop_queue(ndev);
+	ln->tx_skb = skb;
+	queue_work(ln->wq, &(ln->tx_work));
+
+	return NETDEV_TX_OK;
+}
+
+static int
+lora_net_open(struct net_device *ndev)
+{
+	struct lora_net *ln;
+	int status;
+
+	ln = netdev_priv(ndev);
+
+	/* The interface is a user of the device, as an open file. */
+	mutex_lock(&device_list_lock);
+	status = lora_device_get(ln->lrdata);
+	mutex_unlock(&device_list_lock);
+	if (status)
+		return status;
+
+	ln->primed = 0;
+	napi_enable(&(ln->napi));
+	netif_start_queue(ndev);
+	queue_delayed_work(ln->wq, &(ln->rx_work), 0);
+
+	return 0;
+}
+
+static int
+lora_net_stop(struct net_device *ndev)
+{
+	struct lora_net *ln;
+
+	ln = netdev_priv(ndev);
+
+	netif_stop_queue(ndev);
+	cancel_delayed_work_sync(&(ln->rx_work));
+	cancel_work_sync(&(ln->tx_work));
+	if (ln->tx_skb != NULL) {
+		ndev->stats.tx_dropped++;
+		kfree_skb(ln->tx_skb);
+		ln->tx_skb = NULL;
+	}
+	napi_disable(&(ln->napi));
+	skb_queue_purge(&(ln->rxq));
+
+	mutex_lock(&device_list_lock);
+	lora_device_put(ln->lrdata);
+	mutex_unlock(&device_list_lock);
+
+	return 0;
+}
+
+/**
+ * lora_net_ioctl - I/O control the LoRa device of the network interface
+ * @ndev:	the network interface
+ * @ifr:	the request of the interface
+ * @data:	the struct lora_ifcmd in user space
+ * @cmd:	SIOCLORACMD
+ *
+ * The commands other than LORA_GET_* need CAP_NET_ADMIN.  A command holds
+ * the device's lock, as long as a TX on the air, so it goes without RTNL.
+ * The reference of the interface keeps it, and its device, until the command
+ * returns, for removing the device unregisters the interface first.
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+lora_net_ioctl(struct net_device *ndev, struct ifreq *ifr, void __user *data,
+	       int cmd)
+{
+	struct lora_net *ln;
+	struct lora_ifcmd ic;
+	long ret;
+
+	if (cmd != SIOCLORACMD)
+		return -EOPNOTSUPP;
+	if (copy_from_user(&ic, data, sizeof(ic)))
+		return -EFAULT;
+	if ((_IOC_DIR(ic.cmd) != _IOC_READ) && !capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	ln = netdev_priv(ndev);
+
+	dev_hold(ndev);
+	rtnl_unlock();
+	ret = lora_ioctl(ln->lrdata, ic.cmd, u64_to_user_ptr(ic.arg));
+	rtnl_lock();
+	dev_put(ndev);
+
+	return ret;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0)
+static int
+lora_net_do_ioctl(struct net_device *ndev, struct ifreq *ifr, int cmd)
+{
+	return lora_net_ioctl(ndev, ifr, ifr->ifr_data, cmd);
+}
+#endif
+
+static const struct net_device_ops lora_net_ops = {
+	.ndo_open		= lora_net_open,
+	.ndo_stop		= lora_net_stop,
+	.ndo_start_xmit		= lora_net_start_xmit,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	.ndo_siocdevprivate	= lora_net_ioctl,
+#else
+	.ndo_do_ioctl		= lora_net_do_ioctl,
+#endif
+};
+
+/* The counters of the device shown by ethtool -S, as struct lora_stats. */
+#define LORA_NET_STAT(field)	{ #field, offsetof(struct lora_stats, field), \
+				  sizeof(((struct lora_stats *)0)->field) }
+
+static const struct {
+	const char *name;
+	size_t off;
+	size_t size;
+} lora_net_stats[] = {
+	LORA_NET_STAT(rx_packets),
+	LORA_NET_STAT(rx_bytes),
+	LORA_NET_STAT(rx_crcerrors),
+	LORA_NET_STAT(rx_timeouts),
+	LORA_NET_STAT(rx_dropped),
+	LORA_NET_STAT(tx_packets),
+	LORA_NET_STAT(tx_bytes),
+	LORA_NET_STAT(tx_timeouts),
+	LORA_NET_STAT(spi_transactions),
+	LORA_NET_STAT(spi_errors),
+	LORA_NET_STAT(chip_rx_headers),
+	LORA_NET_STAT(chip_rx_packets),
+};
+
+static void
+lora_net_get_drvinfo(struct net_device *ndev, struct ethtool_drvinfo *info)
+{
+	struct lora_net *ln;
+
+	ln = netdev_priv(ndev);
+	strscpy(info->driver, ln->driver->name, sizeof(info->driver));
+	if (ndev->dev.parent != NULL)
+		strscpy(info->bus_info, dev_name(ndev->dev.parent),
+			sizeof(info->bus_info));
+}
+
+static int
+lora_net_get_sset_count(struct net_device *ndev, int sset)
+{
+	if (sset != ETH_SS_STATS)
+		return -EOPNOTSUPP;
+
+	return ARRAY_SIZE(lora_net_stats);
+}
+
+static void
+lora_net_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+	int i;
+
+	if (sset != ETH_SS_STATS)
+		return;
+	for (i = 0; i < ARRAY_SIZE(lora_net_stats); i++)
+		strscpy((char *)data + i * ETH_GSTRING_LEN,
+			lora_net_stats[i].name, ETH_GSTRING_LEN);
+}
+
+static void
+lora_net_get_ethtool_stats(struct net_device *ndev, struct ethtool_stats *es,
+			   u64 *data)
+{
+	struct lora_net *ln;
+	struct lora_stats st;
+	const uint8_t *p;
+	int i;
+
+	ln = netdev_priv(ndev);
+	lora_stats_fetch(ln->lrdata, &st, 1);
+
+	p = (const uint8_t *)&st;
+	for (i = 0; i < ARRAY_SIZE(lora_net_stats); i++) {
+		if (lora_net_stats[i].size == sizeof(u64))
+			data[i] = *(const u64 *)(p + lora_net_stats[i].off);
+		else
+			data[i] = *(const u32 *)(p + lora_net_stats[i].off);
+	}
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+static int
+lora_net_get_ts_info(struct net_device *ndev,
+		     struct kernel_ethtool_ts_info *info)
+#else
+static int
+lora_net_get_ts_info(struct net_device *ndev, struct ethtool_ts_info *info)
+#endif
+{
+	info->so_timestamping = SOF_TIMESTAMPING_TX_SOFTWARE |
+				SOF_TIMESTAMPING_RX_SOFTWARE |
+				SOF_TIMESTAMPING_SOFTWARE |
+				SOF_TIMESTAMPING_TX_HARDWARE |
+				SOF_TIMESTAMPING_RX_HARDWARE |
+				SOF_TIMESTAMPING_RAW_HARDWARE;
+	info->phc_index = -1;
+	info->tx_types = BIT(HWTSTAMP_TX_OFF) | BIT(HWTSTAMP_TX_ON);
+	info->rx_filters = BIT(HWTSTAMP_FILTER_NONE) | BIT(HWTSTAMP_FILTER_ALL);
+
+	return 0;
+}
+
+static const struct ethtool_ops lora_net_ethtool_ops = {
+	.get_drvinfo		= lora_net_get_drvinfo,
+	.get_link		= ethtool_op_get_link,
+	.get_ts_info		= lora_net_get_ts_info,
+	.get_sset_count		= lora_net_get_sset_count,
+	.get_strings		= lora_net_get_strings,
+	.get_ethtool_stats	= lora_net_get_ethtool_stats,
+};
+
+/**
+ * lora_net_header_create - Put the link layer header before the payload
+ * @skb:	the packet going to be sent
+ * @ndev:	the network interface
+ * @type:	the protocol of the packet
+ * @daddr:	the destination address, LoRa has none
+ * @saddr:	the source address, LoRa has none
+ * @len:	the length of the payload
+ *
+ * Return:	The length of the header
+ */
+static int
+lora_net_header_create(struct sk_buff *skb, struct net_device *ndev,
+		       unsigned short type, const void *daddr,
+		       const void *saddr, unsigned int len)
+{
+	struct lora_pkt_meta *meta;
+
+	meta = skb_push(skb, LORA_NET_HLEN);
+	memset(meta, 0, LORA_NET_HLEN);
+	meta->len = len;
+
+	return LORA_NET_HLEN;
+}
+
+static const struct header_ops lora_net_header_ops = {
+	.create		= lora_net_header_create,
+};
+
+/**
+ * lora_net_setup - Set up a network interface of a LoRa device
+ * @ndev:	the network interface
+ *
+ * A frame is a LoRa payload after its metadata, struct lora_pkt_meta, as the
+ * link layer header.  There is no address, and no hardware type is assigned
+ * to LoRa, so the interface is ARPHRD_NONE.
+ */
+static void
+lora_net_setup(struct net_device *ndev)
+{
+	ndev->type = ARPHRD_NONE;
+	ndev->netdev_ops = &lora_net_ops;
+	ndev->ethtool_ops = &lora_net_ethtool_ops;
+	ndev->header_ops = &lora_net_header_ops;
+	ndev->hard_header_len = LORA_NET_HLEN;
+	ndev->addr_len = 0;
+	ndev->mtu = LORA_BUFLEN;
+	ndev->min_mtu = 1;
+	ndev->max_mtu = LORA_BUFLEN;
+	ndev->tx_queue_len = LORA_NET_TXQLEN;
+	ndev->flags = IFF_NOARP;
+}
+
+/**
+ * lora_net_free - Remove the network interface of a LoRa device
+ * @lrdata:	the LoRa device
+ */
+static void
+lora_net_free(struct lora_struct *lrdata)
+{
+	struct net_device *ndev;
+	struct lora_net *ln;
+
+	ndev = lrdata->netdev;
+	if (ndev == NULL)
+		return;
+
+	ln = netdev_priv(ndev);
+	unregister_netdev(ndev);
+	netif_napi_del(&(ln->napi));
+	destroy_workqueue(ln->wq);
+	/* Under RTNL, as lora_net_fit_mtu() finds the interface. */
+	rtnl_lock();
+	lrdata->netdev = NULL;
+	rtnl_unlock();
+	free_netdev(ndev);
+}
+
+/**
+ * lora_client_rx_work - Receive the packets of an in-kernel client
+ * @work:	the RX work of the client
+ *
+ * The packets are handed to the client's rx callback right here, without
+ * any copy to user space.  As the network interface, the radio is set back
+ * to RX without waiting after the client is registered or a TX, then the
+ * device is checked when the driver wakes up the readers, or periodically.
+ * A packet queued by the callback is sent before the next receive.
+ */
+static void
+lora_client_rx_work(struct work_struct *work)
+{
+	struct lora_client *cl;
+	struct lora_struct *lrdata;
+	struct lora_pkt_meta meta;
+	ssize_t c;
+	int n;
+
+	cl = container_of(to_delayed_work(work), struct lora_client, rx_work);
+	lrdata = cl->lrdata;
+
+	if (!cl->primed) {
+		if (lrdata->ops->startRX != NULL)
+			lrdata->ops->startRX(lrdata);
+		cl->primed = 1;
+	}
+
+	for (n = 0; n < LORA_CLIENT_RXBATCH; n++) {
+		if (READ_ONCE(cl->ntx) > 0)
+			return;
+		if ((lrdata->ops->ready2read != NULL)
+			&& !lrdata->ops->ready2read(lrdata))
+			break;
+
+		c = lrdata->ops->recv(lrdata, cl->rxbuf, lrdata->bufmaxlen);
+		if (c <= 0)
+			break;
+
+		memset(&meta, 0, sizeof(meta));
+		if (lrdata->ops->getPktMeta != NULL)
+			lrdata->ops->getPktMeta(lrdata, &meta);
+		meta.len = c;
+		meta.tx_ns = 0;
+		cl->rx(cl, cl->rxbuf, c, &meta);
+	}
+
+	/* The TX work checks the device again after the queued packets. */
+	if (!READ_ONCE(cl->closing) && (READ_ONCE(cl->ntx) == 0))
+		queue_delayed_work(cl->wq, &(cl->rx_work), (n > 0) ? 0 :
+				   msecs_to_jiffies(LORA_CLIENT_POLL_MS));
+}
+
+/**
+ * lora_client_tx_work - Send the queued packets of an in-kernel client
+ * @work:	the TX work of the client
+ */
+static void
+lora_client_tx_work(struct work_struct *work)
+{
+	struct lora_client *cl;
+	struct lora_struct *lrdata;
+	struct lora_client_tx *tx;
+	struct lora_pkt_meta meta;
+	unsigned long flags;
+
+	cl = container_of(work, struct lora_client, tx_work);
+	lrdata = cl->lrdata;
+
+	for (;;) {
+		spin_lock_irqsave(&(cl->lock), flags);
+		tx = list_first_entry_or_null(&(cl->txq), struct lora_client_tx,
+					      entry);
+		if (tx != NULL)
+			list_del(&(tx->entry));
+		spin_unlock_irqrestore(&(cl->lock), flags);
+		if (tx == NULL)
+			break;
+
+		tx->start_ns = ktime_get_ns();
+		tx->status = lrdata->ops->xmit(lrdata, tx->buf, tx->len);
+		/* The driver knows when it left the air, before the RX windows
+		 * and setting the radio back to RX. */
+		memset(&meta, 0, sizeof(meta));
+		if ((tx->status > 0) && (lrdata->ops->getPktMeta != NULL))
+			lrdata->ops->getPktMeta(lrdata, &meta);
+		tx->aired_ns = meta.tx_ns;
+		cl->primed = 0;
+
+		/* The callback may queue the next packet, so it counts. */
+		if (tx->done != NULL)
+			tx->done(cl, tx);
+		kfree(tx);
+		spin_lock_irqsave(&(cl->lock), flags);
+		cl->ntx--;
+		spin_unlock_irqrestore(&(cl->lock), flags);
+	}
+
+	if (!READ_ONCE(cl->closing))
+		mod_delayed_work(cl->wq, &(cl->rx_work), 0);
+}
+
+/* Wake up the RX work of a client when the driver wakes up the readers. */
+static int
+lora_client_wake(wait_queue_entry_t *wait, unsigned int mode, int sync,
+		 void *key)
+{
+	struct lora_client *cl;
+
+	cl = container_of(wait, struct lora_client, wait);
+	if (!READ_ONCE(cl->closing) && (READ_ONCE(cl->ntx) == 0))
+		mod_delayed_work(cl->wq, &(cl->rx_work), 0);
+
+	return 0;
+}
+
+/**
+ * lora_client_quiesce - Stop the works and the packets of an in-kernel client
+ * @cl:		the client
+ *
+ * The packets not sent yet are completed with -ENODEV, and the calls of
+ * lora_client_set() and lora_client_get() in flight are waited for.  It is
+ * called without device_list_lock, because the works may wait on the radio.
+ * It must not be called from the callbacks, and only the first call does it.
+ */
+static void
+lora_client_quiesce(struct lora_client *cl)
+{
+	struct lora_client_tx *tx, *tmp;
+	unsigned long flags;
+	LIST_HEAD(txq);
+
+	mutex_lock(&(cl->stop_lock));
+	if (cl->stopped) {
+		mutex_unlock(&(cl->stop_lock));
+		return;
+	}
+
+	spin_lock_irqsave(&(cl->lock), flags);
+	cl->closing = 1;
+	spin_unlock_irqrestore(&(cl->lock), flags);
+
+	/* No more wake up after it, and no more TX after closing, then the
+	 * TX work is the last one which queues the RX work. */
+	remove_wait_queue(&(cl->lrdata->waitqueue), &(cl->wait));
+	cancel_work_sync(&(cl->tx_work));
+	cancel_delayed_work_sync(&(cl->rx_work));
+	down_write(&(cl->use));
+	up_write(&(cl->use));
+
+	spin_lock_irqsave(&(cl->lock), flags);
+	list_splice_init(&(cl->txq), &txq);
+	cl->ntx = 0;
+	spin_unlock_irqrestore(&(cl->lock), flags);
+	list_for_each_entry_safe(tx, tmp, &txq, entry) {
+		list_del(&(tx->entry));
+		tx->status = -ENODEV;
+		if (tx->done != NULL)
+			tx->done(cl, tx);
+		kfree(tx);
+	}
+
+	cl->stopped = 1;
+	mutex_unlock(&(cl->stop_lock));
+}
+
+/**
+ * lora_client_detach - Detach the in-kernel clients of a removed LoRa device
+ * @lrdata:	the LoRa device, which has left the device list
+ *
+ * Each client is taken off the device under device_list_lock, then it is
+ * quiesced without the lock.  A client being unregistered at the same time
+ * waits until it has been detached here.  The clients are freed by their own
+ * unregistering.
+ */
+static void
+lora_client_detach(struct lora_struct *lrdata)
+{
+	struct lora_client *cl;
 
-#include "lora.h"
+	for (;;) {
+		mutex_lock(&device_list_lock);
+		cl = list_first_entry_or_null(&(lrdata->clients),
+					      struct lora_client, entry);
+		if (cl != NULL) {
+			list_del_init(&(cl->entry));
+			cl->detaching = 1;
+		}
+		mutex_unlock(&device_list_lock);
+		if (cl == NULL)
+			break;
 
-static LIST_HEAD(device_list);
-static DEFINE_MUTEX(device_list_lock);
+		lora_client_quiesce(cl);
 
-#ifndef LORA_BUFLEN
-#define LORA_BUFLEN	123
-#endif
+		mutex_lock(&device_list_lock);
+		lora_device_put(lrdata);
+		cl->lrdata = NULL;
+		mutex_unlock(&device_list_lock);
+		/* The client may be freed right after it. */
+		complete(&(cl->detached));
+	}
+}
 
-static int
-file_open(struct inode *inode, struct file *filp)
+/**
+ * lora_client_register - Attach an in-kernel client to a LoRa device
+ * @devt:	the device number of the LoRa device's character device
+ * @rx:		called with each received packet, its length and its metadata
+ * @priv:	the private data of the client
+ *
+ * Other kernel modules, like the forwarding of a mesh, a tunnel or an ACK
+ * engine, send and receive through the client without crossing to user
+ * space.  The client is a user of the device, as an open file, and they
+ * share the received packets.  The callbacks run in the client's own
+ * ordered workqueue, so they may sleep but they are serialized.
+ *
+ * Return:	The client / ERR_PTR of the negative error number
+ */
+static struct lora_client *
+lora_client_register(dev_t devt,
+		     void (*rx)(struct lora_client *, const uint8_t *, size_t,
+				const struct lora_pkt_meta *),
+		     void *priv)
 {
+	struct lora_client *cl;
 	struct lora_struct *lrdata;
-	int status = -ENXIO;
+	int status;
 
-	pr_debug("lora: open file\n");
-	
+	if (rx == NULL)
+		return ERR_PTR(-EINVAL);
+
+	cl = kzalloc(sizeof(struct lora_client), GFP_KERNEL);
+	if (cl == NULL)
+		return ERR_PTR(-ENOMEM);
+	cl->rx = rx;
+	cl->priv = priv;
+	spin_lock_init(&(cl->lock));
+	mutex_init(&(cl->stop_lock));
+	init_rwsem(&(cl->use));
+	init_completion(&(cl->detached));
+	INIT_LIST_HEAD(&(cl->txq));
+	INIT_DELAYED_WORK(&(cl->rx_work), lora_client_rx_work);
+	INIT_WORK(&(cl->tx_work), lora_client_tx_work);
+	init_waitqueue_func_entry(&(cl->wait), lora_client_wake);
+	cl->wq = alloc_ordered_workqueue("lora_client_%u:%u", 0, MAJOR(devt),
+					 MINOR(devt));
+	if (cl->wq == NULL) {
+		kfree(cl);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	status = -ENXIO;
 	mutex_lock(&device_list_lock);
-	/* Find the lora data in device_entry with matched dev_t in inode. */
 	list_for_each_entry(lrdata, &device_list, device_entry) {
-		if (lrdata->devt == inode->i_rdev) {
+		if (lrdata->devt == devt) {
 			status = 0;
 			break;
 		}
 	}
-
-	if (status) {
-		pr_debug("lora: nothing for minor %d\n", iminor(inode));
-		goto err_find_dev;
-	}
-
-	/* Have the RX/TX memory buffer. */
-	if (!(lrdata->rx_buf)) {
-		lrdata->rx_buf = kzalloc(LORA_BUFLEN, GFP_KERNEL);
-		if (!(lrdata->rx_buf)) {
-			pr_err("lora: no more memory\n");
-			status = -ENOMEM;
-			goto err_find_dev;
-		}
-	}
-	if (!(lrdata->tx_buf)) {
-		lrdata->tx_buf = kzalloc(LORA_BUFLEN, GFP_KERNEL);
-		if (!(lrdata->tx_buf)) {
-			pr_err("lora: no more memory\n");
-			status = -ENOMEM;
-			goto err_alloc_tx_buf;
-		}
+	if (!status && ((lrdata->ops->recv == NULL)
+			|| (lrdata->ops->xmit == NULL)))
+		status = -EOPNOTSUPP;
+	if (!status)
+		status = lora_device_get(lrdata);
+	if (!status) {
+		cl->lrdata = lrdata;
+		list_add_tail(&(cl->entry), &(lrdata->clients));
+		add_wait_queue(&(lrdata->waitqueue), &(cl->wait));
+		queue_delayed_work(cl->wq, &(cl->rx_work), 0);
 	}
-	lrdata->rx_buflen = 0;
-	lrdata->tx_buflen = 0;
-	lrdata->bufmaxlen = LORA_BUFLEN;
-	lrdata->users++;
-	init_waitqueue_head(&(lrdata->waitqueue));
 	mutex_unlock(&device_list_lock);
 
-	/* Map the data location to the file data pointer. */
-	filp->private_data = lrdata;
-	/* This a character device, so it is not seekable. */
-	nonseekable_open(inode, filp);
-
-	return 0;
-
-err_alloc_tx_buf:
-	kfree(lrdata->rx_buf);
-	lrdata->rx_buf = NULL;
-err_find_dev:
-	mutex_unlock(&device_list_lock);
+	if (status) {
+		destroy_workqueue(cl->wq);
+		kfree(cl);
+		return ERR_PTR(status);
+	}
 
-	return status;
+	return cl;
 }
+EXPORT_SYMBOL(lora_client_register);
 
-static int
-file_close(struct inode *inode, struct file *filp)
+/**
+ * lora_client_unregister - Detach and free an in-kernel client
+ * @cl:		the client
+ *
+ * It must not be called from the client's callbacks.
+ */
+static void
+lora_client_unregister(struct lora_client *cl)
 {
-	struct lora_struct *lrdata;
-	
-	pr_debug("lora: close file\n");
-	
-	lrdata = filp->private_data;
+	int detaching;
+
+	lora_client_quiesce(cl);
 
 	mutex_lock(&device_list_lock);
-	filp->private_data = NULL;
-	
-	if (lrdata->users > 0)
-		lrdata->users--;
-	
-	/* Last close */
-	if (lrdata->users == 0) {
-		kfree(lrdata->rx_buf);
-		kfree(lrdata->tx_buf);
-		lrdata->rx_buf = NULL;
-		lrdata->tx_buf = NULL;
+	detaching = cl->detaching;
+	if (!detaching && (cl->lrdata != NULL)) {
+		list_del(&(cl->entry));
+		lora_device_put(cl->lrdata);
+		cl->lrdata = NULL;
 	}
 	mutex_unlock(&device_list_lock);
+	/* The removal of the device is still using the client. */
+	if (detaching)
+		wait_for_completion(&(cl->detached));
 
-	return 0;
+	destroy_workqueue(cl->wq);
+	kfree(cl);
 }
+EXPORT_SYMBOL(lora_client_unregister);
 
-static ssize_t
-file_read(struct file *filp, char __user *buf, size_t size, loff_t *pos)
+/**
+ * lora_client_xmit - Queue a packet to be sent by an in-kernel client
+ * @cl:		the client
+ * @buf:	the packet, it is copied before returning
+ * @len:	the length of the packet
+ * @done:	called after the packet has been sent, NULL for none
+ * @ctx:	the context of done
+ *
+ * It never sleeps, so it can be called in any context, including the rx
+ * callback for a turnaround without waiting for the next poll.
+ *
+ * Return:	0 / negative number for queued / error number
+ */
+static int
+lora_client_xmit(struct lora_client *cl, const uint8_t *buf, size_t len,
+		 void (*done)(struct lora_client *, struct lora_client_tx *),
+		 void *ctx)
 {
-	struct lora_struct *lrdata;
-
-	pr_debug("lora: read file (size=%zu)\n", size);
-
-	lrdata = filp->private_data;
+	struct lora_client_tx *tx;
+	unsigned long flags;
+	int status;
 
-	if (lrdata->ops->read != NULL)
-		return lrdata->ops->read(lrdata, buf, size);
-	else
-		return 0;
-}
+	if ((len == 0) || (len > LORA_BUFLEN))
+		return -EINVAL;
 
-static ssize_t
-file_write(struct file *filp, const char __user *buf, size_t size, loff_t *pos)
-{
-	struct lora_struct *lrdata;
+	tx = kmalloc(sizeof(struct lora_client_tx) + len, GFP_ATOMIC);
+	if (tx == NULL)
+		return -ENOMEM;
+	tx->done = done;
+	tx->ctx = ctx;
+	tx->status = 0;
+	tx->queued_ns = ktime_get_ns();
+	tx->start_ns = 0;
+	tx->aired_ns = 0;
+	tx->len = len;
+	memcpy(tx->buf, buf, len);
 
-	pr_debug("lora: write file (size=%zu)\n", size);
+	status = 0;
+	spin_lock_irqsave(&(cl->lock), flags);
+	if (cl->closing)
+		status = -ENODEV;
+	else if (cl->ntx >= LORA_CLIENT_TXQ)
+		status = -ENOBUFS;
+	else {
+		list_add_tail(&(tx->entry), &(cl->txq));
+		cl->ntx++;
+		/* Queue it under the lock, so it is not queued after stop. */
+		queue_work(cl->wq, &(cl->tx_work));
+	}
+	spin_unlock_irqrestore(&(cl->lock), flags);
 
-	lrdata = filp->private_data;
+	if (status)
+		kfree(tx);
 
-	if (lrdata->ops->write != NULL) {
-		return lrdata->ops->write(lrdata, buf, size);
-	}
-	else
-		return 0;
+	return status;
 }
+EXPORT_SYMBOL(lora_client_xmit);
 
+/**
+ * lora_client_set - Set a setting of the LoRa device of an in-kernel client
+ * @cl:		the client
+ * @cmd:	LORA_SET_FREQUENCY, LORA_SET_POWER, LORA_SET_SPRFACTOR,
+ *		LORA_SET_BANDWIDTH, LORA_SET_CODINGRATE or LORA_SET_CRC
+ * @val:	the value, as the argument of the ioctl command
+ *
+ * It may sleep on the device.  It fails with -ENODEV once the client is
+ * being unregistered or its device is being removed.
+ *
+ * Return:	0 / negative number for success / error number
+ */
 static long
-file_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+lora_client_set(struct lora_client *cl, unsigned int cmd, uint32_t val)
 {
-	long ret;
-	int *pval;
 	struct lora_struct *lrdata;
+	long ret;
 
-	pr_debug("lora: ioctl file (cmd=0x%X)\n", cmd);
-
-	ret = -ENOTTY;
-	pval = (void __user *)arg;
-	lrdata = filp->private_data;
-
-	/* I/O control by each command. */
-	switch (cmd) {
-	/* Set & read the state of the LoRa device. */
-	case LORA_SET_STATE:
-		if (lrdata->ops->setState != NULL)
-			ret = lrdata->ops->setState(lrdata, pval);
-		break;
-	case LORA_GET_STATE:
-		if (lrdata->ops->getState != NULL)
-			ret = lrdata->ops->getState(lrdata, pval);
-		break;
-	/* Set & get the carrier frequency. */
-	case LORA_SET_FREQUENCY:
-		if (lrdata->ops->setFreq != NULL)
-			ret = lrdata->ops->setFreq(lrdata, pval);
-		break;
-	case LORA_GET_FREQUENCY:
-		if (lrdata->ops->getFreq != NULL)
-			ret = lrdata->ops->getFreq(lrdata, pval);
-		break;
-	/* Set & get the PA power. */
-	case LORA_SET_POWER:
-		if (lrdata->ops->setPower != NULL)
-			ret = lrdata->ops->setPower(lrdata, pval);
-		break;
-	case LORA_GET_POWER:
-		if (lrdata->ops->getPower != NULL)
-			ret = lrdata->ops->getPower(lrdata, pval);
-		break;
-	/* Set & get the RF spreading factor. */
-	case LORA_SET_SPRFACTOR:
-		if (lrdata->ops->setSPRFactor != NULL)
-			ret = lrdata->ops->setSPRFactor(lrdata, pval);
-		break;
-	case LORA_GET_SPRFACTOR:
-		if (lrdata->ops->getSPRFactor != NULL)
-			ret = lrdata->ops->getSPRFactor(lrdata, pval);
-		break;
-	/* Set & get the RF bandwith. */
-	case LORA_SET_BANDWIDTH:
-		if (lrdata->ops->setBW != NULL)
-			ret = lrdata->ops->setBW(lrdata, pval);
-		break;
-	case LORA_GET_BANDWIDTH:
-		if (lrdata->ops->getBW != NULL)
-			ret = lrdata->ops->getBW(lrdata, pval);
-		break;
-	/* Get current RSSI. */
-	case LORA_GET_RSSI:
-		if (lrdata->ops->getRSSI != NULL)
-			ret = lrdata->ops->getRSSI(lrdata, pval);
-		break;
-	/* Get last packet's SNR. */
-	case LORA_GET_SNR:
-		if (lrdata->ops->getSNR != NULL)
-			ret = lrdata->ops->getSNR(lrdata, pval);
-		break;
-	default:
-		ret = -ENOTTY;
-	}
+	/* The client is quiesced after the calls in flight. */
+	down_read(&(cl->use));
+	lrdata = cl->lrdata;
+	if (READ_ONCE(cl->closing) || (lrdata == NULL))
+		ret = -ENODEV;
+	else if (lrdata->ops->setParam == NULL)
+		ret = -EOPNOTSUPP;
+	else
+		ret = lrdata->ops->setParam(lrdata, cmd, val);
+	up_read(&(cl->use));
 
 	return ret;
 }
+EXPORT_SYMBOL(lora_client_set);
 
-static unsigned int
-file_poll(struct file *filp, poll_table *wait)
+/**
+ * lora_client_get - Get a setting of the LoRa device of an in-kernel client
+ * @cl:		the client
+ * @cmd:	LORA_GET_FREQUENCY, LORA_GET_POWER, LORA_GET_SPRFACTOR,
+ *		LORA_GET_BANDWIDTH, LORA_GET_CODINGRATE or LORA_GET_CRC
+ * @val:	the buffer going to hold the value
+ *
+ * It may sleep on the device.  It fails with -ENODEV once the client is
+ * being unregistered or its device is being removed.
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static long
+lora_client_get(struct lora_client *cl, unsigned int cmd, uint32_t *val)
 {
 	struct lora_struct *lrdata;
-	unsigned int mask;
-
-	pr_debug("lora: poll file\n");
-
-	lrdata = filp->private_data;
-	if (lrdata == NULL)
-		return -EBADFD;
-
-	/* Register the file into wait queue for multiplexing. */
-	poll_wait(filp, &lrdata->waitqueue, wait);
+	long ret;
 
-	/* Check ready to write / read. */
-	mask = 0;
-	if ((lrdata->ops->ready2write != NULL)
-		&& lrdata->ops->ready2write(lrdata))
-		mask |= POLLOUT | POLLWRNORM;
-	if ((lrdata->ops->ready2read != NULL)
-		&& lrdata->ops->ready2read(lrdata))
-		mask |= POLLIN | POLLRDNORM;
+	/* The client is quiesced after the calls in flight. */
+	down_read(&(cl->use));
+	lrdata = cl->lrdata;
+	if (READ_ONCE(cl->closing) || (lrdata == NULL))
+		ret = -ENODEV;
+	else if (lrdata->ops->getParam == NULL)
+		ret = -EOPNOTSUPP;
+	else
+		ret = lrdata->ops->getParam(lrdata, cmd, val);
+	up_read(&(cl->use));
 
-	return mask;
+	return ret;
 }
+EXPORT_SYMBOL(lora_client_get);
 
 /**
  * lora_device_add - Add a LoRa compatible device into the device list
@@ -290,7 +2611,27 @@ file_poll(struct file *filp, poll_table *wait)
 static int
 lora_device_add(struct lora_struct *lrdata)
 {
+	int cpu;
+
+	lrdata->stats = alloc_percpu(struct lora_pcpu_stats);
+	if (lrdata->stats == NULL)
+		return -ENOMEM;
+	lrdata->hist = alloc_percpu(struct lora_pcpu_hist);
+	if (lrdata->hist == NULL) {
+		free_percpu(lrdata->stats);
+		lrdata->stats = NULL;
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&(per_cpu_ptr(lrdata->stats, cpu)->syncp));
+
+	/* The settings are checked against the buffer before any user. */
+	lrdata->bufmaxlen = LORA_BUFLEN;
 	INIT_LIST_HEAD(&(lrdata->device_entry));
+	INIT_LIST_HEAD(&(lrdata->clients));
+	/* Not with each user, the clients stay on it. */
+	init_waitqueue_head(&(lrdata->waitqueue));
+	lora_uring_init(lrdata);
 
 	mutex_lock(&device_list_lock);
 	list_add(&(lrdata->device_entry), &device_list);
@@ -309,22 +2650,142 @@ EXPORT_SYMBOL(lora_device_add);
 static int
 lora_device_remove(struct lora_struct *lrdata)
 {
+	lora_uring_stop(lrdata);
+	lora_net_free(lrdata);
+
+	/* No more users find it, then its clients are detached. */
 	mutex_lock(&device_list_lock);
 	list_del(&(lrdata->device_entry));
 	mutex_unlock(&device_list_lock);
+	lora_client_detach(lrdata);
+
+	mutex_lock(&device_list_lock);
+	lora_frag_free(lrdata);
+	debugfs_remove_recursive(lrdata->debugfs);
+	lrdata->debugfs = NULL;
+	free_percpu(lrdata->hist);
+	lrdata->hist = NULL;
+	free_percpu(lrdata->stats);
+	lrdata->stats = NULL;
+	mutex_unlock(&device_list_lock);
 
 	return 0;
 }
 EXPORT_SYMBOL(lora_device_remove);
 
+/**
+ * lora_device_debugfs - Create the debugfs directory of a LoRa device
+ * @driver:	the LoRa driver of the device
+ * @lrdata:	the LoRa device which has been added
+ * @name:	the name of the directory
+ *
+ * The latency file shows the histograms, and writing to the reset file
+ * clears them.  The directory is removed with the device.
+ */
+static void
+lora_device_debugfs(struct lora_driver *driver, struct lora_struct *lrdata,
+		    const char *name)
+{
+	lrdata->debugfs = debugfs_create_dir(name, driver->debugfs);
+	debugfs_create_file("latency", S_IRUSR, lrdata->debugfs, lrdata,
+			    &lora_hist_fops);
+	debugfs_create_file("reset", S_IWUSR, lrdata->debugfs, lrdata,
+			    &lora_hist_reset_fops);
+}
+EXPORT_SYMBOL(lora_device_debugfs);
+
+/**
+ * lora_device_netdev - Create the network interface of a LoRa device
+ * @driver:	the LoRa driver of the device
+ * @lrdata:	the LoRa device which has been added
+ * @dev:	the device of the character device, the interface is named
+ *		after it
+ *
+ * The interface is only created with the netdev module parameter, and it is
+ * removed with the device.  Its frames are the LoRa payloads of LORA_ETH_P
+ * after their metadata, and SIOCLORACMD configures the radio as the ioctl of
+ * the device.  Each packet socket bound to it has its own receive queue,
+ * filter and timestamps.
+ *
+ * Return:	0 / negative number for success / error number
+ */
+static int
+lora_device_netdev(struct lora_driver *driver, struct lora_struct *lrdata,
+		   struct device *dev)
+{
+	struct net_device *ndev;
+	struct lora_net *ln;
+	const char *name;
+	int status;
+
+	if (!lora_netdev)
+		return 0;
+	if ((lrdata->ops->recv == NULL) || (lrdata->ops->xmit == NULL))
+		return -EOPNOTSUPP;
+
+	name = (strlen(dev_name(dev)) < IFNAMSIZ) ? dev_name(dev) : "lora%d";
+	ndev = alloc_netdev(sizeof(struct lora_net), name, NET_NAME_PREDICTABLE,
+			    lora_net_setup);
+	if (ndev == NULL)
+		return -ENOMEM;
+	SET_NETDEV_DEV(ndev, dev->parent);
+
+	ln = netdev_priv(ndev);
+	ln->lrdata = lrdata;
+	ln->driver = driver;
+	skb_queue_head_init(&(ln->rxq));
+	INIT_DELAYED_WORK(&(ln->rx_work), lora_net_rx_work);
+	INIT_WORK(&(ln->tx_work), lora_net_tx_work);
+	ln->wq = alloc_ordered_workqueue("%s", 0, dev_name(dev));
+	if (ln->wq == NULL) {
+		free_netdev(ndev);
+		return -ENOMEM;
+	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	netif_napi_add(ndev, &(ln->napi), lora_net_poll);
+#else
+	netif_napi_add(ndev, &(ln->napi), lora_net_poll, NAPI_POLL_WEIGHT);
+#endif
+
+	/* The settings of the device stay without the users. */
+	ndev->max_mtu = max_t(unsigned int, lora_max_payload(lrdata),
+			      ndev->min_mtu);
+	ndev->mtu = ndev->max_mtu;
+
+	lrdata->netdev = ndev;
+	status = register_netdev(ndev);
+	if (status) {
+		lrdata->netdev = NULL;
+		netif_napi_del(&(ln->napi));
+		destroy_workqueue(ln->wq);
+		free_netdev(ndev);
+	}
+
+	return status;
+}
+EXPORT_SYMBOL(lora_device_netdev);
+
 static struct file_operations lora_fops = {
 	.open 		= file_open,
 	.release	= file_close,
 	.read		= file_read,
 	.write		= file_write,
+	.read_iter	= file_read_iter,
+	.write_iter	= file_write_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	.splice_read	= copy_splice_read,
+#else
+	.splice_read	= generic_file_splice_read,
+#endif
+	.splice_write	= iter_file_splice_write,
 	.unlocked_ioctl = file_ioctl,
+#ifdef LORA_URING
+	.uring_cmd	= file_uring_cmd,
+#endif
 	.poll		= file_poll,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 12, 0)
 	.llseek		= no_llseek,
+#endif
 };
 
 /**
@@ -368,7 +2829,11 @@ lora_register_driver(struct lora_driver *driver)
 			driver->name, driver->major);
 
 	/* Create device class. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	driver->lora_class = class_create(driver->name);
+#else
 	driver->lora_class = class_create(driver->owner, driver->name);
+#endif
 	if (IS_ERR(driver->lora_class)) {
 		pr_err("lora: Failed to create a class of device\n");
 		/* Release the added character device. */
@@ -379,8 +2844,13 @@ lora_register_driver(struct lora_driver *driver)
 			unregister_chrdev_region(dev, driver->num);
 		return -1;
 	}
+	/* Each device has its statistics directory. */
+	driver->lora_class->dev_groups = lora_dev_groups;
 	pr_debug("lora: %s class created\n", driver->name);
 
+	/* The devices' histograms are in the driver's debugfs directory. */
+	driver->debugfs = debugfs_create_dir(driver->name, NULL);
+
 	return 0;
 }
 EXPORT_SYMBOL(lora_register_driver);
@@ -397,6 +2867,7 @@ lora_unregister_driver(struct lora_driver *driver)
 	dev_t dev = MKDEV(driver->major, driver->minor_start);
 	
 	pr_debug("lora: unregister %s\n", driver->name);
+	debugfs_remove_recursive(driver->debugfs);
 	/* Delete device class. */
 	class_destroy(driver->lora_class);
 	/* Delete the character device driver from system. */
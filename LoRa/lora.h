@@ -43,6 +43,15 @@
 #include <linux/cdev.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/rwsem.h>
+#include <linux/completion.h>
 
 /* I/O control by each command. */
 #define LORA_IOC_MAGIC '\x74'
@@ -59,6 +68,39 @@
 #define LORA_GET_BANDWIDTH	(_IOR(LORA_IOC_MAGIC,  9, int))
 #define LORA_GET_RSSI		(_IOR(LORA_IOC_MAGIC, 10, int))
 #define LORA_GET_SNR		(_IOR(LORA_IOC_MAGIC, 11, int))
+#define LORA_SET_TXTIME		(_IOW(LORA_IOC_MAGIC, 12, struct lora_txtime))
+#define LORA_GET_TXTIME		(_IOR(LORA_IOC_MAGIC, 13, struct lora_txtime_status))
+#define LORA_SET_RXWIN		(_IOW(LORA_IOC_MAGIC, 14, struct lora_rxwin))
+#define LORA_GET_RXWIN		(_IOR(LORA_IOC_MAGIC, 15, struct lora_rxwin_status))
+#define LORA_SET_CODINGRATE	(_IOW(LORA_IOC_MAGIC, 16, int))
+#define LORA_GET_CODINGRATE	(_IOR(LORA_IOC_MAGIC, 17, int))
+#define LORA_SET_CRC		(_IOW(LORA_IOC_MAGIC, 18, int))
+#define LORA_GET_CRC		(_IOR(LORA_IOC_MAGIC, 19, int))
+#define LORA_SET_IMPLICIT	(_IOW(LORA_IOC_MAGIC, 20, int))
+#define LORA_GET_IMPLICIT	(_IOR(LORA_IOC_MAGIC, 21, int))
+#define LORA_SET_MAXPAYLOAD	(_IOW(LORA_IOC_MAGIC, 22, int))
+#define LORA_GET_FIFOSTAT	(_IOR(LORA_IOC_MAGIC, 23, struct lora_fifo_stat))
+#define LORA_SET_BEACON		(_IOW(LORA_IOC_MAGIC, 24, struct lora_beacon))
+#define LORA_SEND_BEACON	(_IO(LORA_IOC_MAGIC, 25))
+#define LORA_GET_BEACON		(_IOR(LORA_IOC_MAGIC, 26, struct lora_beacon_status))
+#define LORA_SET_FRAG		(_IOW(LORA_IOC_MAGIC, 27, struct lora_frag_param))
+#define LORA_GET_FRAG		(_IOR(LORA_IOC_MAGIC, 28, struct lora_frag_param))
+#define LORA_GET_FRAGSTAT	(_IOR(LORA_IOC_MAGIC, 29, struct lora_frag_stat))
+#define LORA_SET_KEY		(_IOW(LORA_IOC_MAGIC, 30, struct lora_key))
+#define LORA_GET_CRYPTOSTAT	(_IOR(LORA_IOC_MAGIC, 31, struct lora_crypto_stat))
+#define LORA_GET_STATS		(_IOR(LORA_IOC_MAGIC, 32, struct lora_stats))
+#define LORA_GET_PKTSTAT	(_IOR(LORA_IOC_MAGIC, 33, struct lora_pkt_stat))
+
+/* The commands of io_uring passthrough, as cmd_op of IORING_OP_URING_CMD. */
+#define LORA_URING_RECV		(_IOR(LORA_IOC_MAGIC, 64, struct lora_uring_cmd))
+#define LORA_URING_SEND		(_IOW(LORA_IOC_MAGIC, 65, struct lora_uring_cmd))
+#define LORA_URING_IOCTL	(_IOWR(LORA_IOC_MAGIC, 66, struct lora_uring_cmd))
+
+/* The protocol of the frames on the LoRa network interfaces, the local
+ * experimental EtherType ETH_P_802_EX1, for none is assigned to LoRa. */
+#define LORA_ETH_P		0x88B5
+/* Configure the radio of a LoRa network interface by struct lora_ifcmd. */
+#define SIOCLORACMD		(SIOCDEVPRIVATE + 0)
 
 /* List the state of the LoRa device. */
 #define LORA_STATE_SLEEP	0
@@ -67,6 +109,381 @@
 #define LORA_STATE_RX		3
 #define LORA_STATE_CAD		4
 
+/**
+ * struct lora_txtime: Start the next written packet at an absolute time
+ * @time_ns:		The start time of the TX in ns, 0 for cancelling
+ * @clockid:		The clock of the start time, CLOCK_MONOTONIC or
+ *			CLOCK_BOOTTIME
+ * @flags:		Reserved, must be 0
+ */
+struct lora_txtime {
+	int64_t time_ns;
+	uint32_t clockid;
+	uint32_t flags;
+};
+
+/**
+ * struct lora_txtime_status: The accounting of the scheduled TX
+ * @requested_ns:	The requested start time of the last scheduled TX
+ * @achieved_ns:	The achieved start time of the last scheduled TX
+ * @status:		0 for sent, negative error number for dropped
+ * @sent:		How many scheduled packets have been sent
+ * @late:		How many scheduled packets have been dropped for late
+ * @max_lateness_ns:	The max lateness of the achieved start time
+ * @sum_lateness_ns:	The sum of the lateness of the achieved start time
+ */
+struct lora_txtime_status {
+	int64_t requested_ns;
+	int64_t achieved_ns;
+	int32_t status;
+	uint32_t sent;
+	uint32_t late;
+	uint32_t reserved;
+	int64_t max_lateness_ns;
+	int64_t sum_lateness_ns;
+};
+
+/* List the result of an RX window. */
+#define LORA_RXWIN_NONE		0
+#define LORA_RXWIN_CAUGHT	1
+#define LORA_RXWIN_TIMEOUT	2
+#define LORA_RXWIN_CRCERROR	3
+
+/* The max number of the RX windows after a TX. */
+#define LORA_RXWIN_MAX		2
+
+/**
+ * struct lora_rxwin_param: The parameters of an RX window
+ * @delay_ms:		The window opens after the end of the TX in ms
+ * @timeout_ms:		The window lasts for the time, if no preamble detected
+ * @freq:		The carrier frequency of the window in Hz
+ * @sprf:		The spreading factor of the window in chips / symbol
+ * @bw:			The RF bandwidth of the window in Hz
+ */
+struct lora_rxwin_param {
+	uint32_t delay_ms;
+	uint32_t timeout_ms;
+	uint32_t freq;
+	uint32_t sprf;
+	uint32_t bw;
+};
+
+/**
+ * struct lora_rxwin: The RX windows opened after each TX
+ * @nwin:		How many windows are opened, 0 for disabled
+ * @flags:		Reserved, must be 0
+ * @win:		The parameters of each window in order
+ */
+struct lora_rxwin {
+	uint32_t nwin;
+	uint32_t flags;
+	struct lora_rxwin_param win[LORA_RXWIN_MAX];
+};
+
+/**
+ * struct lora_rxwin_status: The result of the last RX windows
+ * @result:		LORA_RXWIN_* or negative error number of each window
+ * @len:		The length of the caught packet in each window
+ * @opened_ns:		The CLOCK_MONOTONIC time of each window opened
+ * @caught:		How many times a downlink was caught in the windows
+ * @missed:		How many times nothing was caught in the windows
+ */
+struct lora_rxwin_status {
+	int32_t result[LORA_RXWIN_MAX];
+	uint32_t len[LORA_RXWIN_MAX];
+	int64_t opened_ns[LORA_RXWIN_MAX];
+	uint32_t caught;
+	uint32_t missed;
+};
+
+/**
+ * struct lora_fifo_stat: The occupancy and the counters of the chip's FIFO
+ * @rx_pending:		How many RX packets are waiting in the FIFO
+ * @used:		The bytes used by the waiting RX and staged TX packets
+ * @rx_slot:		The bytes reserved for the packet being received
+ * @rx_queued:		How many RX packets have been queued in the FIFO
+ * @rx_overwrites:	How many RX packets have been overwritten before read
+ * @rx_crcerrors:	How many RX packets have been dropped for CRC error
+ * @tx_staged:		How many TX packets have been staged in the FIFO
+ * @tx_paused_rx:	How many TX packets paused RX for no free space
+ */
+struct lora_fifo_stat {
+	uint32_t rx_pending;
+	uint32_t used;
+	uint32_t rx_slot;
+	uint32_t rx_queued;
+	uint32_t rx_overwrites;
+	uint32_t rx_crcerrors;
+	uint32_t tx_staged;
+	uint32_t tx_paused_rx;
+};
+
+/* The max length of the resident frame. */
+#define LORA_BEACON_MAXLEN	255
+/* The max length of the counter patched into the resident frame. */
+#define LORA_BEACON_MAXPATCH	4
+
+/**
+ * struct lora_beacon: The resident frame pinned in the chip's FIFO
+ * @len:		The length of the frame in bytes, 0 for unpinning
+ * @period_ms:		Send the frame periodically in milliseconds, 0 for
+ *			sending by LORA_SEND_BEACON only
+ * @patch_off:		The offset of the counter in the frame
+ * @patch_len:		The length of the big-endian counter in bytes, 0 for
+ *			no counter
+ * @payload:		The frame
+ *
+ * The counter starts from the value in the frame, and it is increased
+ * before each following send.
+ */
+struct lora_beacon {
+	uint32_t len;
+	uint32_t period_ms;
+	uint32_t patch_off;
+	uint32_t patch_len;
+	uint8_t payload[LORA_BEACON_MAXLEN];
+};
+
+/**
+ * struct lora_beacon_status: The accounting of the resident frame
+ * @sent:		How many times the frame has been sent
+ * @late:		How many periodic sends started late
+ * @failed:		How many sends have failed
+ * @counter:		The counter of the frame last sent
+ * @last_ns:		The CLOCK_MONOTONIC time of the frame last sent
+ */
+struct lora_beacon_status {
+	uint32_t sent;
+	uint32_t late;
+	uint32_t failed;
+	uint32_t counter;
+	int64_t last_ns;
+};
+
+/* The header of each fragment: message id, index, count and size. */
+#define LORA_FRAG_HDRLEN	4
+/* The max number of the fragments of a message. */
+#define LORA_FRAG_MAXCNT	255
+/* The max length of a fragmented message. */
+#define LORA_FRAG_MAXMSG	16384
+/* How many messages can be reassembled at the same time. */
+#define LORA_FRAG_SLOTS		4
+
+/**
+ * struct lora_frag_param: The fragmentation of the read & write messages
+ * @enable:		1 / 0 for enabled / disabled
+ * @fragsize:		The payload length of each fragment, not including
+ *			the header, 0 for the max
+ * @timeout_ms:		Drop a message which is not reassembled in time
+ *
+ * Both sides must enable the fragmentation in Explicit Header Mode.
+ */
+struct lora_frag_param {
+	uint32_t enable;
+	uint32_t fragsize;
+	uint32_t timeout_ms;
+};
+
+/**
+ * struct lora_frag_stat: The counters of the fragmentation
+ * @tx_msgs:		How many messages have been sent
+ * @tx_frags:		How many fragments have been sent
+ * @tx_errors:		How many messages have failed to be sent
+ * @rx_msgs:		How many messages have been reassembled
+ * @rx_frags:		How many valid fragments have been received
+ * @rx_dups:		How many duplicated fragments have been dropped
+ * @rx_invalid:		How many frames have been dropped for bad header
+ * @rx_timeouts:	How many messages have been dropped for time out
+ * @rx_evicted:		How many messages have been dropped for full table
+ * @rx_lost:		How many fragments are missing in dropped messages
+ */
+struct lora_frag_stat {
+	uint32_t tx_msgs;
+	uint32_t tx_frags;
+	uint32_t tx_errors;
+	uint32_t rx_msgs;
+	uint32_t rx_frags;
+	uint32_t rx_dups;
+	uint32_t rx_invalid;
+	uint32_t rx_timeouts;
+	uint32_t rx_evicted;
+	uint32_t rx_lost;
+};
+
+/* The length of the AES-128 keys. */
+#define LORA_KEYLEN		16
+/* The header of each secured frame: address and frame counter. */
+#define LORA_CRYPTO_HDRLEN	8
+/* The length of the truncated AES-CMAC at the end of each secured frame. */
+#define LORA_CRYPTO_MICLEN	4
+#define LORA_CRYPTO_OVERHEAD	(LORA_CRYPTO_HDRLEN + LORA_CRYPTO_MICLEN)
+/* How many frame counters behind the newest one are still accepted. */
+#define LORA_CRYPTO_REPLAYWIN	64
+
+/* List the flags of the keys. */
+#define LORA_KEY_ENABLE		(1 << 0)	/* Secure the frames */
+#define LORA_KEY_ENCRYPT	(1 << 1)	/* Also encrypt the payload */
+
+/**
+ * struct lora_key: The keys securing the read & written frames
+ * @flags:		LORA_KEY_*, 0 for disabling
+ * @addr:		The address put into the written frames
+ * @peer:		Only the read frames from this address are accepted
+ * @fcnt:		The frame counter of the next written frame
+ * @enc_key:		The AES-128 key of the AES-CTR payload encryption
+ * @mic_key:		The AES-128 key of the AES-CMAC integrity code
+ *
+ * A secured frame is the address and the frame counter in little-endian,
+ * the payload, and the 4 bytes AES-CMAC over all of them.  The keys can not
+ * be read back.  Setting the keys resets the replay window.
+ */
+struct lora_key {
+	uint32_t flags;
+	uint32_t addr;
+	uint32_t peer;
+	uint32_t fcnt;
+	uint8_t enc_key[LORA_KEYLEN];
+	uint8_t mic_key[LORA_KEYLEN];
+};
+
+/**
+ * struct lora_crypto_stat: The counters of the secured frames
+ * @tx_sealed:		How many frames have been secured and sent
+ * @tx_fcnt:		The frame counter of the next written frame
+ * @rx_opened:		How many frames have been verified and read
+ * @rx_badmic:		How many frames have been dropped for bad AES-CMAC
+ * @rx_replayed:	How many frames have been dropped by the replay window
+ * @rx_foreign:		How many frames have been dropped for the address
+ * @rx_short:		How many frames have been dropped for too short
+ * @rx_errors:		How many frames have been dropped for crypto errors
+ * @rx_batches:		How many batches of the pending frames have been
+ *			processed
+ * @rx_maxbatch:	The most frames processed in a batch
+ * @rx_fcnt:		The newest accepted frame counter
+ */
+struct lora_crypto_stat {
+	uint32_t tx_sealed;
+	uint32_t tx_fcnt;
+	uint32_t rx_opened;
+	uint32_t rx_badmic;
+	uint32_t rx_replayed;
+	uint32_t rx_foreign;
+	uint32_t rx_short;
+	uint32_t rx_errors;
+	uint32_t rx_batches;
+	uint32_t rx_maxbatch;
+	uint32_t rx_fcnt;
+};
+
+/**
+ * struct lora_stats: The counters of a LoRa device
+ * @rx_packets:		How many packets have been received
+ * @rx_bytes:		How many payload bytes have been received
+ * @rx_crcerrors:	How many packets have been dropped for CRC error
+ * @rx_timeouts:	How many single RX have timed out without a packet
+ * @rx_dropped:		How many packets have been overwritten before read
+ * @tx_packets:		How many packets have been sent
+ * @tx_bytes:		How many payload bytes have been sent on air
+ * @tx_timeouts:	How many packets have not been sent in time
+ * @spi_transactions:	How many SPI messages have been transferred
+ * @spi_errors:		How many SPI messages have failed
+ * @chip_rx_headers:	The chip's valid header counter, it restarts from 0
+ *			whenever the chip enters RX state
+ * @chip_rx_packets:	The chip's valid packet counter, it restarts from 0
+ *			whenever the chip enters RX state
+ *
+ * A header counted without a packet is a packet lost in the air, while no
+ * header for a long time is a deaf radio.
+ */
+struct lora_stats {
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t rx_crcerrors;
+	uint64_t rx_timeouts;
+	uint64_t rx_dropped;
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_timeouts;
+	uint64_t spi_transactions;
+	uint64_t spi_errors;
+	uint32_t chip_rx_headers;
+	uint32_t chip_rx_packets;
+};
+
+/**
+ * struct lora_pkt_stat: The signal of the packet last read
+ * @rssi:		The RSSI of the packet in dBm
+ * @snr:		The SNR of the packet in 0.25 dB
+ * @len:		The length of the packet in bytes, 0 for nothing read
+ *
+ * Unlike LORA_GET_SNR, it belongs to the packet just read, even if newer
+ * packets have been received into the chip's FIFO.
+ */
+struct lora_pkt_stat {
+	int32_t rssi;
+	int32_t snr;
+	uint32_t len;
+};
+
+/**
+ * struct lora_pkt_meta: The link layer header of a LoRa network interface
+ * @rx_ns:		The CLOCK_MONOTONIC time the packet was received, 0
+ *			for the sent packets
+ * @tx_ns:		The CLOCK_MONOTONIC time the packet last sent left the
+ *			air, 0 for the received packets
+ * @rssi:		The RSSI of the packet in dBm
+ * @snr:		The SNR of the packet in 0.25 dB
+ * @len:		The length of the payload following the header
+ * @reserved:		Reserved, must be 0
+ *
+ * The SOCK_RAW packet sockets read and write it before each payload, while
+ * the SOCK_DGRAM ones have the payload only.
+ */
+struct lora_pkt_meta {
+	int64_t rx_ns;
+	int64_t tx_ns;
+	int32_t rssi;
+	int32_t snr;
+	uint32_t len;
+	uint32_t reserved;
+};
+
+/**
+ * struct lora_uring_cmd: The command in the SQE of IORING_OP_URING_CMD
+ * @addr:		The user buffer of the data, or the argument of ioctl
+ * @len:		The length of the user buffer in bytes
+ * @ioctl:		The ioctl command of LORA_URING_IOCTL, LORA_GET_* and
+ *			LORA_SET_*
+ *
+ * It fits the command area of a 64 bytes SQE.  LORA_URING_RECV and
+ * LORA_URING_SEND act as read() and write(), and the CQE holds the bytes
+ * or the negative error number.  LORA_URING_RECV with
+ * IORING_URING_CMD_MULTISHOT and a provided buffer group ignores addr and
+ * len, and posts a CQE with IORING_CQE_F_MORE for each received packet
+ * until it is cancelled or runs out of buffers.
+ */
+struct lora_uring_cmd {
+	uint64_t addr;
+	uint32_t len;
+	uint32_t ioctl;
+};
+
+/**
+ * struct lora_ifcmd: The ioctl of a LoRa network interface
+ * @cmd:		The ioctl command of the device, LORA_SET_* and
+ *			LORA_GET_*
+ * @reserved:		Reserved, must be 0
+ * @arg:		The argument of the ioctl command
+ *
+ * The ifr_data of SIOCLORACMD points at it.  The commands other than
+ * LORA_GET_* need CAP_NET_ADMIN.
+ */
+struct lora_ifcmd {
+	uint32_t cmd;
+	uint32_t reserved;
+	uint64_t arg;
+};
+
 struct lora_struct;
 
 /* The structure lists the LoRa device's operations. */
@@ -90,13 +507,267 @@ struct lora_operations {
 	long (*getRSSI)(struct lora_struct *, void __user *);
 	/* Get last packet's SNR. */
 	long (*getSNR)(struct lora_struct *, void __user *);
+	/* Set the start time of the next TX & get the scheduled TX status. */
+	long (*setTxTime)(struct lora_struct *, void __user *);
+	long (*getTxTime)(struct lora_struct *, void __user *);
+	/* Set the RX windows after each TX & get the last windows' result. */
+	long (*setRxWin)(struct lora_struct *, void __user *);
+	long (*getRxWin)(struct lora_struct *, void __user *);
+	/* Set & get the coding rate denominator, 5 ~ 8 for 4/5 ~ 4/8. */
+	long (*setCR)(struct lora_struct *, void __user *);
+	long (*getCR)(struct lora_struct *, void __user *);
+	/* Set & get the payload CRC, 1 / 0 for enabled / disabled. */
+	long (*setCRC)(struct lora_struct *, void __user *);
+	long (*getCRC)(struct lora_struct *, void __user *);
+	/* Set & get the fixed payload length of implicit header mode,
+	 * 0 for explicit header mode. */
+	long (*setImplicit)(struct lora_struct *, void __user *);
+	long (*getImplicit)(struct lora_struct *, void __user *);
+	/* Set the max RX payload length & get the chip's FIFO status. */
+	long (*setMaxPayload)(struct lora_struct *, void __user *);
+	long (*getFIFOStat)(struct lora_struct *, void __user *);
+	/* Pin & send the resident frame & get its status. */
+	long (*setBeacon)(struct lora_struct *, void __user *);
+	long (*sendBeacon)(struct lora_struct *, void __user *);
+	long (*getBeacon)(struct lora_struct *, void __user *);
+	/* Set the keys of the secured frames & get their counters. */
+	long (*setKey)(struct lora_struct *, void __user *);
+	long (*getCryptoStat)(struct lora_struct *, void __user *);
+	/* Get the signal of the packet last read. */
+	long (*getPktStat)(struct lora_struct *, void __user *);
+	/* Get the signal and the time of the packet last read, and the time
+	 * the packet last sent left the air, with a kernel buffer. */
+	long (*getPktMeta)(struct lora_struct *, struct lora_pkt_meta *);
+	/* Set & get a 32 bits setting, LORA_SET_* & LORA_GET_* of the carrier
+	 * frequency, the PA power, the spreading factor, the bandwidth, the
+	 * coding rate or the payload CRC, with a kernel value. */
+	long (*setParam)(struct lora_struct *, unsigned int, uint32_t);
+	long (*getParam)(struct lora_struct *, unsigned int, uint32_t *);
+	/* Read the chip's own counters into the statistics. */
+	long (*getChipStat)(struct lora_struct *, struct lora_stats *);
 	/* Read from the LoRa device's communication. */
 	ssize_t (*read)(struct lora_struct *, const char __user *, size_t);
 	/* Write to the LoRa device's communication. */
 	ssize_t (*write)(struct lora_struct *, const char __user *, size_t);
+	/* Receive & send a packet with a kernel buffer. */
+	ssize_t (*recv)(struct lora_struct *, uint8_t *, size_t);
+	ssize_t (*xmit)(struct lora_struct *, const uint8_t *, size_t);
 	/* Is ready to write & read. */
 	long (*ready2write)(struct lora_struct *);
 	long (*ready2read)(struct lora_struct *);
+	/* Set to RX without waiting for a packet, with a kernel caller. */
+	long (*startRX)(struct lora_struct *);
+	/* Get the most bytes a packet carries with the current settings,
+	 * without the lock, for it may be called in atomic context. */
+	long (*getMaxTx)(struct lora_struct *);
+};
+
+/**
+ * struct lora_frag_slot: A message being reassembled
+ * @buf:		The reassembly buffer of the message
+ * @got:		The received fragments of the message
+ * @deadline:		The jiffies the message will be dropped at
+ * @len:		The length of the message, known after the last fragment
+ * @used:		The slot is reassembling a message
+ * @id:			The id of the message
+ * @cnt:		How many fragments the message has
+ * @fsz:		The payload length of each fragment but the last one
+ * @nrcv:		How many fragments have been received
+ */
+struct lora_frag_slot {
+	uint8_t *buf;
+	DECLARE_BITMAP(got, LORA_FRAG_MAXCNT);
+	unsigned long deadline;
+	uint16_t len;
+	uint8_t used;
+	uint8_t id;
+	uint8_t cnt;
+	uint8_t fsz;
+	uint8_t nrcv;
+};
+
+/**
+ * struct lora_frag: The fragmentation layer of a LoRa device
+ * @param:		The parameters of the fragmentation
+ * @stat:		The counters of the fragmentation
+ * @tx_lock:		Serialize the fragmented writes
+ * @rx_lock:		Serialize the reassembled reads and the table
+ * @txid:		The id of the next written message
+ * @slot:		The reassembly table
+ * @txframe:		The frame being sent
+ * @rxframe:		The frame being received
+ */
+struct lora_frag {
+	struct lora_frag_param param;
+	struct lora_frag_stat stat;
+	struct mutex tx_lock;
+	struct mutex rx_lock;
+	uint8_t txid;
+	struct lora_frag_slot slot[LORA_FRAG_SLOTS];
+	uint8_t txframe[256];
+	uint8_t rxframe[256];
+};
+
+/**
+ * struct lora_pcpu_stats: The counters of a LoRa device on a CPU
+ * @stats:		The counters updated on this CPU
+ * @syncp:		Read the 64 bits counters consistently on 32 bits CPUs
+ */
+struct lora_pcpu_stats {
+	struct lora_stats stats;
+	struct u64_stats_sync syncp;
+};
+
+/* List the latency histograms of a LoRa device. */
+enum lora_hist_id {
+	LORA_HIST_TX_LOAD,	/* write() to the packet loaded into FIFO */
+	LORA_HIST_TX_START,	/* FIFO loaded to the chip set to TX state */
+	LORA_HIST_TX_AIR,	/* TX state to TX done polled */
+	LORA_HIST_RX_FIFO,	/* RX done polled to the packet read from FIFO */
+	LORA_HIST_RX_READY,	/* Read from FIFO to available to the reader */
+	LORA_HIST_RX_COPY,	/* Available to the reader to copied out */
+	LORA_HIST_SPI,		/* Each SPI transaction */
+	LORA_HIST_LOCK_WAIT,	/* Waiting for buf_lock */
+	LORA_HIST_LOCK_HOLD,	/* Holding buf_lock */
+	LORA_HIST_NUM,
+};
+
+/* The bucket n counts the latencies in [2^n, 2^(n+1)) ns, up to 18 mins. */
+#define LORA_HIST_BUCKETS	40
+
+/**
+ * struct lora_pcpu_hist: The latency histograms of a LoRa device on a CPU
+ * @bucket:		The log2 buckets of each histogram
+ */
+struct lora_pcpu_hist {
+	unsigned long bucket[LORA_HIST_NUM][LORA_HIST_BUCKETS];
+};
+
+/* How many received packets wait for the multishot RX command. */
+#define LORA_URING_RXQ		4
+/* How often the multishot RX checks the device for packets in ms. */
+#define LORA_URING_POLL_MS	20
+
+/**
+ * struct lora_uring_pkt: A packet received for the multishot RX command
+ * @len:		The length of the packet
+ * @buf:		The packet
+ */
+struct lora_uring_pkt {
+	size_t len;
+	uint8_t buf[256];
+};
+
+struct io_uring_cmd;
+
+/**
+ * struct lora_uring: The multishot RX command of io_uring on a LoRa device
+ * @lock:		Protects the fields below but the packets' data
+ * @cmd:		The armed command, NULL for none
+ * @work:		Receives the packets for the command in process context
+ * @bgid:		The provided buffer group of the command
+ * @err:		Ends the command with the error number, 0 for going on
+ * @tw:			The task work posting the packets is pending
+ * @head:		The first packet not posted yet
+ * @n:			How many packets are not posted yet
+ * @q:			The packets not posted yet
+ */
+struct lora_uring {
+	spinlock_t lock;
+	struct io_uring_cmd *cmd;
+	struct delayed_work work;
+	uint16_t bgid;
+	int err;
+	int tw;
+	int head;
+	int n;
+	struct lora_uring_pkt q[LORA_URING_RXQ];
+};
+
+/* How many packets wait to be sent by an in-kernel client at most. */
+#define LORA_CLIENT_TXQ		16
+/* How many packets an in-kernel client receives in a turn. */
+#define LORA_CLIENT_RXBATCH	8
+/* How often an in-kernel client checks the device for packets in ms, if the
+ * driver does not wake it up. */
+#define LORA_CLIENT_POLL_MS	20
+
+struct lora_client;
+
+/**
+ * struct lora_client_tx: A packet sent by an in-kernel client
+ * @entry:		The entry in the client's TX queue
+ * @done:		Called after the packet has been sent, then it is freed
+ * @ctx:		The context of done
+ * @status:		The bytes sent or the negative error number
+ * @queued_ns:		The CLOCK_MONOTONIC time it was queued
+ * @start_ns:		The CLOCK_MONOTONIC time it was handed to the device
+ * @aired_ns:		The CLOCK_MONOTONIC time it left the air, as the driver
+ *			has seen, 0 if it is not known
+ * @len:		The length of the packet
+ * @buf:		The packet
+ */
+struct lora_client_tx {
+	struct list_head entry;
+	void (*done)(struct lora_client *, struct lora_client_tx *);
+	void *ctx;
+	ssize_t status;
+	u64 queued_ns;
+	u64 start_ns;
+	u64 aired_ns;
+	size_t len;
+	uint8_t buf[];
+};
+
+/**
+ * struct lora_client: An in-kernel user of a LoRa device
+ * @lrdata:		The LoRa device, NULL after the device is removed
+ * @entry:		The entry in the device's client list
+ * @rx:			Called with each received packet and its metadata in
+ *			process context, the packet is only valid in the call
+ * @priv:		The private data of the client
+ * @wq:			Runs the RX and the TX, which sleep on the radio in
+ *			turn, so the callbacks are serialized
+ * @rx_work:		Receives the packets and calls rx
+ * @tx_work:		Sends the packets of txq
+ * @wait:		Wakes up rx_work when the device has packets
+ * @lock:		Protects txq, ntx and closing
+ * @txq:		The packets waiting to be sent
+ * @ntx:		How many packets are waiting
+ * @stop_lock:		Serializes quiescing the client
+ * @use:		Held for reading by the calls of lora_client_set() and
+ *			lora_client_get(), and quiescing waits for them
+ * @detached:		Completed after the removal of the device has detached
+ *			the client
+ * @closing:		No more packets are received or sent
+ * @stopped:		The client has been quiesced
+ * @detaching:		The removal of the device is detaching the client,
+ *			protected by the device list's lock
+ * @primed:		The radio has been set to RX since the client was
+ *			registered or the last TX
+ * @rxbuf:		The packet being received
+ */
+struct lora_client {
+	struct lora_struct *lrdata;
+	struct list_head entry;
+	void (*rx)(struct lora_client *, const uint8_t *, size_t,
+		   const struct lora_pkt_meta *);
+	void *priv;
+	struct workqueue_struct *wq;
+	struct delayed_work rx_work;
+	struct work_struct tx_work;
+	wait_queue_entry_t wait;
+	spinlock_t lock;
+	struct list_head txq;
+	int ntx;
+	struct mutex stop_lock;
+	struct rw_semaphore use;
+	struct completion detached;
+	int closing;
+	int stopped;
+	int detaching;
+	int primed;
+	uint8_t rxbuf[256];
 };
 
 /**
@@ -113,6 +784,16 @@ struct lora_operations {
  * @users:		How many program use this LoRa device
  * @buf_lock:		The lock to protect the synchroniztion of this structure
  * @waitqueue:		The queue to be hung on the wait table for multiplexing
+ * @frag:		The fragmentation layer, NULL before it is enabled
+ * @stats:		The per-CPU counters, NULL before the device is added
+ * @hist:		The per-CPU latency histograms, NULL before the device
+ *			is added
+ * @debugfs:		The debugfs directory of the device
+ * @lock_ns:		The time buf_lock was taken by lora_lock()
+ * @uring:		The multishot RX command of io_uring
+ * @netdev:		The network interface, NULL for none
+ * @clients:		The in-kernel clients, protected by the device list's
+ *			lock
  */
 struct lora_struct {
 	dev_t devt;
@@ -127,8 +808,86 @@ struct lora_struct {
 	uint8_t users;
 	struct mutex buf_lock;
 	wait_queue_head_t waitqueue;
+	struct lora_frag *frag;
+	struct lora_pcpu_stats __percpu *stats;
+	struct lora_pcpu_hist __percpu *hist;
+	struct dentry *debugfs;
+	u64 lock_ns;
+	struct lora_uring uring;
+	struct net_device *netdev;
+	struct list_head clients;
 };
 
+/*
+ * Add to a counter of the LoRa device without any lock.  It is called in
+ * process context only, so the CPU's counters have a single writer.
+ */
+#define lora_stats_add(lr, field, n)					\
+	do {								\
+		struct lora_struct *__lr = (lr);			\
+		struct lora_pcpu_stats *__s;				\
+									\
+		if ((__lr != NULL) && (__lr->stats != NULL)) {		\
+			__s = get_cpu_ptr(__lr->stats);			\
+			u64_stats_update_begin(&(__s->syncp));		\
+			__s->stats.field += (n);			\
+			u64_stats_update_end(&(__s->syncp));		\
+			put_cpu_ptr(__lr->stats);			\
+		}							\
+	} while (0)
+
+#define lora_stats_inc(lr, field)	lora_stats_add(lr, field, 1)
+
+/**
+ * lora_hist_add - Count a latency into its histogram without any lock
+ * @lrdata:	the LoRa device
+ * @id:		which histogram, LORA_HIST_*
+ * @ns:		the latency in ns
+ */
+static inline void
+lora_hist_add(struct lora_struct *lrdata, enum lora_hist_id id, u64 ns)
+{
+	int b;
+
+	if ((lrdata == NULL) || (lrdata->hist == NULL))
+		return;
+
+	b = (ns > 0) ? (fls64(ns) - 1) : 0;
+	if (b >= LORA_HIST_BUCKETS)
+		b = LORA_HIST_BUCKETS - 1;
+	this_cpu_inc(lrdata->hist->bucket[id][b]);
+}
+
+/**
+ * lora_lock - Take buf_lock of a LoRa device and count the time waiting
+ * @lrdata:	the LoRa device
+ *
+ * The drivers take buf_lock with it, so the latency histograms show how
+ * long the operations wait for and hold the lock.
+ */
+static inline void
+lora_lock(struct lora_struct *lrdata)
+{
+	u64 t;
+
+	t = ktime_get_ns();
+	mutex_lock(&(lrdata->buf_lock));
+	lrdata->lock_ns = ktime_get_ns();
+	lora_hist_add(lrdata, LORA_HIST_LOCK_WAIT, lrdata->lock_ns - t);
+}
+
+/**
+ * lora_unlock - Release buf_lock of a LoRa device and count the time held
+ * @lrdata:	the LoRa device
+ */
+static inline void
+lora_unlock(struct lora_struct *lrdata)
+{
+	lora_hist_add(lrdata, LORA_HIST_LOCK_HOLD,
+		      ktime_get_ns() - lrdata->lock_ns);
+	mutex_unlock(&(lrdata->buf_lock));
+}
+
 /**
  * struct lora_driver: Host side LoRa driver
  * @name:		Name of the driver to use with this device
@@ -138,6 +897,7 @@ struct lora_struct {
  * @lora_cdev:		The handle lets the devices act as character devices
  * @lora_class:		The class for being registed into file system
  * @owner:		This driver owned by which kernel module
+ * @debugfs:		The debugfs directory of the driver's devices
  */
 struct lora_driver {
 	char *name;
@@ -147,6 +907,7 @@ struct lora_driver {
 	struct cdev lora_cdev;
 	struct class *lora_class;
 	struct module *owner;
+	struct dentry *debugfs;
 };
 
 #endif
@@ -0,0 +1,173 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lora-cuse.h"
+
+/*
+ * Replay the packets of a file to all the radios at their times from the
+ * start of the daemon.  Each line is "<ms> <hex payload> [<RSSI dBm>
+ * [<SNR in 0.25 dB>]]", as -w records, and '#' starts a comment.  The
+ * written packets go nowhere.
+ */
+
+/* A packet of the file. */
+struct replay_pkt {
+	uint64_t at;		/* From the start in us */
+	uint8_t buf[CUSE_MAXLEN];
+	size_t len;
+	int32_t rssi;
+	int32_t snr;
+};
+
+static struct replay_pkt *pkts;
+static size_t npkts;
+static size_t next;
+static uint64_t base;
+
+/* Parse a line of the file, return 0 for a packet. */
+static int replay_parse(char *line, struct replay_pkt *p)
+{
+	char *hex, *end;
+	unsigned int b;
+	double ms;
+
+	if ((line[0] == '#') || (line[0] == '\n'))
+		return -1;
+	ms = strtod(line, &end);
+	if (end == line)
+		return -1;
+	hex = strtok(end, " \t\n");
+	if (hex == NULL)
+		return -1;
+
+	memset(p, 0, sizeof(*p));
+	p->at = ms * 1000;
+	while ((p->len < CUSE_MAXLEN) && (sscanf(hex, "%2x", &b) == 1)) {
+		p->buf[p->len++] = b;
+		hex += 2;
+	}
+	/* A strong & clean signal, if the file does not tell. */
+	p->rssi = -60;
+	p->snr = 40;
+	end = strtok(NULL, " \t\n");
+	if (end != NULL)
+		p->rssi = atoi(end);
+	end = strtok(NULL, " \t\n");
+	if (end != NULL)
+		p->snr = atoi(end);
+
+	return 0;
+}
+
+/* Load the packets of the file. */
+static int replay_start(const char *file)
+{
+	struct replay_pkt p;
+	char line[1024];
+	size_t max = 0;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		perror(file);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (replay_parse(line, &p) != 0)
+			continue;
+		if (npkts == max) {
+			max = max ? 2 * max : 64;
+			pkts = realloc(pkts, max * sizeof(struct replay_pkt));
+			if (pkts == NULL) {
+				fclose(fp);
+				return -1;
+			}
+		}
+		pkts[npkts++] = p;
+	}
+	fclose(fp);
+
+	printf("%s: %zu packets\n", file, npkts);
+	base = cuse_now();
+
+	return 0;
+}
+
+/* The written packets go nowhere. */
+static void replay_xmit(struct cuse_radio *r, const uint8_t *buf, size_t len,
+			uint64_t now, uint64_t end)
+{
+}
+
+/* The channel is always clear. */
+static int32_t replay_rssi(struct cuse_radio *r)
+{
+	return cuse_noise(r->bw) / 4;
+}
+
+/* Get the time of the next packet of the file. */
+static uint64_t replay_next(void)
+{
+	return (next < npkts) ? base + pkts[next].at : 0;
+}
+
+/* Deliver the packets due to all the radios. */
+static void replay_run(uint64_t now)
+{
+	int i;
+
+	for (; (next < npkts) && (base + pkts[next].at <= now); next++) {
+		for (i = 0; i < cuse_nradio; i++)
+			cuse_deliver(&cuse_radios[i], pkts[next].buf,
+				     pkts[next].len, pkts[next].rssi,
+				     pkts[next].snr);
+	}
+}
+
+struct cuse_engine cuse_replay = {
+	.name = "replay",
+	.start = replay_start,
+	.xmit = replay_xmit,
+	.rssi = replay_rssi,
+	.next = replay_next,
+	.run = replay_run,
+};
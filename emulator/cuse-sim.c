@@ -0,0 +1,206 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lora-cuse.h"
+
+/*
+ * The simulated air between the radios of the daemon, as lora-virt: a
+ * packet reaches the radios in RX on the same SF, BW and header mode within
+ * a quarter of the BW from its carrier, the packets of the same SF collide
+ * unless one is 6 dB stronger, and the SNR must be over the floor of the SF.
+ */
+
+#define SIM_CAPTURE_DB		6
+
+/* A packet on the air, a radio sends one at a time. */
+struct sim_air {
+	int used;
+	struct cuse_radio *tx;
+	uint8_t buf[CUSE_MAXLEN];
+	size_t len;
+	uint32_t freq;
+	int32_t power;
+	uint32_t sprf;
+	uint32_t bw;
+	uint32_t implicit;
+	uint64_t end;
+	uint32_t listeners;
+	uint32_t collided;
+};
+
+static struct sim_air air[CUSE_MAXRADIOS];
+
+/* Can the radio demodulate the packet on the air. */
+static int sim_hears(struct cuse_radio *r, struct sim_air *a)
+{
+	uint32_t df;
+
+	df = (r->freq > a->freq) ? r->freq - a->freq : a->freq - r->freq;
+
+	return (r != a->tx) && (r->state == LORA_STATE_RX)
+		&& (r->sprf == a->sprf) && (r->bw == a->bw)
+		&& (!r->implicit == !a->implicit) && (df <= a->bw / 4);
+}
+
+/* Nothing to load for the simulated air. */
+static int sim_start(const char *file)
+{
+	return 0;
+}
+
+/* A radio puts a packet on the air until the end time in us. */
+static void sim_xmit(struct cuse_radio *r, const uint8_t *buf, size_t len,
+		     uint64_t now, uint64_t end)
+{
+	struct sim_air *a = &air[r->id], *o;
+	uint32_t common;
+	int32_t pn, po;
+	int i, j;
+
+	memset(a, 0, sizeof(*a));
+	a->tx = r;
+	memcpy(a->buf, buf, len);
+	a->len = len;
+	a->freq = r->freq;
+	a->power = r->power;
+	a->sprf = r->sprf;
+	a->bw = r->bw;
+	a->implicit = r->implicit;
+	a->end = end;
+	for (i = 0; i < cuse_nradio; i++) {
+		if (sim_hears(&cuse_radios[i], a))
+			a->listeners |= 1U << i;
+	}
+
+	/* The packets still on the air collide with the new one.  The path
+	 * loss is the same between any radios, so the power decides. */
+	for (j = 0; j < cuse_nradio; j++) {
+		o = &air[j];
+		if (!o->used)
+			continue;
+		/* The half-duplex sender can not hear them any more. */
+		o->collided |= 1U << r->id;
+		common = o->listeners & a->listeners;
+		pn = a->power;
+		po = o->power;
+		if (pn - po < SIM_CAPTURE_DB)
+			o->collided |= common;
+		if (po - pn < SIM_CAPTURE_DB)
+			a->collided |= common;
+	}
+	a->used = 1;
+}
+
+/* Get the strongest packet on the air around the radio's carrier. */
+static int32_t sim_rssi(struct cuse_radio *r)
+{
+	int32_t rssi = cuse_noise(r->bw) / 4;
+	uint32_t df;
+	int i;
+
+	for (i = 0; i < cuse_nradio; i++) {
+		df = (r->freq > air[i].freq) ? r->freq - air[i].freq
+					     : air[i].freq - r->freq;
+		if (!air[i].used || (air[i].tx == r) || (df > r->bw / 2))
+			continue;
+		if (rssi < air[i].power - cuse_pathloss)
+			rssi = air[i].power - cuse_pathloss;
+	}
+
+	return rssi;
+}
+
+/* Get the time the first packet leaves the air. */
+static uint64_t sim_next(void)
+{
+	uint64_t due = 0;
+	int i;
+
+	for (i = 0; i < cuse_nradio; i++) {
+		if (air[i].used && ((due == 0) || (air[i].end < due)))
+			due = air[i].end;
+	}
+
+	return due;
+}
+
+/* Deliver the packets which have left the air. */
+static void sim_run(uint64_t now)
+{
+	struct cuse_radio *r;
+	struct sim_air *a;
+	int32_t rssi, snr;
+	int i, j;
+
+	for (i = 0; i < cuse_nradio; i++) {
+		a = &air[i];
+		if (!a->used || (a->end > now))
+			continue;
+		a->used = 0;
+
+		for (j = 0; j < cuse_nradio; j++) {
+			r = &cuse_radios[j];
+			if (!(a->listeners & (1U << j))
+				|| (a->collided & (1U << j)))
+				continue;
+			/* The radio has left RX or retuned in the middle. */
+			if (!sim_hears(r, a))
+				continue;
+			rssi = a->power - cuse_pathloss;
+			snr = 4 * rssi - cuse_noise(a->bw);
+			if (snr < cuse_floor(a->sprf))
+				continue;
+			if ((cuse_loss > 0)
+				&& ((unsigned int)(rand() % 1000) < cuse_loss))
+				continue;
+			cuse_deliver(r, a->buf, a->len, rssi, snr);
+		}
+	}
+}
+
+struct cuse_engine cuse_sim = {
+	.name = "sim",
+	.start = sim_start,
+	.xmit = sim_xmit,
+	.rssi = sim_rssi,
+	.next = sim_next,
+	.run = sim_run,
+};
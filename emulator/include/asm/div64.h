@@ -0,0 +1,7 @@
+/* A shim of <asm/div64.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_ASM_DIV64_H__
+#define __EMU_ASM_DIV64_H__
+
+#include "emu_kernel.h"
+
+#endif
@@ -0,0 +1,7 @@
+/* A shim of <asm/uaccess.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_ASM_UACCESS_H__
+#define __EMU_ASM_UACCESS_H__
+
+#include "emu_kernel.h"
+
+#endif
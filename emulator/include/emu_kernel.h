@@ -0,0 +1,445 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __EMU_KERNEL_H__
+#define __EMU_KERNEL_H__
+
+/*
+ * The subset of the kernel API used by the LoRa SPI driver, mapped onto the
+ * C library, so that LoRa-SPI/sx1278.c, sx1278_fifo.c and lora_spi.c build
+ * unchanged as user space objects against the SX127x register model.  It
+ * is single threaded: the locks are counters, the timers fire when they
+ * are waited for, and the sleeps advance the emulated chips' virtual time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+/* As the kernel's, for the formats of the messages. */
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+/* The C library's int64_t is long on LP64, the kernel's is long long. */
+#define int64_t			s64
+
+/* The shims follow the API of the kernel since hrtimer_setup(). */
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE	KERNEL_VERSION(6, 13, 0)
+
+#define __user
+#define __percpu
+#define __init
+#define __exit
+
+#define GFP_KERNEL		0
+#define HZ			1000
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BITS_PER_LONG		(8 * sizeof(long))
+#define BITS_TO_LONGS(n)	(((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits)	unsigned long name[BITS_TO_LONGS(bits)]
+
+#define container_of(ptr, type, member)					\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)		(((a) < (b)) ? (a) : (b))
+#define max(a, b)		(((a) > (b)) ? (a) : (b))
+#define min_t(t, a, b)		min((t)(a), (t)(b))
+#define max_t(t, a, b)		max((t)(a), (t)(b))
+
+#define WARN_ON(cond) ({						\
+	int __w = !!(cond);						\
+	if (__w)							\
+		fprintf(stderr, "WARN_ON(%s)\n", #cond);		\
+	__w; })
+
+/*------------------------------ Memory & Errors -----------------------------*/
+
+#define MAX_ERRNO		4095
+#define IS_ERR(p)		((unsigned long)(p) >= (unsigned long)-MAX_ERRNO)
+#define PTR_ERR(p)		((long)(p))
+#define ERR_PTR(e)		((void *)(long)(e))
+#define PTR_ERR_OR_ZERO(p)	(IS_ERR(p) ? PTR_ERR(p) : 0)
+
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(p)		free(p)
+#define memzero_explicit(p, n)	memset(p, 0, n)
+
+/* The user space of the driver is this process. */
+#define copy_from_user(to, from, n)	(memcpy(to, from, n), 0)
+#define copy_to_user(to, from, n)	(memcpy(to, from, n), 0)
+
+/*--------------------------------- Bitmaps ----------------------------------*/
+
+static inline void
+set_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline void
+clear_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+
+static inline unsigned long
+find_first_zero_bit(const unsigned long *addr, unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		if (!(addr[i / BITS_PER_LONG] & (1UL << (i % BITS_PER_LONG))))
+			break;
+	}
+
+	return i;
+}
+
+/*------------------------------ Linked Lists --------------------------------*/
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void
+INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void
+list_add_tail(struct list_head *new, struct list_head *head)
+{
+	new->prev = head->prev;
+	new->next = head;
+	head->prev->next = new;
+	head->prev = new;
+}
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member)				\
+	list_entry((ptr)->next, type, member)
+
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, typeof(*pos), member);	\
+	     &(pos->member) != (head);					\
+	     pos = list_entry(pos->member.next, typeof(*pos), member))
+
+/*---------------------------- Devices & Modules -----------------------------*/
+
+struct module;
+struct class;
+struct dentry;
+struct device_node;
+
+#define THIS_MODULE		NULL
+#define MKDEV(ma, mi)		(((dev_t)(ma) << 20) | (mi))
+#define MINOR(dev)		((unsigned int)((dev) & 0xFFFFF))
+
+struct device {
+	void *driver_data;
+	struct device_node *of_node;
+};
+
+static inline void *
+dev_get_drvdata(const struct device *dev)
+{
+	return dev->driver_data;
+}
+
+static inline void
+dev_set_drvdata(struct device *dev, void *data)
+{
+	dev->driver_data = data;
+}
+
+/* The debug messages are dropped, but their formats are still checked. */
+#define dev_dbg(dev, fmt, ...)						\
+	do { if (0) printf(fmt, ##__VA_ARGS__); (void)(dev); } while (0)
+#define pr_debug(fmt, ...)						\
+	do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+#define dev_info(dev, fmt, ...)						\
+	do { if (0) printf(fmt, ##__VA_ARGS__); (void)(dev); } while (0)
+#define dev_err(dev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+
+static inline const char *
+dev_name(const struct device *dev)
+{
+	return "emu";
+}
+
+/* The device node is not created, any valid pointer will do. */
+static inline struct device *
+device_create(struct class *cls, struct device *parent, dev_t devt,
+	      void *drvdata, const char *fmt, ...)
+{
+	static struct device node;
+
+	return &node;
+}
+
+static inline void
+device_destroy(struct class *cls, dev_t devt)
+{
+}
+
+#define EXPORT_SYMBOL(sym)
+#define MODULE_LICENSE(l)
+#define MODULE_AUTHOR(a)
+#define MODULE_DESCRIPTION(d)
+#define MODULE_DEVICE_TABLE(type, name)
+
+/* The module's init & exit, called by the user space program. */
+int emu_module_init(void);
+void emu_module_exit(void);
+#define module_init(fn)		int emu_module_init(void) { return fn(); }
+#define module_exit(fn)		void emu_module_exit(void) { fn(); }
+
+struct cdev {
+	dev_t dev;
+};
+
+struct mutex {
+	int locked;
+};
+
+#define DEFINE_MUTEX(name)	struct mutex name = { 0 }
+#define mutex_init(m)		((m)->locked = 0)
+#define mutex_lock(m)		((m)->locked++)
+#define mutex_unlock(m)		((m)->locked--)
+#define mutex_is_locked(m)	((m)->locked > 0)
+
+typedef struct {
+	int locked;
+} spinlock_t;
+
+#define spin_lock_init(l)	((l)->locked = 0)
+#define spin_lock(l)		((l)->locked++)
+#define spin_unlock(l)		((l)->locked--)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define atomic_read(v)		((v)->counter)
+#define atomic_set(v, i)	((v)->counter = (i))
+
+typedef struct {
+	int dummy;
+} wait_queue_head_t;
+
+typedef struct {
+	int dummy;
+} wait_queue_entry_t;
+
+struct rw_semaphore {
+	int count;
+};
+
+/*------------------------------ Time & Math ---------------------------------*/
+
+typedef s64 ktime_t;
+
+static inline u64
+ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define ktime_get()		((ktime_t)ktime_get_ns())
+#define ktime_get_boottime()	((ktime_t)ktime_get_ns())
+#define ktime_to_ns(t)		((s64)(t))
+#define ns_to_ktime(ns)		((ktime_t)(ns))
+#define ktime_add_us(t, us)	((t) + (s64)(us) * 1000)
+#define ktime_add_ms(t, ms)	((t) + (s64)(ms) * 1000000)
+#define ktime_sub(a, b)		((a) - (b))
+#define ktime_ms_delta(a, b)	(((a) - (b)) / 1000000)
+#define ktime_compare(a, b)	(((a) < (b)) ? -1 : (((a) > (b)) ? 1 : 0))
+
+/* The jiffies & the sleeps are in the emulated chips' virtual time, so a
+ * polling loop takes no real time.  They are kept by spi-emu.c. */
+unsigned long emu_jiffies(void);
+void emu_sleep_us(unsigned long us);
+
+#define jiffies			emu_jiffies()
+#define msecs_to_jiffies(ms)	((unsigned long)(ms))
+#define time_before(a, b)	((long)((a) - (b)) < 0)
+#define msleep(ms)		emu_sleep_us((unsigned long)(ms) * 1000)
+#define usleep_range(lo, hi)	emu_sleep_us(lo)
+
+/* Divide the 64 bits n by base in place, and give the remainder. */
+#define do_div(n, base) ({						\
+	uint32_t __base = (base);					\
+	uint32_t __rem = (n) % __base;					\
+	(n) /= __base;							\
+	__rem; })
+
+static inline int
+fls64(u64 x)
+{
+	return (x == 0) ? 0 : 64 - __builtin_clzll(x);
+}
+
+static inline u32
+be32_to_cpup(const void *p)
+{
+	const u8 *b = p;
+
+	return ((u32)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+/*------------------------- Per-CPU Data & Counters --------------------------*/
+
+/* There is a single "CPU", so the per-CPU data is just the data. */
+#define get_cpu_ptr(p)		(p)
+#define put_cpu_ptr(p)		do { (void)(p); } while (0)
+#define this_cpu_inc(x)		((x)++)
+
+struct u64_stats_sync {
+	int dummy;
+};
+
+#define u64_stats_update_begin(s)	do { (void)(s); } while (0)
+#define u64_stats_update_end(s)		do { (void)(s); } while (0)
+
+/*----------------------- Timers, Works & Completions ------------------------*/
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_ABS,
+	HRTIMER_MODE_REL,
+};
+
+/* A started timer fires when something waits for a completion. */
+struct hrtimer {
+	enum hrtimer_restart (*function)(struct hrtimer *);
+	ktime_t expires;
+	int active;
+};
+
+void hrtimer_setup(struct hrtimer *timer,
+		   enum hrtimer_restart (*function)(struct hrtimer *),
+		   clockid_t clockid, enum hrtimer_mode mode);
+void hrtimer_start(struct hrtimer *timer, ktime_t at, enum hrtimer_mode mode);
+int hrtimer_cancel(struct hrtimer *timer);
+
+struct completion {
+	unsigned int done;
+};
+
+#define DECLARE_COMPLETION_ONSTACK(x)	\
+	struct completion x __attribute__((unused)) = { 0 }
+#define init_completion(c)		((c)->done = 0)
+#define reinit_completion(c)		((c)->done = 0)
+
+static inline void
+complete(struct completion *c)
+{
+	c->done++;
+}
+
+void wait_for_completion(struct completion *c);
+#define wait_for_completion_interruptible(c)	(wait_for_completion(c), 0)
+
+/* The works never run, nothing is periodic in the tests. */
+struct work_struct {
+	void (*func)(struct work_struct *);
+};
+
+struct delayed_work {
+	struct work_struct work;
+};
+
+#define INIT_DELAYED_WORK(w, f)		((w)->work.func = (f))
+#define to_delayed_work(w)		container_of(w, struct delayed_work, work)
+static inline int
+schedule_delayed_work(struct delayed_work *w, unsigned long delay)
+{
+	return 1;
+}
+
+static inline int
+cancel_delayed_work_sync(struct delayed_work *w)
+{
+	return 0;
+}
+
+/* The crypto layer is not built, only its data structures are. */
+struct scatterlist {
+	void *buf;
+};
+
+/*--------------------------------- Tracing ----------------------------------*/
+
+/* The trace events become empty inline functions. */
+#define PARAMS(args...)		args
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(tmpl, name, proto, args)				\
+	static inline void trace_##name(proto) {}
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)		\
+	static inline void trace_##name(proto) {}
+
+#endif
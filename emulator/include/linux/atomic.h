@@ -0,0 +1,7 @@
+/* A shim of <linux/atomic.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_LINUX_ATOMIC_H__
+#define __EMU_LINUX_ATOMIC_H__
+
+#include "emu_kernel.h"
+
+#endif
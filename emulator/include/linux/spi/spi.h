@@ -0,0 +1,105 @@
+/*
+ * A shim of <linux/spi/spi.h> for the user space build.  spi_sync() is
+ * served by the SX127x register model in spi-emu.c.
+ */
+#ifndef __EMU_LINUX_SPI_SPI_H__
+#define __EMU_LINUX_SPI_SPI_H__
+
+#include "emu_kernel.h"
+
+struct spi_controller {
+	s16 bus_num;
+};
+
+/**
+ * struct spi_device: The slave device on the emulated bus
+ * @dev:		Its driver data is the LoRa device, as in the kernel
+ * @controller:		The emulated bus
+ * @chip_select:	The chip selects of the device, only the first is used
+ * @controller_data:	The register model behind the chip select
+ */
+struct spi_device {
+	struct device dev;
+	struct spi_controller *controller;
+	u8 chip_select[1];
+	void *controller_data;
+};
+
+static inline u8
+spi_get_chipselect(const struct spi_device *spi, u8 idx)
+{
+	return spi->chip_select[idx];
+}
+
+struct spi_transfer {
+	const void *tx_buf;
+	void *rx_buf;
+	unsigned int len;
+	struct list_head transfer_list;
+};
+
+struct spi_message {
+	struct list_head transfers;
+	struct spi_device *spi;
+	void (*complete)(void *context);
+	void *context;
+	unsigned int actual_length;
+	int status;
+};
+
+static inline void
+spi_message_init(struct spi_message *m)
+{
+	memset(m, 0, sizeof(*m));
+	INIT_LIST_HEAD(&(m->transfers));
+}
+
+static inline void
+spi_message_add_tail(struct spi_transfer *t, struct spi_message *m)
+{
+	list_add_tail(&(t->transfer_list), &(m->transfers));
+}
+
+static inline void *
+spi_get_drvdata(struct spi_device *spi)
+{
+	return dev_get_drvdata(&(spi->dev));
+}
+
+static inline void
+spi_set_drvdata(struct spi_device *spi, void *data)
+{
+	dev_set_drvdata(&(spi->dev), data);
+}
+
+int
+spi_sync(struct spi_device *spi, struct spi_message *m);
+
+/* The message is transferred at once, then its completion is called. */
+int
+spi_async(struct spi_device *spi, struct spi_message *m);
+
+struct spi_device_id {
+	char name[32];
+};
+
+struct device_driver {
+	const char *name;
+	struct module *owner;
+};
+
+struct spi_driver {
+	const struct spi_device_id *id_table;
+	int (*probe)(struct spi_device *spi);
+	void (*remove)(struct spi_device *spi);
+	struct device_driver driver;
+};
+
+/* The registered driver probes the emulated devices, see spi-emu.c. */
+int
+spi_register_driver(struct spi_driver *sdrv);
+
+void
+spi_unregister_driver(struct spi_driver *sdrv);
+
+#endif
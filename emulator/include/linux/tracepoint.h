@@ -0,0 +1,7 @@
+/* A shim of <linux/tracepoint.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_LINUX_TRACEPOINT_H__
+#define __EMU_LINUX_TRACEPOINT_H__
+
+#include "emu_kernel.h"
+
+#endif
@@ -0,0 +1,7 @@
+/* A shim of <linux/u64_stats_sync.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_LINUX_U64_STATS_SYNC_H__
+#define __EMU_LINUX_U64_STATS_SYNC_H__
+
+#include "emu_kernel.h"
+
+#endif
@@ -0,0 +1,7 @@
+/* A shim of <linux/wait.h> for the user space build, see emu_kernel.h. */
+#ifndef __EMU_LINUX_WAIT_H__
+#define __EMU_LINUX_WAIT_H__
+
+#include "emu_kernel.h"
+
+#endif
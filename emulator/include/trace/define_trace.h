@@ -0,0 +1,4 @@
+/*
+ * A shim of <trace/define_trace.h> for the user space build.  The trace
+ * events are empty inline functions there, so there is nothing to create.
+ */
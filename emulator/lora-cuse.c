@@ -0,0 +1,864 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <linux/fuse.h>
+
+#include "lora-cuse.h"
+
+/*
+ * Serve /dev/loraSPI0.<n> from user space with CUSE, so the applications
+ * run unmodified without lora.ko & lora-spi.ko:
+ *
+ *	lora-cuse [-n radios] [-d name] [-r file] [-w file] [-p dB] [-L loss]
+ *
+ * Each radio is a CUSE session on /dev/cuse.  The daemon speaks the FUSE
+ * protocol itself and serves all the sessions in one poll loop, with the
+ * LORA_* ioctl ABI and the semantics of the lora-spi driver: a write
+ * returns after the packet's time on air, a read waits 5 seconds at most
+ * for a packet and fails with -1 (EPERM) on time out, and poll reports
+ * POLLOUT while nothing is being sent and POLLIN while packets are queued.
+ *
+ * The engine decides what the radios hear.  "sim" is a simulated air
+ * between the radios of the daemon, "replay" plays the packets of a file
+ * with lines "<ms> <hex payload> [<RSSI dBm> [<SNR in 0.25 dB>]]" to all
+ * the radios.  -w records what radio 0 receives in the same format.
+ *
+ * The service time of each kind of request is counted in the daemon and
+ * printed at exit with -v, which is the user space side overhead apart
+ * from any driver.  Opening /dev/cuse needs root.
+ */
+
+struct cuse_radio cuse_radios[CUSE_MAXRADIOS];
+int cuse_nradio = 2;
+int cuse_pathloss = 100;
+unsigned int cuse_loss;
+
+static struct cuse_engine *engine = &cuse_sim;
+static FILE *record;
+static uint64_t started;
+static volatile sig_atomic_t quit;
+
+/* The kinds of the requests whose service time is counted. */
+enum {
+	COST_OPEN,
+	COST_READ,
+	COST_WRITE,
+	COST_IOCTL,
+	COST_POLL,
+	COST_RELEASE,
+	COST_OTHER,
+	COST_DEFERRED,
+	COST_MAX,
+};
+
+static const char *cost_name[COST_MAX] = {
+	"open", "read", "write", "ioctl", "poll", "release", "other",
+	"deferred",
+};
+
+struct cuse_cost {
+	unsigned long count;
+	uint64_t ns;
+	uint64_t max;
+};
+
+static struct cuse_cost costs[COST_MAX];
+
+static const uint32_t bws[] = {
+	7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+/* The noise floor of each BW in 0.25 dB, as lora-virt. */
+static const int16_t noises[] = {
+	-516, -511, -504, -499, -492, -487, -480, -468, -456, -444
+};
+
+/* The SNR demodulation floor of SF 6 ~ 12 in 0.25 dB. */
+static const int16_t floors[] = {
+	-20, -30, -40, -50, -60, -70, -80
+};
+
+/* Get the monotonic time in us. */
+uint64_t cuse_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Get the monotonic time in ns. */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Get the index of the RF bandwidth in the tables. */
+static unsigned int bw_index(uint32_t bw)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(bws) / sizeof(bws[0]) - 1; i++) {
+		if (bws[i] >= bw)
+			break;
+	}
+
+	return i;
+}
+
+/* Get the modem settings of the radio. */
+void cuse_modem(const struct cuse_radio *r, struct lora_modem *m)
+{
+	m->sprf = r->sprf;
+	m->bw = r->bw;
+	m->cr = r->cr;
+	m->prelen = 8;
+	m->implicit = r->implicit ? 1 : 0;
+	m->crc = r->crc ? 1 : 0;
+	m->ldro = -1;
+}
+
+/* Get the noise floor of the RF bandwidth in 0.25 dB. */
+int32_t cuse_noise(uint32_t bw)
+{
+	return noises[bw_index(bw)];
+}
+
+/* Get the SNR demodulation floor of the spreading factor in 0.25 dB. */
+int32_t cuse_floor(uint32_t sprf)
+{
+	return floors[sprf2sf(sprf) - 6];
+}
+
+/* Count the service time of a request. */
+static void cost_add(int kind, uint64_t t0)
+{
+	uint64_t ns = now_ns() - t0;
+
+	costs[kind].count++;
+	costs[kind].ns += ns;
+	if (costs[kind].max < ns)
+		costs[kind].max = ns;
+}
+
+/* Answer a request with the error or the two parts of the reply. */
+static void reply(struct cuse_radio *r, uint64_t unique, int error,
+		  const void *a, size_t alen, const void *b, size_t blen)
+{
+	struct fuse_out_header out;
+	struct iovec iov[3];
+
+	out.len = sizeof(out) + alen + blen;
+	out.error = error;
+	out.unique = unique;
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = (void *)a;
+	iov[1].iov_len = alen;
+	iov[2].iov_base = (void *)b;
+	iov[2].iov_len = blen;
+
+	/* The request may have been interrupted & dropped by the kernel. */
+	if ((writev(r->fd, iov, 3) < 0) && (errno != ENOENT))
+		perror(r->name);
+}
+
+/* Wake up the pollers of the radio, if the kernel asked for it. */
+static void notify(struct cuse_radio *r)
+{
+	struct fuse_notify_poll_wakeup_out wk;
+
+	if (!r->pollarmed)
+		return;
+	r->pollarmed = 0;
+	wk.kh = r->pollkh;
+	reply(r, 0, FUSE_NOTIFY_POLL, &wk, sizeof(wk), NULL, 0);
+}
+
+/* Set the state of the radio, as lora-virt. */
+static void radio_state(struct cuse_radio *r, uint32_t st)
+{
+	if ((st == LORA_STATE_RX) && (r->state != LORA_STATE_RX)) {
+		r->rx_headers = 0;
+		r->rx_packets = 0;
+	}
+	else if (st == LORA_STATE_SLEEP) {
+		r->head = 0;
+		r->npkt = 0;
+	}
+	r->state = st;
+}
+
+/* Remove the waiting request. */
+static void req_remove(struct cuse_radio *r, unsigned int i)
+{
+	r->nreq--;
+	memmove(&r->req[i], &r->req[i + 1],
+		(r->nreq - i) * sizeof(struct cuse_req));
+}
+
+/* Take a queued packet into the buffer. */
+static size_t pop(struct cuse_radio *r, uint8_t *buf, size_t size)
+{
+	struct cuse_pkt *p;
+	size_t c;
+
+	p = &r->pkt[(r->head + CUSE_RXQ - r->npkt) % CUSE_RXQ];
+	c = (size < p->len) ? size : p->len;
+	memcpy(buf, p->buf, c);
+	r->npkt--;
+
+	r->last.rssi = p->rssi;
+	r->last.snr = p->snr;
+	r->last.len = p->len;
+	r->stats.rx_packets++;
+	r->stats.rx_bytes += c;
+
+	return c;
+}
+
+/* Answer the waiting reads with the queued packets. */
+static void answer_reads(struct cuse_radio *r)
+{
+	uint8_t buf[CUSE_MAXLEN];
+	unsigned int i;
+	uint64_t t0;
+	size_t c;
+
+	for (i = 0; (i < r->nreq) && (r->npkt > 0);) {
+		if (r->req[i].write) {
+			i++;
+			continue;
+		}
+		t0 = now_ns();
+		c = pop(r, buf, r->req[i].size);
+		reply(r, r->req[i].unique, 0, buf, c, NULL, 0);
+		req_remove(r, i);
+		cost_add(COST_DEFERRED, t0);
+	}
+}
+
+/* A packet arrives at the radio, return 0 if it is queued. */
+int cuse_deliver(struct cuse_radio *r, const uint8_t *buf, size_t len,
+		 int32_t rssi, int32_t snr)
+{
+	struct cuse_pkt *p;
+	size_t i, n;
+
+	if (r->state != LORA_STATE_RX)
+		return -1;
+	/* The header's length must not exceed the max payload length. */
+	n = r->implicit ? r->implicit : len;
+	if (!r->implicit && (n > r->maxpayload))
+		return -1;
+
+	/* The oldest packet is overwritten if the queue is full. */
+	if (r->npkt == CUSE_RXQ) {
+		r->npkt--;
+		r->overwrites++;
+		r->stats.rx_dropped++;
+	}
+	p = &r->pkt[r->head];
+	memset(p->buf, 0, sizeof(p->buf));
+	memcpy(p->buf, buf, (n < len) ? n : len);
+	p->len = n;
+	p->rssi = rssi;
+	p->snr = (snr < -128) ? -128 : ((snr > 127) ? 127 : snr);
+	r->head = (r->head + 1) % CUSE_RXQ;
+	r->npkt++;
+	r->queued++;
+	r->rx_headers++;
+	r->rx_packets++;
+
+	if ((record != NULL) && (r->id == 0)) {
+		fprintf(record, "%.3f ", (cuse_now() - started) / 1000.0);
+		for (i = 0; i < n; i++)
+			fprintf(record, "%02x", p->buf[i]);
+		fprintf(record, " %d %d\n", p->rssi, p->snr);
+		fflush(record);
+	}
+
+	answer_reads(r);
+	notify(r);
+
+	return 0;
+}
+
+/* Put the first waiting write of the radio on the air. */
+static void start_write(struct cuse_radio *r, uint64_t now)
+{
+	struct lora_modem m;
+	struct cuse_req *q;
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; (i < r->nreq) && !r->req[i].write; i++);
+	if ((i == r->nreq) || r->req[i].onair)
+		return;
+	q = &r->req[i];
+
+	/* Implicit Header Mode always sends the fixed length payload. */
+	len = r->implicit ? r->implicit : q->len;
+	radio_state(r, LORA_STATE_TX);
+	cuse_modem(r, &m);
+	q->deadline = now + airtime_us(&m, len);
+	q->onair = 1;
+	engine->xmit(r, q->buf, len, now, q->deadline);
+}
+
+/* Answer the writes which have left the air & the reads timed out. */
+static void run_due(uint64_t now)
+{
+	struct fuse_write_out wo;
+	struct cuse_radio *r;
+	struct cuse_req *q;
+	unsigned int i;
+	uint64_t t0;
+	int n;
+
+	if ((engine->next() != 0) && (engine->next() <= now))
+		engine->run(now);
+
+	for (n = 0; n < cuse_nradio; n++) {
+		r = &cuse_radios[n];
+		for (i = 0; i < r->nreq;) {
+			q = &r->req[i];
+			if (q->deadline > now) {
+				i++;
+				continue;
+			}
+			t0 = now_ns();
+			if (q->write) {
+				memset(&wo, 0, sizeof(wo));
+				wo.size = q->len;
+				reply(r, q->unique, 0, &wo, sizeof(wo), NULL, 0);
+				r->stats.tx_packets++;
+				r->stats.tx_bytes += r->implicit ? r->implicit
+								 : q->len;
+				/* Back to RX, as the LoRa SPI devices. */
+				radio_state(r, LORA_STATE_RX);
+			}
+			else {
+				/* The same -1 as the LoRa SPI devices. */
+				reply(r, q->unique, -EPERM, NULL, 0, NULL, 0);
+				r->stats.rx_timeouts++;
+			}
+			req_remove(r, i);
+			cost_add(COST_DEFERRED, t0);
+			start_write(r, now);
+			notify(r);
+		}
+	}
+}
+
+/* Get the time of the next deadline in us, 0 for nothing. */
+static uint64_t next_due(void)
+{
+	uint64_t due = engine->next();
+	unsigned int i;
+	int n;
+
+	for (n = 0; n < cuse_nradio; n++) {
+		for (i = 0; i < cuse_radios[n].nreq; i++) {
+			if ((due == 0) || (cuse_radios[n].req[i].deadline < due))
+				due = cuse_radios[n].req[i].deadline;
+		}
+	}
+
+	return due;
+}
+
+/* Handle the LORA_* ioctl, return 0 or the negative error number. */
+static int do_ioctl(struct cuse_radio *r, uint32_t cmd, const void *in,
+		    size_t insize, void *out, size_t *outlen)
+{
+	struct lora_fifo_stat fs;
+	struct lora_stats st;
+	uint32_t v = 0;
+	int32_t s;
+	unsigned int i;
+
+	/* All the setters take an int. */
+	if ((_IOC_DIR(cmd) & _IOC_WRITE) && (insize >= sizeof(uint32_t)))
+		memcpy(&v, in, sizeof(uint32_t));
+	*outlen = 0;
+
+	switch (cmd) {
+	case LORA_SET_STATE:
+		/* Only the sending puts the radio in TX state. */
+		if ((v != LORA_STATE_SLEEP) && (v != LORA_STATE_RX))
+			v = LORA_STATE_STANDBY;
+		radio_state(r, v);
+		return 0;
+	case LORA_GET_STATE:
+		v = r->state;
+		break;
+	case LORA_SET_FREQUENCY:
+		r->freq = v;
+		return 0;
+	case LORA_GET_FREQUENCY:
+		v = r->freq;
+		break;
+	case LORA_SET_POWER:
+		/* The same range as the SX127x. */
+		s = (int32_t)v;
+		r->power = (s < -2) ? -2 : ((s > 17) ? 17 : s);
+		return 0;
+	case LORA_GET_POWER:
+		v = r->power;
+		break;
+	case LORA_SET_SPRFACTOR:
+		r->sprf = 1U << sprf2sf(v);
+		return 0;
+	case LORA_GET_SPRFACTOR:
+		v = r->sprf;
+		break;
+	case LORA_SET_BANDWIDTH:
+		r->bw = bws[bw_index(v)];
+		return 0;
+	case LORA_GET_BANDWIDTH:
+		v = r->bw;
+		break;
+	case LORA_GET_RSSI:
+		v = engine->rssi(r);
+		break;
+	case LORA_GET_SNR:
+		/* In dB, as the SX127x chip layer. */
+		v = r->last.snr / 4;
+		break;
+	case LORA_SET_CODINGRATE:
+		if ((v < 5) || (v > 8))
+			return -EINVAL;
+		r->cr = v;
+		return 0;
+	case LORA_GET_CODINGRATE:
+		v = r->cr;
+		break;
+	case LORA_SET_CRC:
+		if (v > 1)
+			return -EINVAL;
+		r->crc = v;
+		return 0;
+	case LORA_GET_CRC:
+		v = r->crc;
+		break;
+	case LORA_SET_IMPLICIT:
+		if (v > CUSE_MAXLEN)
+			return -EINVAL;
+		r->implicit = v;
+		return 0;
+	case LORA_GET_IMPLICIT:
+		v = r->implicit;
+		break;
+	case LORA_SET_MAXPAYLOAD:
+		if ((v < 1) || (v > CUSE_MAXLEN))
+			return -EINVAL;
+		r->maxpayload = v;
+		return 0;
+	case LORA_GET_FIFOSTAT:
+		memset(&fs, 0, sizeof(fs));
+		fs.rx_pending = r->npkt;
+		for (i = 0; i < r->npkt; i++)
+			fs.used += r->pkt[(r->head + CUSE_RXQ - 1 - i)
+					  % CUSE_RXQ].len;
+		fs.rx_slot = r->implicit ? r->implicit : r->maxpayload;
+		fs.rx_queued = r->queued;
+		fs.rx_overwrites = r->overwrites;
+		memcpy(out, &fs, sizeof(fs));
+		*outlen = sizeof(fs);
+		return 0;
+	case LORA_GET_PKTSTAT:
+		memcpy(out, &r->last, sizeof(r->last));
+		*outlen = sizeof(r->last);
+		return 0;
+	case LORA_GET_STATS:
+		st = r->stats;
+		/* The chip's counters are 16 bits. */
+		st.chip_rx_headers = r->rx_headers & 0xFFFF;
+		st.chip_rx_packets = r->rx_packets & 0xFFFF;
+		memcpy(out, &st, sizeof(st));
+		*outlen = sizeof(st);
+		return 0;
+	default:
+		/* TxTime, RxWin, Beacon, Frag & Key are not emulated. */
+		return -ENOTTY;
+	}
+
+	memcpy(out, &v, sizeof(uint32_t));
+	*outlen = sizeof(uint32_t);
+
+	return 0;
+}
+
+/* Serve a request of the kernel. */
+static void serve(struct cuse_radio *r, uint8_t *buf, size_t n, uint64_t t0)
+{
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	void *arg = buf + sizeof(struct fuse_in_header);
+	struct fuse_open_out oo;
+	struct fuse_write_out wo;
+	struct fuse_ioctl_out io;
+	struct fuse_poll_out po;
+	struct fuse_read_in *rd;
+	struct fuse_write_in *wr;
+	struct fuse_ioctl_in *ic;
+	struct fuse_poll_in *pl;
+	struct fuse_interrupt_in *it;
+	struct cuse_req *q;
+	uint8_t out[sizeof(struct lora_stats) + sizeof(struct lora_fifo_stat)];
+	uint8_t data[CUSE_MAXLEN];
+	unsigned int i;
+	size_t len;
+	int kind = COST_OTHER;
+
+	if (n < sizeof(struct fuse_in_header))
+		return;
+
+	switch (in->opcode) {
+	case FUSE_OPEN:
+		kind = COST_OPEN;
+		memset(&oo, 0, sizeof(oo));
+		reply(r, in->unique, 0, &oo, sizeof(oo), NULL, 0);
+		break;
+	case FUSE_READ:
+		kind = COST_READ;
+		rd = arg;
+		/* The earlier reads get the queued packets first. */
+		for (i = 0; (i < r->nreq) && r->req[i].write; i++);
+		if ((r->npkt > 0) && (i == r->nreq)) {
+			len = pop(r, data, rd->size);
+			reply(r, in->unique, 0, data, len, NULL, 0);
+			break;
+		}
+		if (r->nreq == CUSE_PENDING) {
+			reply(r, in->unique, -EBUSY, NULL, 0, NULL, 0);
+			break;
+		}
+		/* Set the radio to RX, if it is not. */
+		if (r->state != LORA_STATE_RX)
+			radio_state(r, LORA_STATE_RX);
+		q = &r->req[r->nreq++];
+		memset(q, 0, sizeof(*q));
+		q->unique = in->unique;
+		q->deadline = cuse_now() + CUSE_RXTIMEOUT_US;
+		q->size = rd->size;
+		break;
+	case FUSE_WRITE:
+		kind = COST_WRITE;
+		wr = arg;
+		if (wr->size == 0) {
+			memset(&wo, 0, sizeof(wo));
+			reply(r, in->unique, 0, &wo, sizeof(wo), NULL, 0);
+			break;
+		}
+		if (r->nreq == CUSE_PENDING) {
+			reply(r, in->unique, -EBUSY, NULL, 0, NULL, 0);
+			break;
+		}
+		q = &r->req[r->nreq++];
+		memset(q, 0, sizeof(*q));
+		q->unique = in->unique;
+		q->write = 1;
+		q->deadline = UINT64_MAX;
+		q->len = (wr->size < CUSE_MAXLEN) ? wr->size : CUSE_MAXLEN;
+		memcpy(q->buf, (uint8_t *)(wr + 1), q->len);
+		/* The writes are sent one by one, as with the buffer lock. */
+		start_write(r, cuse_now());
+		notify(r);
+		break;
+	case FUSE_IOCTL:
+		kind = COST_IOCTL;
+		ic = arg;
+		memset(&io, 0, sizeof(io));
+		io.result = do_ioctl(r, ic->cmd, ic + 1, ic->in_size, out, &len);
+		if (len > ic->out_size)
+			len = ic->out_size;
+		reply(r, in->unique, 0, &io, sizeof(io), out, len);
+		break;
+	case FUSE_POLL:
+		kind = COST_POLL;
+		pl = arg;
+		memset(&po, 0, sizeof(po));
+		for (i = 0; (i < r->nreq) && !r->req[i].write; i++);
+		if (i == r->nreq)
+			po.revents |= POLLOUT | POLLWRNORM;
+		if (r->npkt > 0)
+			po.revents |= POLLIN | POLLRDNORM;
+		if (pl->flags & FUSE_POLL_SCHEDULE_NOTIFY) {
+			r->pollkh = pl->kh;
+			r->pollarmed = 1;
+		}
+		reply(r, in->unique, 0, &po, sizeof(po), NULL, 0);
+		break;
+	case FUSE_INTERRUPT:
+		/* Only a waiting read can be interrupted, a write is on air. */
+		it = arg;
+		for (i = 0; i < r->nreq; i++) {
+			if ((r->req[i].unique == it->unique)
+				&& !r->req[i].write) {
+				reply(r, it->unique, -EINTR, NULL, 0, NULL, 0);
+				req_remove(r, i);
+				break;
+			}
+		}
+		break;
+	case FUSE_RELEASE:
+		kind = COST_RELEASE;
+		/* Fall through */
+	case FUSE_FLUSH:
+	case FUSE_FSYNC:
+		reply(r, in->unique, 0, NULL, 0, NULL, 0);
+		break;
+	default:
+		reply(r, in->unique, -ENOSYS, NULL, 0, NULL, 0);
+	}
+
+	cost_add(kind, t0);
+}
+
+/* Create the radio's device by the CUSE handshake. */
+static int open_radio(struct cuse_radio *r, int id, const char *name)
+{
+	uint8_t buf[FUSE_MIN_READ_BUFFER + 8192];
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	struct cuse_init_in *ci;
+	struct cuse_init_out co;
+	char info[64];
+	ssize_t n;
+
+	memset(r, 0, sizeof(*r));
+	r->id = id;
+	snprintf(r->name, sizeof(r->name), "%s.%d", name, id);
+	/* The reset settings of the SX127x, as lora-virt. */
+	r->state = LORA_STATE_RX;
+	r->freq = 434000000;
+	r->power = 17;
+	r->sprf = 128;
+	r->bw = 125000;
+	r->cr = 5;
+	r->maxpayload = CUSE_MAXLEN;
+
+	r->fd = open("/dev/cuse", O_RDWR);
+	if (r->fd < 0) {
+		perror("/dev/cuse");
+		return -1;
+	}
+
+	n = read(r->fd, buf, sizeof(buf));
+	if ((n < (ssize_t)(sizeof(*in) + sizeof(*ci)))
+		|| (in->opcode != CUSE_INIT)) {
+		fprintf(stderr, "%s: no CUSE_INIT\n", r->name);
+		return -1;
+	}
+	ci = (struct cuse_init_in *)(in + 1);
+
+	memset(&co, 0, sizeof(co));
+	co.major = FUSE_KERNEL_VERSION;
+	co.minor = (ci->minor < FUSE_KERNEL_MINOR_VERSION)
+		? ci->minor : FUSE_KERNEL_MINOR_VERSION;
+	/* The LORA_* ioctls encode their sizes, so they are restricted. */
+	co.flags = 0;
+	co.max_read = 4096;
+	co.max_write = 4096;
+	n = snprintf(info, sizeof(info), "DEVNAME=%s", r->name) + 1;
+	reply(r, in->unique, 0, &co, sizeof(co), info, n);
+
+	return 0;
+}
+
+/* Print the service time of each kind of request. */
+static void print_costs(void)
+{
+	int i;
+
+	printf("%-9s %10s %10s %10s\n", "request", "count", "avg ns",
+	       "max ns");
+	for (i = 0; i < COST_MAX; i++) {
+		if (costs[i].count == 0)
+			continue;
+		printf("%-9s %10lu %10llu %10llu\n", cost_name[i],
+		       costs[i].count,
+		       (unsigned long long)(costs[i].ns / costs[i].count),
+		       (unsigned long long)costs[i].max);
+	}
+}
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n", name);
+	printf("  -n radios  the number of radios, 1 ~ %d (default 2)\n",
+	       CUSE_MAXRADIOS);
+	printf("  -d name    the device name, the radios are /dev/<name>.<n> "
+	       "(default loraSPI0)\n");
+	printf("  -r file    replay the packets of the file instead of the "
+	       "simulated air\n");
+	printf("  -w file    record the packets received by radio 0\n");
+	printf("  -p dB      the path loss between the radios (default 100)\n");
+	printf("  -L loss    drop the packets randomly, in per mille\n");
+	printf("  -v         print the service time of the requests at exit\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t buf[FUSE_MIN_READ_BUFFER + 8192];
+	struct pollfd pfd[CUSE_MAXRADIOS];
+	struct sigaction sa;
+	struct timespec ts, *tp;
+	const char *name = "loraSPI0";
+	const char *replay = NULL;
+	uint64_t now, due, t0;
+	ssize_t n;
+	int verbose = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:d:r:w:p:L:vh")) != -1) {
+		switch (c) {
+		case 'n':
+			cuse_nradio = atoi(optarg);	break;
+		case 'd':
+			name = optarg;			break;
+		case 'r':
+			replay = optarg;
+			engine = &cuse_replay;		break;
+		case 'w':
+			record = fopen(optarg, "w");
+			if (record == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			cuse_pathloss = atoi(optarg);	break;
+		case 'L':
+			cuse_loss = atoi(optarg);	break;
+		case 'v':
+			verbose = 1;			break;
+		default:
+			usage(argv[0]);
+			return (c == 'h') ? 0 : 1;
+		}
+	}
+	if ((cuse_nradio < 1) || (cuse_nradio > CUSE_MAXRADIOS)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	started = cuse_now();
+	if (engine->start(replay) != 0)
+		return 1;
+	for (i = 0; i < cuse_nradio; i++) {
+		if (open_radio(&cuse_radios[i], i, name) != 0)
+			return 1;
+		pfd[i].fd = cuse_radios[i].fd;
+		pfd[i].events = POLLIN;
+		printf("/dev/%s on the %s engine\n", cuse_radios[i].name,
+		       engine->name);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!quit) {
+		now = cuse_now();
+		run_due(now);
+		due = next_due();
+		tp = NULL;
+		if (due != 0) {
+			due = (due > now) ? due - now : 0;
+			ts.tv_sec = due / 1000000;
+			ts.tv_nsec = (due % 1000000) * 1000;
+			tp = &ts;
+		}
+		if (ppoll(pfd, cuse_nradio, tp, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("ppoll");
+			break;
+		}
+
+		for (i = 0; i < cuse_nradio; i++) {
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			n = read(pfd[i].fd, buf, sizeof(buf));
+			t0 = now_ns();
+			if (n < 0) {
+				/* The request has been aborted. */
+				if ((errno == ENOENT) || (errno == EINTR)
+					|| (errno == EAGAIN))
+					continue;
+				perror(cuse_radios[i].name);
+				quit = 1;
+				break;
+			}
+			serve(&cuse_radios[i], buf, n, t0);
+		}
+	}
+
+	for (i = 0; i < cuse_nradio; i++)
+		close(cuse_radios[i].fd);
+	if (record != NULL)
+		fclose(record);
+	if (verbose)
+		print_costs();
+
+	return 0;
+}
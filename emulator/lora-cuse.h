@@ -0,0 +1,162 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_CUSE_H__
+#define __LORA_CUSE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/* The max number of the served radios. */
+#define CUSE_MAXRADIOS		8
+/* The max length of a packet in bytes, as LORA_BUFLEN of the framework. */
+#define CUSE_MAXLEN		255
+/* How many received packets a radio queues, as lora-virt. */
+#define CUSE_RXQ		16
+/* How many requests of a radio can wait for the air. */
+#define CUSE_PENDING		32
+/* A read waits for 5 seconds at most, as the LoRa SPI devices. */
+#define CUSE_RXTIMEOUT_US	5000000
+
+/* A packet received by a radio. */
+struct cuse_pkt {
+	uint8_t buf[CUSE_MAXLEN];
+	size_t len;
+	int32_t rssi;		/* In dBm */
+	int32_t snr;		/* In 0.25 dB */
+};
+
+/* A read or a write request waiting for the air. */
+struct cuse_req {
+	uint64_t unique;	/* The FUSE request */
+	int write;		/* 1 / 0 for write / read */
+	uint64_t deadline;	/* When it is answered in us */
+	uint32_t size;		/* The size of the read buffer */
+	uint8_t buf[CUSE_MAXLEN];
+	size_t len;		/* The length of the written data */
+	int onair;		/* The written packet is on the air */
+};
+
+/* A radio served as /dev/<name> by a CUSE session. */
+struct cuse_radio {
+	int fd;			/* The session on /dev/cuse */
+	int id;
+	char name[32];
+
+	/* The settings, as the SX127x's reset values. */
+	uint32_t state;
+	uint32_t freq;
+	int32_t power;
+	uint32_t sprf;
+	uint32_t bw;
+	uint32_t cr;
+	uint32_t crc;
+	uint32_t implicit;
+	uint32_t maxpayload;
+
+	/* The received packets waiting to be read. */
+	struct cuse_pkt pkt[CUSE_RXQ];
+	unsigned int head;
+	unsigned int npkt;
+	uint32_t queued;
+	uint32_t overwrites;
+	uint32_t rx_headers;
+	uint32_t rx_packets;
+	struct lora_pkt_stat last;
+	struct lora_stats stats;
+
+	/* The requests waiting for the air, in arrival order. */
+	struct cuse_req req[CUSE_PENDING];
+	unsigned int nreq;
+
+	/* The poll handle to notify, if the kernel asked for it. */
+	uint64_t pollkh;
+	int pollarmed;
+};
+
+/*
+ * An engine decides what the radios hear.  The daemon answers the
+ * requests, keeps the settings & the queues, and calls the engine with
+ * the written packets and whenever the engine's next event is due.
+ */
+struct cuse_engine {
+	const char *name;
+	/* Start with the file of the engine, return 0 for success. */
+	int (*start)(const char *file);
+	/* A radio puts a packet on the air until the end time in us. */
+	void (*xmit)(struct cuse_radio *r, const uint8_t *buf, size_t len,
+		     uint64_t now, uint64_t end);
+	/* Get the RSSI of the channel of the radio in dBm. */
+	int32_t (*rssi)(struct cuse_radio *r);
+	/* Get the time of the next event in us, 0 for nothing. */
+	uint64_t (*next)(void);
+	/* Run the events due at the time in us. */
+	void (*run)(uint64_t now);
+};
+
+extern struct cuse_engine cuse_sim;
+extern struct cuse_engine cuse_replay;
+
+/* The served radios. */
+extern struct cuse_radio cuse_radios[CUSE_MAXRADIOS];
+extern int cuse_nradio;
+/* The path loss between the radios in dB & the loss in per mille. */
+extern int cuse_pathloss;
+extern unsigned int cuse_loss;
+
+/* Get the monotonic time in us. */
+uint64_t cuse_now(void);
+
+/* Get the modem settings of the radio. */
+void cuse_modem(const struct cuse_radio *r, struct lora_modem *m);
+
+/* Get the noise floor of the RF bandwidth in 0.25 dB. */
+int32_t cuse_noise(uint32_t bw);
+
+/* Get the SNR demodulation floor of the spreading factor in 0.25 dB. */
+int32_t cuse_floor(uint32_t sprf);
+
+/* A packet arrives at the radio, return 0 if it is queued. */
+int cuse_deliver(struct cuse_radio *r, const uint8_t *buf, size_t len,
+		 int32_t rssi, int32_t snr);
+
+#endif
@@ -0,0 +1,237 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spi-emu.h"
+#include "lora_spi.h"
+#include "lora_crypto.h"
+#include "lora_spi_budget.h"
+
+/*
+ * Run each public operation of the LoRa SPI driver, LoRa-SPI/lora_spi.c built
+ * unchanged, against the SX127x register model and check its SPI bus cost
+ * against the budget in LoRa-SPI/lora_spi_budget.h.  It exits with 1 if any
+ * operation goes over its budget, so "make test" fails.
+ */
+
+/* The signal of the received packets. */
+#define LINK_RSSI	-80	/* dBm */
+#define LINK_SNR	28	/* 0.25 dB */
+
+static struct spi_emu emu;
+/* It stands for the user space memory of the ioctl arguments. */
+static uint8_t ubuf[1024];
+static uint8_t kbuf[LORA_SPI_BUDGET_BUFLEN];
+
+/* The LoRa framework is not built, so the devices are only counted. */
+int lora_register_driver(struct lora_driver *driver)
+{
+	return 0;
+}
+
+int lora_unregister_driver(struct lora_driver *driver)
+{
+	return 0;
+}
+
+int lora_device_add(struct lora_struct *lrdata)
+{
+	return 0;
+}
+
+int lora_device_remove(struct lora_struct *lrdata)
+{
+	return 0;
+}
+
+void lora_device_debugfs(struct lora_driver *driver, struct lora_struct *lrdata,
+			 const char *name)
+{
+}
+
+int lora_device_netdev(struct lora_driver *driver, struct lora_struct *lrdata,
+		       struct device *dev)
+{
+	return 0;
+}
+
+/* The crypto API is not in user space, so the secured frames are disabled. */
+struct lora_crypto *lora_crypto_alloc(const struct lora_key *key)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+void lora_crypto_free(struct lora_crypto *cr)
+{
+}
+
+ssize_t lora_crypto_seal(struct lora_crypto *cr, uint8_t *buf, size_t len,
+			 size_t max)
+{
+	return -EOPNOTSUPP;
+}
+
+int lora_crypto_open(struct lora_crypto *cr)
+{
+	return -EOPNOTSUPP;
+}
+
+ssize_t lora_crypto_pop(struct lora_crypto *cr, uint8_t *buf, size_t len)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Copy the argument into the user space memory. */
+static int put(struct lora_spi_budget_env *env, const void *arg, size_t len)
+{
+	memset(ubuf, 0, sizeof(ubuf));
+	memcpy(ubuf, arg, len);
+
+	return 0;
+}
+
+/* The packet arrives at the chip from the air. */
+static void receive(struct lora_spi_budget_env *env, const uint8_t *buf,
+		    size_t len)
+{
+	sx127x_model_receive(&(emu.chip), buf, len, LINK_RSSI, LINK_SNR, 0);
+}
+
+static void reset(struct lora_spi_budget_env *env)
+{
+	memset(&(emu.count), 0, sizeof(emu.count));
+}
+
+static void count(struct lora_spi_budget_env *env, unsigned long *xfers,
+		  unsigned long *bytes)
+{
+	*xfers = emu.count.transactions;
+	*bytes = emu.count.bytes;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-v]\n", name);
+	printf("  -v             log the transactions of each operation\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct lora_spi_budget_env env = {
+		.arg = ubuf,
+		.buf = kbuf,
+		.put = put,
+		.receive = receive,
+		.reset = reset,
+		.count = count,
+	};
+	const struct lora_spi_budget *b;
+	unsigned long xfers, bytes;
+	int verbose = 0;
+	int fails = 0;
+	int opt;
+	size_t i;
+	long ret;
+
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;	break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	/* Load the driver and probe the chip as the kernel does. */
+	emu_module_init();
+	spi_emu_init(&emu, 0, 0);
+	if (spi_emu_probe(&emu)) {
+		printf("Failed to probe the emulated chip\n");
+		return 1;
+	}
+	env.spi = &(emu.spi);
+	env.lrdata = spi_get_drvdata(&(emu.spi));
+	if (lora_spi_budget_open(env.lrdata)) {
+		printf("No more memory\n");
+		return 1;
+	}
+
+	printf("%-20s %8s %8s %8s %8s\n", "operation",
+	       "xfers", "budget", "bytes", "budget");
+	for (i = 0; i < ARRAY_SIZE(lora_spi_budgets); i++) {
+		b = &(lora_spi_budgets[i]);
+		if (verbose) {
+			printf("%s:\n", b->name);
+			emu.log = stdout;
+		}
+		ret = lora_spi_budget_run(&env, b, &xfers, &bytes);
+		emu.log = NULL;
+		printf("%-20s %8lu %8lu %8lu %8lu", b->name,
+		       xfers, b->xfers, bytes, b->bytes);
+		if (ret == -E2BIG) {
+			printf("  OVER BUDGET\n");
+			fails++;
+		}
+		else if (ret < 0) {
+			printf("  FAILED %ld\n", ret);
+			fails++;
+		}
+		else {
+			printf("\n");
+		}
+	}
+
+	lora_spi_budget_release(env.lrdata);
+	spi_emu_remove(&emu);
+	emu_module_exit();
+
+	if (fails) {
+		printf("%d of %zu operations are over budget or failed\n",
+		       fails, ARRAY_SIZE(lora_spi_budgets));
+		return 1;
+	}
+	printf("All %zu operations are within budget\n",
+	       ARRAY_SIZE(lora_spi_budgets));
+
+	return 0;
+}
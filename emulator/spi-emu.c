@@ -0,0 +1,251 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <string.h>
+
+#include "spi-emu.h"
+
+/* The powered devices, which share the virtual time. */
+static struct spi_emu *emus[SPI_EMU_MAX];
+static unsigned int nemu;
+static uint64_t emu_us;
+
+/* The registered SPI driver & the started timers. */
+static struct spi_driver *driver;
+static struct hrtimer *timers[SPI_EMU_MAX];
+
+/* Power on the chip at the bus & chip select. */
+void spi_emu_init(struct spi_emu *e, int bus, int cs)
+{
+	unsigned int i;
+
+	memset(e, 0, sizeof(*e));
+	e->master.bus_num = bus;
+	e->spi.controller = &(e->master);
+	e->spi.chip_select[0] = cs;
+	e->spi.controller_data = e;
+	sx127x_model_init(&(e->chip));
+
+	for (i = 0; (i < nemu) && (emus[i] != e); i++);
+	if ((i == nemu) && (nemu < SPI_EMU_MAX))
+		emus[nemu++] = e;
+}
+
+/* Probe the device with the registered SPI driver. */
+int spi_emu_probe(struct spi_emu *e)
+{
+	if ((driver == NULL) || (driver->probe == NULL))
+		return -ENODEV;
+
+	return driver->probe(&(e->spi));
+}
+
+/* Remove the device from the registered SPI driver. */
+void spi_emu_remove(struct spi_emu *e)
+{
+	if ((driver != NULL) && (driver->remove != NULL))
+		driver->remove(&(e->spi));
+}
+
+int spi_register_driver(struct spi_driver *sdrv)
+{
+	driver = sdrv;
+
+	return 0;
+}
+
+void spi_unregister_driver(struct spi_driver *sdrv)
+{
+	if (driver == sdrv)
+		driver = NULL;
+}
+
+/* The virtual time in ms. */
+unsigned long emu_jiffies(void)
+{
+	return emu_us / 1000;
+}
+
+/* Sleep in the virtual time: all the chips go on with their states. */
+void emu_sleep_us(unsigned long us)
+{
+	unsigned int i;
+
+	emu_us += us;
+	for (i = 0; i < nemu; i++)
+		sx127x_model_advance(&(emus[i]->chip), us);
+}
+
+void hrtimer_setup(struct hrtimer *timer,
+		   enum hrtimer_restart (*function)(struct hrtimer *),
+		   clockid_t clockid, enum hrtimer_mode mode)
+{
+	timer->function = function;
+	timer->active = 0;
+}
+
+void hrtimer_start(struct hrtimer *timer, ktime_t at, enum hrtimer_mode mode)
+{
+	unsigned int i;
+
+	timer->expires = at;
+	timer->active = 1;
+	for (i = 0; i < SPI_EMU_MAX; i++) {
+		if ((timers[i] == NULL) || (timers[i] == timer)) {
+			timers[i] = timer;
+			break;
+		}
+	}
+}
+
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	unsigned int i;
+	int active = timer->active;
+
+	timer->active = 0;
+	for (i = 0; i < SPI_EMU_MAX; i++) {
+		if (timers[i] == timer)
+			timers[i] = NULL;
+	}
+
+	return active;
+}
+
+/* Nothing runs concurrently, so the started timers fire one by one, the
+ * earliest first, until the completion is done. */
+void wait_for_completion(struct completion *c)
+{
+	struct hrtimer *t;
+	unsigned int i, k;
+
+	while (c->done == 0) {
+		k = SPI_EMU_MAX;
+		for (i = 0; i < SPI_EMU_MAX; i++) {
+			if ((timers[i] != NULL) && ((k == SPI_EMU_MAX)
+				|| (timers[i]->expires < timers[k]->expires)))
+				k = i;
+		}
+		if (k == SPI_EMU_MAX) {
+			fprintf(stderr, "wait_for_completion: nothing to wait "
+				"for\n");
+			return;
+		}
+		t = timers[k];
+		hrtimer_cancel(t);
+		if (t->function(t) == HRTIMER_RESTART)
+			hrtimer_start(t, t->expires, HRTIMER_MODE_ABS);
+	}
+	c->done--;
+}
+
+/* Log a transaction as: spi<bus>.<cs> R|W <reg> <len>: <data bytes>. */
+static void spi_emu_log(struct spi_emu *e, const uint8_t *frame, size_t len)
+{
+	size_t i;
+
+	fprintf(e->log, "spi%d.%d %c 0x%02X %zu:", e->master.bus_num,
+		spi_get_chipselect(&(e->spi), 0), (frame[0] & 0x80) ? 'W' : 'R',
+		frame[0] & 0x7F, len - 1);
+	for (i = 1; i < len; i++)
+		fprintf(e->log, " %02X", frame[i]);
+	fprintf(e->log, "\n");
+}
+
+/*
+ * The transfers of a message are a single chip select frame, so they are
+ * shifted through the register model as one burst.
+ */
+int spi_sync(struct spi_device *spi, struct spi_message *m)
+{
+	struct spi_emu *e = spi_emu_of(spi);
+	struct spi_transfer *t;
+	uint8_t frame[1 + 256 + 1];
+	const uint8_t *tx;
+	uint8_t *rx;
+	size_t n = 0;
+	unsigned int i;
+
+	if (e == NULL)
+		return -ENODEV;
+
+	m->spi = spi;
+	m->actual_length = 0;
+	sx127x_model_select(&(e->chip));
+	list_for_each_entry(t, &(m->transfers), transfer_list) {
+		tx = t->tx_buf;
+		rx = t->rx_buf;
+		for (i = 0; i < t->len; i++) {
+			frame[n] = sx127x_model_shift(&(e->chip),
+						      (tx != NULL) ? tx[i] : 0);
+			if (rx != NULL)
+				rx[i] = frame[n];
+			/* Log what is written, or what is read. */
+			if (tx != NULL)
+				frame[n] = tx[i];
+			if (n < sizeof(frame) - 1)
+				n++;
+		}
+		m->actual_length += t->len;
+	}
+
+	e->count.transactions++;
+	e->count.bytes += m->actual_length;
+	if ((n > 0) && (frame[0] & 0x80))
+		e->count.writes++;
+	else
+		e->count.reads++;
+	if ((e->log != NULL) && (n > 0))
+		spi_emu_log(e, frame, n);
+
+	m->status = 0;
+
+	return 0;
+}
+
+/* The message is transferred at once, then its completion is called. */
+int spi_async(struct spi_device *spi, struct spi_message *m)
+{
+	int status;
+
+	status = spi_sync(spi, m);
+	if (m->complete != NULL)
+		m->complete(m->context);
+
+	return status;
+}
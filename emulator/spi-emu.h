@@ -0,0 +1,84 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __SPI_EMU_H__
+#define __SPI_EMU_H__
+
+#include <stdio.h>
+#include <linux/spi/spi.h>
+
+#include "sx127x-model.h"
+
+/* The SPI bus cost counted by an emulated device. */
+struct spi_emu_count {
+	unsigned long transactions;	/* spi_sync() calls */
+	unsigned long bytes;		/* Bytes on the bus, with the address */
+	unsigned long reads;		/* Read transactions */
+	unsigned long writes;		/* Write transactions */
+};
+
+/* An SX127x on the emulated SPI bus. */
+struct spi_emu {
+	struct spi_controller master;
+	struct spi_device spi;
+	struct sx127x_model chip;
+	struct spi_emu_count count;
+	/* Log each transaction into it if it is not NULL. */
+	FILE *log;
+};
+
+/* The max number of the emulated devices. */
+#define SPI_EMU_MAX	8
+
+/* Power on the chip at the bus & chip select. */
+void spi_emu_init(struct spi_emu *e, int bus, int cs);
+
+/* Probe the device with the registered SPI driver. */
+int spi_emu_probe(struct spi_emu *e);
+
+/* Remove the device from the registered SPI driver. */
+void spi_emu_remove(struct spi_emu *e);
+
+/* Get the emulated device of the SPI device. */
+static inline struct spi_emu *
+spi_emu_of(struct spi_device *spi)
+{
+	return spi->controller_data;
+}
+
+#endif
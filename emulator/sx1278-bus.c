@@ -0,0 +1,405 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "spi-emu.h"
+#include "sx1278.h"
+
+/*
+ * Run each function of the chip layer, LoRa-SPI/sx1278.c built unchanged,
+ * against the SX127x register model and report its SPI bus cost: the
+ * transactions and the bytes of a call, and the CPU time of a call on this
+ * host.  The costs written by -o can be diffed against a saved baseline to
+ * catch the regressions of the bus cost.
+ */
+
+/* The signal between the two emulated radios. */
+#define LINK_RSSI	-80	/* dBm */
+#define LINK_SNR	28	/* 0.25 dB */
+
+static struct spi_emu dev[2];
+static uint8_t payload[256];
+static uint8_t rbuf[256];
+static size_t plen = 32;
+/* The driver polls the flags every 20 ms. */
+static uint32_t poll_us = 20000;
+
+/* Write a register of the model directly, it is not on the counted bus. */
+static void poke(struct sx127x_model *m, uint8_t adr, uint8_t v)
+{
+	sx127x_model_select(m);
+	sx127x_model_shift(m, adr | 0x80);
+	sx127x_model_shift(m, v);
+}
+
+/* Set both radios back to the same modem settings and listening. */
+static void setup_link(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		init_sx127X(&(dev[i].spi));
+		sx127X_setLoRaFreq(&(dev[i].spi), 434000000);
+		sx127X_setLoRaSPRFactor(&(dev[i].spi), 128);
+		sx127X_setLoRaBW(&(dev[i].spi), 125000);
+		sx127X_setLoRaCR(&(dev[i].spi), 0x45);
+		sx127X_setLoRaCRC(&(dev[i].spi), 1);
+		sx127X_setLoRaPreambleLen(&(dev[i].spi), 8);
+	}
+}
+
+/* Put a received packet into the FIFO of the first radio. */
+static void setup_rx(void)
+{
+	struct sx127x_model *m = &(dev[0].chip);
+
+	poke(m, SX127X_REG_OP_MODE, 0x88 | SX127X_STANDBY_MODE);
+	poke(m, SX127X_REG_OP_MODE, 0x88 | SX127X_RXCONTINUOUS_MODE);
+	poke(m, SX127X_REG_IRQ_FLAGS, 0xFF);
+	sx127x_model_receive(m, payload, plen, LINK_RSSI, LINK_SNR, 0);
+}
+
+/* Send a packet and poll until it is sent, as the driver's write does. */
+static void tx_cycle(struct spi_device *spi)
+{
+	struct sx127x_model *m = &(spi_emu_of(spi)->chip);
+
+	sx127X_setState(spi, SX127X_STANDBY_MODE);
+	sx127X_sendLoRaData(spi, payload, plen);
+	sx127X_setState(spi, SX127X_TX_MODE);
+	do {
+		sx127x_model_advance(m, poll_us);
+	} while (!sx127X_getLoRaFlag(spi, SX127X_FLAG_TXDONE));
+	sx127X_clearLoRaFlag(spi, SX127X_FLAG_TXDONE);
+	sx127X_setState(spi, SX127X_RXCONTINUOUS_MODE);
+}
+
+/* Take a received packet with its signal, as the driver's read does. */
+static ssize_t rx_cycle(struct spi_device *spi)
+{
+	uint8_t flags;
+	ssize_t c = 0;
+
+	flags = sx127X_getLoRaAllFlag(spi);
+	if (flags & SX127X_FLAG_RXDONE) {
+		c = sx127X_readLoRaData(spi, rbuf, sizeof(rbuf));
+		sx127X_getLoRaLastPacketRSSI(spi);
+		sx127X_getLoRaLastPacketSNR(spi);
+	}
+	sx127X_clearLoRaFlag(spi, flags);
+
+	return c;
+}
+
+#define OP(name, call)							\
+	static void op_##name(struct spi_device *spi) { call; }
+
+OP(init_sx127X, init_sx127X(spi))
+OP(startLoRaMode, sx127X_startLoRaMode(spi))
+OP(readVersion, sx127X_readVersion(spi, (char *)rbuf, 4))
+OP(getMode, sx127X_getMode(spi))
+OP(setState, sx127X_setState(spi, SX127X_STANDBY_MODE))
+OP(getState, sx127X_getState(spi))
+OP(setLoRaFreq, sx127X_setLoRaFreq(spi, 434000000))
+OP(getLoRaFreq, sx127X_getLoRaFreq(spi))
+OP(setLoRaPower, sx127X_setLoRaPower(spi, 14))
+OP(getLoRaPower, sx127X_getLoRaPower(spi))
+OP(getLoRaAllFlag, sx127X_getLoRaAllFlag(spi))
+OP(clearLoRaFlag, sx127X_clearLoRaFlag(spi, 0xFF))
+OP(setLoRaSPRFactor, sx127X_setLoRaSPRFactor(spi, 128))
+OP(getLoRaSPRFactor, sx127X_getLoRaSPRFactor(spi))
+OP(setLoRaBW, sx127X_setLoRaBW(spi, 125000))
+OP(getLoRaBW, sx127X_getLoRaBW(spi))
+OP(setLoRaCR, sx127X_setLoRaCR(spi, 0x45))
+OP(getLoRaCR, sx127X_getLoRaCR(spi))
+OP(setLoRaImplicit, sx127X_setLoRaImplicit(spi, 0))
+OP(getLoRaImplicit, sx127X_getLoRaImplicit(spi))
+OP(setLoRaPayloadLen, sx127X_setLoRaPayloadLen(spi, plen))
+OP(setLoRaRXByteTimeout, sx127X_setLoRaRXByteTimeout(spi, 100))
+OP(getLoRaRXByteTimeout, sx127X_getLoRaRXByteTimeout(spi))
+OP(setLoRaRXTimeout, sx127X_setLoRaRXTimeout(spi, 1000))
+OP(getLoRaRXTimeout, sx127X_getLoRaRXTimeout(spi))
+OP(setLoRaMaxRXBuff, sx127X_setLoRaMaxRXBuff(spi, 255))
+OP(readLoRaData, sx127X_readLoRaData(spi, rbuf, sizeof(rbuf)))
+OP(sendLoRaData, sx127X_sendLoRaData(spi, payload, plen))
+OP(getLoRaLastPacketRSSI, sx127X_getLoRaLastPacketRSSI(spi))
+OP(getLoRaLastPacketSNR, sx127X_getLoRaLastPacketSNR(spi))
+OP(getLoRaRSSI, sx127X_getLoRaRSSI(spi))
+OP(setLoRaPreambleLen, sx127X_setLoRaPreambleLen(spi, 8))
+OP(getLoRaPreambleLen, sx127X_getLoRaPreambleLen(spi))
+OP(setLoRaCRC, sx127X_setLoRaCRC(spi, 1))
+OP(getLoRaCRC, sx127X_getLoRaCRC(spi))
+OP(getLoRaAirTime, sx127X_getLoRaAirTime(spi, plen))
+OP(setBoost, sx127X_setBoost(spi, 0))
+OP(tx_cycle, tx_cycle(spi))
+OP(rx_cycle, rx_cycle(spi))
+
+/* An operation, with the setup which is neither counted nor timed. */
+struct op {
+	const char *name;
+	void (*run)(struct spi_device *spi);
+	void (*setup)(void);
+};
+
+#define OPENTRY(name, setup)	{#name, op_##name, setup}
+
+static const struct op ops[] = {
+	OPENTRY(init_sx127X, NULL),
+	OPENTRY(startLoRaMode, NULL),
+	OPENTRY(readVersion, NULL),
+	OPENTRY(getMode, NULL),
+	OPENTRY(setState, NULL),
+	OPENTRY(getState, NULL),
+	OPENTRY(setLoRaFreq, NULL),
+	OPENTRY(getLoRaFreq, NULL),
+	OPENTRY(setLoRaPower, NULL),
+	OPENTRY(getLoRaPower, NULL),
+	OPENTRY(getLoRaAllFlag, NULL),
+	OPENTRY(clearLoRaFlag, NULL),
+	OPENTRY(setLoRaSPRFactor, NULL),
+	OPENTRY(getLoRaSPRFactor, NULL),
+	OPENTRY(setLoRaBW, NULL),
+	OPENTRY(getLoRaBW, NULL),
+	OPENTRY(setLoRaCR, NULL),
+	OPENTRY(getLoRaCR, NULL),
+	OPENTRY(setLoRaImplicit, NULL),
+	OPENTRY(getLoRaImplicit, NULL),
+	OPENTRY(setLoRaPayloadLen, NULL),
+	OPENTRY(setLoRaRXByteTimeout, NULL),
+	OPENTRY(getLoRaRXByteTimeout, NULL),
+	OPENTRY(setLoRaRXTimeout, NULL),
+	OPENTRY(getLoRaRXTimeout, NULL),
+	OPENTRY(setLoRaMaxRXBuff, NULL),
+	OPENTRY(readLoRaData, setup_rx),
+	OPENTRY(sendLoRaData, NULL),
+	OPENTRY(getLoRaLastPacketRSSI, setup_rx),
+	OPENTRY(getLoRaLastPacketSNR, setup_rx),
+	OPENTRY(getLoRaRSSI, NULL),
+	OPENTRY(setLoRaPreambleLen, NULL),
+	OPENTRY(getLoRaPreambleLen, NULL),
+	OPENTRY(setLoRaCRC, NULL),
+	OPENTRY(getLoRaCRC, NULL),
+	OPENTRY(getLoRaAirTime, NULL),
+	OPENTRY(setBoost, NULL),
+	OPENTRY(tx_cycle, setup_link),
+	OPENTRY(rx_cycle, setup_rx),
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Check the chip layer and the model agree with each other. */
+static int self_check(void)
+{
+	struct spi_device *a = &(dev[0].spi), *b = &(dev[1].spi);
+	struct sx127x_model *ma = &(dev[0].chip), *mb = &(dev[1].chip);
+	char ver[8];
+	uint32_t fr;
+	int fails = 0;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			printf("Self check failed: %s\n", #cond);	\
+			fails++;					\
+		}							\
+	} while (0)
+
+	setup_link();
+	sx127X_readVersion(a, ver, 4);
+	ver[4] = '\0';
+	CHECK(strcmp(ver, "1.2") == 0);
+	CHECK(sx127X_getState(a) == SX127X_RXCONTINUOUS_MODE);
+	fr = sx127X_getLoRaFreq(a);
+	CHECK((fr > 434000000 - 62) && (fr < 434000000 + 62));
+	CHECK(sx127X_getLoRaSPRFactor(a) == 128);
+	CHECK(sx127X_getLoRaBW(a) == 125000);
+	CHECK(sx127X_getLoRaCR(a) == 0x45);
+	CHECK(sx127X_getLoRaCRC(a) == 1);
+	CHECK(sx127X_getLoRaPreambleLen(a) == 8);
+	sx127X_setLoRaPower(a, 14);
+	CHECK(sx127X_getLoRaPower(a) == 14);
+	CHECK(sx127X_getLoRaAirTime(a, plen) == sx127x_model_airtime(ma, plen));
+
+	/* A packet goes from a to b over the air. */
+	tx_cycle(a);
+	CHECK(mb->rx_packets == 1);
+	CHECK(rx_cycle(b) == (ssize_t)plen);
+	CHECK(memcmp(rbuf, payload, plen) == 0);
+	CHECK(sx127X_getLoRaLastPacketRSSI(b) == LINK_RSSI);
+	CHECK(sx127X_getLoRaLastPacketSNR(b) == LINK_SNR / 4);
+
+	/* RX single times out after the symbols of the time out. */
+	sx127X_setState(b, SX127X_STANDBY_MODE);
+	sx127X_setLoRaRXByteTimeout(b, 10);
+	sx127X_setState(b, SX127X_RXSINGLE_MODE);
+	sx127x_model_advance(mb, 11 * sx127x_model_symbol(mb));
+	CHECK(sx127X_getLoRaFlag(b, SX127X_FLAG_RXTIMEOUT));
+	CHECK(sx127X_getState(b) == SX127X_STANDBY_MODE);
+
+	/* A corrupted payload raises the CRC error flag. */
+	sx127X_clearLoRaAllFlag(b);
+	sx127X_setState(b, SX127X_RXCONTINUOUS_MODE);
+	sx127x_model_receive(mb, payload, plen, LINK_RSSI, LINK_SNR, 1);
+	CHECK(sx127X_getLoRaFlag(b, SX127X_FLAG_PAYLOADCRCERROR));
+
+#undef CHECK
+
+	return fails;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-n iterations] [-l len] [-p us] [-v] [-o file]\n",
+	       name);
+	printf("  -n iterations  calls of each operation to time "
+	       "(default 10000)\n");
+	printf("  -l len         payload length 1 ~ 255 (default 32)\n");
+	printf("  -p us          the interval of polling the flags in the TX "
+	       "cycle\n"
+	       "                 (default 20000 as the driver)\n");
+	printf("  -v             log the transactions of each operation's "
+	       "first call\n");
+	printf("  -o file        write \"operation transactions bytes\" lines "
+	       "to diff against\n"
+	       "                 a baseline\n");
+}
+
+int main(int argc, char **argv)
+{
+	const struct op *op;
+	struct spi_emu_count c;
+	unsigned long n = 10000, i;
+	uint64_t t, total;
+	const char *out = NULL;
+	int verbose = 0;
+	int opt;
+	size_t k;
+	FILE *f = NULL;
+
+	while ((opt = getopt(argc, argv, "n:l:p:vo:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);	break;
+		case 'l':
+			plen = strtoul(optarg, NULL, 0);	break;
+		case 'p':
+			poll_us = strtoul(optarg, NULL, 0);	break;
+		case 'v':
+			verbose = 1;	break;
+		case 'o':
+			out = optarg;	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if ((n == 0) || (plen == 0) || (plen > 255) || (poll_us == 0)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	for (k = 0; k < plen; k++)
+		payload[k] = k * 7 + 1;
+	spi_emu_init(&dev[0], 0, 0);
+	spi_emu_init(&dev[1], 0, 1);
+	sx127x_model_link(&(dev[0].chip), &(dev[1].chip), LINK_RSSI, LINK_SNR);
+
+	if (self_check() > 0)
+		return 1;
+
+	if (out != NULL) {
+		f = fopen(out, "w");
+		if (f == NULL) {
+			perror("Open the output file failed");
+			return -1;
+		}
+	}
+
+	setup_link();
+	printf("%-24s %8s %8s %10s\n", "operation", "xfers", "bytes",
+	       "ns/call");
+	for (k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+		op = &(ops[k]);
+
+		/* Count the first call. */
+		if (op->setup != NULL)
+			op->setup();
+		if (verbose) {
+			printf("%s:\n", op->name);
+			dev[0].log = stdout;
+		}
+		memset(&(dev[0].count), 0, sizeof(dev[0].count));
+		op->run(&(dev[0].spi));
+		c = dev[0].count;
+		dev[0].log = NULL;
+
+		/* Time the calls. */
+		total = 0;
+		for (i = 0; i < n; i++) {
+			if (op->setup != NULL)
+				op->setup();
+			t = now_ns();
+			op->run(&(dev[0].spi));
+			total += now_ns() - t;
+		}
+
+		printf("%-24s %8lu %8lu %10.1f\n", op->name, c.transactions,
+		       c.bytes, (double)total / n);
+		if (f != NULL)
+			fprintf(f, "%s %lu %lu\n", op->name, c.transactions,
+				c.bytes);
+	}
+
+	if (f != NULL)
+		fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,416 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+#include <linux/spi/spi.h>
+
+#include "sx1278.h"
+#include "sx127x-model.h"
+
+#define MODE(m)		((m)->reg[SX127X_REG_OP_MODE] & 0x07)
+#define LORA(m)		((m)->reg[SX127X_REG_OP_MODE] & 0x80)
+
+static const uint32_t model_bw[] = {
+	7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+/* The registers' reset values in LoRa mode from the datasheet. */
+static const struct {
+	uint8_t adr;
+	uint8_t val;
+} model_reset[] = {
+	{SX127X_REG_OP_MODE, 0x09},
+	{SX127X_REG_FRF_MSB, 0x6C},
+	{SX127X_REG_FRF_MID, 0x80},
+	{SX127X_REG_PA_CONFIG, 0x4F},
+	{SX127X_REG_PA_RAMP, 0x09},
+	{SX127X_REG_OCP, 0x2B},
+	{SX127X_REG_LNA, 0x20},
+	{SX127X_REG_FIFO_TX_BASE_ADDR, 0x80},
+	{SX127X_REG_MODEM_STAT, 0x10},
+	{SX127X_REG_MODEM_CONFIG1, 0x72},
+	{SX127X_REG_MODEM_CONFIG2, 0x70},
+	{SX127X_REG_SYMB_TIMEOUT_LSB, 0x64},
+	{SX127X_REG_PREAMBLE_LSB, 0x08},
+	{SX127X_REG_PAYLOAD_LENGTH, 0x01},
+	{SX127X_REG_MAX_PAYLOAD_LENGTH, 0xFF},
+	{SX127X_REG_MODEM_CONFIG3, 0x04},
+	{SX127X_REG_DETECT_OPTIMIZE, 0xC3},
+	{SX127X_REG_INVERT_IRQ, 0x27},
+	{SX127X_REG_DETECTION_THRESHOLD, 0x0A},
+	{SX127X_REG_SYNC_WORD, 0x12},
+	{SX127X_REG_VERSION, 0x12},
+	{SX127X_REG_PA_DAC, 0x84},
+};
+
+/* Power on reset the chip: the registers get their reset values. */
+void sx127x_model_init(struct sx127x_model *m)
+{
+	size_t i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < sizeof(model_reset) / sizeof(model_reset[0]); i++)
+		m->reg[model_reset[i].adr] = model_reset[i].val;
+	m->noise = SX127X_MODEL_NOISE;
+}
+
+/* Get the RSSI register's value of the signal in dBm. */
+static uint8_t model_rssi(const struct sx127x_model *m, int32_t dbm)
+{
+	int32_t raw;
+
+	/* The offset depends on the low / high frequency port. */
+	raw = dbm - ((m->reg[SX127X_REG_OP_MODE] & 0x08) ? -164 : -157);
+
+	return (raw < 0) ? 0 : (raw > 255) ? 255 : raw;
+}
+
+/* Raise the IRQ flags which are not masked. */
+static void model_flag(struct sx127x_model *m, uint8_t f)
+{
+	m->reg[SX127X_REG_IRQ_FLAGS] |= f & ~m->reg[SX127X_REG_IRQ_FLAGS_MASK];
+}
+
+/* Get the symbol time with the current modem registers in us. */
+uint32_t sx127x_model_symbol(const struct sx127x_model *m)
+{
+	uint32_t sf, bw;
+
+	sf = m->reg[SX127X_REG_MODEM_CONFIG2] >> 4;
+	sf = (sf < 6) ? 6 : (sf > 12) ? 12 : sf;
+	bw = m->reg[SX127X_REG_MODEM_CONFIG1] >> 4;
+	bw = (bw < 10) ? model_bw[bw] : model_bw[9];
+
+	return ((uint64_t)1000000 << sf) / bw;
+}
+
+/* Get the time on air of a packet with the current modem registers in us.
+ * It is the formula of Semtech's SX1276/77/78/79 datasheet, 4.1.1.7. */
+uint32_t sx127x_model_airtime(const struct sx127x_model *m, size_t len)
+{
+	uint8_t mc1 = m->reg[SX127X_REG_MODEM_CONFIG1];
+	uint8_t mc2 = m->reg[SX127X_REG_MODEM_CONFIG2];
+	uint8_t mc3 = m->reg[SX127X_REG_MODEM_CONFIG3];
+	int32_t sf, cr, num, den;
+	uint32_t bw, prelen, nsym;
+
+	sf = mc2 >> 4;
+	sf = (sf < 6) ? 6 : (sf > 12) ? 12 : sf;
+	bw = ((mc1 >> 4) < 10) ? model_bw[mc1 >> 4] : model_bw[9];
+	cr = ((mc1 >> 1) & 0x07) + 4;
+	prelen = (m->reg[SX127X_REG_PREAMBLE_MSB] << 8)
+		| m->reg[SX127X_REG_PREAMBLE_LSB];
+
+	num = 8 * (int32_t)len - 4 * sf + 28 + 16 * ((mc2 >> 2) & 0x01)
+		- 20 * (mc1 & 0x01);
+	den = 4 * (sf - 2 * ((mc3 >> 3) & 0x01));
+	nsym = 8;
+	if (num > 0)
+		nsym += ((num + den - 1) / den) * cr;
+
+	/* The preamble lasts for (prelen + 4.25) symbols. */
+	return (((uint64_t)(4 * prelen + 17) + 4 * (uint64_t)nsym)
+		* ((uint64_t)1000000 << sf)) / (4 * (uint64_t)bw);
+}
+
+/* Enter the state written into OP_MODE. */
+static void model_set_mode(struct sx127x_model *m, uint8_t v)
+{
+	uint8_t old = m->reg[SX127X_REG_OP_MODE];
+	uint32_t n;
+
+	/* LongRangeMode can be changed in sleep state only. */
+	if ((old & 0x07) != SX127X_SLEEP_MODE)
+		v = (v & 0x7F) | (old & 0x80);
+	m->reg[SX127X_REG_OP_MODE] = v;
+	if (!LORA(m))
+		return;
+
+	switch (v & 0x07) {
+	case SX127X_SLEEP_MODE:
+		/* The FIFO is lost in sleep state. */
+		memset(m->fifo, 0, sizeof(m->fifo));
+		break;
+	case SX127X_TX_MODE:
+		/* Send the payload from the TX base of the FIFO. */
+		m->tx_len = m->reg[SX127X_REG_PAYLOAD_LENGTH];
+		for (n = 0; n < m->tx_len; n++)
+			m->tx_buf[n] = m->fifo[(uint8_t)(n
+				+ m->reg[SX127X_REG_FIFO_TX_BASE_ADDR])];
+		m->tx_end_us = m->now_us + sx127x_model_airtime(m, m->tx_len);
+		break;
+	case SX127X_RXCONTINUOUS_MODE:
+	case SX127X_RXSINGLE_MODE:
+		if (((old & 0x07) == SX127X_RXCONTINUOUS_MODE)
+			|| ((old & 0x07) == SX127X_RXSINGLE_MODE))
+			break;
+		/* The packets are written from the RX base, and the counters
+		 * count from the transition into RX. */
+		m->rx_adr = m->reg[SX127X_REG_FIFO_RX_BASE_ADDR];
+		memset(&(m->reg[SX127X_REG_RX_HEADER_CNT_VALUE_MSB]), 0, 4);
+		n = ((m->reg[SX127X_REG_MODEM_CONFIG2] & 0x03) << 8)
+			| m->reg[SX127X_REG_SYMB_TIMEOUT_LSB];
+		m->rx_end_us = m->now_us + n * sx127x_model_symbol(m);
+		break;
+	case SX127X_CAD_MODE:
+		m->cad_end_us = m->now_us + 2 * sx127x_model_symbol(m);
+		break;
+	}
+}
+
+/* Can the receiver demodulate what the sender sends. */
+static int model_hears(const struct sx127x_model *rx,
+		       const struct sx127x_model *tx)
+{
+	uint8_t mode = rx->reg[SX127X_REG_OP_MODE] & 0x07;
+
+	return LORA(rx)
+		&& ((mode == SX127X_RXCONTINUOUS_MODE)
+			|| (mode == SX127X_RXSINGLE_MODE))
+		&& !memcmp(&(rx->reg[SX127X_REG_FRF_MSB]),
+			   &(tx->reg[SX127X_REG_FRF_MSB]), 3)
+		&& ((rx->reg[SX127X_REG_MODEM_CONFIG1] & 0xF1)
+			== (tx->reg[SX127X_REG_MODEM_CONFIG1] & 0xF1))
+		&& ((rx->reg[SX127X_REG_MODEM_CONFIG2] >> 4)
+			== (tx->reg[SX127X_REG_MODEM_CONFIG2] >> 4))
+		&& (rx->reg[SX127X_REG_SYNC_WORD]
+			== tx->reg[SX127X_REG_SYNC_WORD]);
+}
+
+/* Advance the virtual time and finish the states whose time is up. */
+void sx127x_model_advance(struct sx127x_model *m, uint32_t us)
+{
+	m->now_us += us;
+	if (!LORA(m))
+		return;
+
+	switch (MODE(m)) {
+	case SX127X_TX_MODE:
+		if (m->now_us < m->tx_end_us)
+			break;
+		m->tx_packets++;
+		model_flag(m, SX127X_FLAG_TXDONE);
+		m->reg[SX127X_REG_OP_MODE] =
+			(m->reg[SX127X_REG_OP_MODE] & 0xF8)
+			| SX127X_STANDBY_MODE;
+		if ((m->peer != NULL) && model_hears(m->peer, m))
+			sx127x_model_receive(m->peer, m->tx_buf, m->tx_len,
+					     m->peer_rssi, m->peer_snr, 0);
+		break;
+	case SX127X_RXSINGLE_MODE:
+		if (m->now_us < m->rx_end_us)
+			break;
+		model_flag(m, SX127X_FLAG_RXTIMEOUT);
+		m->reg[SX127X_REG_OP_MODE] =
+			(m->reg[SX127X_REG_OP_MODE] & 0xF8)
+			| SX127X_STANDBY_MODE;
+		break;
+	case SX127X_CAD_MODE:
+		if (m->now_us < m->cad_end_us)
+			break;
+		/* The peer's preamble is detected if it is sending. */
+		if ((m->peer != NULL) && LORA(m->peer)
+			&& (MODE(m->peer) == SX127X_TX_MODE))
+			model_flag(m, SX127X_FLAG_CADDETECTED);
+		model_flag(m, SX127X_FLAG_CADDONE);
+		m->reg[SX127X_REG_OP_MODE] =
+			(m->reg[SX127X_REG_OP_MODE] & 0xF8)
+			| SX127X_STANDBY_MODE;
+		break;
+	}
+}
+
+/* Count a 16 bits big endian counter register pair. */
+static void model_count(struct sx127x_model *m, uint8_t msb)
+{
+	uint16_t c;
+
+	c = (m->reg[msb] << 8) | m->reg[msb + 1];
+	c++;
+	m->reg[msb] = c >> 8;
+	m->reg[msb + 1] = c & 0xFF;
+}
+
+/* A packet arrives over the air, with its RSSI in dBm and SNR in 0.25 dB.
+ * Return the length written into the FIFO, -1 if the chip is not listening
+ * or drops the packet. */
+int sx127x_model_receive(struct sx127x_model *m, const uint8_t *buf,
+			 size_t len, int32_t rssi, int32_t snr, int crcerr)
+{
+	uint8_t start;
+	size_t i;
+
+	if (!LORA(m) || ((MODE(m) != SX127X_RXCONTINUOUS_MODE)
+			 && (MODE(m) != SX127X_RXSINGLE_MODE)))
+		return -1;
+
+	/* The length is known in implicit header mode, or the header's length
+	 * must not exceed the max payload length. */
+	if (m->reg[SX127X_REG_MODEM_CONFIG1] & 0x01)
+		len = m->reg[SX127X_REG_PAYLOAD_LENGTH];
+	else if (len > m->reg[SX127X_REG_MAX_PAYLOAD_LENGTH])
+		return -1;
+	if (len > 255)
+		len = 255;
+
+	start = m->rx_adr;
+	for (i = 0; i < len; i++)
+		m->fifo[(uint8_t)(start + i)] = buf[i];
+	m->rx_adr = start + len;
+
+	snr = (snr < -128) ? -128 : (snr > 127) ? 127 : snr;
+	m->reg[SX127X_REG_FIFO_RX_CURRENT_ADDR] = start;
+	m->reg[SX127X_REG_FIFO_RX_BYTE_ADDR] = start + len - 1;
+	m->reg[SX127X_REG_RX_NB_BYTES] = len;
+	m->reg[SX127X_REG_PKT_SNR_VALUE] = (uint8_t)(int8_t)snr;
+	/* Below the noise floor the RSSI is corrected by the SNR. */
+	m->reg[SX127X_REG_PKT_RSSI_VALUE] =
+		model_rssi(m, (snr < 0) ? rssi - snr / 4 : rssi);
+	model_count(m, SX127X_REG_RX_HEADER_CNT_VALUE_MSB);
+	if (!crcerr)
+		model_count(m, SX127X_REG_RX_PACKET_CNT_VALUE_MSB);
+	m->rx_packets++;
+
+	model_flag(m, SX127X_FLAG_VALIDHEADER | SX127X_FLAG_RXDONE
+		   | (crcerr ? SX127X_FLAG_PAYLOADCRCERROR : 0));
+	if (MODE(m) == SX127X_RXSINGLE_MODE)
+		m->reg[SX127X_REG_OP_MODE] =
+			(m->reg[SX127X_REG_OP_MODE] & 0xF8)
+			| SX127X_STANDBY_MODE;
+
+	return len;
+}
+
+/* Let the two chips hear each other with the signal. */
+void sx127x_model_link(struct sx127x_model *a, struct sx127x_model *b,
+		       int32_t rssi, int32_t snr)
+{
+	a->peer = b;
+	a->peer_rssi = rssi;
+	a->peer_snr = snr;
+	b->peer = a;
+	b->peer_rssi = rssi;
+	b->peer_snr = snr;
+}
+
+/* Read a register, the FIFO is read at and advances FIFO_ADDR_PTR. */
+static uint8_t model_read(struct sx127x_model *m, uint8_t adr)
+{
+	uint8_t *ptr = &(m->reg[SX127X_REG_FIFO_ADDR_PTR]);
+
+	switch (adr) {
+	case SX127X_REG_FIFO:
+		/* The FIFO can not be accessed in sleep state. */
+		if (MODE(m) == SX127X_SLEEP_MODE)
+			return 0;
+		return m->fifo[(*ptr)++];
+	case SX127X_REG_RSSI_VALUE:
+		return model_rssi(m, m->noise);
+	default:
+		return m->reg[adr];
+	}
+}
+
+/* Write a register, the FIFO is written at and advances FIFO_ADDR_PTR. */
+static void model_write(struct sx127x_model *m, uint8_t adr, uint8_t v)
+{
+	uint8_t *ptr = &(m->reg[SX127X_REG_FIFO_ADDR_PTR]);
+
+	switch (adr) {
+	case SX127X_REG_FIFO:
+		if (MODE(m) != SX127X_SLEEP_MODE)
+			m->fifo[(*ptr)++] = v;
+		break;
+	case SX127X_REG_OP_MODE:
+		model_set_mode(m, v);
+		break;
+	case SX127X_REG_IRQ_FLAGS:
+		/* Writing 1 clears the flag. */
+		m->reg[adr] &= ~v;
+		break;
+	case SX127X_REG_FIFO_RX_CURRENT_ADDR:
+	case SX127X_REG_RX_NB_BYTES:
+	case SX127X_REG_RX_HEADER_CNT_VALUE_MSB:
+	case SX127X_REG_RX_HEADER_CNT_VALUE_LSB:
+	case SX127X_REG_RX_PACKET_CNT_VALUE_MSB:
+	case SX127X_REG_RX_PACKET_CNT_VALUE_LSB:
+	case SX127X_REG_MODEM_STAT:
+	case SX127X_REG_PKT_SNR_VALUE:
+	case SX127X_REG_PKT_RSSI_VALUE:
+	case SX127X_REG_RSSI_VALUE:
+	case SX127X_REG_FIFO_RX_BYTE_ADDR:
+	case SX127X_REG_VERSION:
+		/* Read only. */
+		break;
+	default:
+		m->reg[adr] = v;
+	}
+}
+
+/* Assert the chip select, the next byte shifted in is an address. */
+void sx127x_model_select(struct sx127x_model *m)
+{
+	m->addressed = 0;
+}
+
+/* Shift a byte into the chip and get the byte shifted out.  The address
+ * increases after each byte of a burst, except the FIFO's. */
+uint8_t sx127x_model_shift(struct sx127x_model *m, uint8_t mosi)
+{
+	uint8_t miso = 0;
+
+	if (!m->addressed) {
+		m->addressed = 1;
+		m->write = mosi & 0x80;
+		m->adr = mosi & 0x7F;
+		return 0;
+	}
+
+	if (m->write)
+		model_write(m, m->adr, mosi);
+	else
+		miso = model_read(m, m->adr);
+	if (m->adr != SX127X_REG_FIFO)
+		m->adr = (m->adr + 1) & 0x7F;
+
+	return miso;
+}
@@ -0,0 +1,122 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __SX127X_MODEL_H__
+#define __SX127X_MODEL_H__
+
+/* It is built into the KUnit suite of LoRa-SPI, too. */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+/*
+ * A register model of the SX127x in LoRa mode, driven byte by byte like
+ * the chip's SPI slave.  It keeps the FIFO and its pointers, the IRQ flags
+ * with their mask, the OP_MODE transitions and the packet registers
+ * (RX_NB_BYTES, PKT_SNR_VALUE, PKT_RSSI_VALUE and the counters).  Time is
+ * virtual: TX done, RX single time-out and CAD done happen when the model
+ * is advanced past their time on air.
+ */
+
+/* The default noise floor of the channel in dBm. */
+#define SX127X_MODEL_NOISE	-120
+
+struct sx127x_model {
+	/* The registers, the FIFO ones are kept in the fields below. */
+	uint8_t reg[0x80];
+	uint8_t fifo[256];
+
+	/* The SPI frame: the address byte is shifted in first. */
+	uint8_t adr;
+	uint8_t write;
+	uint8_t addressed;
+
+	/* The virtual time and the deadlines of the current state. */
+	uint64_t now_us;
+	uint64_t tx_end_us;
+	uint64_t rx_end_us;
+	uint64_t cad_end_us;
+	/* Where the next received packet is written into the FIFO. */
+	uint8_t rx_adr;
+	/* The packet being sent. */
+	uint8_t tx_buf[256];
+	uint8_t tx_len;
+
+	/* The radios receiving what this one sends, and their signal. */
+	struct sx127x_model *peer;
+	int32_t peer_rssi;	/* In dBm */
+	int32_t peer_snr;	/* In 0.25 dB */
+	int32_t noise;		/* The idle channel's RSSI in dBm */
+
+	/* How many packets were sent & received. */
+	uint32_t tx_packets;
+	uint32_t rx_packets;
+};
+
+/* Power on reset the chip: the registers get their reset values. */
+void sx127x_model_init(struct sx127x_model *m);
+
+/* Assert the chip select, the next byte shifted in is an address. */
+void sx127x_model_select(struct sx127x_model *m);
+
+/* Shift a byte into the chip and get the byte shifted out. */
+uint8_t sx127x_model_shift(struct sx127x_model *m, uint8_t mosi);
+
+/* Advance the virtual time and finish the states whose time is up. */
+void sx127x_model_advance(struct sx127x_model *m, uint32_t us);
+
+/* A packet arrives over the air, with its RSSI in dBm and SNR in 0.25 dB.
+ * Return the length written into the FIFO, -1 if the chip is not listening
+ * or drops the packet. */
+int sx127x_model_receive(struct sx127x_model *m, const uint8_t *buf,
+			 size_t len, int32_t rssi, int32_t snr, int crcerr);
+
+/* Let the two chips hear each other with the signal. */
+void sx127x_model_link(struct sx127x_model *a, struct sx127x_model *b,
+		       int32_t rssi, int32_t snr);
+
+/* Get the time on air of a packet with the current modem registers in us. */
+uint32_t sx127x_model_airtime(const struct sx127x_model *m, size_t len);
+
+/* Get the symbol time with the current modem registers in us. */
+uint32_t sx127x_model_symbol(const struct sx127x_model *m);
+
+#endif
@@ -0,0 +1,269 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "lora-airtime.h"
+#include "lora-compress.h"
+
+/* Compare the compression methods on the sensor frames and the airtime. */
+
+#define MAX_FRAMES	4096
+#define NFIELDS		8
+
+struct workload {
+	const char *name;
+	uint8_t frame[MAX_FRAMES][LORA_ZFRAME_MAX];
+	size_t len[MAX_FRAMES];
+	size_t n;
+};
+
+struct result {
+	double len;		/* Average frame length in bytes */
+	double enc_ns;		/* Average encode time per frame */
+	double dec_ns;		/* Average decode time per frame */
+	unsigned int errors;	/* Frames not decoded back */
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Text records from a slowly changing sensor. */
+static void gen_json(struct workload *w, size_t n)
+{
+	size_t i;
+
+	w->name = "json";
+	w->n = n;
+	for (i = 0; i < n; i++)
+		w->len[i] = snprintf((char *)w->frame[i], LORA_ZFRAME_MAX,
+			"{\"id\":17,\"seq\":%zu,\"ts\":%lu,\"temp\":%.1f,"
+			"\"hum\":%d,\"bat\":%.2f,\"state\":\"ok\"}",
+			i, 1700000000UL + 60 * i, 21.0 + (rand() % 20) / 10.0,
+			40 + rand() % 5, 3.70 - i / 10000.0);
+}
+
+/* Binary records packed as varints of the differences. */
+static void gen_binary(struct workload *w, size_t n)
+{
+	int32_t rec[NFIELDS], prev[NFIELDS];
+	size_t i, k;
+
+	w->name = "varint";
+	w->n = n;
+	memset(prev, 0, sizeof(prev));
+	for (i = 0; i < n; i++) {
+		rec[0] = 17;
+		rec[1] = i;
+		rec[2] = 1700000000 + 60 * i;
+		rec[3] = 2100 + rand() % 20;
+		rec[4] = 4000 + rand() % 50;
+		rec[5] = 3700 - i / 10;
+		rec[6] = -80 - rand() % 10;
+		rec[7] = 0;
+		/* Each 16th record is absolute for resync. */
+		w->len[i] = lora_record_pack(w->frame[i], LORA_ZFRAME_MAX, rec,
+					     (i % 16) ? prev : NULL, NFIELDS);
+		for (k = 0; k < NFIELDS; k++)
+			prev[k] = rec[k];
+	}
+}
+
+/* Raw binary records, 4 bytes for each field. */
+static void gen_raw(struct workload *w, size_t n)
+{
+	int32_t rec[NFIELDS];
+	size_t i;
+
+	w->name = "int32";
+	w->n = n;
+	for (i = 0; i < n; i++) {
+		memset(rec, 0, sizeof(rec));
+		rec[0] = 17;
+		rec[1] = i;
+		rec[2] = 1700000000 + 60 * i;
+		rec[3] = 2100 + rand() % 20;
+		rec[4] = 4000 + rand() % 50;
+		rec[5] = 3700 - i / 10;
+		rec[6] = -80 - rand() % 10;
+		memcpy(w->frame[i], rec, sizeof(rec));
+		w->len[i] = sizeof(rec);
+	}
+}
+
+static void run(const struct workload *w, unsigned int methods,
+		unsigned int keyint, struct result *r)
+{
+	struct lora_zstream enc, dec;
+	uint8_t c[LORA_ZFRAME_MAX], d[LORA_ZFRAME_MAX];
+	double t0, tenc = 0, tdec = 0;
+	size_t total = 0;
+	ssize_t n, m;
+	size_t i;
+
+	lora_zinit(&enc, &lora_zdict_sensor, keyint);
+	lora_zinit(&dec, &lora_zdict_sensor, keyint);
+	enc.methods = methods;
+	memset(r, 0, sizeof(struct result));
+
+	for (i = 0; i < w->n; i++) {
+		t0 = now_ns();
+		n = lora_zcompress(&enc, w->frame[i], w->len[i], c, sizeof(c));
+		tenc += now_ns() - t0;
+		if (n < 0) {
+			r->errors++;
+			continue;
+		}
+		total += n;
+
+		t0 = now_ns();
+		m = lora_zdecompress(&dec, c, n, d, sizeof(d));
+		tdec += now_ns() - t0;
+		if ((m != (ssize_t)w->len[i]) || memcmp(d, w->frame[i], m))
+			r->errors++;
+	}
+
+	r->len = (double)total / w->n;
+	r->enc_ns = tenc / w->n;
+	r->dec_ns = tdec / w->n;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-n frames] [-k keyint]\n", name);
+	printf("  -n frames  frames of each workload (default 1000)\n");
+	printf("  -k keyint  a frame without delta every keyint frames "
+	       "(default 16)\n");
+}
+
+int main(int argc, char **argv)
+{
+	static struct workload w[3];
+	static const char *mname[] = {"raw", "dict", "delta", "auto"};
+	static const unsigned int mset[] = {
+		LORA_ZRAW, LORA_ZDICT, LORA_ZDELTA, LORA_ZALL,
+	};
+	static const uint32_t bws[] = {125000, 250000, 500000};
+	struct result r[4];
+	struct lora_modem m;
+	double raw_us, z_us;
+	unsigned int keyint = 16;
+	size_t nframes = 1000;
+	size_t i, j, b;
+	uint32_t sf;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:k:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nframes = strtoul(optarg, NULL, 0);	break;
+		case 'k':
+			keyint = strtoul(optarg, NULL, 0);	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if ((nframes == 0) || (nframes > MAX_FRAMES)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	srand(1);
+	gen_json(&w[0], nframes);
+	gen_raw(&w[1], nframes);
+	gen_binary(&w[2], nframes);
+
+	memset(&m, 0, sizeof(m));
+	m.cr = 5;
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+
+	for (i = 0; i < 3; i++) {
+		printf("Workload %s, %zu frames, key frame every %u\n",
+		       w[i].name, w[i].n, keyint);
+		printf("method | avg bytes | ratio | encode ns | decode ns "
+		       "| errors\n");
+		for (j = 0; j < 4; j++) {
+			run(&w[i], mset[j], keyint, &r[j]);
+			printf("%6s | %9.1f | %5.2f | %9.0f | %9.0f | %6u\n",
+			       mname[j], r[j].len, r[0].len / r[j].len,
+			       r[j].enc_ns, r[j].dec_ns, r[j].errors);
+		}
+
+		/* The airtime of the average frame, raw against auto. */
+		printf("SF |     BW | raw ms | auto ms | saved ms | saved\n");
+		for (sf = 7; sf <= 12; sf++) {
+			for (b = 0; b < sizeof(bws) / sizeof(bws[0]); b++) {
+				m.sprf = 1U << sf;
+				m.bw = bws[b];
+				raw_us = z_us = 0;
+				for (j = 0; j < w[i].n; j++)
+					raw_us += airtime_us(&m, w[i].len[j]);
+				raw_us /= w[i].n;
+				/* Interpolate the airtime of the average
+				 * compressed length between whole bytes. */
+				z_us = airtime_us(&m, (size_t)r[3].len) +
+				       (r[3].len - (size_t)r[3].len) *
+				       ((double)airtime_us(&m,
+					(size_t)r[3].len + 1) -
+					airtime_us(&m, (size_t)r[3].len));
+				printf("%2u | %6u | %6.1f | %7.1f | %8.1f "
+				       "| %4.1f%%\n", sf, bws[b],
+				       raw_us / 1000, z_us / 1000,
+				       (raw_us - z_us) / 1000,
+				       100.0 * (raw_us - z_us) / raw_us);
+			}
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/*
+ * Benchmark the RX -> TX turnaround of an echo on another radio.  Each ping
+ * is written, then its echo is read.  The turnaround is the time from the
+ * ping leaving the air to the echo read back, minus the echo's own time on
+ * air, so it is what the echo side and the RX of this side add.
+ *
+ * The echo is the lora-echo kernel module, which sends back in the RX
+ * completion path of the LoRa framework, or this program with -e, which
+ * sends back by read() and write() in user space.  For example with the
+ * virtual radios:
+ *
+ *   insmod lora-echo.ko device=/dev/loraVIRT1; echo-bench /dev/loraVIRT0
+ *   echo-bench -e /dev/loraVIRT1 & echo-bench /dev/loraVIRT0
+ */
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Get the percentile in per mille of the sorted samples in us. */
+static double percentile_us(const uint64_t *v, unsigned int n,
+			    unsigned int permil)
+{
+	unsigned int i;
+
+	if (n == 0)
+		return 0;
+	i = ((uint64_t)n * permil + 999) / 1000;
+	i = (i > 0) ? (i - 1) : 0;
+
+	return v[i] / 1e3;
+}
+
+/* Send the read packets back in user space. */
+static int do_echo(int fd, unsigned int count)
+{
+	char buf[256];
+	unsigned int n;
+	ssize_t c;
+
+	for (n = 0; (count == 0) || (n < count); ) {
+		c = do_read(fd, buf, sizeof(buf));
+		if (c <= 0)
+			continue;
+		if (do_write(fd, buf, c) == c)
+			n++;
+	}
+	printf("Echoed %u packets\n", n);
+
+	return 0;
+}
+
+/* Print the min, the percentiles and the max of the samples. */
+static void print_lat(const char *name, uint64_t *v, unsigned int n)
+{
+	qsort(v, n, sizeof(uint64_t), cmp_u64);
+	printf("%-10s %10.1f %10.1f %10.1f %10.1f\n", name,
+	       n ? v[0] / 1e3 : 0.0, percentile_us(v, n, 500),
+	       percentile_us(v, n, 990), n ? v[n - 1] / 1e3 : 0.0);
+}
+
+/* Ping the echo and measure the round trip and the turnaround. */
+static int do_ping(int fd, unsigned int count, size_t len,
+		   unsigned int interval_ms)
+{
+	struct lora_modem m;
+	char tx[256], rx[256];
+	uint64_t *rtt, *ta;
+	uint64_t t0, t1, t2, air_ns;
+	unsigned int i, n, lost;
+	uint32_t seq;
+	ssize_t c;
+
+	memset(&m, 0, sizeof(m));
+	m.sprf = get_sprfactor(fd);
+	m.bw = get_bw(fd);
+	m.cr = get_cr(fd);
+	m.prelen = 8;
+	m.implicit = get_implicit(fd) ? 1 : 0;
+	m.crc = get_crc(fd);
+	m.ldro = -1;
+	air_ns = (uint64_t)airtime_us(&m, len) * 1000;
+
+	rtt = calloc(count, sizeof(uint64_t));
+	ta = calloc(count, sizeof(uint64_t));
+	if ((rtt == NULL) || (ta == NULL))
+		return -1;
+
+	n = lost = 0;
+	for (i = 0; i < count; i++) {
+		seq = 0x45434800 + i;
+		memset(tx, 'E', len);
+		memcpy(tx, &seq, sizeof(seq));
+
+		t0 = now_ns();
+		if (do_write(fd, tx, len) != (ssize_t)len) {
+			lost++;
+			continue;
+		}
+		t1 = now_ns();
+
+		/* Skip anything else, until the echo or a time out. */
+		do {
+			c = do_read(fd, rx, sizeof(rx));
+		} while ((c > 0) && ((c != (ssize_t)len)
+				     || memcmp(rx, tx, len)));
+		t2 = now_ns();
+		if (c <= 0) {
+			lost++;
+			continue;
+		}
+
+		rtt[n] = t2 - t0;
+		ta[n] = (t2 - t1 > air_ns) ? (t2 - t1 - air_ns) : 0;
+		n++;
+		if (interval_ms > 0)
+			usleep(interval_ms * 1000);
+	}
+
+	printf("SF %u, BW %u Hz, CR 4/%u, %zu bytes, %.1f ms on air, "
+	       "%u echoed, %u lost\n", sprf2sf(m.sprf), m.bw, m.cr, len,
+	       air_ns / 1e6, n, lost);
+	printf("%-10s %10s %10s %10s %10s\n", "us", "min", "p50", "p99",
+	       "max");
+	print_lat("rtt", rtt, n);
+	print_lat("turnaround", ta, n);
+	free(rtt);
+	free(ta);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-e] [-n count] [-l len] [-i ms] device\n", name);
+	printf("  -e         echo the packets in user space, instead of "
+	       "pinging\n");
+	printf("  -n count   packets to ping or to echo, 0 for echoing "
+	       "forever (default 100)\n");
+	printf("  -l len     ping length 4 ~ 255 (default 16)\n");
+	printf("  -i ms      interval between the pings (default 0)\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count, interval_ms;
+	size_t len;
+	int echo, fd, opt, ret;
+
+	echo = 0;
+	count = 100;
+	len = 16;
+	interval_ms = 0;
+	while ((opt = getopt(argc, argv, "en:l:i:h")) != -1) {
+		switch (opt) {
+		case 'e': echo = 1;			break;
+		case 'n': count = atoi(optarg);		break;
+		case 'l': len = atoi(optarg);		break;
+		case 'i': interval_ms = atoi(optarg);	break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+	if ((optind >= argc) || (len < 4) || (len > 255)
+	    || (!echo && (count == 0))) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return -1;
+	}
+
+	ret = echo ? do_echo(fd, count) : do_ping(fd, count, len, interval_ms);
+	close(fd);
+
+	return ret;
+}
@@ -0,0 +1,309 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "lora-airtime.h"
+#include "lora-fec.h"
+
+/* Measure the FEC codecs and the goodput over a simulated lossy channel. */
+
+/* The length of the acknowledge frame which asks for the lost frames. */
+#define ACK_LEN		(LORA_FEC_HDRLEN + LORA_FEC_MAXK / 8)
+/* Give up a message after so many rounds. */
+#define MAX_ROUNDS	16
+
+/* The time for the link to turn around each round, e.g. the RX delay. */
+static uint64_t turnaround_us = 1000000;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Get the encode & decode speed of a kernel in MB/s of data symbols. */
+static void codec_speed(int kernel, unsigned int k, unsigned int m,
+			size_t len, double *enc, double *dec)
+{
+	uint8_t *buf, *orig;
+	uint8_t *data[LORA_FEC_MAXK];
+	uint8_t *repair[LORA_FEC_MAXM];
+	const uint8_t *rep[LORA_FEC_MAXM];
+	uint8_t have[LORA_FEC_MAXK];
+	uint8_t rindex[LORA_FEC_MAXM];
+	unsigned int i, n, iter;
+	double t0, t;
+
+	lora_gf_select(kernel);
+	buf = malloc((k + m) * len);
+	orig = malloc(k * len);
+	for (i = 0; i < (k + m) * len; i++)
+		buf[i] = rand();
+	for (i = 0; i < k; i++)
+		data[i] = buf + i * len;
+	for (i = 0; i < m; i++) {
+		repair[i] = buf + (k + i) * len;
+		rep[i] = repair[i];
+		rindex[i] = i;
+	}
+	memcpy(orig, buf, k * len);
+
+	/* Run for about 0.2 s each. */
+	iter = 0;
+	t0 = now_s();
+	do {
+		lora_fec_encode(k, m, (const uint8_t **)data, repair, len);
+		iter++;
+		t = now_s() - t0;
+	} while (t < 0.2);
+	*enc = (double)iter * k * len / t / 1e6;
+
+	/* The worst case, the first m data symbols lost. */
+	n = (m < k) ? m : k;
+	iter = 0;
+	t0 = now_s();
+	do {
+		memset(have, 1, k);
+		memset(have, 0, n);
+		lora_fec_decode(k, m, data, have, rep, rindex, n, len);
+		iter++;
+		t = now_s() - t0;
+	} while (t < 0.2);
+	*dec = (double)iter * k * len / t / 1e6;
+
+	if (memcmp(orig, buf, k * len))
+		printf("%s decoded wrong data\n", lora_gf_name(kernel));
+
+	free(orig);
+	free(buf);
+}
+
+/* Deliver one message over the channel with the loss rate.  Return the
+ * time spent in us, 0 for given up, and the rounds it took. */
+static uint64_t deliver(struct lora_fec *fec, struct lora_fec_rx *rx,
+			const struct lora_modem *m, double loss,
+			const uint8_t *msg, size_t len, uint8_t *frames,
+			unsigned int *rounds)
+{
+	uint8_t out[LORA_FEC_MAXMSG];
+	uint8_t got[2 * LORA_FEC_MAXK];
+	unsigned int k, need, sent, i;
+	uint64_t us = 0;
+	size_t fl;
+	ssize_t n = 0;
+	ssize_t r;
+	int nf;
+
+	nf = lora_fec_frames(fec, msg, len, frames, &fl);
+	if (nf < 0)
+		return 0;
+	k = frames[2];
+	memset(got, 0, sizeof(got));
+
+	/* The first round sends all the frames, the next rounds only as many
+	 * not yet received ones as the receiver still misses. */
+	need = nf;
+	for (*rounds = 1; *rounds <= MAX_ROUNDS; (*rounds)++) {
+		sent = 0;
+		for (i = 0; (i < (unsigned int)nf) && (sent < need); i++) {
+			if (got[i])
+				continue;
+			sent++;
+			us += airtime_us(m, fl);
+			if ((double)rand() / RAND_MAX < loss)
+				continue;
+			got[i] = 1;
+			r = lora_fec_input(rx, frames + i * fl, fl, out,
+					   sizeof(out));
+			if (r > 0)
+				n = r;
+		}
+		/* The receiver acknowledges or asks for more. */
+		us += turnaround_us + airtime_us(m, ACK_LEN);
+		if (n > 0)
+			break;
+		need = k - rx->ndata - rx->nrepair;
+	}
+
+	if ((n != (ssize_t)len) || memcmp(out, msg, len))
+		return 0;
+
+	return us;
+}
+
+/* Get the goodput over the channel in bytes / s. */
+static double goodput(const struct lora_modem *m, unsigned int overhead,
+		      double loss, size_t len, unsigned int count,
+		      double *rounds, unsigned int *failed)
+{
+	struct lora_fec fec;
+	static struct lora_fec_rx rx;
+	uint8_t *msg, *frames;
+	uint64_t us, total = 0;
+	unsigned int i, r, nr = 0;
+	size_t j;
+
+	lora_fec_init(&fec, 255, overhead);
+	lora_fec_rx_init(&rx);
+	msg = malloc(len);
+	frames = malloc(2 * LORA_FEC_MAXK * 255);
+	*failed = 0;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < len; j++)
+			msg[j] = rand();
+		us = deliver(&fec, &rx, m, loss, msg, len, frames, &r);
+		if (us == 0) {
+			(*failed)++;
+			continue;
+		}
+		total += us;
+		nr += r;
+	}
+
+	free(frames);
+	free(msg);
+
+	*rounds = (count > *failed) ? (double)nr / (count - *failed) : 0;
+
+	return (total) ? (double)(count - *failed) * len * 1e6 / total : 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-l len] [-s sf] [-b bw] [-o overhead] [-n count] "
+	       "[-t ms] [-k k]\n", name);
+	printf("  -l len       message length in bytes (default 4000)\n");
+	printf("  -s sf        spreading factor 7 ~ 12 (default 9)\n");
+	printf("  -b bw        RF bandwidth in Hz (default 125000)\n");
+	printf("  -o overhead  repair frames per 100 data frames "
+	       "(default 25)\n");
+	printf("  -n count     messages sent per loss rate (default 200)\n");
+	printf("  -t ms        turnaround time of each round in ms "
+	       "(default 1000)\n");
+	printf("  -k k         data symbols per block of the codec speed "
+	       "(default 16)\n");
+}
+
+int main(int argc, char **argv)
+{
+	/* The loss rates going to be compared. */
+	static const double losses[] = {0, 0.01, 0.02, 0.05, 0.1, 0.2, 0.3};
+	struct lora_modem m;
+	unsigned int overhead = 25;
+	unsigned int count = 200;
+	unsigned int k = 16;
+	unsigned int fa, fb;
+	double enc, dec, ga, gb, ra, rb;
+	size_t len = 4000;
+	uint32_t sf = 9;
+	size_t i;
+	int opt;
+
+	memset(&m, 0, sizeof(m));
+	m.bw = 125000;
+	m.cr = 5;
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+
+	while ((opt = getopt(argc, argv, "l:s:b:o:n:t:k:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			len = strtoul(optarg, NULL, 0);	break;
+		case 's':
+			sf = strtoul(optarg, NULL, 0);	break;
+		case 'b':
+			m.bw = strtoul(optarg, NULL, 0);	break;
+		case 'o':
+			overhead = strtoul(optarg, NULL, 0);	break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		case 't':
+			turnaround_us = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'k':
+			k = strtoul(optarg, NULL, 0);	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if ((len == 0) || (len > LORA_FEC_MAXMSG) || (sf < 7) || (sf > 12)
+		|| (count == 0) || (k == 0) || (k > LORA_FEC_MAXK)) {
+		usage(argv[0]);
+		return -1;
+	}
+	m.sprf = 1U << sf;
+	srand(1);
+
+	printf("Codec speed, k = %u, m = %u, %u bytes symbols\n",
+	       k, (k + 3) / 4, LORA_FEC_SYMMAX);
+	printf("kernel | encode MB/s | decode MB/s\n");
+	for (i = 0; i < LORA_GF_NKERNEL; i++) {
+		if (!lora_gf_supported(i))
+			continue;
+		codec_speed(i, k, (k + 3) / 4, LORA_FEC_SYMMAX, &enc, &dec);
+		printf("%6s | %11.1f | %11.1f\n", lora_gf_name(i), enc, dec);
+	}
+	printf("Selected kernel: %s\n\n", lora_gf_name(lora_gf_select(-1)));
+
+	printf("Message %zu bytes, SF%u, BW %u Hz, %u%% repair frames, "
+	       "turnaround %u ms\n", len, sf, m.bw, overhead,
+	       (unsigned int)(turnaround_us / 1000));
+	printf(" loss | ARQ B/s | rounds | failed | FEC B/s | rounds "
+	       "| failed | gain\n");
+	for (i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+		ga = goodput(&m, 0, losses[i], len, count, &ra, &fa);
+		gb = goodput(&m, overhead, losses[i], len, count, &rb, &fb);
+		printf("%4.0f%% | %7.1f | %6.2f | %6u | %7.1f | %6.2f "
+		       "| %6u | %3.0f%%\n", losses[i] * 100, ga, ra, fa,
+		       gb, rb, fb, (ga > 0) ? 100.0 * (gb / ga - 1) : 0);
+	}
+
+	return 0;
+}
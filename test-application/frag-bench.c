@@ -0,0 +1,247 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/* Compare the throughput of the fragmented messages across fragment sizes. */
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Get the time on air of a message sent as fragments in us. */
+static uint64_t message_us(const struct lora_modem *m, size_t len,
+			   size_t fsz, unsigned int *nfrag)
+{
+	uint64_t us = 0;
+	size_t off;
+	size_t n;
+
+	*nfrag = 0;
+	for (off = 0; off < len; off += n) {
+		n = (len - off < fsz) ? (len - off) : fsz;
+		us += airtime_us(m, LORA_FRAG_HDRLEN + n);
+		(*nfrag)++;
+	}
+
+	return us;
+}
+
+/* Send count messages with the fragment size and return the bytes / s. */
+static double measure(int fd, uint32_t fsz, char *buf, size_t len,
+		      unsigned int count)
+{
+	double start;
+	unsigned int i;
+	ssize_t sz;
+
+	set_frag(fd, 1, fsz, 0);
+	start = now_s();
+	for (i = 0; i < count; i++) {
+		sz = do_write(fd, buf, len);
+		if (sz != (ssize_t)len) {
+			printf("\tWrite failed at message %u\n", i);
+			break;
+		}
+	}
+
+	return i * len / (now_s() - start);
+}
+
+/* Receive messages until interrupted, and print the counters. */
+static int receive(int fd, size_t len)
+{
+	struct lora_frag_stat st;
+	char *buf;
+	ssize_t sz;
+
+	buf = malloc(len);
+	if (buf == NULL)
+		return -1;
+
+	set_frag(fd, 1, 0, 0);
+	for (;;) {
+		sz = do_read(fd, buf, len);
+		get_frag_stat(fd, &st);
+		printf("read %zd bytes | msgs %u frags %u dups %u invalid %u "
+		       "timeouts %u evicted %u lost frags %u\n",
+		       sz, st.rx_msgs, st.rx_frags, st.rx_dups, st.rx_invalid,
+		       st.rx_timeouts, st.rx_evicted, st.rx_lost);
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-l len] [-s sf] [-b bw] [-c cr] [-n count] [-r] "
+	       "[device]\n", name);
+	printf("  -l len     message length in bytes (default 4096)\n");
+	printf("  -s sf      spreading factor 7 ~ 12 (default 7)\n");
+	printf("  -b bw      RF bandwidth in Hz (default 125000)\n");
+	printf("  -c cr      coding rate denominator 5 ~ 8 (default 5)\n");
+	printf("  -n count   messages sent per fragment size on device "
+	       "(default 3)\n");
+	printf("  -r         receive and reassemble messages on device\n");
+	printf("  device     also measure on the device, e.g. "
+	       "/dev/loraSPI0.0\n");
+}
+
+int main(int argc, char **argv)
+{
+	/* The fragment sizes going to be compared. */
+	static const uint32_t fsizes[] = {16, 32, 64, 96, 128, 192, 251};
+	struct lora_modem m;
+	struct lora_frag_stat st;
+	uint64_t us;
+	uint32_t sf = 7;
+	unsigned int nfrag;
+	unsigned int count = 3;
+	size_t len = 4096;
+	size_t i;
+	char *buf;
+	char *path = NULL;
+	int rx = 0;
+	int fd = -1;
+	int opt;
+
+	memset(&m, 0, sizeof(m));
+	m.bw = 125000;
+	m.cr = 5;
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+
+	while ((opt = getopt(argc, argv, "l:s:b:c:n:rh")) != -1) {
+		switch (opt) {
+		case 'l':
+			len = strtoul(optarg, NULL, 0);	break;
+		case 's':
+			sf = strtoul(optarg, NULL, 0);	break;
+		case 'b':
+			m.bw = strtoul(optarg, NULL, 0);	break;
+		case 'c':
+			m.cr = strtoul(optarg, NULL, 0);	break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		case 'r':
+			rx = 1;				break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if ((len == 0) || (len > LORA_FRAG_MAXMSG) || (sf < 7) || (sf > 12)
+		|| (m.cr < 5) || (m.cr > 8)) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (optind < argc)
+		path = argv[optind];
+	m.sprf = 1U << sf;
+
+	buf = malloc(len);
+	if (buf == NULL)
+		return -1;
+	memset(buf, 'A', len);
+
+	if (path != NULL) {
+		fd = open(path, O_RDWR);
+		if (fd == -1) {
+			perror(path);
+			free(buf);
+			return -1;
+		}
+		set_sprfactor(fd, m.sprf);
+		set_bw(fd, m.bw);
+		set_cr(fd, m.cr);
+		set_crc(fd, m.crc);
+		if (rx)
+			return receive(fd, len);
+	}
+
+	printf("Message %zu bytes, SF%u, BW %u Hz, CR 4/%u, header %u bytes\n",
+	       len, sf, m.bw, m.cr, LORA_FRAG_HDRLEN);
+	printf("frag size | frags | airtime ms | goodput B/s | overhead");
+	if (fd != -1)
+		printf(" | measured B/s | errors");
+	printf("\n");
+
+	for (i = 0; i < sizeof(fsizes) / sizeof(fsizes[0]); i++) {
+		us = message_us(&m, len, fsizes[i], &nfrag);
+		if (nfrag > LORA_FRAG_MAXCNT)
+			continue;
+		printf("%9u | %5u | %10.1f | %11.1f | %7.1f%%", fsizes[i],
+		       nfrag, us / 1000.0, len * 1e6 / us,
+		       100.0 * (1.0 - (double)len * 1e6 / us /
+				airtime_throughput(&m, 251)));
+
+		if (fd != -1) {
+			printf(" | %12.1f",
+			       measure(fd, fsizes[i], buf, len, count));
+			get_frag_stat(fd, &st);
+			printf(" | %6u", st.tx_errors);
+		}
+		printf("\n");
+	}
+
+	if (fd != -1) {
+		/* Back to the unfragmented read & write. */
+		set_frag(fd, 0, 0, 0);
+		close(fd);
+	}
+	free(buf);
+
+	return 0;
+}
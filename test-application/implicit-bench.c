@@ -0,0 +1,199 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/* Compare the implicit header mode against the explicit header mode. */
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Send count packets with the header mode and return the packets / s. */
+static double measure(int fd, uint32_t implicit, char *buf, size_t len,
+		      unsigned int count)
+{
+	double start;
+	unsigned int i;
+	ssize_t sz;
+
+	set_implicit(fd, implicit);
+	start = now_s();
+	for (i = 0; i < count; i++) {
+		sz = do_write(fd, buf, len);
+		if (sz <= 0) {
+			printf("\tWrite failed at packet %u\n", i);
+			break;
+		}
+	}
+
+	return i / (now_s() - start);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-l len] [-b bw] [-c cr] [-p prelen] [-n count] "
+	       "[device]\n", name);
+	printf("  -l len     fixed payload length in bytes (default 16)\n");
+	printf("  -b bw      RF bandwidth in Hz (default 125000)\n");
+	printf("  -c cr      coding rate denominator 5 ~ 8 (default 5)\n");
+	printf("  -p prelen  preamble length in symbols (default 8)\n");
+	printf("  -n count   packets sent per SF and mode on device "
+	       "(default 10)\n");
+	printf("  device     also measure on the device, e.g. "
+	       "/dev/loraSPI0.0\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct lora_modem exp, imp;
+	uint32_t us_exp, us_imp;
+	uint32_t sf;
+	size_t len = 16;
+	unsigned int count = 10;
+	char buf[256];
+	char *path = NULL;
+	double pps_exp, pps_imp;
+	int fd = -1;
+	int opt;
+
+	memset(&exp, 0, sizeof(exp));
+	exp.bw = 125000;
+	exp.cr = 5;
+	exp.prelen = 8;
+	exp.crc = 1;
+	exp.ldro = -1;
+
+	while ((opt = getopt(argc, argv, "l:b:c:p:n:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			len = strtoul(optarg, NULL, 0);	break;
+		case 'b':
+			exp.bw = strtoul(optarg, NULL, 0);	break;
+		case 'c':
+			exp.cr = strtoul(optarg, NULL, 0);	break;
+		case 'p':
+			exp.prelen = strtoul(optarg, NULL, 0);	break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if ((len == 0) || (len > 255) || (exp.cr < 5) || (exp.cr > 8)) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (optind < argc)
+		path = argv[optind];
+
+	imp = exp;
+	imp.implicit = 1;
+
+	if (path != NULL) {
+		fd = open(path, O_RDWR);
+		if (fd == -1) {
+			perror(path);
+			return -1;
+		}
+		memset(buf, 'A', sizeof(buf));
+		set_bw(fd, exp.bw);
+		set_cr(fd, exp.cr);
+		set_crc(fd, exp.crc);
+	}
+
+	printf("Payload %zu bytes, BW %u Hz, CR 4/%u, preamble %u symbols\n",
+	       len, exp.bw, exp.cr, exp.prelen);
+	printf("SF | explicit us | implicit us | saved | explicit B/s "
+	       "| implicit B/s | gain");
+	if (fd != -1)
+		printf(" | measured explicit pkt/s | measured implicit pkt/s");
+	printf("\n");
+
+	for (sf = 6; sf <= 12; sf++) {
+		exp.sprf = imp.sprf = 1U << sf;
+		us_imp = airtime_us(&imp, len);
+		/* SF6 can only be used in implicit header mode. */
+		us_exp = (sf > 6) ? airtime_us(&exp, len) : 0;
+
+		if (us_exp > 0)
+			printf("%2u | %11u | %11u | ", sf, us_exp, us_imp);
+		else
+			printf("%2u | %11s | %11u | ", sf, "-", us_imp);
+		if (us_exp > 0)
+			printf("%4.1f%% | %12.1f | %12.1f | %+4.1f%%",
+			       100.0 * (us_exp - us_imp) / us_exp,
+			       airtime_throughput(&exp, len),
+			       airtime_throughput(&imp, len),
+			       100.0 * ((double)us_exp / us_imp - 1.0));
+		else
+			printf("    - | %12s | %12.1f |     -", "-",
+			       airtime_throughput(&imp, len));
+
+		if (fd != -1) {
+			set_sprfactor(fd, exp.sprf);
+			pps_exp = (sf > 6) ? measure(fd, 0, buf, len, count) : 0;
+			pps_imp = measure(fd, len, buf, len, count);
+			printf(" | %23.2f | %23.2f", pps_exp, pps_imp);
+		}
+		printf("\n");
+	}
+
+	if (fd != -1) {
+		/* Back to explicit header mode. */
+		set_implicit(fd, 0);
+		close(fd);
+	}
+
+	return 0;
+}
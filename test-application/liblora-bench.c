@@ -0,0 +1,301 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+
+#include "lora-ioctl.h"
+#include "liblora.h"
+
+/*
+ * Compare the CPU time per packet between the helpers of lora-ioctl.c, used
+ * the way send.c and receive.c use them, and liblora.  Device A sends the
+ * packets to device B, e.g. two lora-virt radios:
+ *
+ *   helpers  set the radio, select() until writable, write, set RX state,
+ *            select() until readable, read, then get RSSI and SNR, each
+ *            packet as the demo applications do
+ *   liblora  the same settings through the cache, the packets submitted to
+ *            the event loop, the signal with a single ioctl
+ */
+
+/* The settings applied for each packet. */
+static uint32_t sprf = 128;
+static uint32_t bw = 125000;
+static int32_t power = 10;
+
+static uint8_t payload[256];
+static size_t plen = 16;
+static unsigned int count = 100;
+
+/* The result of a run. */
+struct result {
+	unsigned int sent;
+	unsigned int recv;
+	unsigned long ioctls;
+	double wall_s;
+	double cpu_s;
+};
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_s(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+		+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* Wait for the fd as ready2rw() of send.c, with its 5 s time out. */
+static int wait_fd(int fd, int wr)
+{
+	struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+	fd_set fds;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	if (select(fd + 1, wr ? NULL : &fds, wr ? &fds : NULL, NULL, &tv) <= 0)
+		return 0;
+
+	return FD_ISSET(fd, &fds);
+}
+
+static void run_helpers(const char *pa, const char *pb, struct result *r)
+{
+	char buf[256];
+	double t, c;
+	unsigned int i;
+	int a, b;
+
+	a = open(pa, O_RDWR);
+	b = open(pb, O_RDWR);
+	if ((a < 0) || (b < 0)) {
+		perror("open");
+		exit(1);
+	}
+
+	t = now_s();
+	c = cpu_s();
+	for (i = 0; i < count; i++) {
+		set_sprfactor(a, sprf);
+		set_bw(a, bw);
+		set_power(a, power);
+		set_sprfactor(b, sprf);
+		set_bw(b, bw);
+		r->ioctls += 5;
+		if (!wait_fd(a, 1))
+			continue;
+		if (do_write(a, (char *)payload, plen) == (ssize_t)plen)
+			r->sent++;
+
+		set_state(b, LORA_STATE_RX);
+		r->ioctls++;
+		if (!wait_fd(b, 0))
+			continue;
+		if (do_read(b, buf, sizeof(buf)) > 0) {
+			r->recv++;
+			get_rssi(b);
+			get_snr(b);
+			r->ioctls += 2;
+		}
+	}
+	r->cpu_s = cpu_s() - c;
+	r->wall_s = now_s() - t;
+
+	close(a);
+	close(b);
+}
+
+/* The state of the liblora run shared with the callbacks. */
+struct lib_run {
+	struct lora_dev *a;
+	struct lora_dev *b;
+	struct result *r;
+	int done;
+};
+
+static void on_rx(struct lora_dev *dev, const uint8_t *buf, size_t len,
+		  void *user)
+{
+	struct lib_run *run = user;
+	struct lora_pkt_stat st;
+
+	if (lora_get_pkt_stat(dev, &st) == 0)
+		run->r->recv++;
+	run->r->ioctls++;
+	run->done = 1;
+}
+
+static void on_tx(struct lora_dev *dev, void *cookie, ssize_t result,
+		  void *user)
+{
+	struct lib_run *run = user;
+
+	if (result == (ssize_t)plen)
+		run->r->sent++;
+	else
+		run->done = 1;
+}
+
+static void run_liblora(const char *pa, const char *pb, unsigned int poll_ms,
+			struct result *r, struct lora_cache_stat *cs)
+{
+	struct lora_cache_stat csb;
+	struct lora_loop *loop;
+	struct lib_run run = {.r = r};
+	double t, c, deadline;
+	unsigned int i;
+	int err;
+
+	loop = lora_loop_new(poll_ms);
+	err = lora_open(pa, &(run.a));
+	if (err == 0)
+		err = lora_open(pb, &(run.b));
+	if ((loop == NULL) || err) {
+		err = err ? -err : errno;
+		fprintf(stderr, "liblora: %s\n", strerror(err));
+		exit(1);
+	}
+	lora_loop_add(loop, run.a, NULL, on_tx, &run);
+	lora_loop_add(loop, run.b, on_rx, NULL, &run);
+
+	t = now_s();
+	c = cpu_s();
+	for (i = 0; i < count; i++) {
+		lora_set(run.a, LORA_PARAM_SPRF, sprf);
+		lora_set(run.a, LORA_PARAM_BW, bw);
+		lora_set(run.a, LORA_PARAM_POWER, power);
+		lora_set(run.b, LORA_PARAM_SPRF, sprf);
+		lora_set(run.b, LORA_PARAM_BW, bw);
+		run.done = 0;
+		if (lora_submit(run.a, payload, plen, NULL))
+			continue;
+		/* Wait for the packet at B, as long as select() of helpers. */
+		deadline = now_s() + 10;
+		while (!run.done && (now_s() < deadline))
+			lora_loop_run(loop, 100);
+	}
+	r->cpu_s = cpu_s() - c;
+	r->wall_s = now_s() - t;
+
+	lora_cache_stat(run.a, cs);
+	lora_cache_stat(run.b, &csb);
+	r->ioctls += cs->ioctls + csb.ioctls;
+	lora_close(run.a);
+	lora_close(run.b);
+	lora_loop_free(loop);
+}
+
+static void print_result(const char *name, const struct result *r)
+{
+	printf("%-8s %6u %6u %9.2f %12.1f %10.2f\n", name, r->sent, r->recv,
+	       r->wall_s, r->recv ? r->cpu_s * 1e6 / r->recv : 0,
+	       r->sent ? (double)r->ioctls / r->sent : 0);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-n count] [-l len] [-p ms] devA devB\n", name);
+	printf("  -n count   packets of each run (default 100)\n");
+	printf("  -l len     payload length 1 ~ 255 (default 16)\n");
+	printf("  -p ms      the interval liblora polls the devices, 0 for "
+	       "the wake ups\n"
+	       "             only (default 20 as lora-spi polls)\n");
+	printf("  devA devB  A sends to B, e.g. /dev/loraVIRT0 "
+	       "/dev/loraVIRT1\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct result helpers, lib;
+	struct lora_cache_stat cs;
+	unsigned int poll_ms = 20;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:p:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		case 'l':
+			plen = strtoul(optarg, NULL, 0);	break;
+		case 'p':
+			poll_ms = strtoul(optarg, NULL, 0);	break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if ((argc - optind != 2) || (plen < 1) || (plen > 255)) {
+		usage(argv[0]);
+		return 1;
+	}
+	for (i = 0; i < plen; i++)
+		payload[i] = 'a' + i % 26;
+
+	memset(&helpers, 0, sizeof(helpers));
+	memset(&lib, 0, sizeof(lib));
+	run_helpers(argv[optind], argv[optind + 1], &helpers);
+	run_liblora(argv[optind], argv[optind + 1], poll_ms, &lib, &cs);
+
+	printf("%-8s %6s %6s %9s %12s %10s\n", "api", "sent", "recv",
+	       "wall s", "CPU us/pkt", "ioctls/pkt");
+	print_result("helpers", &helpers);
+	print_result("liblora", &lib);
+	printf("liblora cache of A: %lu hits, %lu ioctls\n", cs.hits, cs.ioctls);
+
+	return 0;
+}
@@ -0,0 +1,483 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "liblora.h"
+
+/* The max length of a LoRa packet. */
+#define LORA_PKT_MAX		256
+/* The max events handled in a run of the loop. */
+#define LORA_LOOP_EVENTS	16
+
+/* A packet waiting to be written. */
+struct lora_txreq {
+	uint8_t buf[LORA_PKT_MAX];
+	size_t len;
+	void *cookie;
+};
+
+struct lora_dev {
+	int fd;
+	char *path;
+
+	/* The last value set & the last value read back of each setting.
+	 * The driver may round a value set, so it is read back again. */
+	int32_t set_val[LORA_PARAM_NUM];
+	int32_t get_val[LORA_PARAM_NUM];
+	uint32_t set_known;
+	uint32_t get_known;
+	struct lora_cache_stat cache;
+
+	/* Served by a loop. */
+	struct lora_loop *loop;
+	struct lora_dev *next;
+	lora_rx_cb rx;
+	lora_tx_cb tx;
+	void *user;
+	uint32_t events;
+	struct lora_txreq q[LORA_TXQ_LEN];
+	unsigned int qhead;
+	unsigned int qn;
+};
+
+struct lora_loop {
+	int epfd;
+	int tfd;
+	struct lora_dev *devs;
+};
+
+/* The ioctls of each setting, 0 for none. */
+static const struct {
+	unsigned long set;
+	unsigned long get;
+} lora_param_ioc[LORA_PARAM_NUM] = {
+	[LORA_PARAM_FREQ] = {LORA_SET_FREQUENCY, LORA_GET_FREQUENCY},
+	[LORA_PARAM_POWER] = {LORA_SET_POWER, LORA_GET_POWER},
+	[LORA_PARAM_SPRF] = {LORA_SET_SPRFACTOR, LORA_GET_SPRFACTOR},
+	[LORA_PARAM_BW] = {LORA_SET_BANDWIDTH, LORA_GET_BANDWIDTH},
+	[LORA_PARAM_CR] = {LORA_SET_CODINGRATE, LORA_GET_CODINGRATE},
+	[LORA_PARAM_CRC] = {LORA_SET_CRC, LORA_GET_CRC},
+	[LORA_PARAM_IMPLICIT] = {LORA_SET_IMPLICIT, LORA_GET_IMPLICIT},
+	[LORA_PARAM_MAXPAYLOAD] = {LORA_SET_MAXPAYLOAD, 0},
+	[LORA_PARAM_STATE] = {LORA_SET_STATE, LORA_GET_STATE},
+};
+
+/* Issue an ioctl and get its -errno. */
+static int lora_ioctl(struct lora_dev *dev, unsigned long cmd, void *arg)
+{
+	return (ioctl(dev->fd, cmd, arg) < 0) ? -errno : 0;
+}
+
+int lora_open(const char *path, struct lora_dev **dev)
+{
+	struct lora_dev *d;
+	int err;
+
+	d = calloc(1, sizeof(*d));
+	if (d == NULL)
+		return -ENOMEM;
+	d->path = strdup(path);
+	d->fd = open(path, O_RDWR | O_CLOEXEC);
+	if ((d->path == NULL) || (d->fd < 0)) {
+		err = (d->path == NULL) ? -ENOMEM : -errno;
+		free(d->path);
+		free(d);
+		return err;
+	}
+
+	*dev = d;
+
+	return 0;
+}
+
+void lora_close(struct lora_dev *dev)
+{
+	if (dev == NULL)
+		return;
+	if (dev->loop != NULL)
+		lora_loop_del(dev->loop, dev);
+	close(dev->fd);
+	free(dev->path);
+	free(dev);
+}
+
+int lora_fd(const struct lora_dev *dev)
+{
+	return dev->fd;
+}
+
+const char *lora_path(const struct lora_dev *dev)
+{
+	return dev->path;
+}
+
+int lora_set(struct lora_dev *dev, enum lora_param p, int32_t v)
+{
+	int err;
+
+	if ((unsigned int)p >= LORA_PARAM_NUM)
+		return -EINVAL;
+	if ((p != LORA_PARAM_STATE) && (dev->set_known & (1U << p))
+		&& (dev->set_val[p] == v)) {
+		dev->cache.hits++;
+		return 0;
+	}
+
+	dev->cache.ioctls++;
+	err = lora_ioctl(dev, lora_param_ioc[p].set, &v);
+	/* The value is unknown after a failed set. */
+	dev->set_known &= ~(1U << p);
+	dev->get_known &= ~(1U << p);
+	if (err)
+		return err;
+	dev->set_val[p] = v;
+	dev->set_known |= 1U << p;
+
+	return 0;
+}
+
+int lora_get(struct lora_dev *dev, enum lora_param p, int32_t *v)
+{
+	int32_t val;
+	int err;
+
+	if (((unsigned int)p >= LORA_PARAM_NUM) || (lora_param_ioc[p].get == 0))
+		return -EINVAL;
+	if ((p != LORA_PARAM_STATE) && (dev->get_known & (1U << p))) {
+		dev->cache.hits++;
+		*v = dev->get_val[p];
+		return 0;
+	}
+
+	dev->cache.ioctls++;
+	err = lora_ioctl(dev, lora_param_ioc[p].get, &val);
+	if (err)
+		return err;
+	dev->get_val[p] = val;
+	dev->get_known |= 1U << p;
+	*v = val;
+
+	return 0;
+}
+
+void lora_cache_flush(struct lora_dev *dev)
+{
+	dev->set_known = 0;
+	dev->get_known = 0;
+}
+
+void lora_cache_stat(const struct lora_dev *dev, struct lora_cache_stat *st)
+{
+	*st = dev->cache;
+}
+
+ssize_t lora_send(struct lora_dev *dev, const void *buf, size_t len)
+{
+	ssize_t c;
+
+	c = write(dev->fd, buf, len);
+
+	return (c < 0) ? -errno : c;
+}
+
+ssize_t lora_recv(struct lora_dev *dev, void *buf, size_t len)
+{
+	ssize_t c;
+
+	c = read(dev->fd, buf, len);
+
+	return (c < 0) ? -errno : c;
+}
+
+int lora_get_rssi(struct lora_dev *dev, int32_t *rssi)
+{
+	return lora_ioctl(dev, LORA_GET_RSSI, rssi);
+}
+
+int lora_get_pkt_stat(struct lora_dev *dev, struct lora_pkt_stat *st)
+{
+	return lora_ioctl(dev, LORA_GET_PKTSTAT, st);
+}
+
+int lora_get_stats(struct lora_dev *dev, struct lora_stats *st)
+{
+	return lora_ioctl(dev, LORA_GET_STATS, st);
+}
+
+struct lora_loop *lora_loop_new(unsigned int poll_ms)
+{
+	struct lora_loop *loop;
+	struct itimerspec its;
+	struct epoll_event ev;
+	int err;
+
+	loop = calloc(1, sizeof(*loop));
+	if (loop == NULL)
+		return NULL;
+	loop->tfd = -1;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0)
+		goto err;
+
+	/* The timer polls the devices which do not wake up the pollers. */
+	if (poll_ms > 0) {
+		loop->tfd = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+		if (loop->tfd < 0)
+			goto err;
+		its.it_value.tv_sec = poll_ms / 1000;
+		its.it_value.tv_nsec = (poll_ms % 1000) * 1000000;
+		its.it_interval = its.it_value;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if ((timerfd_settime(loop->tfd, 0, &its, NULL) < 0)
+			|| (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->tfd,
+				      &ev) < 0))
+			goto err;
+	}
+
+	return loop;
+
+err:
+	err = errno;
+	if (loop->tfd >= 0)
+		close(loop->tfd);
+	if (loop->epfd >= 0)
+		close(loop->epfd);
+	free(loop);
+	errno = err;
+
+	return NULL;
+}
+
+void lora_loop_free(struct lora_loop *loop)
+{
+	if (loop == NULL)
+		return;
+	while (loop->devs != NULL)
+		lora_loop_del(loop, loop->devs);
+	if (loop->tfd >= 0)
+		close(loop->tfd);
+	close(loop->epfd);
+	free(loop);
+}
+
+int lora_loop_fd(const struct lora_loop *loop)
+{
+	return loop->epfd;
+}
+
+/* Wait for writing only while there are packets to be written. */
+static int lora_loop_arm(struct lora_dev *dev)
+{
+	struct epoll_event ev;
+	uint32_t events;
+
+	events = EPOLLIN | ((dev->qn > 0) ? EPOLLOUT : 0);
+	if (events == dev->events)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = dev;
+	if (epoll_ctl(dev->loop->epfd, EPOLL_CTL_MOD, dev->fd, &ev) < 0)
+		return -errno;
+	dev->events = events;
+
+	return 0;
+}
+
+int lora_loop_add(struct lora_loop *loop, struct lora_dev *dev,
+		  lora_rx_cb rx, lora_tx_cb tx, void *user)
+{
+	struct epoll_event ev;
+
+	if (dev->loop != NULL)
+		return -EBUSY;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = dev;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, dev->fd, &ev) < 0)
+		return -errno;
+
+	dev->loop = loop;
+	dev->events = ev.events;
+	dev->rx = rx;
+	dev->tx = tx;
+	dev->user = user;
+	dev->qhead = 0;
+	dev->qn = 0;
+	dev->next = loop->devs;
+	loop->devs = dev;
+
+	return 0;
+}
+
+int lora_loop_del(struct lora_loop *loop, struct lora_dev *dev)
+{
+	struct lora_dev **p;
+
+	if (dev->loop != loop)
+		return -ENOENT;
+
+	for (p = &(loop->devs); *p != dev; p = &((*p)->next));
+	*p = dev->next;
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+	dev->loop = NULL;
+	dev->next = NULL;
+
+	/* The packets not written yet are cancelled. */
+	for (; dev->qn > 0; dev->qn--) {
+		if (dev->tx != NULL)
+			dev->tx(dev, dev->q[dev->qhead].cookie, -ECANCELED,
+				dev->user);
+		dev->qhead = (dev->qhead + 1) % LORA_TXQ_LEN;
+	}
+
+	return 0;
+}
+
+int lora_submit(struct lora_dev *dev, const void *buf, size_t len,
+		void *cookie)
+{
+	struct lora_txreq *r;
+
+	if (dev->loop == NULL)
+		return -ENOTCONN;
+	if ((len == 0) || (len > LORA_PKT_MAX))
+		return -EINVAL;
+	if (dev->qn == LORA_TXQ_LEN)
+		return -EAGAIN;
+
+	r = &(dev->q[(dev->qhead + dev->qn) % LORA_TXQ_LEN]);
+	memcpy(r->buf, buf, len);
+	r->len = len;
+	r->cookie = cookie;
+	dev->qn++;
+
+	return lora_loop_arm(dev);
+}
+
+/* Run the callbacks of the device's ready events. */
+static int lora_loop_dispatch(struct lora_dev *dev, uint32_t events)
+{
+	uint8_t buf[LORA_PKT_MAX];
+	struct lora_txreq *r;
+	ssize_t c;
+	int n = 0;
+
+	if (events & (EPOLLIN | EPOLLERR)) {
+		c = read(dev->fd, buf, sizeof(buf));
+		if ((c > 0) && (dev->rx != NULL)) {
+			dev->rx(dev, buf, c, dev->user);
+			n++;
+		}
+	}
+
+	/* The callback may have removed the device from the loop. */
+	if ((dev->loop != NULL) && (events & EPOLLOUT) && (dev->qn > 0)) {
+		r = &(dev->q[dev->qhead]);
+		c = write(dev->fd, r->buf, r->len);
+		if (c < 0)
+			c = -errno;
+		dev->qhead = (dev->qhead + 1) % LORA_TXQ_LEN;
+		dev->qn--;
+		lora_loop_arm(dev);
+		if (dev->tx != NULL)
+			dev->tx(dev, r->cookie, c, dev->user);
+		n++;
+	}
+
+	return n;
+}
+
+/* Poll each device of the loop for the timer. */
+static int lora_loop_tick(struct lora_loop *loop)
+{
+	struct lora_dev *dev, *next;
+	struct pollfd pfd;
+	uint64_t exp;
+	int n = 0;
+
+	if (read(loop->tfd, &exp, sizeof(exp)) < 0)
+		return 0;
+
+	for (dev = loop->devs; dev != NULL; dev = next) {
+		next = dev->next;
+		pfd.fd = dev->fd;
+		pfd.events = dev->events;
+		pfd.revents = 0;
+		if ((poll(&pfd, 1, 0) > 0) && (pfd.revents != 0))
+			n += lora_loop_dispatch(dev, pfd.revents);
+	}
+
+	return n;
+}
+
+int lora_loop_run(struct lora_loop *loop, int timeout_ms)
+{
+	struct epoll_event ev[LORA_LOOP_EVENTS];
+	struct lora_dev *dev;
+	int i, nev, n = 0;
+
+	nev = epoll_wait(loop->epfd, ev, LORA_LOOP_EVENTS, timeout_ms);
+	if (nev < 0)
+		return (errno == EINTR) ? 0 : -errno;
+
+	for (i = 0; i < nev; i++) {
+		dev = ev[i].data.ptr;
+		if (dev == NULL)
+			n += lora_loop_tick(loop);
+		/* A callback may have removed the device from the loop. */
+		else if (dev->loop == loop)
+			n += lora_loop_dispatch(dev, ev[i].events);
+	}
+
+	return n;
+}
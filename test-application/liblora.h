@@ -0,0 +1,144 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LIBLORA_H__
+#define __LIBLORA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "lora-ioctl.h"
+
+/*
+ * A library over the LoRa character devices.  The devices are opaque
+ * handles, every function returns 0 or the length for success and a
+ * negative errno for error.  The settings are cached, so setting a value
+ * already set or getting a value already read issues no ioctl.  The event
+ * loop serves many devices from one thread with epoll: the received packets
+ * and the finished writes are passed to the callbacks, and the loop's fd can
+ * be added into the application's own epoll or poll.
+ */
+
+/* An opened LoRa device. */
+struct lora_dev;
+
+/* An event loop serving many devices. */
+struct lora_loop;
+
+/* The settings of a device. */
+enum lora_param {
+	LORA_PARAM_FREQ,	/* Carrier frequency in Hz */
+	LORA_PARAM_POWER,	/* PA output power in dBm */
+	LORA_PARAM_SPRF,	/* Spreading factor in chips / symbol */
+	LORA_PARAM_BW,		/* RF bandwidth in Hz */
+	LORA_PARAM_CR,		/* Coding rate denominator, 5 ~ 8 */
+	LORA_PARAM_CRC,		/* Payload CRC, 1 / 0 for enabled / disabled */
+	LORA_PARAM_IMPLICIT,	/* Fixed payload length, 0 for explicit header */
+	LORA_PARAM_MAXPAYLOAD,	/* Max RX payload length, it can only be set */
+	LORA_PARAM_STATE,	/* LORA_STATE_*, the driver changes it, never
+				 * cached */
+	LORA_PARAM_NUM,
+};
+
+/* How many ioctls the cache has saved. */
+struct lora_cache_stat {
+	unsigned long hits;	/* Gets & sets served without any ioctl */
+	unsigned long ioctls;	/* Gets & sets issued as ioctls */
+};
+
+/* A packet has been received by the device. */
+typedef void (*lora_rx_cb)(struct lora_dev *dev, const uint8_t *buf,
+			   size_t len, void *user);
+
+/* A submitted packet has been written, result is its length or -errno. */
+typedef void (*lora_tx_cb)(struct lora_dev *dev, void *cookie,
+			   ssize_t result, void *user);
+
+/* The max packets submitted but not written yet of a device. */
+#define LORA_TXQ_LEN		16
+
+/* Open & close a device. */
+int lora_open(const char *path, struct lora_dev **dev);
+void lora_close(struct lora_dev *dev);
+
+/* Get the fd & the path of a device. */
+int lora_fd(const struct lora_dev *dev);
+const char *lora_path(const struct lora_dev *dev);
+
+/* Set & get a setting through the cache. */
+int lora_set(struct lora_dev *dev, enum lora_param p, int32_t v);
+int lora_get(struct lora_dev *dev, enum lora_param p, int32_t *v);
+
+/* Forget the cached settings, if another process may have changed them. */
+void lora_cache_flush(struct lora_dev *dev);
+void lora_cache_stat(const struct lora_dev *dev, struct lora_cache_stat *st);
+
+/* Send & receive a packet, blocking as the device does. */
+ssize_t lora_send(struct lora_dev *dev, const void *buf, size_t len);
+ssize_t lora_recv(struct lora_dev *dev, void *buf, size_t len);
+
+/* Get the current RSSI, the last packet's signal & the counters. */
+int lora_get_rssi(struct lora_dev *dev, int32_t *rssi);
+int lora_get_pkt_stat(struct lora_dev *dev, struct lora_pkt_stat *st);
+int lora_get_stats(struct lora_dev *dev, struct lora_stats *st);
+
+/* Create & free an event loop.  The devices are polled every poll_ms,
+ * since lora-spi has no interrupt to wake up the pollers when a packet
+ * arrives; 0 relies on the wake ups only, enough for lora-virt. */
+struct lora_loop *lora_loop_new(unsigned int poll_ms);
+void lora_loop_free(struct lora_loop *loop);
+
+/* Get the loop's epoll fd, readable when lora_loop_run() has work. */
+int lora_loop_fd(const struct lora_loop *loop);
+
+/* Serve & stop serving a device with the callbacks in the loop. */
+int lora_loop_add(struct lora_loop *loop, struct lora_dev *dev,
+		  lora_rx_cb rx, lora_tx_cb tx, void *user);
+int lora_loop_del(struct lora_loop *loop, struct lora_dev *dev);
+
+/* Queue a packet to be written by the loop, -EAGAIN if the queue is full. */
+int lora_submit(struct lora_dev *dev, const void *buf, size_t len,
+		void *cookie);
+
+/* Wait up to timeout_ms, -1 for ever, and run the callbacks of the events.
+ * The callbacks may submit packets and remove devices from the loop, but
+ * not close them.  Return how many callbacks have run. */
+int lora_loop_run(struct lora_loop *loop, int timeout_ms);
+
+#endif
@@ -0,0 +1,96 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include "lora-airtime.h"
+
+/* Get the spreading factor, 6 ~ 12, of the chips / symbol. */
+uint32_t sprf2sf(uint32_t sprf)
+{
+	uint32_t sf;
+
+	for (sf = 6; (sf < 12) && ((1U << sf) < sprf); sf++);
+
+	return sf;
+}
+
+/* Get the symbol time in us. */
+double symbol_us(const struct lora_modem *m)
+{
+	return (double)(1U << sprf2sf(m->sprf)) * 1000000.0 / m->bw;
+}
+
+/* Get the time on air of a LoRa packet with len bytes payload in us.
+ * It is the formula of Semtech's SX1276/77/78/79 datasheet, 4.1.1.7. */
+uint32_t airtime_us(const struct lora_modem *m, size_t len)
+{
+	int32_t sf;
+	int32_t ldro;
+	int32_t num, den;
+	uint64_t nsym;
+	uint64_t t;
+
+	if (m->bw == 0)
+		return 0;
+
+	sf = sprf2sf(m->sprf);
+	/* LDRO is mandated when the symbol time exceeds 16 ms. */
+	ldro = (m->ldro >= 0) ? (m->ldro != 0) : (symbol_us(m) > 16000.0);
+
+	num = 8 * (int32_t)len - 4 * sf + 28 + 16 * (m->crc != 0)
+		- 20 * (m->implicit != 0);
+	den = 4 * (sf - 2 * ldro);
+	nsym = 8;
+	if (num > 0)
+		nsym += ((num + den - 1) / den) * m->cr;
+
+	/* The preamble lasts for (prelen + 4.25) symbols. */
+	t = ((uint64_t)(4 * m->prelen + 17) + 4 * nsym)
+		* ((uint64_t)1 << sf) * 1000000;
+
+	return t / (4 * (uint64_t)m->bw);
+}
+
+/* Get the max payload throughput limited by the time on air in bytes / s. */
+double airtime_throughput(const struct lora_modem *m, size_t len)
+{
+	uint32_t us;
+
+	us = airtime_us(m, len);
+
+	return (us > 0) ? (double)len * 1000000.0 / us : 0.0;
+}
@@ -0,0 +1,68 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_AIRTIME_H__
+#define __LORA_AIRTIME_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The modem settings which decide the time on air of a LoRa packet. */
+struct lora_modem {
+	uint32_t sprf;		/* Spreading factor in chips / symbol */
+	uint32_t bw;		/* RF bandwidth in Hz */
+	uint32_t cr;		/* Coding rate denominator, 5 ~ 8 */
+	uint32_t prelen;	/* Preamble length in symbols */
+	int implicit;		/* 1 / 0 for implicit / explicit header */
+	int crc;		/* 1 / 0 for with / without payload CRC */
+	int ldro;		/* Low data rate optimization, -1 for auto */
+};
+
+/* Get the spreading factor, 6 ~ 12, of the chips / symbol. */
+uint32_t sprf2sf(uint32_t sprf);
+
+/* Get the symbol time in us. */
+double symbol_us(const struct lora_modem *m);
+
+/* Get the time on air of a LoRa packet with len bytes payload in us. */
+uint32_t airtime_us(const struct lora_modem *m, size_t len);
+
+/* Get the max payload throughput limited by the time on air in bytes / s. */
+double airtime_throughput(const struct lora_modem *m, size_t len);
+
+#endif
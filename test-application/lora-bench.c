@@ -0,0 +1,607 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/*
+ * Benchmark the throughput and the latency between a pair of radios, two
+ * devices on this host or an emulated pair in this process.  The same
+ * workloads run over each combination of SF, BW, CR and payload length:
+ *
+ *   ping   A sends a frame and B echoes it, the round trip time is measured
+ *   flood  A sends back to back, the one way latency is measured at B
+ *   mixed  Like flood, but every Nth frame is echoed and A waits for it
+ */
+
+/* The frame header: type, sequence number and the send time. */
+#define HDR_LEN		13
+#define FRAME_DATA	0
+#define FRAME_PING	1
+#define FRAME_PONG	2
+
+#define MAX_LIST	8
+
+/* The emulated frames waiting to be read by a radio. */
+#define EMU_QLEN	16
+
+struct emu_frame {
+	uint8_t buf[256];
+	size_t len;
+};
+
+/* A pair of emulated radios sharing a channel. */
+struct emu_link {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct lora_modem m;
+	double loss;		/* The probability a frame is lost in the air */
+	unsigned int speed;	/* Run faster than the air by the factor */
+	unsigned int seed;
+	uint64_t busy_from[2];	/* The TX time of each radio in ns */
+	uint64_t busy_to[2];
+	struct emu_frame q[2][EMU_QLEN];
+	unsigned int qhead[2];
+	unsigned int qn[2];
+};
+
+/* One end of the pair, a device or an emulated radio. */
+struct endpoint {
+	int fd;			/* The device, -1 for the emulated radio */
+	int id;			/* The index of the emulated radio */
+	struct emu_link *link;
+};
+
+/* The latency samples in ns. */
+struct samples {
+	uint64_t *v;
+	unsigned int n;
+	unsigned int max;
+};
+
+/* The echo side running in its own thread. */
+struct responder {
+	struct endpoint *ep;
+	volatile int stop;
+	unsigned int rx;		/* How many frames have been read */
+	uint64_t rx_bytes;
+	uint64_t last_ns;		/* The time of the last frame read */
+	struct samples lat;		/* One way latency of the data frames */
+};
+
+/* The result of a workload. */
+struct result {
+	unsigned int sent;
+	unsigned int recv;
+	uint64_t bytes;
+	double elapsed;		/* In s of the air time */
+	double cpu_us;		/* CPU time per sent packet */
+	struct samples *lat;
+};
+
+/* Times the real time to get the air time, for the emulated radios. */
+static unsigned int scale = 1;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double cpu_s(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+		+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	nanosleep(&ts, NULL);
+}
+
+static void put_le(uint8_t *p, uint64_t v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		p[i] = v >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = n - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+
+	return v;
+}
+
+static void samples_add(struct samples *s, uint64_t v)
+{
+	if (s->n < s->max)
+		s->v[s->n++] = v;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Get the percentile in per mille of the sorted samples in ms. */
+static double percentile_ms(const struct samples *s, unsigned int permil)
+{
+	unsigned int i;
+
+	if (s->n == 0)
+		return 0;
+	i = ((uint64_t)s->n * permil + 999) / 1000;
+	i = (i > 0) ? (i - 1) : 0;
+
+	return s->v[i] * (double)scale / 1e6;
+}
+
+/* Configure the modem of an endpoint. */
+static void ep_config(struct endpoint *ep, const struct lora_modem *m)
+{
+	if (ep->fd < 0) {
+		pthread_mutex_lock(&(ep->link->lock));
+		ep->link->m = *m;
+		pthread_mutex_unlock(&(ep->link->lock));
+		return;
+	}
+
+	set_sprfactor(ep->fd, m->sprf);
+	set_bw(ep->fd, m->bw);
+	set_cr(ep->fd, m->cr);
+	set_crc(ep->fd, m->crc);
+	set_implicit(ep->fd, 0);
+	set_state(ep->fd, LORA_STATE_RX);
+}
+
+/* Send a frame, it returns after the frame has left the air. */
+static ssize_t ep_send(struct endpoint *ep, uint8_t *buf, size_t len)
+{
+	struct emu_link *l = ep->link;
+	struct emu_frame *f;
+	uint64_t start, air;
+	int peer = 1 - ep->id;
+	int lost;
+
+	if (ep->fd >= 0)
+		return do_write(ep->fd, (char *)buf, len);
+
+	pthread_mutex_lock(&(l->lock));
+	air = (uint64_t)airtime_us(&(l->m), len) * 1000 / l->speed;
+	start = now_ns();
+	l->busy_from[ep->id] = start;
+	l->busy_to[ep->id] = start + air;
+	pthread_mutex_unlock(&(l->lock));
+
+	sleep_ns(air);
+
+	pthread_mutex_lock(&(l->lock));
+	/* Half duplex, the peer can not hear while it is sending. */
+	lost = (l->busy_from[peer] < start + air)
+		&& (l->busy_to[peer] > start);
+	if (!lost && (l->loss > 0))
+		lost = rand_r(&(l->seed)) < l->loss * RAND_MAX;
+	if (!lost && (l->qn[peer] < EMU_QLEN)) {
+		f = &(l->q[peer][(l->qhead[peer] + l->qn[peer]) % EMU_QLEN]);
+		memcpy(f->buf, buf, len);
+		f->len = len;
+		l->qn[peer]++;
+		pthread_cond_broadcast(&(l->cond));
+	}
+	pthread_mutex_unlock(&(l->lock));
+
+	return len;
+}
+
+/* Receive a frame, 0 for nothing in the time out. */
+static ssize_t ep_recv(struct endpoint *ep, uint8_t *buf, size_t len,
+		       unsigned int timeout_ms)
+{
+	struct emu_link *l = ep->link;
+	struct emu_frame *f;
+	struct pollfd pfd;
+	struct timespec ts;
+	uint64_t end;
+	ssize_t n = 0;
+
+	if (ep->fd >= 0) {
+		pfd.fd = ep->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout_ms) <= 0)
+			return 0;
+		n = do_read(ep->fd, (char *)buf, len);
+		return (n > 0) ? n : 0;
+	}
+
+	end = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	ts.tv_sec = end / 1000000000ULL;
+	ts.tv_nsec = end % 1000000000ULL;
+	pthread_mutex_lock(&(l->lock));
+	while (l->qn[ep->id] == 0) {
+		if (pthread_cond_timedwait(&(l->cond), &(l->lock), &ts) != 0)
+			break;
+	}
+	if (l->qn[ep->id] > 0) {
+		f = &(l->q[ep->id][l->qhead[ep->id]]);
+		n = (f->len < len) ? f->len : len;
+		memcpy(buf, f->buf, n);
+		l->qhead[ep->id] = (l->qhead[ep->id] + 1) % EMU_QLEN;
+		l->qn[ep->id]--;
+	}
+	pthread_mutex_unlock(&(l->lock));
+
+	return n;
+}
+
+static void emu_init(struct emu_link *l, double loss, unsigned int speed)
+{
+	pthread_condattr_t attr;
+
+	memset(l, 0, sizeof(*l));
+	pthread_mutex_init(&(l->lock), NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(l->cond), &attr);
+	pthread_condattr_destroy(&attr);
+	l->loss = loss;
+	l->speed = speed;
+	l->seed = 1;
+}
+
+/* Echo the pings and count the data frames until stopped. */
+static void *respond(void *arg)
+{
+	struct responder *r = arg;
+	uint8_t buf[256];
+	ssize_t n;
+
+	while (!r->stop) {
+		n = ep_recv(r->ep, buf, sizeof(buf), 100);
+		if (n < HDR_LEN)
+			continue;
+		r->last_ns = now_ns();
+		r->rx++;
+		r->rx_bytes += n;
+		if (buf[0] == FRAME_PING) {
+			buf[0] = FRAME_PONG;
+			ep_send(r->ep, buf, n);
+		}
+		else if (buf[0] == FRAME_DATA) {
+			samples_add(&(r->lat),
+				    r->last_ns - get_le(buf + 5, 8));
+		}
+	}
+
+	return NULL;
+}
+
+/* Stamp the type, the sequence number and the send time on a frame. */
+static void stamp(uint8_t *buf, uint8_t type, uint32_t seq)
+{
+	buf[0] = type;
+	put_le(buf + 1, seq, 4);
+	put_le(buf + 5, now_ns(), 8);
+}
+
+/* Wait for the echo of the sequence number, return its round trip time. */
+static uint64_t wait_pong(struct endpoint *ep, uint32_t seq,
+			  unsigned int timeout_ms)
+{
+	uint8_t buf[256];
+	uint64_t end;
+	ssize_t n;
+
+	end = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	while (now_ns() < end) {
+		n = ep_recv(ep, buf, sizeof(buf), timeout_ms);
+		if ((n >= HDR_LEN) && (buf[0] == FRAME_PONG)
+			&& (get_le(buf + 1, 4) == seq))
+			return now_ns() - get_le(buf + 5, 8);
+	}
+
+	return 0;
+}
+
+/*
+ * Run a workload from A to B.  Every echo'th frame is a ping, so 1 is the
+ * ping-pong workload and 0 is the flood workload.
+ */
+static void run(struct endpoint *a, struct responder *r, size_t len,
+		unsigned int count, unsigned int echo, unsigned int timeout_ms,
+		struct result *res, struct samples *rtt)
+{
+	uint8_t buf[256];
+	uint64_t t0, t1, tend, d;
+	pthread_t th;
+	double c0;
+	unsigned int i, pongs;
+	int ping;
+
+	memset(buf, 0xA5, sizeof(buf));
+	r->stop = 0;
+	r->rx = 0;
+	r->rx_bytes = 0;
+	r->lat.n = 0;
+	rtt->n = 0;
+	pongs = 0;
+	pthread_create(&th, NULL, respond, r);
+
+	c0 = cpu_s();
+	t0 = now_ns();
+	for (i = 0; i < count; i++) {
+		ping = (echo > 0) && ((i % echo) == 0);
+		stamp(buf, ping ? FRAME_PING : FRAME_DATA, i);
+		if (ep_send(a, buf, len) != len)
+			break;
+		if (!ping)
+			continue;
+		d = wait_pong(a, i, timeout_ms);
+		if (d > 0) {
+			samples_add(rtt, d);
+			pongs++;
+		}
+	}
+	tend = now_ns();
+	/* Let the last frame arrive. */
+	sleep_ns((uint64_t)timeout_ms * 1000000ULL / 4);
+	r->stop = 1;
+	pthread_join(th, NULL);
+	t1 = (r->last_ns > tend) ? r->last_ns : tend;
+
+	res->sent = i;
+	res->recv = r->rx;
+	res->bytes = r->rx_bytes + (uint64_t)pongs * len;
+	res->elapsed = (t1 - t0) * (double)scale / 1e9;
+	res->cpu_us = (i > 0) ? (cpu_s() - c0) * 1e6 / i : 0;
+	res->lat = (echo > 0) ? rtt : &(r->lat);
+	qsort(res->lat->v, res->lat->n, sizeof(uint64_t), cmp_u64);
+}
+
+/* Parse a comma separated list of numbers. */
+static int parse_list(char *s, uint32_t *v, int max)
+{
+	char *tok;
+	int n = 0;
+
+	for (tok = strtok(s, ","); (tok != NULL) && (n < max);
+	     tok = strtok(NULL, ","))
+		v[n++] = strtoul(tok, NULL, 0);
+
+	return n;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-w workloads] [-s sf,..] [-b bw,..] [-c cr,..] "
+	       "[-l len,..] [-n count] [-m n] [-e] [-x speed] [-L loss] "
+	       "[devA devB]\n", name);
+	printf("  -w list    ping,flood,mixed (default all)\n");
+	printf("  -s sf,..   spreading factors 7 ~ 12 (default 7)\n");
+	printf("  -b bw,..   RF bandwidths in Hz (default 125000)\n");
+	printf("  -c cr,..   coding rate denominators 5 ~ 8 (default 5)\n");
+	printf("  -l len,..  payload lengths %d ~ 255 (default 16)\n",
+	       HDR_LEN);
+	printf("  -n count   packets per run (default 50)\n");
+	printf("  -m n       every nth packet of mixed is echoed "
+	       "(default 4)\n");
+	printf("  -e         use the emulated radios instead of devices\n");
+	printf("  -x speed   run the emulated air faster by the factor "
+	       "(default 1)\n");
+	printf("  -L loss    the emulated frame loss probability "
+	       "(default 0)\n");
+	printf("  devA devB  the pair of devices, e.g. /dev/loraSPI0.0 "
+	       "/dev/loraSPI0.1\n");
+	printf("The emulated times are reported in air time, the CPU time "
+	       "is not scaled.\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = {"ping", "flood", "mixed"};
+	uint32_t sfs[MAX_LIST] = {7}, bws[MAX_LIST] = {125000};
+	uint32_t crs[MAX_LIST] = {5}, lens[MAX_LIST] = {16};
+	int nsf = 1, nbw = 1, ncr = 1, nlen = 1;
+	struct endpoint a, b;
+	struct emu_link link;
+	struct responder r;
+	struct samples rtt;
+	struct result res;
+	struct lora_modem m;
+	unsigned int count = 50, mix = 4, speed = 1;
+	unsigned int timeout_ms, echo;
+	double loss = 0, limit, goodput;
+	int workloads = 7, emulate = 0;
+	int is, ib, ic, il, w, opt;
+	char *tok;
+
+	while ((opt = getopt(argc, argv, "w:s:b:c:l:n:m:ex:L:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			workloads = 0;
+			for (tok = strtok(optarg, ","); tok != NULL;
+			     tok = strtok(NULL, ","))
+				for (w = 0; w < 3; w++)
+					if (strcmp(tok, names[w]) == 0)
+						workloads |= 1 << w;
+			break;
+		case 's':
+			nsf = parse_list(optarg, sfs, MAX_LIST);	break;
+		case 'b':
+			nbw = parse_list(optarg, bws, MAX_LIST);	break;
+		case 'c':
+			ncr = parse_list(optarg, crs, MAX_LIST);	break;
+		case 'l':
+			nlen = parse_list(optarg, lens, MAX_LIST);	break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		case 'm':
+			mix = strtoul(optarg, NULL, 0);	break;
+		case 'e':
+			emulate = 1;	break;
+		case 'x':
+			speed = strtoul(optarg, NULL, 0);	break;
+		case 'L':
+			loss = strtod(optarg, NULL);	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	for (il = 0; il < nlen; il++)
+		if ((lens[il] < HDR_LEN) || (lens[il] > 255))
+			nlen = 0;
+	for (is = 0; is < nsf; is++)
+		if ((sfs[is] < 7) || (sfs[is] > 12))
+			nsf = 0;
+	for (ic = 0; ic < ncr; ic++)
+		if ((crs[ic] < 5) || (crs[ic] > 8))
+			ncr = 0;
+	if ((nsf == 0) || (nbw == 0) || (ncr == 0) || (nlen == 0)
+		|| (count == 0) || (mix == 0) || (speed == 0) || (workloads == 0)
+		|| (!emulate && (optind + 2 > argc))) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	if (emulate) {
+		emu_init(&link, loss, speed);
+		scale = speed;
+		a.fd = b.fd = -1;
+		a.link = b.link = &link;
+		b.id = 1;
+	}
+	else {
+		a.fd = open(argv[optind], O_RDWR);
+		b.fd = open(argv[optind + 1], O_RDWR);
+		if ((a.fd < 0) || (b.fd < 0)) {
+			perror("Open the devices failed");
+			return -1;
+		}
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.ep = &b;
+	r.lat.max = count;
+	r.lat.v = calloc(count, sizeof(uint64_t));
+	rtt.max = count;
+	rtt.v = calloc(count, sizeof(uint64_t));
+
+	memset(&m, 0, sizeof(m));
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+
+	printf("%-5s %2s %6s %2s %3s | %5s %5s | %7s %8s %8s %4s | %9s %9s "
+	       "%9s | %6s\n", "load", "sf", "bw", "cr", "len", "sent", "recv",
+	       "pkt/s", "B/s", "limit", "eff", "p50 ms", "p99 ms", "p999 ms",
+	       "cpu us");
+	for (is = 0; is < nsf; is++)
+	for (ib = 0; ib < nbw; ib++)
+	for (ic = 0; ic < ncr; ic++)
+	for (il = 0; il < nlen; il++) {
+		m.sprf = 1U << sfs[is];
+		m.bw = bws[ib];
+		m.cr = crs[ic];
+		ep_config(&a, &m);
+		ep_config(&b, &m);
+		/* Wait for both frames of a round trip and the turn around. */
+		timeout_ms = (2 * airtime_us(&m, lens[il]) / 1000 + 200)
+			/ scale + 10;
+		limit = airtime_throughput(&m, lens[il]);
+
+		for (w = 0; w < 3; w++) {
+			if (!(workloads & (1 << w)))
+				continue;
+			echo = (w == 0) ? 1 : ((w == 1) ? 0 : mix);
+			run(&a, &r, lens[il], count, echo, timeout_ms, &res,
+			    &rtt);
+			goodput = (res.elapsed > 0) ? res.bytes / res.elapsed
+				: 0;
+			printf("%-5s %2u %6u %2u %3u | %5u %5u | %7.2f %8.1f "
+			       "%8.1f %3.0f%% | %9.1f %9.1f %9.1f | %6.1f\n",
+			       names[w], sfs[is], bws[ib], crs[ic], lens[il],
+			       res.sent, res.recv,
+			       (res.elapsed > 0) ? res.recv / res.elapsed : 0,
+			       goodput, limit, 100 * goodput / limit,
+			       percentile_ms(res.lat, 500),
+			       percentile_ms(res.lat, 990),
+			       percentile_ms(res.lat, 999), res.cpu_us);
+		}
+	}
+
+	free(r.lat.v);
+	free(rtt.v);
+	if (!emulate) {
+		close(a.fd);
+		close(b.fd);
+	}
+
+	return 0;
+}
@@ -0,0 +1,471 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "lora-ioctl.h"
+#include "lora-compress.h"
+
+/*
+ * A compressed frame is a 1 byte header and the compressed payload.  The
+ * header holds the method in bits 7 ~ 6 and the sequence number of the
+ * frame in the stream in bits 5 ~ 0.  The frames must be sent in Explicit
+ * Header Mode, because the padding of Implicit Header Mode is not data.
+ *
+ * The payload of the LZ methods is a series of tokens:
+ *   0x00 ~ 0x7F	literal run of (token + 1) bytes which follow
+ *   0x80 ~ 0xFF	match of ((token & 0x7F) + 3) bytes copied from the
+ *			varint distance back in the window
+ * The window starts with the static dictionary, or some zeros for the XOR
+ * delta whose unchanged bytes become long zero runs.
+ */
+#define LORA_ZHDR_RAW		0
+#define LORA_ZHDR_DICT		1
+#define LORA_ZHDR_DELTA		2
+
+#define LZ_MINMATCH		3
+#define LZ_MAXMATCH		(0x7F + LZ_MINMATCH)
+#define LZ_MAXLIT		0x80
+#define LZ_HASHBITS		10
+#define LZ_CHAIN		32
+#define LZ_ZEROS		4
+#define LZ_WINDOW		(LORA_ZDICT_MAX + LORA_ZFRAME_MAX)
+
+static const char sensor_dict[] =
+	"\"lat\":\"lon\":\"alt\":\"co2\":\"pm25\":\"lux\":\"err\":null,"
+	"\"state\":\"ok\",false,true,\"rssi\":-\"snr\":\"pres\":10"
+	"\"bat\":3.\"hum\":\"temp\":2\"ts\":16\"seq\":,{\"id\":";
+
+const struct lora_zdict lora_zdict_sensor = {
+	.data = (const uint8_t *)sensor_dict,
+	.len = sizeof(sensor_dict) - 1,
+};
+
+/* Put & get an unsigned LEB128 varint, get returns 0 for bad input. */
+size_t lora_varint_put(uint8_t *out, uint64_t v)
+{
+	size_t n = 0;
+	uint8_t b;
+
+	do {
+		b = v & 0x7F;
+		v >>= 7;
+		out[n++] = b | (v ? 0x80 : 0);
+	} while (v);
+
+	return n;
+}
+
+size_t lora_varint_get(const uint8_t *in, size_t len, uint64_t *v)
+{
+	uint64_t r = 0;
+	size_t n;
+
+	for (n = 0; (n < len) && (n < 10); n++) {
+		r |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+		if (!(in[n] & 0x80)) {
+			*v = r;
+			return n + 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Pack & unpack the fields of a sensor record as zigzag varints. */
+size_t lora_record_pack(uint8_t *out, size_t outmax, const int32_t *rec,
+			const int32_t *prev, size_t n)
+{
+	uint8_t tmp[10];
+	uint64_t zz;
+	int64_t d;
+	size_t o = 0;
+	size_t k;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		d = (int64_t)rec[i] - ((prev != NULL) ? prev[i] : 0);
+		zz = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+		k = lora_varint_put(tmp, zz);
+		if (o + k > outmax)
+			return 0;
+		memcpy(out + o, tmp, k);
+		o += k;
+	}
+
+	return o;
+}
+
+size_t lora_record_unpack(const uint8_t *in, size_t len, int32_t *rec,
+			  const int32_t *prev, size_t n)
+{
+	uint64_t zz;
+	int64_t d;
+	size_t o = 0;
+	size_t k;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		k = lora_varint_get(in + o, len - o, &zz);
+		if (k == 0)
+			return 0;
+		d = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+		rec[i] = (int32_t)(((prev != NULL) ? prev[i] : 0) + d);
+		o += k;
+	}
+
+	return o;
+}
+
+static unsigned int lz_hash(const uint8_t *p)
+{
+	uint32_t v;
+
+	v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+
+	return (v * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+/* Flush the pending literals, return the new output length, 0 for full. */
+static size_t lz_literal(const uint8_t *lit, size_t n, uint8_t *out,
+			 size_t o, size_t outmax)
+{
+	size_t k;
+
+	while (n > 0) {
+		k = (n < LZ_MAXLIT) ? n : LZ_MAXLIT;
+		if (o + 1 + k > outmax)
+			return 0;
+		out[o++] = k - 1;
+		memcpy(out + o, lit, k);
+		o += k;
+		lit += k;
+		n -= k;
+	}
+
+	return o;
+}
+
+/* Encode win[pre, total) with win[0, pre) as the preceding dictionary.
+ * Return the encoded length, 0 if it does not fit in outmax. */
+static size_t lz_encode(const uint8_t *win, size_t pre, size_t total,
+			uint8_t *out, size_t outmax)
+{
+	int16_t head[1 << LZ_HASHBITS];
+	int16_t chain[LZ_WINDOW];
+	uint8_t d[10];
+	size_t i, lit, o;
+	size_t n, max, best, bestd, k;
+	int16_t p;
+	int depth;
+
+	memset(head, 0xFF, sizeof(head));
+#define LZ_INSERT(x)	do { \
+		if ((x) + 2 < total) { \
+			chain[x] = head[lz_hash(win + (x))]; \
+			head[lz_hash(win + (x))] = (x); \
+		} \
+	} while (0)
+
+	for (i = 0; i < pre; i++)
+		LZ_INSERT(i);
+
+	o = 0;
+	lit = pre;
+	i = pre;
+	while (i < total) {
+		best = 0;
+		bestd = 0;
+		if (i + LZ_MINMATCH <= total) {
+			max = total - i;
+			max = (max < LZ_MAXMATCH) ? max : LZ_MAXMATCH;
+			p = head[lz_hash(win + i)];
+			for (depth = 0; (p >= 0) && (depth < LZ_CHAIN); depth++) {
+				for (n = 0; (n < max) && (win[p + n] == win[i + n]);
+				     n++);
+				if (n > best) {
+					best = n;
+					bestd = i - p;
+					if (n == max)
+						break;
+				}
+				p = chain[p];
+			}
+		}
+
+		if (best < LZ_MINMATCH) {
+			LZ_INSERT(i);
+			i++;
+			continue;
+		}
+
+		/* Flush the literals before the match. */
+		if (i > lit) {
+			o = lz_literal(win + lit, i - lit, out, o, outmax);
+			if (o == 0)
+				return 0;
+		}
+		k = lora_varint_put(d, bestd);
+		if (o + 1 + k > outmax)
+			return 0;
+		out[o++] = 0x80 | (best - LZ_MINMATCH);
+		memcpy(out + o, d, k);
+		o += k;
+
+		for (n = 0; n < best; n++, i++)
+			LZ_INSERT(i);
+		lit = i;
+	}
+#undef LZ_INSERT
+
+	if (i > lit)
+		o = lz_literal(win + lit, i - lit, out, o, outmax);
+
+	return o;
+}
+
+/* Decode the tokens into win[pre, winmax) after the dictionary win[0, pre).
+ * Return the decoded length, -1 for a corrupted payload. */
+static ssize_t lz_decode(uint8_t *win, size_t pre, size_t winmax,
+			 const uint8_t *in, size_t len)
+{
+	uint64_t d;
+	size_t i, o, n, k;
+	uint8_t c;
+
+	i = 0;
+	o = pre;
+	while (i < len) {
+		c = in[i++];
+		if (c < 0x80) {
+			n = c + 1;
+			if ((i + n > len) || (o + n > winmax))
+				return -1;
+			memcpy(win + o, in + i, n);
+			i += n;
+			o += n;
+			continue;
+		}
+
+		n = (c & 0x7F) + LZ_MINMATCH;
+		k = lora_varint_get(in + i, len - i, &d);
+		if ((k == 0) || (d == 0) || (d > o) || (o + n > winmax))
+			return -1;
+		i += k;
+		/* The match may overlap itself, so copy byte by byte. */
+		for (; n > 0; n--, o++)
+			win[o] = win[o - d];
+	}
+
+	return o - pre;
+}
+
+/* Initial a compressed stream with the dictionary. */
+void lora_zinit(struct lora_zstream *zs, const struct lora_zdict *dict,
+		unsigned int keyint)
+{
+	memset(zs, 0, sizeof(struct lora_zstream));
+	zs->dict = dict;
+	zs->methods = LORA_ZALL;
+	zs->keyint = keyint;
+	zs->seq = LORA_ZSEQ_MOD - 1;
+}
+
+/* Keep the frame as the previous one of the stream. */
+static void lora_zupdate(struct lora_zstream *zs, const uint8_t *frame,
+			 size_t len, uint8_t seq)
+{
+	memcpy(zs->prev, frame, len);
+	zs->prevlen = len;
+	zs->seq = seq;
+	zs->valid = 1;
+}
+
+/* Compress a frame with the smallest allowed method. */
+ssize_t lora_zcompress(struct lora_zstream *zs, const uint8_t *in,
+		       size_t len, uint8_t *out, size_t outmax)
+{
+	uint8_t win[LZ_WINDOW];
+	uint8_t cdict[LORA_ZFRAME_MAX];
+	uint8_t cdelta[LORA_ZFRAME_MAX];
+	const uint8_t *best;
+	size_t bestlen;
+	size_t dlen;
+	size_t n;
+	size_t i;
+	uint8_t method;
+	uint8_t seq;
+
+	if ((len > LORA_ZFRAME_MAX - 1) || (outmax < 1))
+		return -1;
+
+	seq = (zs->seq + 1) % LORA_ZSEQ_MOD;
+	/* Not compressed is always the fallback. */
+	method = LORA_ZHDR_RAW;
+	best = in;
+	bestlen = len;
+
+	if ((zs->methods & LORA_ZDICT) && (zs->dict != NULL) && (len > 0)) {
+		dlen = zs->dict->len;
+		memcpy(win, zs->dict->data, dlen);
+		memcpy(win + dlen, in, len);
+		n = lz_encode(win, dlen, dlen + len, cdict, bestlen - 1);
+		if (n > 0) {
+			method = LORA_ZHDR_DICT;
+			best = cdict;
+			bestlen = n;
+		}
+	}
+
+	if ((zs->methods & LORA_ZDELTA) && zs->valid && (len > 0)
+		&& !(zs->keyint && (zs->since_key + 1 >= zs->keyint))) {
+		memset(win, 0, LZ_ZEROS);
+		for (i = 0; i < len; i++)
+			win[LZ_ZEROS + i] = in[i] ^
+					    ((i < zs->prevlen) ? zs->prev[i] : 0);
+		n = lz_encode(win, LZ_ZEROS, LZ_ZEROS + len, cdelta,
+			      bestlen - 1);
+		if (n > 0) {
+			method = LORA_ZHDR_DELTA;
+			best = cdelta;
+			bestlen = n;
+		}
+	}
+
+	if (1 + bestlen > outmax)
+		return -1;
+	out[0] = (method << 6) | seq;
+	memcpy(out + 1, best, bestlen);
+
+	zs->since_key = (method == LORA_ZHDR_DELTA) ? zs->since_key + 1 : 0;
+	lora_zupdate(zs, in, len, seq);
+
+	return 1 + bestlen;
+}
+
+/* Decompress a frame. */
+ssize_t lora_zdecompress(struct lora_zstream *zs, const uint8_t *in,
+			 size_t len, uint8_t *out, size_t outmax)
+{
+	uint8_t win[LZ_WINDOW];
+	const uint8_t *frame;
+	ssize_t n;
+	size_t dlen;
+	size_t i;
+	uint8_t method;
+	uint8_t seq;
+
+	if (len < 1)
+		return -1;
+	method = in[0] >> 6;
+	seq = in[0] & (LORA_ZSEQ_MOD - 1);
+
+	switch (method) {
+	case LORA_ZHDR_RAW:
+		n = len - 1;
+		frame = in + 1;
+		break;
+	case LORA_ZHDR_DICT:
+		if (zs->dict == NULL)
+			return -1;
+		dlen = zs->dict->len;
+		memcpy(win, zs->dict->data, dlen);
+		n = lz_decode(win, dlen, dlen + LORA_ZFRAME_MAX - 1,
+			      in + 1, len - 1);
+		frame = win + dlen;
+		break;
+	case LORA_ZHDR_DELTA:
+		/* The delta is useless, if the previous frame is lost. */
+		if (!zs->valid || (seq != (zs->seq + 1) % LORA_ZSEQ_MOD)) {
+			zs->valid = 0;
+			return -1;
+		}
+		memset(win, 0, LZ_ZEROS);
+		n = lz_decode(win, LZ_ZEROS, LZ_ZEROS + LORA_ZFRAME_MAX - 1,
+			      in + 1, len - 1);
+		for (i = 0; (n > 0) && (i < (size_t)n); i++)
+			win[LZ_ZEROS + i] ^= (i < zs->prevlen) ? zs->prev[i] : 0;
+		frame = win + LZ_ZEROS;
+		break;
+	default:
+		return -1;
+	}
+
+	if ((n < 0) || ((size_t)n > outmax))
+		return -1;
+	memcpy(out, frame, n);
+	lora_zupdate(zs, out, n, seq);
+
+	return n;
+}
+
+/* Write the device data compressed transparently. */
+ssize_t do_zwrite(int fd, struct lora_zstream *zs, char *buf, size_t len)
+{
+	uint8_t frame[LORA_ZFRAME_MAX];
+	ssize_t n;
+	ssize_t sz;
+
+	n = lora_zcompress(zs, (uint8_t *)buf, len, frame, sizeof(frame));
+	if (n < 0)
+		return -1;
+
+	sz = do_write(fd, (char *)frame, n);
+	if (sz != n) {
+		/* The peer does not have this frame, so no delta against it. */
+		zs->valid = 0;
+		return -1;
+	}
+
+	return len;
+}
+
+/* Read the device data decompressed transparently. */
+ssize_t do_zread(int fd, struct lora_zstream *zs, char *buf, size_t len)
+{
+	uint8_t frame[LORA_ZFRAME_MAX];
+	ssize_t sz;
+
+	sz = do_read(fd, (char *)frame, sizeof(frame));
+	if (sz <= 0)
+		return sz;
+
+	return lora_zdecompress(zs, frame, sz, (uint8_t *)buf, len);
+}
@@ -0,0 +1,111 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_COMPRESS_H__
+#define __LORA_COMPRESS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The max length of a LoRa frame, including the 1 byte header. */
+#define LORA_ZFRAME_MAX		255
+/* The max length of a static dictionary. */
+#define LORA_ZDICT_MAX		1024
+/* The sequence number of the frames in a stream wraps around at it. */
+#define LORA_ZSEQ_MOD		64
+
+/* The methods of the compressed frames. */
+#define LORA_ZRAW		(1 << 0)	/* Not compressed */
+#define LORA_ZDICT		(1 << 1)	/* LZ with the static dictionary */
+#define LORA_ZDELTA		(1 << 2)	/* XOR with the previous frame */
+#define LORA_ZALL		(LORA_ZRAW | LORA_ZDICT | LORA_ZDELTA)
+
+/* A static dictionary shared by the both sides. */
+struct lora_zdict {
+	const uint8_t *data;
+	size_t len;		/* Up to LORA_ZDICT_MAX bytes */
+};
+
+/* The state of a compressed stream, one for each direction. */
+struct lora_zstream {
+	const struct lora_zdict *dict;	/* NULL for no dictionary */
+	unsigned int methods;		/* The allowed LORA_Z* methods */
+	unsigned int keyint;		/* Send a frame without delta every
+					 * keyint frames, 0 for never */
+	unsigned int since_key;
+	uint8_t prev[LORA_ZFRAME_MAX];	/* The previous frame */
+	size_t prevlen;
+	uint8_t seq;			/* The sequence number of prev */
+	int valid;			/* prev is in sync with the peer */
+};
+
+/* The dictionary for small text sensor records like {"id":1,"temp":23.5}. */
+extern const struct lora_zdict lora_zdict_sensor;
+
+/* Initial a compressed stream with the dictionary. */
+void lora_zinit(struct lora_zstream *zs, const struct lora_zdict *dict,
+		unsigned int keyint);
+
+/* Compress a frame with the smallest allowed method.
+ * Return the length of the compressed frame, -1 for too long input. */
+ssize_t lora_zcompress(struct lora_zstream *zs, const uint8_t *in,
+		       size_t len, uint8_t *out, size_t outmax);
+
+/* Decompress a frame.  Return the length of the original frame, -1 for a
+ * corrupted frame or a delta frame whose previous frame is lost. */
+ssize_t lora_zdecompress(struct lora_zstream *zs, const uint8_t *in,
+			 size_t len, uint8_t *out, size_t outmax);
+
+/* Write & read the device data compressed transparently. */
+ssize_t do_zwrite(int fd, struct lora_zstream *zs, char *buf, size_t len);
+ssize_t do_zread(int fd, struct lora_zstream *zs, char *buf, size_t len);
+
+/* Put & get an unsigned LEB128 varint, get returns 0 for bad input. */
+size_t lora_varint_put(uint8_t *out, uint64_t v);
+size_t lora_varint_get(const uint8_t *in, size_t len, uint64_t *v);
+
+/* Pack & unpack n fields of a sensor record as zigzag varints of the
+ * differences from the previous record, NULL prev for absolute values.
+ * Return the packed length, 0 for no room or bad input. */
+size_t lora_record_pack(uint8_t *out, size_t outmax, const int32_t *rec,
+			const int32_t *prev, size_t n);
+size_t lora_record_unpack(const uint8_t *in, size_t len, int32_t *rec,
+			  const int32_t *prev, size_t n);
+
+#endif
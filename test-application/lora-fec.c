@@ -0,0 +1,687 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LORA_GF_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LORA_GF_ARM
+#endif
+
+#include "lora-ioctl.h"
+#include "lora-fec.h"
+
+/*
+ * A block of k data frames is followed by m repair frames.  Repair symbol r
+ * is the sum of C[r][j] * data[j] over the data symbols, where C is the
+ * Cauchy matrix C[r][j] = 1 / ((k + r) ^ j).  Every square sub matrix of a
+ * Cauchy matrix is invertible, so any k of the k + m frames recover the
+ * block.  All the work is dst ^= c * src over a symbol, which the SIMD
+ * kernels do 16 or 32 bytes at once by looking up the products of the low
+ * and the high nibbles with a byte shuffle.
+ */
+#define LORA_GF_POLY		0x11D
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t gf_mul_tbl[256][256];
+static int gf_ready;
+
+typedef void (*gf_kernel_t)(uint8_t *, const uint8_t *, uint8_t, size_t);
+
+static void gf_init(void)
+{
+	unsigned int i, j, x;
+
+	if (gf_ready)
+		return;
+
+	x = 1;
+	for (i = 0; i < 255; i++) {
+		gf_exp[i] = x;
+		gf_exp[i + 255] = x;
+		gf_log[x] = i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= LORA_GF_POLY;
+	}
+	gf_exp[510] = gf_exp[0];
+	gf_exp[511] = gf_exp[1];
+
+	for (i = 0; i < 256; i++)
+		for (j = 0; j < 256; j++)
+			gf_mul_tbl[i][j] = (i && j) ?
+				gf_exp[gf_log[i] + gf_log[j]] : 0;
+
+	gf_ready = 1;
+}
+
+uint8_t lora_gf_mul(uint8_t a, uint8_t b)
+{
+	gf_init();
+
+	return gf_mul_tbl[a][b];
+}
+
+uint8_t lora_gf_inv(uint8_t a)
+{
+	gf_init();
+
+	return (a) ? gf_exp[255 - gf_log[a]] : 0;
+}
+
+/* The products of c and the low & the high nibbles for the shuffles. */
+static void gf_nibbles(uint8_t c, uint8_t *lo, uint8_t *hi)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		lo[i] = gf_mul_tbl[c][i];
+		hi[i] = gf_mul_tbl[c][i << 4];
+	}
+}
+
+static void gf_muladd_scalar(uint8_t *dst, const uint8_t *src, uint8_t c,
+			     size_t len)
+{
+	const uint8_t *t = gf_mul_tbl[c];
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		dst[i] ^= t[src[i]];
+}
+
+#ifdef LORA_GF_X86
+__attribute__((target("ssse3")))
+static void gf_muladd_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c,
+			    size_t len)
+{
+	uint8_t lo[16], hi[16];
+	__m128i tlo, thi, mask, v, l, h, d;
+	size_t i;
+
+	gf_nibbles(c, lo, hi);
+	tlo = _mm_loadu_si128((const __m128i *)lo);
+	thi = _mm_loadu_si128((const __m128i *)hi);
+	mask = _mm_set1_epi8(0x0F);
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		l = _mm_and_si128(v, mask);
+		h = _mm_and_si128(_mm_srli_epi64(v, 4), mask);
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		d = _mm_xor_si128(d, _mm_shuffle_epi8(tlo, l));
+		d = _mm_xor_si128(d, _mm_shuffle_epi8(thi, h));
+		_mm_storeu_si128((__m128i *)(dst + i), d);
+	}
+
+	gf_muladd_scalar(dst + i, src + i, c, len - i);
+}
+
+__attribute__((target("avx2")))
+static void gf_muladd_avx2(uint8_t *dst, const uint8_t *src, uint8_t c,
+			   size_t len)
+{
+	uint8_t lo[16], hi[16];
+	__m256i tlo, thi, mask, v, l, h, d;
+	size_t i;
+
+	gf_nibbles(c, lo, hi);
+	tlo = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)lo));
+	thi = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)hi));
+	mask = _mm256_set1_epi8(0x0F);
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(src + i));
+		l = _mm256_and_si256(v, mask);
+		h = _mm256_and_si256(_mm256_srli_epi64(v, 4), mask);
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		d = _mm256_xor_si256(d, _mm256_shuffle_epi8(tlo, l));
+		d = _mm256_xor_si256(d, _mm256_shuffle_epi8(thi, h));
+		_mm256_storeu_si256((__m256i *)(dst + i), d);
+	}
+
+	/* The 128 bits tail stays in VEX encoding, mixing it with the legacy
+	 * SSE kernel costs a state transition on every symbol. */
+	if (i + 16 <= len) {
+		__m128i v1, l1, h1, d1;
+
+		v1 = _mm_loadu_si128((const __m128i *)(src + i));
+		l1 = _mm_and_si128(v1, _mm256_castsi256_si128(mask));
+		h1 = _mm_and_si128(_mm_srli_epi64(v1, 4),
+				   _mm256_castsi256_si128(mask));
+		d1 = _mm_loadu_si128((const __m128i *)(dst + i));
+		d1 = _mm_xor_si128(d1, _mm_shuffle_epi8(
+					_mm256_castsi256_si128(tlo), l1));
+		d1 = _mm_xor_si128(d1, _mm_shuffle_epi8(
+					_mm256_castsi256_si128(thi), h1));
+		_mm_storeu_si128((__m128i *)(dst + i), d1);
+		i += 16;
+	}
+
+	gf_muladd_scalar(dst + i, src + i, c, len - i);
+}
+#endif
+
+#ifdef LORA_GF_ARM
+static void gf_muladd_neon(uint8_t *dst, const uint8_t *src, uint8_t c,
+			   size_t len)
+{
+	uint8_t lo[16], hi[16];
+	uint8x16_t tlo, thi, mask, v, l, h, d;
+#ifndef __aarch64__
+	uint8x8x2_t tl, th;
+#endif
+	size_t i;
+
+	gf_nibbles(c, lo, hi);
+	tlo = vld1q_u8(lo);
+	thi = vld1q_u8(hi);
+#ifndef __aarch64__
+	tl.val[0] = vget_low_u8(tlo);
+	tl.val[1] = vget_high_u8(tlo);
+	th.val[0] = vget_low_u8(thi);
+	th.val[1] = vget_high_u8(thi);
+#endif
+	mask = vdupq_n_u8(0x0F);
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = vld1q_u8(src + i);
+		l = vandq_u8(v, mask);
+		h = vshrq_n_u8(v, 4);
+		d = vld1q_u8(dst + i);
+#ifdef __aarch64__
+		d = veorq_u8(d, vqtbl1q_u8(tlo, l));
+		d = veorq_u8(d, vqtbl1q_u8(thi, h));
+#else
+		/* ARMv7 looks up 8 bytes at once from a pair of D registers. */
+		d = veorq_u8(d, vcombine_u8(vtbl2_u8(tl, vget_low_u8(l)),
+					    vtbl2_u8(tl, vget_high_u8(l))));
+		d = veorq_u8(d, vcombine_u8(vtbl2_u8(th, vget_low_u8(h)),
+					    vtbl2_u8(th, vget_high_u8(h))));
+#endif
+		vst1q_u8(dst + i, d);
+	}
+
+	gf_muladd_scalar(dst + i, src + i, c, len - i);
+}
+#endif
+
+static const char *gf_names[LORA_GF_NKERNEL] = {
+	"scalar", "ssse3", "avx2", "neon",
+};
+
+static gf_kernel_t gf_kernels[LORA_GF_NKERNEL] = {
+	gf_muladd_scalar,
+#ifdef LORA_GF_X86
+	gf_muladd_ssse3,
+	gf_muladd_avx2,
+#else
+	NULL,
+	NULL,
+#endif
+#ifdef LORA_GF_ARM
+	gf_muladd_neon,
+#else
+	NULL,
+#endif
+};
+
+static gf_kernel_t gf_muladd;
+
+const char *lora_gf_name(int kernel)
+{
+	if ((kernel < 0) || (kernel >= LORA_GF_NKERNEL))
+		return "none";
+
+	return gf_names[kernel];
+}
+
+int lora_gf_supported(int kernel)
+{
+	if ((kernel < 0) || (kernel >= LORA_GF_NKERNEL))
+		return 0;
+	if (gf_kernels[kernel] == NULL)
+		return 0;
+
+#ifdef LORA_GF_X86
+	__builtin_cpu_init();
+	if (kernel == LORA_GF_SSSE3)
+		return __builtin_cpu_supports("ssse3");
+	if (kernel == LORA_GF_AVX2)
+		return __builtin_cpu_supports("avx2");
+#endif
+
+	return 1;
+}
+
+int lora_gf_select(int kernel)
+{
+	int k;
+
+	gf_init();
+
+	if (kernel < 0) {
+		/* The kernels are listed from the slowest one. */
+		for (k = LORA_GF_NKERNEL - 1; k > 0; k--)
+			if (lora_gf_supported(k))
+				break;
+		kernel = k;
+	}
+	if (!lora_gf_supported(kernel))
+		return -1;
+
+	gf_muladd = gf_kernels[kernel];
+
+	return kernel;
+}
+
+void lora_gf_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	if (gf_muladd == NULL)
+		lora_gf_select(-1);
+
+	if (c == 0)
+		return;
+	if (c == 1) {
+		size_t i;
+
+		for (i = 0; i < len; i++)
+			dst[i] ^= src[i];
+		return;
+	}
+
+	gf_muladd(dst, src, c, len);
+}
+
+/* The Cauchy coefficient of repair symbol r over data symbol j. */
+static uint8_t fec_coef(unsigned int k, unsigned int r, unsigned int j)
+{
+	return lora_gf_inv((k + r) ^ j);
+}
+
+static int fec_valid(unsigned int k, unsigned int m)
+{
+	return (k > 0) && (k <= LORA_FEC_MAXK) && (m <= LORA_FEC_MAXM);
+}
+
+int lora_fec_encode(unsigned int k, unsigned int m, const uint8_t **data,
+		    uint8_t **repair, size_t len)
+{
+	unsigned int r, j;
+
+	if (!fec_valid(k, m))
+		return -1;
+
+	for (r = 0; r < m; r++) {
+		memset(repair[r], 0, len);
+		for (j = 0; j < k; j++)
+			lora_gf_muladd(repair[r], data[j], fec_coef(k, r, j),
+				       len);
+	}
+
+	return 0;
+}
+
+/* Invert the n x n matrix a into b with Gauss-Jordan elimination. */
+static int fec_invert(uint8_t *a, uint8_t *b, unsigned int n)
+{
+	unsigned int i, j, c, p;
+	uint8_t t, f;
+
+	memset(b, 0, n * n);
+	for (i = 0; i < n; i++)
+		b[i * n + i] = 1;
+
+	for (c = 0; c < n; c++) {
+		for (p = c; p < n; p++)
+			if (a[p * n + c])
+				break;
+		if (p == n)
+			return -1;
+		if (p != c) {
+			for (j = 0; j < n; j++) {
+				t = a[p * n + j];
+				a[p * n + j] = a[c * n + j];
+				a[c * n + j] = t;
+				t = b[p * n + j];
+				b[p * n + j] = b[c * n + j];
+				b[c * n + j] = t;
+			}
+		}
+
+		f = lora_gf_inv(a[c * n + c]);
+		for (j = 0; j < n; j++) {
+			a[c * n + j] = lora_gf_mul(a[c * n + j], f);
+			b[c * n + j] = lora_gf_mul(b[c * n + j], f);
+		}
+
+		for (i = 0; i < n; i++) {
+			if ((i == c) || (a[i * n + c] == 0))
+				continue;
+			f = a[i * n + c];
+			for (j = 0; j < n; j++) {
+				a[i * n + j] ^= lora_gf_mul(f, a[c * n + j]);
+				b[i * n + j] ^= lora_gf_mul(f, b[c * n + j]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int lora_fec_decode(unsigned int k, unsigned int m, uint8_t **data,
+		    const uint8_t *have, const uint8_t **repair,
+		    const uint8_t *rindex, unsigned int nrepair, size_t len)
+{
+	uint8_t miss[LORA_FEC_MAXK];
+	uint8_t *a, *b, *syn;
+	unsigned int nmiss, i, j;
+	int ret = -1;
+
+	if (!fec_valid(k, m))
+		return -1;
+
+	nmiss = 0;
+	for (j = 0; j < k; j++)
+		if (!have[j])
+			miss[nmiss++] = j;
+	if (nmiss == 0)
+		return 0;
+	if (nrepair < nmiss)
+		return -1;
+
+	a = malloc(nmiss * nmiss);
+	b = malloc(nmiss * nmiss);
+	syn = malloc(nmiss * len);
+	if ((a == NULL) || (b == NULL) || (syn == NULL))
+		goto out;
+
+	/* Take off the received data from the first nmiss repair symbols,
+	 * leaving the sums over the missing data only. */
+	for (i = 0; i < nmiss; i++) {
+		if (rindex[i] >= m)
+			goto out;
+		memcpy(syn + i * len, repair[i], len);
+		for (j = 0; j < k; j++)
+			if (have[j])
+				lora_gf_muladd(syn + i * len, data[j],
+					       fec_coef(k, rindex[i], j), len);
+		for (j = 0; j < nmiss; j++)
+			a[i * nmiss + j] = fec_coef(k, rindex[i], miss[j]);
+	}
+
+	if (fec_invert(a, b, nmiss) < 0)
+		goto out;
+
+	for (i = 0; i < nmiss; i++) {
+		memset(data[miss[i]], 0, len);
+		for (j = 0; j < nmiss; j++)
+			lora_gf_muladd(data[miss[i]], syn + j * len,
+				       b[i * nmiss + j], len);
+	}
+	ret = nmiss;
+
+out:
+	free(a);
+	free(b);
+	free(syn);
+
+	return ret;
+}
+
+void lora_fec_init(struct lora_fec *fec, size_t frame, unsigned int overhead)
+{
+	if ((frame <= LORA_FEC_HDRLEN) || (frame > 255))
+		frame = 255;
+	fec->frame = frame;
+	fec->overhead = overhead;
+	fec->block = 0;
+}
+
+void lora_fec_rx_init(struct lora_fec_rx *rx)
+{
+	memset(rx, 0, sizeof(struct lora_fec_rx));
+}
+
+int lora_fec_frames(struct lora_fec *fec, const uint8_t *msg, size_t len,
+		    uint8_t *out, size_t *framelen)
+{
+	const uint8_t *data[LORA_FEC_MAXK];
+	uint8_t *repair[LORA_FEC_MAXM];
+	size_t maxsym, symlen, fl, total;
+	unsigned int k, m, i;
+	uint8_t *f;
+
+	maxsym = fec->frame - LORA_FEC_HDRLEN;
+	total = len + 2;
+	k = (total + maxsym - 1) / maxsym;
+	if ((len > LORA_FEC_MAXMSG) || (k > LORA_FEC_MAXK))
+		return -1;
+	/* Spread the message evenly, so short messages get short frames. */
+	symlen = (total + k - 1) / k;
+	fl = LORA_FEC_HDRLEN + symlen;
+	m = (k * fec->overhead + 99) / 100;
+	if (m > LORA_FEC_MAXM)
+		m = LORA_FEC_MAXM;
+
+	memset(out, 0, (k + m) * fl);
+	for (i = 0; i < k + m; i++) {
+		f = out + i * fl;
+		f[0] = fec->block;
+		f[1] = i;
+		f[2] = k;
+		f[3] = m;
+		if (i < k)
+			data[i] = f + LORA_FEC_HDRLEN;
+		else
+			repair[i - k] = f + LORA_FEC_HDRLEN;
+	}
+
+	/* The data symbols are the length prefixed message with zero
+	 * padding in the last one. */
+	f = out + LORA_FEC_HDRLEN;
+	f[0] = len >> 8;
+	f[1] = len & 0xFF;
+	for (i = 0; i < len; i++) {
+		size_t p = i + 2;
+
+		out[(p / symlen) * fl + LORA_FEC_HDRLEN + p % symlen] = msg[i];
+	}
+
+	lora_fec_encode(k, m, data, repair, symlen);
+
+	fec->block++;
+	*framelen = fl;
+
+	return k + m;
+}
+
+/* Put the data symbols of a complete block together into the message. */
+static ssize_t fec_deliver(struct lora_fec_rx *rx, uint8_t *out,
+			   size_t outmax)
+{
+	uint8_t *data[LORA_FEC_MAXK];
+	const uint8_t *repair[LORA_FEC_MAXK];
+	size_t len, i, p;
+	unsigned int j;
+	int n;
+
+	for (j = 0; j < rx->k; j++)
+		data[j] = rx->data[j];
+	for (j = 0; j < rx->nrepair; j++)
+		repair[j] = rx->repair[j];
+
+	n = lora_fec_decode(rx->k, rx->m, data, rx->have, repair, rx->rindex,
+			    rx->nrepair, rx->symlen);
+	if (n < 0)
+		return 0;
+
+	rx->done = 1;
+	rx->stat.blocks++;
+	if (n > 0) {
+		rx->stat.repaired++;
+		rx->stat.symbols += n;
+	}
+
+	len = (rx->data[0][0] << 8) | rx->data[0][1];
+	if ((len + 2 > rx->k * rx->symlen) || (len > outmax))
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		p = i + 2;
+		out[i] = rx->data[p / rx->symlen][p % rx->symlen];
+	}
+
+	return len;
+}
+
+ssize_t lora_fec_input(struct lora_fec_rx *rx, const uint8_t *frame,
+		       size_t len, uint8_t *out, size_t outmax)
+{
+	unsigned int idx, k, m;
+	size_t symlen;
+
+	if (len <= LORA_FEC_HDRLEN) {
+		rx->stat.invalid++;
+		return -1;
+	}
+	idx = frame[1];
+	k = frame[2];
+	m = frame[3];
+	symlen = len - LORA_FEC_HDRLEN;
+	if (!fec_valid(k, m) || (idx >= k + m)) {
+		rx->stat.invalid++;
+		return -1;
+	}
+
+	/* A new block gives up the one in flight. */
+	if (!rx->active || (frame[0] != rx->block)) {
+		if (rx->active && !rx->done)
+			rx->stat.lost++;
+		rx->active = 1;
+		rx->done = 0;
+		rx->block = frame[0];
+		rx->k = k;
+		rx->m = m;
+		rx->symlen = symlen;
+		rx->ndata = 0;
+		rx->nrepair = 0;
+		memset(rx->have, 0, sizeof(rx->have));
+	}
+	else if ((k != rx->k) || (m != rx->m) || (symlen != rx->symlen)) {
+		rx->stat.invalid++;
+		return -1;
+	}
+
+	if (rx->done)
+		return 0;
+
+	if (idx < k) {
+		if (rx->have[idx])
+			return 0;
+		memcpy(rx->data[idx], frame + LORA_FEC_HDRLEN, symlen);
+		rx->have[idx] = 1;
+		rx->ndata++;
+	}
+	else {
+		/* Only k - ndata repair frames are ever needed. */
+		if (rx->nrepair >= k)
+			return 0;
+		memcpy(rx->repair[rx->nrepair], frame + LORA_FEC_HDRLEN,
+		       symlen);
+		rx->rindex[rx->nrepair] = idx - k;
+		rx->nrepair++;
+	}
+
+	if (rx->ndata + rx->nrepair < k)
+		return 0;
+
+	return fec_deliver(rx, out, outmax);
+}
+
+/* Write the device data with the FEC framing transparently. */
+ssize_t do_fec_write(int fd, struct lora_fec *fec, char *buf, size_t len)
+{
+	uint8_t *frames;
+	size_t fl;
+	ssize_t sz;
+	int n, i;
+
+	frames = malloc(2 * LORA_FEC_MAXK * 255);
+	if (frames == NULL)
+		return -1;
+
+	n = lora_fec_frames(fec, (uint8_t *)buf, len, frames, &fl);
+	for (i = 0; i < n; i++) {
+		sz = do_write(fd, (char *)(frames + i * fl), fl);
+		if (sz != (ssize_t)fl) {
+			n = -1;
+			break;
+		}
+	}
+
+	free(frames);
+
+	return (n < 0) ? -1 : (ssize_t)len;
+}
+
+/* Read the device data with the FEC framing transparently. */
+ssize_t do_fec_read(int fd, struct lora_fec_rx *rx, char *buf, size_t len)
+{
+	uint8_t frame[255];
+	ssize_t sz;
+	ssize_t n;
+
+	do {
+		sz = do_read(fd, (char *)frame, sizeof(frame));
+		if (sz <= 0)
+			return sz;
+		n = lora_fec_input(rx, frame, sz, (uint8_t *)buf, len);
+	} while (n <= 0);
+
+	return n;
+}
@@ -0,0 +1,144 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#ifndef __LORA_FEC_H__
+#define __LORA_FEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The FEC header in front of each frame: block, index, k, m. */
+#define LORA_FEC_HDRLEN		4
+/* The max data & repair frames in a block. */
+#define LORA_FEC_MAXK		64
+#define LORA_FEC_MAXM		64
+/* The max symbol length, a frame without the FEC header. */
+#define LORA_FEC_SYMMAX		(255 - LORA_FEC_HDRLEN)
+/* A message is prefixed with its 2 bytes length before splitted. */
+#define LORA_FEC_MAXMSG		(LORA_FEC_MAXK * LORA_FEC_SYMMAX - 2)
+
+/* The GF(256) multiply-accumulate kernels. */
+enum {
+	LORA_GF_SCALAR,
+	LORA_GF_SSSE3,
+	LORA_GF_AVX2,
+	LORA_GF_NEON,
+	LORA_GF_NKERNEL,
+};
+
+/* Get the name of a kernel. */
+const char *lora_gf_name(int kernel);
+/* Check the kernel is built in and supported by this CPU. */
+int lora_gf_supported(int kernel);
+/* Select a kernel, -1 for the fastest supported one.
+ * Return the selected kernel, -1 for not supported. */
+int lora_gf_select(int kernel);
+
+/* Multiply & inverse in GF(256) with the polynomial 0x11D. */
+uint8_t lora_gf_mul(uint8_t a, uint8_t b);
+uint8_t lora_gf_inv(uint8_t a);
+/* dst[i] ^= c * src[i] with the selected kernel. */
+void lora_gf_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+/* Encode m repair symbols from k data symbols with a systematic Cauchy
+ * Reed-Solomon code.  Any k of the k + m symbols recover the data.
+ * Return 0 for OK, -1 for bad k or m. */
+int lora_fec_encode(unsigned int k, unsigned int m, const uint8_t **data,
+		    uint8_t **repair, size_t len);
+
+/* Recover the missing data symbols in place.  have[j] tells data[j] is
+ * received, repair[r] is the received repair symbol of index rindex[r].
+ * Return the number of recovered symbols, -1 for not enough symbols. */
+int lora_fec_decode(unsigned int k, unsigned int m, uint8_t **data,
+		    const uint8_t *have, const uint8_t **repair,
+		    const uint8_t *rindex, unsigned int nrepair, size_t len);
+
+/* The sender side of the FEC framing. */
+struct lora_fec {
+	size_t frame;		/* Max frame length, up to 255 */
+	unsigned int overhead;	/* Repair frames per 100 data frames */
+	uint8_t block;		/* The next block number */
+};
+
+/* The statistics of the receiver side. */
+struct lora_fec_stat {
+	unsigned int blocks;	/* Blocks delivered */
+	unsigned int repaired;	/* Blocks needed the repair frames */
+	unsigned int symbols;	/* Data frames recovered by repair frames */
+	unsigned int lost;	/* Blocks given up for a newer block */
+	unsigned int invalid;	/* Frames with a bad FEC header */
+};
+
+/* The receiver side of the FEC framing, one block in flight. */
+struct lora_fec_rx {
+	int active;
+	int done;
+	uint8_t block;
+	unsigned int k, m;
+	size_t symlen;
+	unsigned int ndata;
+	uint8_t have[LORA_FEC_MAXK];
+	uint8_t data[LORA_FEC_MAXK][LORA_FEC_SYMMAX];
+	unsigned int nrepair;
+	uint8_t rindex[LORA_FEC_MAXK];
+	uint8_t repair[LORA_FEC_MAXK][LORA_FEC_SYMMAX];
+	struct lora_fec_stat stat;
+};
+
+/* Initial the sender & the receiver side. */
+void lora_fec_init(struct lora_fec *fec, size_t frame, unsigned int overhead);
+void lora_fec_rx_init(struct lora_fec_rx *rx);
+
+/* Split a message into the data & repair frames of one block.
+ * The frames are put one after another in out with *framelen bytes each,
+ * out must have room for 2 * LORA_FEC_MAXK frames of 255 bytes.
+ * Return the number of frames, -1 for too long message. */
+int lora_fec_frames(struct lora_fec *fec, const uint8_t *msg, size_t len,
+		    uint8_t *out, size_t *framelen);
+
+/* Feed a received frame.  Return the length of the message put in out when
+ * the block completes, 0 for more frames needed, -1 for a bad frame. */
+ssize_t lora_fec_input(struct lora_fec_rx *rx, const uint8_t *frame,
+		       size_t len, uint8_t *out, size_t outmax);
+
+/* Write & read the device data with the FEC framing transparently. */
+ssize_t do_fec_write(int fd, struct lora_fec *fec, char *buf, size_t len);
+ssize_t do_fec_read(int fd, struct lora_fec_rx *rx, char *buf, size_t len);
+
+#endif
@@ -156,3 +156,146 @@ uint32_t get_bw(int fd)
 
 	return bw;
 }
+
+/* Set the start time of the next written packet & get the TX status. */
+int set_txtime(int fd, uint32_t clockid, int64_t time_ns)
+{
+	struct lora_txtime req = {
+		.time_ns = time_ns,
+		.clockid = clockid,
+		.flags = 0,
+	};
+
+	return ioctl(fd, LORA_SET_TXTIME, &req);
+}
+
+int get_txtime_status(int fd, struct lora_txtime_status *st)
+{
+	return ioctl(fd, LORA_GET_TXTIME, st);
+}
+
+/* Set the RX windows after each TX & get the last windows' result. */
+int set_rxwin(int fd, const struct lora_rxwin *rxw)
+{
+	return ioctl(fd, LORA_SET_RXWIN, rxw);
+}
+
+int get_rxwin_status(int fd, struct lora_rxwin_status *st)
+{
+	return ioctl(fd, LORA_GET_RXWIN, st);
+}
+
+/* Set & get the coding rate denominator, 5 ~ 8 for 4/5 ~ 4/8. */
+void set_cr(int fd, uint32_t cr)
+{
+	ioctl(fd, LORA_SET_CODINGRATE, &cr);
+}
+
+uint32_t get_cr(int fd)
+{
+	uint32_t cr;
+
+	ioctl(fd, LORA_GET_CODINGRATE, &cr);
+
+	return cr;
+}
+
+/* Set & get the payload CRC, 1 / 0 for enabled / disabled. */
+void set_crc(int fd, uint32_t yesno)
+{
+	ioctl(fd, LORA_SET_CRC, &yesno);
+}
+
+uint32_t get_crc(int fd)
+{
+	uint32_t yesno;
+
+	ioctl(fd, LORA_GET_CRC, &yesno);
+
+	return yesno;
+}
+
+/* Set & get the fixed payload length, 0 for explicit header mode. */
+void set_implicit(int fd, uint32_t len)
+{
+	ioctl(fd, LORA_SET_IMPLICIT, &len);
+}
+
+uint32_t get_implicit(int fd)
+{
+	uint32_t len;
+
+	ioctl(fd, LORA_GET_IMPLICIT, &len);
+
+	return len;
+}
+
+/* Set the max RX payload length & get the chip's FIFO status. */
+void set_maxpayload(int fd, uint32_t len)
+{
+	ioctl(fd, LORA_SET_MAXPAYLOAD, &len);
+}
+
+int get_fifo_stat(int fd, struct lora_fifo_stat *st)
+{
+	return ioctl(fd, LORA_GET_FIFOSTAT, st);
+}
+
+/* Pin & send the resident frame & get its status. */
+int set_beacon(int fd, const struct lora_beacon *bcn)
+{
+	return ioctl(fd, LORA_SET_BEACON, bcn);
+}
+
+int send_beacon(int fd)
+{
+	return ioctl(fd, LORA_SEND_BEACON);
+}
+
+int get_beacon_status(int fd, struct lora_beacon_status *st)
+{
+	return ioctl(fd, LORA_GET_BEACON, st);
+}
+
+/* Set & get the fragmentation & get its counters. */
+int set_frag(int fd, uint32_t enable, uint32_t fragsize, uint32_t timeout_ms)
+{
+	struct lora_frag_param param;
+
+	param.enable = enable;
+	param.fragsize = fragsize;
+	param.timeout_ms = timeout_ms;
+
+	return ioctl(fd, LORA_SET_FRAG, &param);
+}
+
+int get_frag(int fd, struct lora_frag_param *param)
+{
+	return ioctl(fd, LORA_GET_FRAG, param);
+}
+
+int get_frag_stat(int fd, struct lora_frag_stat *st)
+{
+	return ioctl(fd, LORA_GET_FRAGSTAT, st);
+}
+
+/* Set the keys of the secured frames & get their counters. */
+int set_key(int fd, const struct lora_key *key)
+{
+	return ioctl(fd, LORA_SET_KEY, key);
+}
+
+int get_crypto_stat(int fd, struct lora_crypto_stat *st)
+{
+	return ioctl(fd, LORA_GET_CRYPTOSTAT, st);
+}
+
+int get_stats(int fd, struct lora_stats *st)
+{
+	return ioctl(fd, LORA_GET_STATS, st);
+}
+
+int get_pkt_stat(int fd, struct lora_pkt_stat *st)
+{
+	return ioctl(fd, LORA_GET_PKTSTAT, st);
+}
@@ -39,6 +39,7 @@
 #ifndef __LORA_IOCTL_H__
 #define __LORA_IOCTL_H__
 
+#include <stdint.h>
 #include <sys/ioctl.h>
 
 /* I/O control by each command. */
@@ -56,6 +57,38 @@
 #define LORA_GET_BANDWIDTH	(_IOR(LORA_IOC_MAGIC,  9, int))
 #define LORA_GET_RSSI		(_IOR(LORA_IOC_MAGIC, 10, int))
 #define LORA_GET_SNR		(_IOR(LORA_IOC_MAGIC, 11, int))
+#define LORA_SET_TXTIME		(_IOW(LORA_IOC_MAGIC, 12, struct lora_txtime))
+#define LORA_GET_TXTIME		(_IOR(LORA_IOC_MAGIC, 13, struct lora_txtime_status))
+#define LORA_SET_RXWIN		(_IOW(LORA_IOC_MAGIC, 14, struct lora_rxwin))
+#define LORA_GET_RXWIN		(_IOR(LORA_IOC_MAGIC, 15, struct lora_rxwin_status))
+#define LORA_SET_CODINGRATE	(_IOW(LORA_IOC_MAGIC, 16, int))
+#define LORA_GET_CODINGRATE	(_IOR(LORA_IOC_MAGIC, 17, int))
+#define LORA_SET_CRC		(_IOW(LORA_IOC_MAGIC, 18, int))
+#define LORA_GET_CRC		(_IOR(LORA_IOC_MAGIC, 19, int))
+#define LORA_SET_IMPLICIT	(_IOW(LORA_IOC_MAGIC, 20, int))
+#define LORA_GET_IMPLICIT	(_IOR(LORA_IOC_MAGIC, 21, int))
+#define LORA_SET_MAXPAYLOAD	(_IOW(LORA_IOC_MAGIC, 22, int))
+#define LORA_GET_FIFOSTAT	(_IOR(LORA_IOC_MAGIC, 23, struct lora_fifo_stat))
+#define LORA_SET_BEACON		(_IOW(LORA_IOC_MAGIC, 24, struct lora_beacon))
+#define LORA_SEND_BEACON	(_IO(LORA_IOC_MAGIC, 25))
+#define LORA_GET_BEACON		(_IOR(LORA_IOC_MAGIC, 26, struct lora_beacon_status))
+#define LORA_SET_FRAG		(_IOW(LORA_IOC_MAGIC, 27, struct lora_frag_param))
+#define LORA_GET_FRAG		(_IOR(LORA_IOC_MAGIC, 28, struct lora_frag_param))
+#define LORA_GET_FRAGSTAT	(_IOR(LORA_IOC_MAGIC, 29, struct lora_frag_stat))
+#define LORA_SET_KEY		(_IOW(LORA_IOC_MAGIC, 30, struct lora_key))
+#define LORA_GET_CRYPTOSTAT	(_IOR(LORA_IOC_MAGIC, 31, struct lora_crypto_stat))
+#define LORA_GET_STATS		(_IOR(LORA_IOC_MAGIC, 32, struct lora_stats))
+#define LORA_GET_PKTSTAT	(_IOR(LORA_IOC_MAGIC, 33, struct lora_pkt_stat))
+
+/* The commands of io_uring passthrough, as cmd_op of IORING_OP_URING_CMD. */
+#define LORA_URING_RECV		(_IOR(LORA_IOC_MAGIC, 64, struct lora_uring_cmd))
+#define LORA_URING_SEND		(_IOW(LORA_IOC_MAGIC, 65, struct lora_uring_cmd))
+#define LORA_URING_IOCTL	(_IOWR(LORA_IOC_MAGIC, 66, struct lora_uring_cmd))
+
+/* The frames' protocol of the network interfaces, ETH_P_802_EX1. */
+#define LORA_ETH_P		0x88B5
+/* Configure the radio of a network interface by struct lora_ifcmd. */
+#define SIOCLORACMD		(SIOCDEVPRIVATE + 0)
 
 /* List the state of the LoRa device. */
 #define LORA_STATE_SLEEP	0
@@ -64,6 +97,198 @@
 #define LORA_STATE_RX		3
 #define LORA_STATE_CAD		4
 
+/* Start the next written packet at an absolute time. */
+struct lora_txtime {
+	int64_t time_ns;	/* 0 for cancelling */
+	uint32_t clockid;	/* CLOCK_MONOTONIC or CLOCK_BOOTTIME */
+	uint32_t flags;
+};
+
+/* The accounting of the scheduled TX. */
+struct lora_txtime_status {
+	int64_t requested_ns;
+	int64_t achieved_ns;
+	int32_t status;		/* 0 for sent, negative errno for dropped */
+	uint32_t sent;
+	uint32_t late;
+	uint32_t reserved;
+	int64_t max_lateness_ns;
+	int64_t sum_lateness_ns;
+};
+
+/* List the result of an RX window. */
+#define LORA_RXWIN_NONE		0
+#define LORA_RXWIN_CAUGHT	1
+#define LORA_RXWIN_TIMEOUT	2
+#define LORA_RXWIN_CRCERROR	3
+
+/* The max number of the RX windows after a TX. */
+#define LORA_RXWIN_MAX		2
+
+/* The parameters of an RX window. */
+struct lora_rxwin_param {
+	uint32_t delay_ms;	/* Opens after the end of the TX */
+	uint32_t timeout_ms;	/* Lasts for, if no preamble detected */
+	uint32_t freq;
+	uint32_t sprf;
+	uint32_t bw;
+};
+
+/* The RX windows opened after each TX. */
+struct lora_rxwin {
+	uint32_t nwin;		/* 0 for disabled */
+	uint32_t flags;
+	struct lora_rxwin_param win[LORA_RXWIN_MAX];
+};
+
+/* The result of the last RX windows. */
+struct lora_rxwin_status {
+	int32_t result[LORA_RXWIN_MAX];
+	uint32_t len[LORA_RXWIN_MAX];
+	int64_t opened_ns[LORA_RXWIN_MAX];
+	uint32_t caught;
+	uint32_t missed;
+};
+
+/* The occupancy and the counters of the chip's FIFO. */
+struct lora_fifo_stat {
+	uint32_t rx_pending;	/* RX packets waiting in the FIFO */
+	uint32_t used;		/* Bytes used by the RX and TX packets */
+	uint32_t rx_slot;	/* Bytes reserved for the receiving packet */
+	uint32_t rx_queued;
+	uint32_t rx_overwrites;
+	uint32_t rx_crcerrors;
+	uint32_t tx_staged;
+	uint32_t tx_paused_rx;
+};
+
+#define LORA_BEACON_MAXLEN	255
+#define LORA_BEACON_MAXPATCH	4
+
+/* The resident frame pinned in the chip's FIFO. */
+struct lora_beacon {
+	uint32_t len;		/* 0 for unpinning */
+	uint32_t period_ms;	/* 0 for sending by send_beacon() only */
+	uint32_t patch_off;	/* The offset of the big-endian counter */
+	uint32_t patch_len;	/* 0 ~ 4 bytes, 0 for no counter */
+	uint8_t payload[LORA_BEACON_MAXLEN];
+};
+
+/* The accounting of the resident frame. */
+struct lora_beacon_status {
+	uint32_t sent;
+	uint32_t late;
+	uint32_t failed;
+	uint32_t counter;
+	int64_t last_ns;
+};
+
+#define LORA_FRAG_HDRLEN	4
+#define LORA_FRAG_MAXCNT	255
+#define LORA_FRAG_MAXMSG	16384
+
+/* The fragmentation of the read & write messages. */
+struct lora_frag_param {
+	uint32_t enable;	/* 1 / 0 for enabled / disabled */
+	uint32_t fragsize;	/* Payload bytes of each fragment, 0 for max */
+	uint32_t timeout_ms;	/* Reassembly time out, 0 for default */
+};
+
+/* The counters of the fragmentation. */
+struct lora_frag_stat {
+	uint32_t tx_msgs;
+	uint32_t tx_frags;
+	uint32_t tx_errors;
+	uint32_t rx_msgs;
+	uint32_t rx_frags;
+	uint32_t rx_dups;
+	uint32_t rx_invalid;
+	uint32_t rx_timeouts;
+	uint32_t rx_evicted;
+	uint32_t rx_lost;	/* Missing fragments of the dropped messages */
+};
+
+#define LORA_KEYLEN		16
+#define LORA_CRYPTO_HDRLEN	8
+#define LORA_CRYPTO_MICLEN	4
+#define LORA_CRYPTO_OVERHEAD	(LORA_CRYPTO_HDRLEN + LORA_CRYPTO_MICLEN)
+
+#define LORA_KEY_ENABLE		(1 << 0)
+#define LORA_KEY_ENCRYPT	(1 << 1)
+
+/* The keys securing the read & written frames, they can not be read back. */
+struct lora_key {
+	uint32_t flags;		/* LORA_KEY_*, 0 for disabling */
+	uint32_t addr;		/* The address put into the written frames */
+	uint32_t peer;		/* Only the frames from it are read */
+	uint32_t fcnt;		/* The frame counter of the next written frame */
+	uint8_t enc_key[LORA_KEYLEN];	/* AES-CTR payload encryption */
+	uint8_t mic_key[LORA_KEYLEN];	/* AES-CMAC integrity code */
+};
+
+/* The counters of the secured frames. */
+struct lora_crypto_stat {
+	uint32_t tx_sealed;
+	uint32_t tx_fcnt;
+	uint32_t rx_opened;
+	uint32_t rx_badmic;
+	uint32_t rx_replayed;
+	uint32_t rx_foreign;
+	uint32_t rx_short;
+	uint32_t rx_errors;
+	uint32_t rx_batches;
+	uint32_t rx_maxbatch;	/* The most frames verified at once */
+	uint32_t rx_fcnt;	/* The newest accepted frame counter */
+};
+
+/* The counters of the device, also in /sys/class/lora-spi/<dev>/statistics. */
+struct lora_stats {
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t rx_crcerrors;
+	uint64_t rx_timeouts;	/* Single RX timed out without a packet */
+	uint64_t rx_dropped;	/* Overwritten in the FIFO before read */
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_timeouts;
+	uint64_t spi_transactions;
+	uint64_t spi_errors;
+	uint32_t chip_rx_headers;	/* The chip's counters since it */
+	uint32_t chip_rx_packets;	/* entered RX state */
+};
+
+/* The signal of the packet last read. */
+struct lora_pkt_stat {
+	int32_t rssi;		/* In dBm */
+	int32_t snr;		/* In 0.25 dB */
+	uint32_t len;		/* 0 for nothing read */
+};
+
+/* The link layer header of the network interfaces, before each payload of
+ * the SOCK_RAW packet sockets. */
+struct lora_pkt_meta {
+	int64_t rx_ns;		/* CLOCK_MONOTONIC, 0 for sent */
+	int64_t tx_ns;		/* CLOCK_MONOTONIC, 0 for received */
+	int32_t rssi;		/* In dBm */
+	int32_t snr;		/* In 0.25 dB */
+	uint32_t len;		/* The payload length */
+	uint32_t reserved;
+};
+
+/* The command in the SQE of IORING_OP_URING_CMD. */
+struct lora_uring_cmd {
+	uint64_t addr;		/* The buffer, or the argument of ioctl */
+	uint32_t len;		/* The length of the buffer */
+	uint32_t ioctl;		/* The ioctl command of LORA_URING_IOCTL */
+};
+
+/* The ioctl of a network interface, pointed by ifr_data of SIOCLORACMD. */
+struct lora_ifcmd {
+	uint32_t cmd;		/* LORA_SET_* and LORA_GET_* */
+	uint32_t reserved;
+	uint64_t arg;
+};
+
 /* Read the device data. */
 ssize_t do_read(int fd, char *buf, size_t len);
 
@@ -96,4 +321,48 @@ uint32_t get_sprfactor(int fd);
 void set_bw(int fd, uint32_t bw);
 uint32_t get_bw(int fd);
 
+/* Set the start time of the next written packet & get the TX status. */
+int set_txtime(int fd, uint32_t clockid, int64_t time_ns);
+int get_txtime_status(int fd, struct lora_txtime_status *st);
+
+/* Set the RX windows after each TX & get the last windows' result. */
+int set_rxwin(int fd, const struct lora_rxwin *rxw);
+int get_rxwin_status(int fd, struct lora_rxwin_status *st);
+
+/* Set & get the coding rate denominator, 5 ~ 8 for 4/5 ~ 4/8. */
+void set_cr(int fd, uint32_t cr);
+uint32_t get_cr(int fd);
+
+/* Set & get the payload CRC, 1 / 0 for enabled / disabled. */
+void set_crc(int fd, uint32_t yesno);
+uint32_t get_crc(int fd);
+
+/* Set & get the fixed payload length, 0 for explicit header mode. */
+void set_implicit(int fd, uint32_t len);
+uint32_t get_implicit(int fd);
+
+/* Set the max RX payload length & get the chip's FIFO status. */
+void set_maxpayload(int fd, uint32_t len);
+int get_fifo_stat(int fd, struct lora_fifo_stat *st);
+
+/* Pin & send the resident frame & get its status. */
+int set_beacon(int fd, const struct lora_beacon *bcn);
+int send_beacon(int fd);
+int get_beacon_status(int fd, struct lora_beacon_status *st);
+
+/* Set & get the fragmentation & get its counters. */
+int set_frag(int fd, uint32_t enable, uint32_t fragsize, uint32_t timeout_ms);
+int get_frag(int fd, struct lora_frag_param *param);
+int get_frag_stat(int fd, struct lora_frag_stat *st);
+
+/* Set the keys of the secured frames & get their counters. */
+int set_key(int fd, const struct lora_key *key);
+int get_crypto_stat(int fd, struct lora_crypto_stat *st);
+
+/* Get a consistent snapshot of the device's counters. */
+int get_stats(int fd, struct lora_stats *st);
+
+/* Get the signal of the packet last read. */
+int get_pkt_stat(int fd, struct lora_pkt_stat *st);
+
 #endif
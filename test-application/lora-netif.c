@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+
+#include "lora-ioctl.h"
+
+/*
+ * Send and receive the frames of a LoRa network interface with AF_PACKET,
+ * and configure its radio by SIOCLORACMD.  The frames go through the qdisc,
+ * so tc shapes them, and tcpdump -i sees them.
+ */
+
+/* I/O control the radio of the interface, as ioctl() of the device. */
+static int if_ioctl(int sock, const char *ifname, uint32_t cmd, void *arg)
+{
+	struct lora_ifcmd ic;
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	memset(&ic, 0, sizeof(ic));
+	ic.cmd = cmd;
+	ic.arg = (uintptr_t)arg;
+	ifr.ifr_data = (void *)&ic;
+
+	return ioctl(sock, SIOCLORACMD, &ifr);
+}
+
+/* Set a parameter of the radio, if it is given. */
+static void if_set(int sock, const char *ifname, uint32_t cmd, int32_t val,
+		   const char *name)
+{
+	if (val < 0)
+		return;
+	if (if_ioctl(sock, ifname, cmd, &val) < 0)
+		fprintf(stderr, "set %s: %s\n", name, strerror(errno));
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-f Hz] [-s sf] [-b Hz] [-p dBm] [-n count] "
+	       "[-l len] [-g ms] [-r] interface\n", name);
+	printf("  -f Hz      set the carrier frequency\n");
+	printf("  -s sf      set the spreading factor\n");
+	printf("  -b Hz      set the bandwidth\n");
+	printf("  -p dBm     set the output power\n");
+	printf("  -n count   frames to send or receive (default 10)\n");
+	printf("  -l len     payload length 1 ~ 255 (default 16)\n");
+	printf("  -g ms      the gap between the sent frames (default 0)\n");
+	printf("  -r         receive instead of send\n");
+	printf("  interface  the interface, e.g. loraSPI0.0 with the lora "
+	       "module's netdev=1\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_ll sll;
+	struct lora_stats st;
+	uint8_t buf[256];
+	const char *ifname;
+	int32_t freq, sprf, bw, power;
+	int count, len, gap_ms, rx;
+	int opt, sock, i;
+	ssize_t c;
+
+	freq = sprf = bw = power = -1;
+	count = 10;
+	len = 16;
+	gap_ms = 0;
+	rx = 0;
+	while ((opt = getopt(argc, argv, "f:s:b:p:n:l:g:rh")) != -1) {
+		switch (opt) {
+		case 'f': freq = atoi(optarg);		break;
+		case 's': sprf = atoi(optarg);		break;
+		case 'b': bw = atoi(optarg);		break;
+		case 'p': power = atoi(optarg);		break;
+		case 'n': count = atoi(optarg);		break;
+		case 'l': len = atoi(optarg);		break;
+		case 'g': gap_ms = atoi(optarg);	break;
+		case 'r': rx = 1;			break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+	if ((optind >= argc) || (len < 1) || (len > 255)) {
+		usage(argv[0]);
+		return -1;
+	}
+	ifname = argv[optind];
+
+	/* The frames are bare payloads, so no link layer header to build. */
+	sock = socket(AF_PACKET, SOCK_DGRAM, htons(LORA_ETH_P));
+	if (sock == -1) {
+		perror("socket");
+		return -1;
+	}
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(LORA_ETH_P);
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if ((sll.sll_ifindex == 0)
+	    || (bind(sock, (struct sockaddr *)&sll, sizeof(sll)) == -1)) {
+		perror(ifname);
+		close(sock);
+		return -1;
+	}
+
+	if_set(sock, ifname, LORA_SET_FREQUENCY, freq, "frequency");
+	if_set(sock, ifname, LORA_SET_SPRFACTOR, sprf, "spreading factor");
+	if_set(sock, ifname, LORA_SET_BANDWIDTH, bw, "bandwidth");
+	if_set(sock, ifname, LORA_SET_POWER, power, "power");
+
+	for (i = 0; i < count; i++) {
+		if (rx) {
+			c = recv(sock, buf, sizeof(buf), 0);
+			if (c < 0)
+				break;
+			printf("%s: received %zd bytes\n", ifname, c);
+			continue;
+		}
+
+		memset(buf, 'A' + (i % 26), len);
+		/* It blocks only when the qdisc is full. */
+		c = sendto(sock, buf, len, 0, (struct sockaddr *)&sll,
+			   sizeof(sll));
+		if (c < 0)
+			break;
+		if (gap_ms > 0)
+			usleep(gap_ms * 1000);
+	}
+	if (i < count)
+		perror(rx ? "recv" : "sendto");
+
+	if (if_ioctl(sock, ifname, LORA_GET_STATS, &st) == 0)
+		printf("%s: rx %llu packets %llu bytes, tx %llu packets %llu "
+		       "bytes\n", ifname,
+		       (unsigned long long)st.rx_packets,
+		       (unsigned long long)st.rx_bytes,
+		       (unsigned long long)st.tx_packets,
+		       (unsigned long long)st.tx_bytes);
+	close(sock);
+
+	return (i < count) ? -1 : 0;
+}
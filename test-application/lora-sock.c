@@ -0,0 +1,410 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "lora-ioctl.h"
+
+/*
+ * Independent, filtered access to a radio through the packet sockets of its
+ * network interface.  Each RX socket has its own receive queue, SO_RCVBUF
+ * limit and filter on the first payload byte, and reads the packets with
+ * their metadata and timestamps in batches by recvmmsg().  The TX side
+ * sends in batches by sendmmsg() and reads the time each packet has left
+ * the air from the error queue.
+ */
+
+#define MAXSOCK		8
+#define BATCH		16
+#define FRAMELEN	(sizeof(struct lora_pkt_meta) + 256)
+
+struct rxsock {
+	int fd;
+	unsigned long packets;
+	unsigned long calls;
+	unsigned long maxbatch;
+	uint32_t drops;		/* Of the socket's queue */
+	long long rssi_sum;
+	double delay_sum;	/* From the radio to the application in s */
+};
+
+static double ts_s(const struct timespec *ts)
+{
+	return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double now_s(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+
+	return ts_s(&ts);
+}
+
+/* Open a packet socket bound to the interface. */
+static int open_sock(int type, int ifindex)
+{
+	struct sockaddr_ll sll;
+	int fd;
+
+	fd = socket(AF_PACKET, type, htons(LORA_ETH_P));
+	if (fd == -1)
+		return -1;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(LORA_ETH_P);
+	sll.sll_ifindex = ifindex;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Accept only the frames whose first payload byte is the port. */
+static int set_port_filter(int fd, uint8_t port)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+			 sizeof(struct lora_pkt_meta)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xFFFF),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+			  sizeof(prog));
+}
+
+/* Read the received frames of a socket in a batch. */
+static void rx_batch(struct rxsock *rs)
+{
+	static uint8_t buf[BATCH][FRAMELEN];
+	static uint8_t ctl[BATCH][256];
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov[BATCH];
+	struct scm_timestamping *tss;
+	struct lora_pkt_meta *meta;
+	struct cmsghdr *cm;
+	double now;
+	int i, n;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < BATCH; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = FRAMELEN;
+		msgs[i].msg_hdr.msg_iov = &(iov[i]);
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = ctl[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(ctl[i]);
+	}
+
+	n = recvmmsg(rs->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+	if (n <= 0)
+		return;
+	now = now_s(CLOCK_MONOTONIC);
+	rs->calls++;
+	if (n > rs->maxbatch)
+		rs->maxbatch = n;
+
+	for (i = 0; i < n; i++) {
+		if (msgs[i].msg_len < sizeof(*meta))
+			continue;
+		meta = (struct lora_pkt_meta *)buf[i];
+		rs->packets++;
+		rs->rssi_sum += meta->rssi;
+
+		for (cm = CMSG_FIRSTHDR(&(msgs[i].msg_hdr)); cm != NULL;
+		     cm = CMSG_NXTHDR(&(msgs[i].msg_hdr), cm)) {
+			if (cm->cmsg_level != SOL_SOCKET)
+				continue;
+			if (cm->cmsg_type == SO_TIMESTAMPING) {
+				/* The raw hardware one is on CLOCK_MONOTONIC. */
+				tss = (struct scm_timestamping *)CMSG_DATA(cm);
+				if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec)
+					rs->delay_sum += now - ts_s(&(tss->ts[2]));
+			}
+			else if (cm->cmsg_type == SO_RXQ_OVFL)
+				memcpy(&(rs->drops), CMSG_DATA(cm),
+				       sizeof(rs->drops));
+		}
+	}
+}
+
+/* Receive on the sockets for the seconds. */
+static int do_rx(int ifindex, int nsock, int all, int rcvbuf, double seconds)
+{
+	struct rxsock rs[MAXSOCK];
+	struct pollfd pfd[MAXSOCK];
+	double end;
+	int flags, one, i;
+
+	memset(rs, 0, sizeof(rs));
+	flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+		SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+	one = 1;
+	for (i = 0; i < nsock; i++) {
+		rs[i].fd = open_sock(SOCK_RAW, ifindex);
+		if ((rs[i].fd == -1)
+		    || (!all && (set_port_filter(rs[i].fd, 'A' + i) == -1))
+		    || ((rcvbuf > 0) && (setsockopt(rs[i].fd, SOL_SOCKET,
+						     SO_RCVBUF, &rcvbuf,
+						     sizeof(rcvbuf)) == -1))
+		    || (setsockopt(rs[i].fd, SOL_SOCKET, SO_TIMESTAMPING,
+				   &flags, sizeof(flags)) == -1)
+		    || (setsockopt(rs[i].fd, SOL_SOCKET, SO_RXQ_OVFL, &one,
+				   sizeof(one)) == -1)) {
+			perror("RX socket");
+			return -1;
+		}
+		pfd[i].fd = rs[i].fd;
+		pfd[i].events = POLLIN;
+	}
+
+	end = now_s(CLOCK_MONOTONIC) + seconds;
+	while (now_s(CLOCK_MONOTONIC) < end) {
+		if (poll(pfd, nsock, 100) <= 0)
+			continue;
+		for (i = 0; i < nsock; i++)
+			if (pfd[i].revents & POLLIN)
+				rx_batch(&(rs[i]));
+	}
+
+	printf("%-6s %6s %8s %8s %9s %8s %8s %12s\n", "socket", "port",
+	       "packets", "calls", "maxbatch", "drops", "rssi", "delay_ms");
+	for (i = 0; i < nsock; i++) {
+		printf("%-6d %6c %8lu %8lu %9lu %8u %8.1f %12.3f\n", i,
+		       all ? '*' : 'A' + i, rs[i].packets, rs[i].calls,
+		       rs[i].maxbatch, rs[i].drops,
+		       rs[i].packets ? (double)rs[i].rssi_sum / rs[i].packets
+				     : 0.0,
+		       rs[i].packets ? rs[i].delay_sum * 1000 / rs[i].packets
+				     : 0.0);
+		close(rs[i].fd);
+	}
+
+	return 0;
+}
+
+/* Read the times the sent frames have left the air from the error queue. */
+static int tx_stamps(int fd, double *first, double *last)
+{
+	struct scm_timestamping *tss;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	uint8_t ctl[256];
+	int n;
+
+	n = 0;
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = ctl;
+		msg.msg_controllen = sizeof(ctl);
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+		     cm = CMSG_NXTHDR(&msg, cm)) {
+			if ((cm->cmsg_level != SOL_SOCKET)
+			    || (cm->cmsg_type != SO_TIMESTAMPING))
+				continue;
+			tss = (struct scm_timestamping *)CMSG_DATA(cm);
+			if (!tss->ts[2].tv_sec && !tss->ts[2].tv_nsec)
+				continue;
+			if (*first == 0)
+				*first = ts_s(&(tss->ts[2]));
+			*last = ts_s(&(tss->ts[2]));
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Send the frames in batches, to the ports in turn. */
+static int do_tx(int ifindex, int nsock, int count, int len)
+{
+	struct sockaddr_ll sll;
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov[BATCH];
+	static uint8_t buf[BATCH][256];
+	struct pollfd pfd;
+	double first, last, start;
+	int fd, flags, sent, stamped, calls;
+	int i, n;
+
+	fd = open_sock(SOCK_DGRAM, ifindex);
+	flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE |
+		SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+		SOF_TIMESTAMPING_OPT_TSONLY;
+	if ((fd == -1) || (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+				      sizeof(flags)) == -1)) {
+		perror("TX socket");
+		return -1;
+	}
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(LORA_ETH_P);
+	sll.sll_ifindex = ifindex;
+
+	first = last = 0;
+	sent = stamped = calls = 0;
+	start = now_s(CLOCK_MONOTONIC);
+	while (sent < count) {
+		n = (count - sent < BATCH) ? count - sent : BATCH;
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < n; i++) {
+			memset(buf[i], 'A' + ((sent + i) % nsock), len);
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = len;
+			msgs[i].msg_hdr.msg_name = &sll;
+			msgs[i].msg_hdr.msg_namelen = sizeof(sll);
+			msgs[i].msg_hdr.msg_iov = &(iov[i]);
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = sendmmsg(fd, msgs, n, 0);
+		calls++;
+		if (n > 0)
+			sent += n;
+		else if ((errno == ENOBUFS) || (errno == EAGAIN))
+			/* The qdisc is full, wait for the air. */
+			usleep(10000);
+		else {
+			perror("sendmmsg");
+			break;
+		}
+		stamped += tx_stamps(fd, &first, &last);
+	}
+
+	/* Wait for the last frames to leave the air. */
+	pfd.fd = fd;
+	pfd.events = 0;
+	while ((stamped < sent) && (poll(&pfd, 1, 5000) > 0))
+		stamped += tx_stamps(fd, &first, &last);
+
+	printf("Sent %d frames by %d sendmmsg() in %.2f s, %d left the air",
+	       sent, calls, now_s(CLOCK_MONOTONIC) - start, stamped);
+	if (stamped > 1)
+		printf(", %.1f ms apart", (last - first) * 1000 / (stamped - 1));
+	printf("\n");
+	close(fd);
+
+	return (sent == count) ? 0 : -1;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-n sockets] [-a] [-b bytes] [-d s] [-t count] "
+	       "[-l len] interface\n", name);
+	printf("  -n sockets RX sockets, or the ports sent to in turn "
+	       "(default 2)\n");
+	printf("  -a         the RX sockets accept all, instead of the port "
+	       "'A' + the socket\n");
+	printf("  -b bytes   SO_RCVBUF of the RX sockets\n");
+	printf("  -d s       seconds to receive (default 10)\n");
+	printf("  -t count   send the frames instead of receiving\n");
+	printf("  -l len     payload length 1 ~ 255 (default 16)\n");
+	printf("  interface  the interface, e.g. loraVIRT0 with the lora "
+	       "module's netdev=1\n");
+}
+
+int main(int argc, char **argv)
+{
+	double seconds;
+	int nsock, all, rcvbuf, count, len;
+	int ifindex, opt;
+
+	nsock = 2;
+	all = 0;
+	rcvbuf = 0;
+	seconds = 10;
+	count = 0;
+	len = 16;
+	while ((opt = getopt(argc, argv, "n:ab:d:t:l:h")) != -1) {
+		switch (opt) {
+		case 'n': nsock = atoi(optarg);		break;
+		case 'a': all = 1;			break;
+		case 'b': rcvbuf = atoi(optarg);	break;
+		case 'd': seconds = atof(optarg);	break;
+		case 't': count = atoi(optarg);		break;
+		case 'l': len = atoi(optarg);		break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+	if ((optind >= argc) || (nsock < 1) || (nsock > MAXSOCK)
+	    || (len < 1) || (len > 255)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	ifindex = if_nametoindex(argv[optind]);
+	if (ifindex == 0) {
+		perror(argv[optind]);
+		return -1;
+	}
+
+	if (count > 0)
+		return do_tx(ifindex, nsock, count, len);
+
+	return do_rx(ifindex, nsock, all, rcvbuf, seconds);
+}
@@ -0,0 +1,671 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <glob.h>
+#include <signal.h>
+#include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/*
+ * Stress the character device interface with a mix of processes on one or
+ * many devices at the same time:
+ *
+ *   reader   read() the packets in a loop
+ *   writer   write() the packets in a loop
+ *   poller   the monitoring ioctls and a non-blocking poll() in a loop
+ *   churner  open() and close() the device in a loop
+ *
+ * Each operation's latency is counted into a log2 histogram, and the time
+ * waiting for and holding the driver's buf_lock is read from the driver's
+ * latency file in debugfs, or from /proc/lock_stat with CONFIG_LOCK_STAT.
+ * The devices may be the emulated ones of lora-virt or lora-cuse, and with
+ * -e the processes stress devices emulated in this tool, whose lock is held
+ * the way lora-spi holds buf_lock.
+ */
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define MAX_DEV		8
+#define MAX_WORKER	64
+/* The bucket n counts the latencies in [2^n, 2^(n+1)) ns, as the driver. */
+#define BUCKETS		40
+
+/* The operations timed. */
+enum {
+	OP_READ,
+	OP_WRITE,
+	OP_IOCTL,
+	OP_POLL,
+	OP_OPEN,
+	OP_CLOSE,
+	OP_NUM,
+};
+
+static const char *op_names[OP_NUM] = {
+	"read", "write", "ioctl", "poll", "open", "close",
+};
+
+/* The roles of the processes. */
+enum {
+	ROLE_READER,
+	ROLE_WRITER,
+	ROLE_POLLER,
+	ROLE_CHURNER,
+	ROLE_NUM,
+};
+
+static const char *role_names[ROLE_NUM] = {
+	"reader", "writer", "poller", "churner",
+};
+
+/* The latency histogram of an operation. */
+struct op_stat {
+	unsigned long n;
+	unsigned long err;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	unsigned long bucket[BUCKETS];
+};
+
+/* A process of the mix. */
+struct worker {
+	pid_t pid;
+	int role;
+	int dev;
+	struct op_stat op[OP_NUM];
+};
+
+/*
+ * An emulated device: the driver holds buf_lock over the whole read()
+ * polling for a packet, the whole write() until TX done, and the SPI
+ * transactions of each ioctl, while poll() only peeks at the lock.
+ */
+struct emu_dev {
+	pthread_mutex_t lock;
+	uint64_t lock_ns;		/* The time the lock was taken */
+	unsigned int rxq;		/* The packets waiting to be read */
+	struct op_stat wait;		/* Waiting for the lock */
+	struct op_stat hold;		/* Holding the lock */
+};
+
+/* The memory shared by all the processes. */
+struct shared {
+	volatile int stop;
+	pthread_mutex_t list_lock;	/* The driver's device list lock */
+	struct emu_dev emu[MAX_DEV];
+	struct worker w[MAX_WORKER];
+};
+
+/* The driver polls the flags every 20 ms, 250 times in a read. */
+#define EMU_POLL_US	20000
+#define EMU_POLLS	250
+/* An SPI transaction of a register at the usual 10 MHz with overhead. */
+#define EMU_SPI_US	20
+#define EMU_RXQ		16
+
+static struct shared *sh;
+static const char *devs[MAX_DEV];
+static int ndev;
+static int emulated;
+static size_t plen = 16;
+static unsigned int gap_us;
+static unsigned int interval_us = 1000;
+static struct lora_modem modem = {128, 125000, 5, 8, 0, 1, -1};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+/* Count a latency into the histogram. */
+static void stat_add(struct op_stat *s, uint64_t ns, int err)
+{
+	int b = 0;
+
+	while ((b < BUCKETS - 1) && ((ns >> (b + 1)) > 0))
+		b++;
+	s->bucket[b]++;
+	s->n++;
+	s->sum_ns += ns;
+	if (ns > s->max_ns)
+		s->max_ns = ns;
+	if (err)
+		s->err++;
+}
+
+static void stat_merge(struct op_stat *to, const struct op_stat *from)
+{
+	int i;
+
+	to->n += from->n;
+	to->err += from->err;
+	to->sum_ns += from->sum_ns;
+	if (from->max_ns > to->max_ns)
+		to->max_ns = from->max_ns;
+	for (i = 0; i < BUCKETS; i++)
+		to->bucket[i] += from->bucket[i];
+}
+
+/* Get the upper bound of the bucket holding the percentile in per mille. */
+static uint64_t stat_pct(const struct op_stat *s, unsigned int permil)
+{
+	unsigned long sum, want;
+	int i;
+
+	want = ((uint64_t)s->n * permil + 999) / 1000;
+	for (sum = 0, i = 0; i < BUCKETS - 1; i++) {
+		sum += s->bucket[i];
+		if (sum >= want)
+			break;
+	}
+
+	/* The bucket's bound may be beyond the max latency. */
+	return ((2ULL << i) - 1 < s->max_ns) ? (2ULL << i) - 1 : s->max_ns;
+}
+
+/* Take the emulated device's lock and count the waiting. */
+static void emu_lock(struct emu_dev *e)
+{
+	uint64_t t = now_ns();
+
+	pthread_mutex_lock(&(e->lock));
+	e->lock_ns = now_ns();
+	stat_add(&(e->wait), e->lock_ns - t, 0);
+}
+
+static void emu_unlock(struct emu_dev *e)
+{
+	stat_add(&(e->hold), now_ns() - e->lock_ns, 0);
+	pthread_mutex_unlock(&(e->lock));
+}
+
+/* The emulated read: hold the lock and poll for a packet as lora-spi. */
+static ssize_t emu_read(struct emu_dev *e)
+{
+	unsigned int q;
+	int i;
+
+	emu_lock(e);
+	for (i = 0; i < EMU_POLLS; i++) {
+		q = __atomic_load_n(&(e->rxq), __ATOMIC_ACQUIRE);
+		if ((q > 0) && __atomic_compare_exchange_n(&(e->rxq), &q,
+				q - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			break;
+		if (sh->stop)
+			i = EMU_POLLS - 1;
+		if (i < EMU_POLLS - 1)
+			sleep_us(EMU_POLL_US);
+	}
+	emu_unlock(e);
+
+	return (i < EMU_POLLS) ? (ssize_t)plen : -EPERM;
+}
+
+/* The emulated write: hold the lock until the packet is on the air. */
+static ssize_t emu_write(int dev)
+{
+	struct emu_dev *e = &(sh->emu[dev]);
+	struct emu_dev *peer = &(sh->emu[(dev + 1) % ndev]);
+
+	emu_lock(e);
+	sleep_us(airtime_us(&modem, plen));
+	if (__atomic_load_n(&(peer->rxq), __ATOMIC_ACQUIRE) < EMU_RXQ)
+		__atomic_add_fetch(&(peer->rxq), 1, __ATOMIC_ACQ_REL);
+	emu_unlock(e);
+
+	return plen;
+}
+
+/* The emulated ioctl: hold the lock over a few SPI transactions. */
+static long emu_ioctl(struct emu_dev *e)
+{
+	emu_lock(e);
+	sleep_us(2 * EMU_SPI_US);
+	emu_unlock(e);
+
+	return 0;
+}
+
+/* The emulated poll() peeks at the lock as the driver's ready2read. */
+static int emu_poll(struct emu_dev *e)
+{
+	int ready;
+
+	if (pthread_mutex_trylock(&(e->lock)))
+		return 0;
+	ready = __atomic_load_n(&(e->rxq), __ATOMIC_ACQUIRE) > 0;
+	pthread_mutex_unlock(&(e->lock));
+
+	return ready ? POLLIN | POLLOUT : POLLOUT;
+}
+
+/* Open the device, or take the device list lock of the emulated one. */
+static int dev_open(int dev)
+{
+	if (!emulated)
+		return open(devs[dev], O_RDWR);
+
+	pthread_mutex_lock(&(sh->list_lock));
+	pthread_mutex_unlock(&(sh->list_lock));
+
+	return dev;
+}
+
+static int dev_close(int fd)
+{
+	if (!emulated)
+		return close(fd);
+
+	pthread_mutex_lock(&(sh->list_lock));
+	pthread_mutex_unlock(&(sh->list_lock));
+
+	return 0;
+}
+
+/* Time an operation of the role with the device opened as fd. */
+static void run_op(struct worker *w, int fd, unsigned long k)
+{
+	static const unsigned long cmds[] = {
+		LORA_GET_STATE, LORA_GET_FREQUENCY, LORA_GET_RSSI,
+		LORA_GET_STATS,
+	};
+	struct emu_dev *e = &(sh->emu[w->dev]);
+	struct lora_stats st;
+	struct pollfd pfd;
+	uint8_t buf[256];
+	uint64_t t;
+	long ret;
+	int op;
+
+	memset(buf, 0xA5, plen);
+	t = now_ns();
+	switch (w->role) {
+	case ROLE_READER:
+		op = OP_READ;
+		ret = emulated ? emu_read(e) : read(fd, buf, sizeof(buf));
+		break;
+	case ROLE_WRITER:
+		op = OP_WRITE;
+		ret = emulated ? emu_write(w->dev) : write(fd, buf, plen);
+		break;
+	case ROLE_POLLER:
+		if ((k % (ARRAY_SIZE(cmds) + 1)) < ARRAY_SIZE(cmds)) {
+			op = OP_IOCTL;
+			ret = emulated ? emu_ioctl(e) :
+			      ioctl(fd, cmds[k % (ARRAY_SIZE(cmds) + 1)], &st);
+		}
+		else {
+			op = OP_POLL;
+			pfd.fd = fd;
+			pfd.events = POLLIN | POLLOUT;
+			ret = emulated ? emu_poll(e) : poll(&pfd, 1, 0);
+		}
+		break;
+	default:
+		fd = dev_open(w->dev);
+		stat_add(&(w->op[OP_OPEN]), now_ns() - t, fd < 0);
+		if (fd < 0)
+			return;
+		op = OP_CLOSE;
+		t = now_ns();
+		ret = dev_close(fd);
+		break;
+	}
+	stat_add(&(w->op[op]), now_ns() - t, ret < 0);
+}
+
+/* The loop of a process until it is stopped. */
+static void work(struct worker *w)
+{
+	unsigned long k;
+	int fd = -1;
+
+	if (w->role != ROLE_CHURNER) {
+		fd = dev_open(w->dev);
+		if (fd < 0) {
+			perror(devs[w->dev]);
+			exit(1);
+		}
+	}
+
+	for (k = 0; !sh->stop; k++) {
+		run_op(w, fd, k);
+		if ((w->role == ROLE_WRITER) && (gap_us > 0))
+			sleep_us(gap_us);
+		else if (w->role == ROLE_POLLER)
+			sleep_us(interval_us);
+	}
+
+	if (fd >= 0)
+		dev_close(fd);
+	exit(0);
+}
+
+/* Find the driver's latency file of the device in debugfs. */
+static int find_latency(const char *dev, char *path, size_t len)
+{
+	char name[PATH_MAX];
+	glob_t g;
+	int ret = -1;
+
+	snprintf(name, sizeof(name), "%s", dev);
+	snprintf(path, len, "/sys/kernel/debug/*/%s/latency", basename(name));
+	if (glob(path, 0, NULL, &g) == 0) {
+		snprintf(path, len, "%s", g.gl_pathv[0]);
+		ret = 0;
+	}
+	globfree(&g);
+
+	return ret;
+}
+
+/* Clear the driver's histograms of the device, and the lock statistics. */
+static void reset_locks(void)
+{
+	char path[PATH_MAX];
+	char *p;
+	int i, fd;
+
+	for (i = 0; i < ndev; i++) {
+		if (find_latency(devs[i], path, sizeof(path)))
+			continue;
+		p = strrchr(path, '/');
+		strcpy(p + 1, "reset");
+		fd = open(path, O_WRONLY);
+		if (fd >= 0) {
+			if (write(fd, "1", 1) < 0)
+				perror(path);
+			close(fd);
+		}
+	}
+
+	fd = open("/proc/lock_stat", O_WRONLY);
+	if (fd >= 0) {
+		if (write(fd, "0", 1) < 0)
+			perror("/proc/lock_stat");
+		close(fd);
+	}
+}
+
+/* Print the lines of the file starting with any of the prefixes. */
+static int grep_file(const char *path, const char *p1, const char *p2)
+{
+	char line[512];
+	FILE *f;
+	int n = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((strstr(line, p1) != NULL)
+			|| ((p2 != NULL) && (strncmp(line, p2, strlen(p2)) == 0))) {
+			printf("  %s", line);
+			n++;
+		}
+	}
+	fclose(f);
+
+	return n;
+}
+
+static void print_stat(const char *name, const struct op_stat *s,
+		       double elapsed)
+{
+	if (s->n == 0)
+		return;
+	printf("%-16s %9lu %6lu %9.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+	       name, s->n, s->err, s->n / elapsed,
+	       s->sum_ns / 1e3 / s->n, stat_pct(s, 500) / 1e3,
+	       stat_pct(s, 990) / 1e3, stat_pct(s, 999) / 1e3,
+	       s->max_ns / 1e3);
+}
+
+/* Print the latencies of each role's operations and the lock times. */
+static void report(int nw, double elapsed)
+{
+	struct op_stat s;
+	char name[32];
+	char path[PATH_MAX];
+	int r, op, i;
+
+	printf("%-16s %9s %6s %9s %10s %10s %10s %10s %10s\n", "operation",
+	       "count", "err", "ops/s", "mean us", "p50 < us", "p99 < us",
+	       "p99.9 < us", "max us");
+	for (r = 0; r < ROLE_NUM; r++) {
+		for (op = 0; op < OP_NUM; op++) {
+			memset(&s, 0, sizeof(s));
+			for (i = 0; i < nw; i++)
+				if (sh->w[i].role == r)
+					stat_merge(&s, &(sh->w[i].op[op]));
+			snprintf(name, sizeof(name), "%s %s", role_names[r],
+				 op_names[op]);
+			print_stat(name, &s, elapsed);
+		}
+	}
+
+	printf("\nbuf_lock\n");
+	for (i = 0; i < ndev; i++) {
+		if (emulated) {
+			snprintf(name, sizeof(name), "emu%d wait", i);
+			print_stat(name, &(sh->emu[i].wait), elapsed);
+			snprintf(name, sizeof(name), "emu%d hold", i);
+			print_stat(name, &(sh->emu[i].hold), elapsed);
+			continue;
+		}
+		printf("%s:\n", devs[i]);
+		if (find_latency(devs[i], path, sizeof(path))
+			|| (grep_file(path, "lock_", NULL) <= 0))
+			printf("  no driver counters, lora_lock() is not used "
+			       "or debugfs is not readable\n");
+	}
+	if (!emulated && (access("/proc/lock_stat", R_OK) == 0)) {
+		printf("/proc/lock_stat:\n");
+		grep_file("/proc/lock_stat", "buf_lock", " class name");
+	}
+}
+
+/* Start the processes of a role, spread over the devices.  The readers
+ * start from the second device, which hears the first device's writer. */
+static int spawn(int role, int n, int nw)
+{
+	struct worker *w;
+	pid_t pid;
+	int i;
+
+	for (i = 0; (i < n) && (nw < MAX_WORKER); i++, nw++) {
+		w = &(sh->w[nw]);
+		w->role = role;
+		w->dev = (i + (role == ROLE_READER)) % ndev;
+		pid = fork();
+		if (pid == 0)
+			work(w);
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		w->pid = pid;
+	}
+
+	return nw;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-r n] [-w n] [-i n] [-c n] [-t s] [-l len] "
+	       "[-g us] [-p us] [-s sf] [-e n | device ...]\n", name);
+	printf("  -r n       reader processes (default 1)\n");
+	printf("  -w n       writer processes (default 1)\n");
+	printf("  -i n       ioctl poller processes (default 1)\n");
+	printf("  -c n       open / close churner processes (default 0)\n");
+	printf("  -t s       seconds to run (default 10)\n");
+	printf("  -l len     payload length 1 ~ 255 (default 16)\n");
+	printf("  -g us      the gap between the writes (default 0)\n");
+	printf("  -p us      the interval of the pollers (default 1000)\n");
+	printf("  -s sf      the spreading factor of the emulated air "
+	       "(default 7)\n");
+	printf("  -e n       stress n devices emulated in this tool\n");
+	printf("  device     the devices, e.g. /dev/loraSPI0.0 "
+	       "/dev/loraVIRT0\n");
+	printf("The processes of each role are spread over the devices. "
+	       "Run as root to read\nand reset the driver's lock times in "
+	       "debugfs.\n");
+}
+
+int main(int argc, char **argv)
+{
+	pthread_mutexattr_t ma;
+	int n[ROLE_NUM] = {1, 1, 1, 0};
+	unsigned int secs = 10;
+	uint64_t start, end;
+	int nw = 0, alive, status;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "r:w:i:c:t:l:g:p:s:e:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			n[ROLE_READER] = atoi(optarg);		break;
+		case 'w':
+			n[ROLE_WRITER] = atoi(optarg);		break;
+		case 'i':
+			n[ROLE_POLLER] = atoi(optarg);		break;
+		case 'c':
+			n[ROLE_CHURNER] = atoi(optarg);		break;
+		case 't':
+			secs = strtoul(optarg, NULL, 0);	break;
+		case 'l':
+			plen = strtoul(optarg, NULL, 0);	break;
+		case 'g':
+			gap_us = strtoul(optarg, NULL, 0);	break;
+		case 'p':
+			interval_us = strtoul(optarg, NULL, 0);	break;
+		case 's':
+			modem.sprf = 1 << atoi(optarg);		break;
+		case 'e':
+			emulated = atoi(optarg);		break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if (emulated) {
+		for (ndev = 0; (ndev < emulated) && (ndev < MAX_DEV); ndev++)
+			devs[ndev] = "emulated";
+	}
+	else {
+		for (; (optind < argc) && (ndev < MAX_DEV); optind++)
+			devs[ndev++] = argv[optind];
+	}
+	if ((ndev == 0) || (plen < 1) || (plen > 255)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sh == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(sh, 0, sizeof(*sh));
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&(sh->list_lock), &ma);
+	for (i = 0; i < MAX_DEV; i++)
+		pthread_mutex_init(&(sh->emu[i].lock), &ma);
+
+	if (!emulated)
+		reset_locks();
+
+	printf("%d readers, %d writers, %d pollers, %d churners on %d "
+	       "device(s) for %u s\n", n[ROLE_READER], n[ROLE_WRITER],
+	       n[ROLE_POLLER], n[ROLE_CHURNER], ndev, secs);
+	fflush(stdout);
+	start = now_ns();
+	for (i = 0; i < ROLE_NUM; i++)
+		nw = spawn(i, n[i], nw);
+	sleep(secs);
+	sh->stop = 1;
+
+	/* A read may be blocked for seconds in the driver, wait for it. */
+	for (i = 0; i < 100; i++) {
+		while (waitpid(-1, &status, WNOHANG) > 0);
+		for (alive = 0; alive < nw; alive++)
+			if (kill(sh->w[alive].pid, 0) == 0)
+				break;
+		if (alive == nw)
+			break;
+		sleep_us(100000);
+	}
+	for (i = 0; i < nw; i++)
+		if (kill(sh->w[i].pid, SIGKILL) == 0)
+			waitpid(sh->w[i].pid, &status, 0);
+	end = now_ns();
+
+	report(nw, (end - start) / 1e9);
+
+	return 0;
+}
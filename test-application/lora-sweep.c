@@ -0,0 +1,659 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "lora-ioctl.h"
+#include "lora-airtime.h"
+
+/*
+ * Sweep the SF x BW x CR x power matrix between two endpoints to find the
+ * fastest configuration meeting a packet error rate target.
+ *
+ * The receiving endpoint serves the control channel:
+ *	lora-sweep -S [-p port] /dev/loraSPI0.1
+ * The sending endpoint steps through the combinations and writes the CSV:
+ *	lora-sweep -H host [-p port] [-o sweep.csv] /dev/loraSPI0.0
+ *
+ * For each combination the receiver is configured over the control
+ * channel, the sender sends sequence numbered frames, and the receiver
+ * reports how many arrived with the RSSI & SNR of each.  The combinations
+ * already in the CSV are skipped, so an interrupted sweep resumes.
+ */
+
+#define MAX_LIST	8
+#define MAGIC		"LSWP"
+/* The frame header: magic, run id and sequence number. */
+#define HDR_LEN		12
+/* In quick mode the receiver is asked for its count every so many frames. */
+#define QUICK_STEP	10
+
+/* The RSSI & SNR of the received frames of a run. */
+struct signal {
+	int32_t *rssi;
+	int32_t *snr;		/* In 0.25 dB */
+	unsigned int n;
+	unsigned int max;
+};
+
+/* The result of a combination. */
+struct result {
+	uint32_t sf, bw, cr;
+	int32_t power;
+	uint32_t len;
+	unsigned int sent;
+	unsigned int recv;
+	double per;
+	double rssi[3];		/* p10, p50 & p90 in dBm */
+	double snr[3];		/* p10, p50 & p90 in dB */
+	double goodput;		/* In bytes / s */
+	uint32_t air_us;
+	int stopped;		/* Stopped early for missing the PER target */
+};
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int cmp_i32(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Get the percentile of the values, they are sorted in place. */
+static int32_t percentile(int32_t *v, unsigned int n, unsigned int pct)
+{
+	if (n == 0)
+		return 0;
+	qsort(v, n, sizeof(int32_t), cmp_i32);
+
+	return v[(n - 1) * pct / 100];
+}
+
+/* Send a line of the control channel. */
+static int ctl_send(int sock, const char *line)
+{
+	size_t len = strlen(line);
+
+	return (send(sock, line, len, 0) == len) ? 0 : -1;
+}
+
+/* Receive a line of the control channel, -1 for closed. */
+static int ctl_recv(int sock, char *line, size_t max)
+{
+	size_t n = 0;
+	char c;
+
+	while (n + 1 < max) {
+		if (recv(sock, &c, 1, 0) != 1)
+			return -1;
+		if (c == '\n')
+			break;
+		line[n++] = c;
+	}
+	line[n] = '\0';
+
+	return n;
+}
+
+static void configure(int fd, uint32_t sf, uint32_t bw, uint32_t cr)
+{
+	set_state(fd, LORA_STATE_STANDBY);
+	set_sprfactor(fd, 1U << sf);
+	set_bw(fd, bw);
+	set_cr(fd, cr);
+	set_crc(fd, 1);
+	set_implicit(fd, 0);
+	set_state(fd, LORA_STATE_RX);
+}
+
+/*
+ * Serve a controller: configure the radio for each run, count the frames
+ * of the run and report them with their RSSI & SNR.
+ */
+static void serve(int sock, int fd, struct signal *sig)
+{
+	struct lora_pkt_stat ps;
+	struct pollfd pfd[2];
+	char line[256];
+	uint8_t buf[256];
+	uint32_t run = 0, sf, bw, cr, len, seq;
+	uint8_t *seen;
+	unsigned int recv = 0, dups = 0, count;
+	ssize_t n;
+
+	seen = calloc(sig->max, 1);
+	pfd[0].fd = sock;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, 2, 1000) < 0)
+			break;
+
+		if (pfd[1].revents & POLLIN) {
+			n = do_read(fd, (char *)buf, sizeof(buf));
+			if ((n < HDR_LEN) || memcmp(buf, MAGIC, 4)
+				|| (get_le32(buf + 4) != run))
+				continue;
+			seq = get_le32(buf + 8);
+			if ((seq >= sig->max) || seen[seq]) {
+				dups++;
+				continue;
+			}
+			seen[seq] = 1;
+			recv++;
+			if ((sig->n < sig->max)
+				&& (get_pkt_stat(fd, &ps) == 0)) {
+				sig->rssi[sig->n] = ps.rssi;
+				sig->snr[sig->n] = ps.snr;
+				sig->n++;
+			}
+		}
+
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+		if (ctl_recv(sock, line, sizeof(line)) < 0)
+			break;
+
+		if (sscanf(line, "RUN %u %u %u %u %u %u", &run, &sf, &bw, &cr,
+			   &len, &count) == 6) {
+			configure(fd, sf, bw, cr);
+			memset(seen, 0, sig->max);
+			recv = 0;
+			dups = 0;
+			sig->n = 0;
+			printf("Run %u: SF%u BW %u CR 4/%u, %u x %u bytes\n",
+			       run, sf, bw, cr, count, len);
+			ctl_send(sock, "OK\n");
+		}
+		else if (strcmp(line, "STAT") == 0) {
+			snprintf(line, sizeof(line), "STAT %u\n", recv);
+			ctl_send(sock, line);
+		}
+		else if (strcmp(line, "END") == 0) {
+			snprintf(line, sizeof(line),
+				 "RES %u %u %d %d %d %d %d %d\n", recv, dups,
+				 percentile(sig->rssi, sig->n, 10),
+				 percentile(sig->rssi, sig->n, 50),
+				 percentile(sig->rssi, sig->n, 90),
+				 percentile(sig->snr, sig->n, 10),
+				 percentile(sig->snr, sig->n, 50),
+				 percentile(sig->snr, sig->n, 90));
+			ctl_send(sock, line);
+			printf("\treceived %u, %u duplicated\n", recv, dups);
+		}
+		else if (strcmp(line, "BYE") == 0) {
+			break;
+		}
+	}
+
+	free(seen);
+}
+
+/* Ask the receiver for a reply line to the command. */
+static int ask(int sock, const char *cmd, char *reply, size_t max)
+{
+	if (ctl_send(sock, cmd) < 0)
+		return -1;
+
+	return ctl_recv(sock, reply, max);
+}
+
+/*
+ * Send the frames of a combination and collect the receiver's report.  In
+ * quick mode the run stops as soon as the lost frames miss the PER target.
+ */
+static int sweep_one(int sock, int fd, uint32_t run, unsigned int count,
+		     double target, int quick, struct result *res)
+{
+	struct lora_modem m;
+	char line[256];
+	uint8_t buf[256];
+	unsigned int i, got;
+	int rssi[3], snr[3];
+	double t0, t;
+
+	memset(&m, 0, sizeof(m));
+	m.sprf = 1U << res->sf;
+	m.bw = res->bw;
+	m.cr = res->cr;
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+	res->air_us = airtime_us(&m, res->len);
+
+	snprintf(line, sizeof(line), "RUN %u %u %u %u %u %u\n", run, res->sf,
+		 res->bw, res->cr, res->len, count);
+	if ((ask(sock, line, line, sizeof(line)) < 0)
+		|| (strcmp(line, "OK") != 0))
+		return -1;
+
+	configure(fd, res->sf, res->bw, res->cr);
+	set_power(fd, res->power);
+
+	memset(buf, 0x5A, sizeof(buf));
+	memcpy(buf, MAGIC, 4);
+	put_le32(buf + 4, run);
+	res->stopped = 0;
+	t0 = now_s();
+	for (i = 0; i < count; i++) {
+		put_le32(buf + 8, i);
+		if (do_write(fd, (char *)buf, res->len) <= 0)
+			break;
+
+		if (!quick || (((i + 1) % QUICK_STEP) != 0))
+			continue;
+		if ((ask(sock, "STAT\n", line, sizeof(line)) < 0)
+			|| (sscanf(line, "STAT %u", &got) != 1))
+			return -1;
+		/* The target can not be met even if the rest all arrive. */
+		if (i + 1 - got > target * count) {
+			res->stopped = 1;
+			i++;
+			break;
+		}
+	}
+	t = now_s() - t0;
+	res->sent = i;
+
+	/* Wait for the last frame to be read. */
+	usleep(res->air_us + 200000);
+	if ((ask(sock, "END\n", line, sizeof(line)) < 0)
+		|| (sscanf(line, "RES %u %*u %d %d %d %d %d %d", &(res->recv),
+			   &rssi[0], &rssi[1], &rssi[2],
+			   &snr[0], &snr[1], &snr[2]) != 7))
+		return -1;
+
+	for (i = 0; i < 3; i++) {
+		res->rssi[i] = rssi[i];
+		res->snr[i] = snr[i] / 4.0;
+	}
+	res->per = (res->sent > 0) ? 1 - (double)res->recv / res->sent : 1;
+	res->goodput = (t > 0) ? (double)res->recv * res->len / t : 0;
+
+	return 0;
+}
+
+static void csv_header(FILE *f)
+{
+	fprintf(f, "sf,bw,cr,power,len,sent,recv,per,rssi_p10,rssi_p50,"
+		"rssi_p90,snr_p10,snr_p50,snr_p90,goodput,airtime_us,"
+		"stopped\n");
+}
+
+static void csv_row(FILE *f, const struct result *r)
+{
+	fprintf(f, "%u,%u,%u,%d,%u,%u,%u,%.4f,%.0f,%.0f,%.0f,%.2f,%.2f,%.2f,"
+		"%.2f,%u,%d\n", r->sf, r->bw, r->cr, r->power, r->len,
+		r->sent, r->recv, r->per, r->rssi[0], r->rssi[1], r->rssi[2],
+		r->snr[0], r->snr[1], r->snr[2], r->goodput, r->air_us,
+		r->stopped);
+	fflush(f);
+}
+
+static int csv_parse(const char *line, struct result *r)
+{
+	memset(r, 0, sizeof(*r));
+
+	return sscanf(line, "%u,%u,%u,%d,%u,%u,%u,%lf,%lf,%lf,%lf,%lf,%lf,%lf,"
+		      "%lf,%u,%d", &(r->sf), &(r->bw), &(r->cr), &(r->power),
+		      &(r->len), &(r->sent), &(r->recv), &(r->per),
+		      &(r->rssi[0]), &(r->rssi[1]), &(r->rssi[2]),
+		      &(r->snr[0]), &(r->snr[1]), &(r->snr[2]),
+		      &(r->goodput), &(r->air_us), &(r->stopped)) == 17;
+}
+
+/* Parse a comma separated list of numbers. */
+static int parse_list(char *s, int32_t *v, int max)
+{
+	char *tok;
+	int n = 0;
+
+	for (tok = strtok(s, ","); (tok != NULL) && (n < max);
+	     tok = strtok(NULL, ","))
+		v[n++] = strtol(tok, NULL, 0);
+
+	return n;
+}
+
+static int connect_to(const char *host, const char *port)
+{
+	struct addrinfo hints, *ai, *p;
+	int sock = -1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &ai) != 0)
+		return -1;
+	for (p = ai; p != NULL; p = p->ai_next) {
+		sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+		if (sock < 0)
+			continue;
+		if (connect(sock, p->ai_addr, p->ai_addrlen) == 0)
+			break;
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(ai);
+
+	return sock;
+}
+
+static int listen_on(const char *port)
+{
+	struct sockaddr_in6 sa;
+	int sock, one = 1;
+
+	sock = socket(AF_INET6, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin6_family = AF_INET6;
+	sa.sin6_addr = in6addr_any;
+	sa.sin6_port = htons(atoi(port));
+	if ((bind(sock, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		|| (listen(sock, 1) < 0)) {
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s -S [-p port] device\n", name);
+	printf("       %s -H host [-p port] [-s sf,..] [-b bw,..] [-c cr,..] "
+	       "[-w dbm,..] [-l len] [-n count] [-t per] [-q] [-o csv] "
+	       "device\n", name);
+	printf("  -S         serve as the receiving endpoint\n");
+	printf("  -H host    the receiving endpoint to control\n");
+	printf("  -p port    the TCP port of the control channel "
+	       "(default 4774)\n");
+	printf("  -s sf,..   spreading factors 7 ~ 12 (default 7,8,9,10,11,"
+	       "12)\n");
+	printf("  -b bw,..   RF bandwidths in Hz (default 125000,250000)\n");
+	printf("  -c cr,..   coding rate denominators 5 ~ 8 (default 5)\n");
+	printf("  -w dbm,..  TX powers in dBm (default 10)\n");
+	printf("  -l len     payload length %d ~ 255 (default 32)\n", HDR_LEN);
+	printf("  -n count   frames per combination (default 100)\n");
+	printf("  -t per     the packet error rate target (default 0.01)\n");
+	printf("  -q         quick mode, fastest first, stop each combination "
+	       "once it misses\n"
+	       "             the target and the sweep once one meets it\n");
+	printf("  -o csv     append the results, skip the combinations "
+	       "already in it\n"
+	       "             (default sweep.csv)\n");
+}
+
+/* Order the combinations from the fastest to the slowest. */
+static int cmp_speed(const void *a, const void *b)
+{
+	const struct result *x = a, *y = b;
+
+	return (x->air_us > y->air_us) - (x->air_us < y->air_us);
+}
+
+int main(int argc, char **argv)
+{
+	int32_t sfs[MAX_LIST] = {7, 8, 9, 10, 11, 12};
+	int32_t bws[MAX_LIST] = {125000, 250000};
+	int32_t crs[MAX_LIST] = {5};
+	int32_t pws[MAX_LIST] = {10};
+	int nsf = 6, nbw = 2, ncr = 1, npw = 1;
+	struct result *todo, done, best;
+	struct lora_modem m;
+	struct signal sig;
+	const char *port = "4774";
+	const char *host = NULL;
+	const char *csv = "sweep.csv";
+	unsigned int count = 100, len = 32;
+	unsigned int ntodo, i, run;
+	double target = 0.01;
+	int serving = 0, quick = 0, found = 0;
+	int is, ib, ic, ip, opt, fd, sock, lsock;
+	char line[256];
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "SH:p:s:b:c:w:l:n:t:qo:h")) != -1) {
+		switch (opt) {
+		case 'S':
+			serving = 1;	break;
+		case 'H':
+			host = optarg;	break;
+		case 'p':
+			port = optarg;	break;
+		case 's':
+			nsf = parse_list(optarg, sfs, MAX_LIST);	break;
+		case 'b':
+			nbw = parse_list(optarg, bws, MAX_LIST);	break;
+		case 'c':
+			ncr = parse_list(optarg, crs, MAX_LIST);	break;
+		case 'w':
+			npw = parse_list(optarg, pws, MAX_LIST);	break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);	break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);	break;
+		case 't':
+			target = strtod(optarg, NULL);	break;
+		case 'q':
+			quick = 1;	break;
+		case 'o':
+			csv = optarg;	break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	for (is = 0; is < nsf; is++)
+		if ((sfs[is] < 7) || (sfs[is] > 12))
+			nsf = 0;
+	for (ic = 0; ic < ncr; ic++)
+		if ((crs[ic] < 5) || (crs[ic] > 8))
+			ncr = 0;
+	if ((serving == (host != NULL)) || (optind >= argc) || (nsf == 0)
+		|| (nbw == 0) || (ncr == 0) || (npw == 0) || (len < HDR_LEN)
+		|| (len > 255) || (count == 0)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0) {
+		perror("Open the device failed");
+		return -1;
+	}
+
+	if (serving) {
+		/* Enough for the longest run of any controller. */
+		sig.max = 65536;
+		sig.n = 0;
+		sig.rssi = calloc(sig.max, sizeof(int32_t));
+		sig.snr = calloc(sig.max, sizeof(int32_t));
+		lsock = listen_on(port);
+		if (lsock < 0) {
+			perror("Listen on the control channel failed");
+			return -1;
+		}
+		printf("Serving %s on port %s\n", argv[optind], port);
+		for (;;) {
+			sock = accept(lsock, NULL, NULL);
+			if (sock < 0)
+				continue;
+			serve(sock, fd, &sig);
+			close(sock);
+		}
+	}
+
+	if (count > 65536)
+		count = 65536;
+	sock = connect_to(host, port);
+	if (sock < 0) {
+		perror("Connect to the receiving endpoint failed");
+		return -1;
+	}
+
+	/* The combinations not in the CSV yet. */
+	memset(&m, 0, sizeof(m));
+	m.prelen = 8;
+	m.crc = 1;
+	m.ldro = -1;
+	todo = calloc(nsf * nbw * ncr * npw, sizeof(struct result));
+	ntodo = 0;
+	for (is = 0; is < nsf; is++)
+	for (ib = 0; ib < nbw; ib++)
+	for (ic = 0; ic < ncr; ic++)
+	for (ip = 0; ip < npw; ip++) {
+		todo[ntodo].sf = sfs[is];
+		todo[ntodo].bw = bws[ib];
+		todo[ntodo].cr = crs[ic];
+		todo[ntodo].power = pws[ip];
+		todo[ntodo].len = len;
+		m.sprf = 1U << sfs[is];
+		m.bw = bws[ib];
+		m.cr = crs[ic];
+		todo[ntodo].air_us = airtime_us(&m, len);
+		ntodo++;
+	}
+	if (quick)
+		qsort(todo, ntodo, sizeof(struct result), cmp_speed);
+
+	f = fopen(csv, "r");
+	if (f != NULL) {
+		while (fgets(line, sizeof(line), f) != NULL) {
+			if (!csv_parse(line, &done))
+				continue;
+			for (i = 0; i < ntodo; i++)
+				if ((todo[i].sf == done.sf)
+					&& (todo[i].bw == done.bw)
+					&& (todo[i].cr == done.cr)
+					&& (todo[i].power == done.power)
+					&& (todo[i].len == done.len))
+					todo[i].sent = 1;
+			if (quick && !done.stopped && (done.per <= target))
+				found = 1;
+		}
+		fclose(f);
+	}
+	f = fopen(csv, "a");
+	if (f == NULL) {
+		perror("Open the CSV failed");
+		return -1;
+	}
+	if (ftell(f) == 0)
+		csv_header(f);
+
+	srand(time(NULL));
+	run = rand();
+	for (i = 0; (i < ntodo) && !found; i++) {
+		if (todo[i].sent)
+			continue;
+		printf("SF%u BW %u CR 4/%u %d dBm: ", todo[i].sf, todo[i].bw,
+		       todo[i].cr, todo[i].power);
+		fflush(stdout);
+		if (sweep_one(sock, fd, ++run, count, target, quick,
+			      &(todo[i])) < 0) {
+			printf("the control channel failed\n");
+			break;
+		}
+		printf("PER %.3f, %.1f B/s, RSSI %.0f dBm, SNR %.2f dB%s\n",
+		       todo[i].per, todo[i].goodput, todo[i].rssi[1],
+		       todo[i].snr[1], todo[i].stopped ? ", stopped" : "");
+		csv_row(f, &(todo[i]));
+		if (quick && !todo[i].stopped && (todo[i].per <= target))
+			found = 1;
+	}
+	fclose(f);
+	ctl_send(sock, "BYE\n");
+	close(sock);
+	close(fd);
+	free(todo);
+
+	/* Pick the fastest from all the results, the resumed ones too. */
+	memset(&best, 0, sizeof(best));
+	f = fopen(csv, "r");
+	while ((f != NULL) && (fgets(line, sizeof(line), f) != NULL)) {
+		if (csv_parse(line, &done) && !done.stopped
+			&& (done.per <= target) && (done.goodput > best.goodput))
+			best = done;
+	}
+	if (f != NULL)
+		fclose(f);
+	if (best.goodput > 0)
+		printf("Fastest meeting PER %.3f: SF%u BW %u CR 4/%u %d dBm, "
+		       "%.1f B/s, PER %.3f\n", target, best.sf, best.bw,
+		       best.cr, best.power, best.goodput, best.per);
+	else
+		printf("No configuration meets PER %.3f\n", target);
+
+	return 0;
+}
@@ -0,0 +1,501 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "lora-ioctl.h"
+
+/*
+ * A gateway on io_uring passthrough.  Each device has a multishot RX
+ * command posting a CQE per received packet into its provided buffers, and
+ * the TX and the counter snapshots are SQEs too.  All the devices share a
+ * ring, so a single io_uring_enter() submits and reaps the work of many
+ * packets.
+ */
+
+#ifndef IORING_URING_CMD_MULTISHOT
+#define IORING_URING_CMD_MULTISHOT	(1U << 1)
+#endif
+
+#define MAXDEV		8
+#define RING_ENTRIES	64
+/* The provided buffers of each device, a power of 2. */
+#define NBUF		16
+#define BUFLEN		256
+
+/* The user_data of the SQEs is the operation << 8 | the device. */
+enum {
+	OP_RECV,
+	OP_SEND,
+	OP_STATS,
+	OP_TICK,
+};
+
+struct ring {
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned to_submit;
+	unsigned long enters;
+};
+
+struct gwdev {
+	const char *path;
+	int fd;
+	int mshot;		/* 1 for multishot RX, 0 for single shot */
+	int rx_off;		/* RX has ended on an error */
+	int tx_busy;
+	struct io_uring_buf_ring *br;
+	uint8_t *bufs;
+	uint16_t br_tail;
+	uint8_t rxbuf[BUFLEN];	/* The buffer of the single shot RX */
+	uint8_t txbuf[BUFLEN];
+	struct lora_stats st;
+	unsigned long rx;
+	unsigned long rx_bytes;
+	unsigned long tx;
+	unsigned long tx_err;
+	unsigned long rearm;
+	unsigned long snapshots;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Set up a ring and map its queues. */
+static int ring_init(struct ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	size_t sqsz, cqsz;
+	uint8_t *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+
+	sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && (cqsz > sqsz))
+		sqsz = cqsz;
+	sq = mmap(NULL, sqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  r->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return -1;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else {
+		cq = mmap(NULL, cqsz, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			return -1;
+	}
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		return -1;
+
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	r->sq_entries = p.sq_entries;
+
+	return 0;
+}
+
+/* Get a cleared SQE, NULL for the queue is full. */
+static struct io_uring_sqe *ring_sqe(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+
+	tail = *r->sq_tail;
+	if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE)
+	    >= r->sq_entries)
+		return NULL;
+
+	idx = tail & *r->sq_mask;
+	sqe = &(r->sqes[idx]);
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit++;
+
+	return sqe;
+}
+
+/* Submit the queued SQEs and wait for a CQE. */
+static int ring_enter(struct ring *r)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1,
+		      IORING_ENTER_GETEVENTS, NULL, 0);
+	r->enters++;
+	if (ret > 0)
+		r->to_submit -= ret;
+
+	return ret;
+}
+
+/* Queue a LoRa command of io_uring passthrough. */
+static int prep_cmd(struct ring *r, struct gwdev *d, int dev, int op,
+		    uint32_t cmd_op, void *addr, uint32_t len, uint32_t ioctl)
+{
+	struct io_uring_sqe *sqe;
+	struct lora_uring_cmd *uc;
+
+	sqe = ring_sqe(r);
+	if (sqe == NULL)
+		return -1;
+
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = d->fd;
+	sqe->cmd_op = cmd_op;
+	sqe->user_data = (op << 8) | dev;
+	uc = (struct lora_uring_cmd *)sqe->cmd;
+	uc->addr = (uintptr_t)addr;
+	uc->len = len;
+	uc->ioctl = ioctl;
+
+	return 0;
+}
+
+/* Hand a provided buffer back to the device's buffer ring. */
+static void buf_add(struct gwdev *d, int bid)
+{
+	struct io_uring_buf *b;
+
+	b = &(d->br->bufs[d->br_tail & (NBUF - 1)]);
+	b->addr = (uintptr_t)(d->bufs + bid * BUFLEN);
+	b->len = BUFLEN;
+	b->bid = bid;
+	d->br_tail++;
+	__atomic_store_n(&(d->br->tail), d->br_tail, __ATOMIC_RELEASE);
+}
+
+/* Register the provided buffers of a device as the buffer group dev. */
+static int buf_init(struct ring *r, struct gwdev *d, int dev)
+{
+	struct io_uring_buf_reg reg;
+	int i;
+
+	d->br = mmap(NULL, NBUF * sizeof(struct io_uring_buf),
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	d->bufs = malloc(NBUF * BUFLEN);
+	if ((d->br == MAP_FAILED) || (d->bufs == NULL))
+		return -1;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)d->br;
+	reg.ring_entries = NBUF;
+	reg.bgid = dev;
+	if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING,
+		    &reg, 1) < 0)
+		return -1;
+
+	for (i = 0; i < NBUF; i++)
+		buf_add(d, i);
+
+	return 0;
+}
+
+/* Arm the RX command of a device, multishot or single shot. */
+static int arm_recv(struct ring *r, struct gwdev *d, int dev)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!d->mshot)
+		return prep_cmd(r, d, dev, OP_RECV, LORA_URING_RECV, d->rxbuf,
+				BUFLEN, 0);
+
+	if (prep_cmd(r, d, dev, OP_RECV, LORA_URING_RECV, NULL, 0, 0) < 0)
+		return -1;
+	sqe = &(r->sqes[(*r->sq_tail - 1) & *r->sq_mask]);
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = dev;
+	sqe->uring_cmd_flags = IORING_URING_CMD_MULTISHOT;
+
+	return 0;
+}
+
+/* Handle the completion of an RX command. */
+static void on_recv(struct ring *r, struct gwdev *d, int dev,
+		    struct io_uring_cqe *cqe)
+{
+	if (cqe->res > 0) {
+		d->rx++;
+		d->rx_bytes += cqe->res;
+	}
+	if (cqe->flags & IORING_CQE_F_BUFFER)
+		buf_add(d, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+
+	/* The kernel without multishot, fall back to single shot. */
+	if (d->mshot && ((cqe->res == -EINVAL) || (cqe->res == -EOPNOTSUPP))) {
+		printf("%s: no multishot RX, use single shot\n", d->path);
+		d->mshot = 0;
+	}
+	else if ((cqe->res < 0) && (cqe->res != -ENOBUFS)
+		 && (cqe->res != -EAGAIN) && (cqe->res != -ETIMEDOUT)
+		 && (cqe->res != -EINTR)) {
+		fprintf(stderr, "%s: RX ended: %s\n", d->path,
+			strerror(-cqe->res));
+		d->rx_off = 1;
+		return;
+	}
+	else if (d->mshot)
+		d->rearm++;
+
+	arm_recv(r, d, dev);
+}
+
+/* Queue the periodic tick as a timeout SQE. */
+static void arm_tick(struct ring *r, struct __kernel_timespec *ts)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = ring_sqe(r);
+	if (sqe == NULL)
+		return;
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->addr = (uintptr_t)ts;
+	sqe->len = 1;
+	sqe->user_data = OP_TICK << 8;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-t s] [-s ms] [-l len] [-1] device ...\n", name);
+	printf("  -t s       seconds to run (default 10)\n");
+	printf("  -s ms      send a packet on each device every ms "
+	       "(default 0, receive only)\n");
+	printf("  -l len     payload length 1 ~ 255 (default 16)\n");
+	printf("  -1         single shot RX instead of multishot\n");
+	printf("  device     the devices, e.g. /dev/loraSPI0.0 "
+	       "/dev/loraVIRT0\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct gwdev dev[MAXDEV];
+	struct __kernel_timespec ts;
+	struct io_uring_cqe *cqe;
+	struct ring r;
+	struct gwdev *d;
+	double seconds, start, last_tx, last_stats, t;
+	unsigned long packets;
+	unsigned head;
+	int send_ms, len, mshot, ndev;
+	int opt, i, op;
+
+	seconds = 10;
+	send_ms = 0;
+	len = 16;
+	mshot = 1;
+	while ((opt = getopt(argc, argv, "t:s:l:1h")) != -1) {
+		switch (opt) {
+		case 't': seconds = atof(optarg);	break;
+		case 's': send_ms = atoi(optarg);	break;
+		case 'l': len = atoi(optarg);		break;
+		case '1': mshot = 0;			break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+	ndev = argc - optind;
+	if ((ndev < 1) || (ndev > MAXDEV) || (len < 1) || (len > 255)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (ring_init(&r, RING_ENTRIES) < 0) {
+		perror("io_uring");
+		return -1;
+	}
+
+	memset(dev, 0, sizeof(dev));
+	for (i = 0; i < ndev; i++) {
+		d = &(dev[i]);
+		d->path = argv[optind + i];
+		d->mshot = mshot;
+		d->fd = open(d->path, O_RDWR);
+		if (d->fd == -1) {
+			perror(d->path);
+			return -1;
+		}
+		if (buf_init(&r, d, i) < 0) {
+			perror("provided buffers");
+			return -1;
+		}
+		memset(d->txbuf, 'A' + i, len);
+		arm_recv(&r, d, i);
+	}
+
+	signal(SIGINT, on_signal);
+	ts.tv_sec = 0;
+	ts.tv_nsec = ((send_ms > 0) && (send_ms < 100) ? send_ms : 100)
+		     * 1000000L;
+	arm_tick(&r, &ts);
+
+	start = now_s();
+	last_tx = start;
+	last_stats = start;
+	while (!stop) {
+		if ((ring_enter(&r) < 0) && (errno != EINTR)) {
+			perror("io_uring_enter");
+			break;
+		}
+
+		head = *r.cq_head;
+		while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &(r.cqes[head & *r.cq_mask]);
+			op = cqe->user_data >> 8;
+			d = &(dev[cqe->user_data & 0xff]);
+
+			switch (op) {
+			case OP_RECV:
+				on_recv(&r, d, cqe->user_data & 0xff, cqe);
+				break;
+			case OP_SEND:
+				d->tx_busy = 0;
+				if (cqe->res == len)
+					d->tx++;
+				else
+					d->tx_err++;
+				break;
+			case OP_STATS:
+				if (cqe->res == 0)
+					d->snapshots++;
+				break;
+			case OP_TICK:
+				t = now_s();
+				if (t - start >= seconds)
+					stop = 1;
+				for (i = 0; i < ndev; i++) {
+					d = &(dev[i]);
+					if ((send_ms > 0) && !d->tx_busy
+					    && ((t - last_tx) * 1000 >= send_ms)
+					    && (prep_cmd(&r, d, i, OP_SEND,
+							 LORA_URING_SEND,
+							 d->txbuf, len, 0) == 0))
+						d->tx_busy = 1;
+					if ((t - last_stats >= 1)
+					    && (prep_cmd(&r, d, i, OP_STATS,
+							 LORA_URING_IOCTL,
+							 &(d->st), 0,
+							 LORA_GET_STATS) < 0))
+						break;
+				}
+				if ((send_ms > 0) && ((t - last_tx) * 1000
+						      >= send_ms))
+					last_tx = t;
+				if (t - last_stats >= 1)
+					last_stats = t;
+				arm_tick(&r, &ts);
+				break;
+			}
+			head++;
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+	t = now_s() - start;
+
+	/* Closing the ring cancels the armed multishot RX commands. */
+	close(r.fd);
+
+	packets = 0;
+	printf("%-18s %8s %10s %8s %8s %8s %10s %10s\n", "device", "rx",
+	       "rx_bytes", "tx", "tx_err", "rearm", "drv_rx", "drv_tx");
+	for (i = 0; i < ndev; i++) {
+		d = &(dev[i]);
+		printf("%-18s %8lu %10lu %8lu %8lu %8lu %10llu %10llu\n",
+		       d->path, d->rx, d->rx_bytes, d->tx, d->tx_err, d->rearm,
+		       (unsigned long long)d->st.rx_packets,
+		       (unsigned long long)d->st.tx_packets);
+		packets += d->rx + d->tx;
+		close(d->fd);
+	}
+	printf("%lu packets, %lu io_uring_enter() in %.1f s, %.3f syscalls "
+	       "per packet (%s RX)\n", packets, r.enters, t,
+	       packets ? (double)r.enters / packets : 0.0,
+	       mshot ? "multishot" : "single shot");
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce at minimum a disclaimer
+ *    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+ *    redistribution must be conditioned upon including a substantially
+ *    similar Disclaimer requirement for further binary redistribution.
+ * 3. Neither the names of the above-listed copyright holders nor the names
+ *    of any contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License ("GPL") version 2 as published by the Free
+ * Software Foundation.
+ *
+ * NO WARRANTY
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGES.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "lora-ioctl.h"
+
+/* Stream a file into the LoRa device by sendfile() in a single syscall. */
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct stat st;
+	double start, sec;
+	ssize_t sz;
+	off_t off;
+	int in, fd;
+
+	if (argc < 3) {
+		printf("Usage: %s <device> <file> [fragsize]\n", argv[0]);
+		printf("  fragsize   send as fragmented messages with the "
+		       "fragment size\n");
+		return -1;
+	}
+
+	fd = open(argv[1], O_RDWR);
+	if (fd == -1) {
+		perror(argv[1]);
+		return -1;
+	}
+	in = open(argv[2], O_RDONLY);
+	if ((in == -1) || (fstat(in, &st) == -1)) {
+		perror(argv[2]);
+		close(fd);
+		return -1;
+	}
+	if (argc > 3)
+		set_frag(fd, 1, strtoul(argv[3], NULL, 0), 0);
+
+	/* The device cuts the data into packets and paces the radio. */
+	off = 0;
+	start = now_s();
+	sz = sendfile(fd, in, &off, st.st_size);
+	sec = now_s() - start;
+	if (sz < 0)
+		perror("sendfile");
+	else
+		printf("Sent %zd of %lld bytes in %.2f s, %.1f B/s\n", sz,
+		       (long long)st.st_size, sec, sz / sec);
+
+	if (argc > 3)
+		set_frag(fd, 0, 0, 0);
+	close(in);
+	close(fd);
+
+	return (sz < 0) ? -1 : 0;
+}
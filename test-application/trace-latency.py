@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+#-
+# Copyright (c) 2017 Jian-Hong, Pan <starnight@g.ncu.edu.tw>
+#
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer,
+#    without modification.
+# 2. Redistributions in binary form must reproduce at minimum a disclaimer
+#    similar to the "NO WARRANTY" disclaimer below ("Disclaimer") and any
+#    redistribution must be conditioned upon including a substantially
+#    similar Disclaimer requirement for further binary redistribution.
+# 3. Neither the names of the above-listed copyright holders nor the names
+#    of any contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# Alternatively, this software may be distributed under the terms of the
+# GNU General Public License ("GPL") version 2 as published by the Free
+# Software Foundation.
+#
+# NO WARRANTY
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# ''AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF NONINFRINGEMENT, MERCHANTIBILITY
+# AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+# THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR SPECIAL, EXEMPLARY,
+# OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+# THE POSSIBILITY OF SUCH DAMAGES.
+#
+
+"""Turn a lora_spi trace into a per-packet latency breakdown.
+
+Record the lora_spi tracepoints while the applications run, then feed the
+text report to this script:
+
+	trace-cmd record -e lora_spi ./send /dev/loraSPI0.0
+	trace-cmd report | ./trace-latency.py
+
+It also reads the raw ftrace text, e.g.
+/sys/kernel/tracing/trace.  Every TX packet is split into the queueing
+before the chip goes to TX and the airtime until TX done, and every RX
+packet into the time it waits in the FIFO and the time until the
+application reads it.  The SPI transactions issued for a packet are
+counted between its first and last event.
+"""
+
+import re
+import sys
+from collections import defaultdict
+
+# "<task>-<pid> [cpu] <flags> <timestamp>: <event>: spi<bus>.<cs> <fields>"
+LINE = re.compile(r'\s(\d+\.\d+):\s+(\w+):\s+(spi\d+\.\d+)\s*(.*)$')
+FIELD = re.compile(r'(\w+)=(\S+)')
+
+
+def parse(stream):
+    for line in stream:
+        m = LINE.search(line)
+        if m is None:
+            continue
+        ts, event, dev, rest = m.groups()
+        fields = dict(FIELD.findall(rest))
+        yield float(ts) * 1e6, event, dev, fields
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    i = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[i]
+
+
+class Device:
+    def __init__(self, name):
+        self.name = name
+        self.tx = {}
+        self.rx = {}
+        self.spi_count = 0
+        self.spi_us = 0.0
+        self.states = 0
+
+    def spi_mark(self):
+        return (self.spi_count, self.spi_us)
+
+
+def packet(table, pid, dev):
+    if pid not in table:
+        table[pid] = {'spi0': dev.spi_mark()}
+    return table[pid]
+
+
+def close(pkt, dev):
+    c0, t0 = pkt['spi0']
+    pkt['spi_n'] = dev.spi_count - c0
+    pkt['spi_us'] = dev.spi_us - t0
+
+
+def collect(stream):
+    devs = {}
+    tx_done = []
+    rx_done = []
+
+    for ts, event, name, f in parse(stream):
+        dev = devs.setdefault(name, Device(name))
+
+        if event == 'sx127x_sync':
+            dev.spi_count += 1
+            dev.spi_us += int(f.get('duration_ns', '0')) / 1000.0
+            continue
+        if event == 'sx127x_state':
+            dev.states += 1
+            continue
+        if 'id' not in f:
+            continue
+        pid = int(f['id'])
+
+        if event == 'lora_tx_enqueue':
+            # A new packet may reuse the id of the resident beacon.
+            dev.tx[pid] = {'spi0': dev.spi_mark(), 'enqueue': ts,
+                           'len': int(f['len'])}
+        elif event == 'lora_tx_start':
+            pkt = packet(dev.tx, pid, dev)
+            pkt['start'] = ts
+            pkt['scheduled'] = f.get('scheduled') == '1'
+        elif event == 'lora_tx_done':
+            pkt = dev.tx.pop(pid, None)
+            if pkt is None:
+                continue
+            pkt['done'] = ts
+            pkt['status'] = int(f['status'])
+            pkt.setdefault('len', int(f['len']))
+            close(pkt, dev)
+            tx_done.append((name, pid, pkt))
+        elif event == 'lora_rx_done':
+            if f.get('crc_error') == '1':
+                continue
+            dev.rx[pid] = {'spi0': dev.spi_mark(), 'done': ts,
+                           'len': int(f['len'])}
+        elif event == 'lora_rx_pop':
+            if pid in dev.rx:
+                dev.rx[pid]['pop'] = ts
+        elif event == 'lora_rx_read':
+            pkt = dev.rx.pop(pid, None)
+            if pkt is None:
+                continue
+            pkt['read'] = ts
+            close(pkt, dev)
+            rx_done.append((name, pid, pkt))
+
+    return devs, tx_done, rx_done
+
+
+def span(pkt, a, b):
+    if a in pkt and b in pkt:
+        return pkt[b] - pkt[a]
+    return None
+
+
+def fmt(v):
+    return '%10.1f' % v if v is not None else '%10s' % '-'
+
+
+def summary(title, columns):
+    print('%s (us)' % title)
+    print('  %-12s %8s %10s %10s %10s %10s' %
+          ('', 'count', 'min', 'p50', 'p99', 'max'))
+    for label, values in columns:
+        values = [v for v in values if v is not None]
+        if not values:
+            continue
+        print('  %-12s %8d %10.1f %10.1f %10.1f %10.1f' %
+              (label, len(values), min(values), percentile(values, 50),
+               percentile(values, 99), max(values)))
+    print('')
+
+
+def main():
+    verbose = '-v' in sys.argv[1:]
+    devs, tx, rx = collect(sys.stdin)
+
+    if verbose:
+        print('%-10s %6s %4s %10s %10s %10s %5s %10s' %
+              ('TX', 'id', 'len', 'queue', 'air', 'total', 'spi', 'spi_us'))
+        for name, pid, p in tx:
+            print('%-10s %6d %4d %s %s %s %5d %10.1f%s' %
+                  (name, pid, p['len'], fmt(span(p, 'enqueue', 'start')),
+                   fmt(span(p, 'start', 'done')),
+                   fmt(span(p, 'enqueue', 'done')), p['spi_n'], p['spi_us'],
+                   ' error %d' % p['status'] if p['status'] else ''))
+        print('')
+        print('%-10s %6s %4s %10s %10s %10s %5s %10s' %
+              ('RX', 'id', 'len', 'fifo', 'copy', 'total', 'spi', 'spi_us'))
+        for name, pid, p in rx:
+            print('%-10s %6d %4d %s %s %s %5d %10.1f' %
+                  (name, pid, p['len'], fmt(span(p, 'done', 'pop')),
+                   fmt(span(p, 'pop', 'read')),
+                   fmt(span(p, 'done', 'read')), p['spi_n'], p['spi_us']))
+        print('')
+
+    if tx:
+        summary('TX %d packets' % len(tx), [
+            ('queue', [span(p, 'enqueue', 'start') for _, _, p in tx]),
+            ('air', [span(p, 'start', 'done') for _, _, p in tx]),
+            ('total', [span(p, 'enqueue', 'done') for _, _, p in tx]),
+            ('spi', [p['spi_us'] for _, _, p in tx]),
+        ])
+    if rx:
+        summary('RX %d packets' % len(rx), [
+            ('fifo', [span(p, 'done', 'pop') for _, _, p in rx]),
+            ('copy', [span(p, 'pop', 'read') for _, _, p in rx]),
+            ('total', [span(p, 'done', 'read') for _, _, p in rx]),
+            ('spi', [p['spi_us'] for _, _, p in rx]),
+        ])
+    for dev in devs.values():
+        print('%s: %d SPI transactions, %.1f us on the bus, '
+              '%d state changes' %
+              (dev.name, dev.spi_count, dev.spi_us, dev.states))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())